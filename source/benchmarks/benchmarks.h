@@ -0,0 +1,54 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include "engine/timer.h"
+
+#include <algorithm>
+#include <vector>
+
+
+namespace Benchmarks {
+
+/** The item counts every benchmark is run at */
+const uint kBenchmarkSizes[] = {1000u, 10000u, 100000u};
+
+/**
+ * Times 'func' several times, and returns the median, so a single preempted run doesn't skew the result
+ *
+ * @param repetitions    The number of times to run 'func'
+ * @param reset          Called before every run of 'func', outside of the timing. Restores the input 'func' changes
+ * @param func           The work to time
+ * @return               The median run time in milliseconds
+ */
+template <typename ResetFunc, typename Func>
+double MedianTime(uint repetitions, ResetFunc reset, Func func) {
+	std::vector<double> times(repetitions);
+	Engine::Timer timer;
+
+	for (uint i = 0; i < repetitions; ++i) {
+		reset();
+
+		timer.Start();
+		func();
+		timer.Stop();
+
+		times[i] = timer.GetTime();
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[repetitions / 2];
+}
+
+/** Compares Common::RadixSort against std::sort and std::stable_sort on CommandBucket packets */
+void RunRadixSortBenchmark();
+/** Compares Common::FlatHashMap against std::unordered_map */
+void RunFlatHashMapBenchmark();
+
+} // End of namespace Benchmarks
@@ -0,0 +1,115 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "benchmarks/benchmarks.h"
+
+#include "common/flat_hash_map.h"
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
+
+namespace Benchmarks {
+
+/** The times of one map type at one size, in milliseconds */
+struct MapTimes {
+	double Insert;
+	double FindHit;
+	double FindMiss;
+	double Iterate;
+	double Erase;
+};
+
+/**
+ * Times the operations the engine uses on its caches. 'keys' are inserted into an empty map,
+ * so the inserts include growing the table
+ *
+ * @param repetitions    The number of times to time each operation
+ * @param keys           The keys to insert, find and erase
+ * @param missingKeys    Keys that aren't in 'keys', to time failed lookups
+ * @param checksum       Accumulates the values found, so the lookups can't be optimized away
+ */
+template <typename MapType>
+MapTimes TimeMap(uint repetitions, const std::vector<uint64> &keys, const std::vector<uint64> &missingKeys, uint64 &checksum) {
+	MapTimes times;
+	std::unique_ptr<MapType> map;
+
+	auto newMap = [&]() {
+		map.reset(new MapType());
+	};
+	auto fillMap = [&]() {
+		map.reset(new MapType());
+		for (uint i = 0; i < keys.size(); ++i) {
+			(*map)[keys[i]] = i;
+		}
+	};
+	auto noReset = []() {};
+
+	times.Insert = MedianTime(repetitions, newMap, [&]() {
+		for (uint i = 0; i < keys.size(); ++i) {
+			(*map)[keys[i]] = i;
+		}
+	});
+
+	fillMap();
+	times.FindHit = MedianTime(repetitions, noReset, [&]() {
+		for (auto iter = keys.begin(); iter != keys.end(); ++iter) {
+			checksum += map->find(*iter)->second;
+		}
+	});
+	times.FindMiss = MedianTime(repetitions, noReset, [&]() {
+		for (auto iter = missingKeys.begin(); iter != missingKeys.end(); ++iter) {
+			checksum += map->count(*iter);
+		}
+	});
+	times.Iterate = MedianTime(repetitions, noReset, [&]() {
+		for (auto iter = map->begin(); iter != map->end(); ++iter) {
+			checksum += iter->second;
+		}
+	});
+
+	times.Erase = MedianTime(repetitions, fillMap, [&]() {
+		for (auto iter = keys.begin(); iter != keys.end(); ++iter) {
+			map->erase(*iter);
+		}
+	});
+
+	return times;
+}
+
+void RunFlatHashMapBenchmark() {
+	const uint kRepetitions = 21u;
+
+	printf("FlatHashMap vs std::unordered_map - uint64 keys to uint values, median of %u runs\n", kRepetitions);
+	printf("%10s %-14s %12s %12s %12s %12s %12s\n", "Entries", "Map", "Insert", "Find (hit)", "Find (miss)", "Iterate", "Erase");
+
+	std::mt19937_64 random(12345u);
+	uint64 checksum = 0u;
+
+	for (uint i = 0; i < sizeof(kBenchmarkSizes) / sizeof(kBenchmarkSizes[0]); ++i) {
+		uint count = kBenchmarkSizes[i];
+
+		// Random 64-bit keys are vanishingly unlikely to collide, so 'missingKeys' can just be more random keys
+		std::vector<uint64> keys(count);
+		std::vector<uint64> missingKeys(count);
+		for (uint j = 0; j < count; ++j) {
+			keys[j] = random();
+			missingKeys[j] = random();
+		}
+
+		MapTimes flatTimes = TimeMap<Common::FlatHashMap<uint64, uint> >(kRepetitions, keys, missingKeys, checksum);
+		MapTimes stdTimes = TimeMap<std::unordered_map<uint64, uint> >(kRepetitions, keys, missingKeys, checksum);
+
+		printf("%10u %-14s %9.3f ms %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n", count, "FlatHashMap", flatTimes.Insert, flatTimes.FindHit, flatTimes.FindMiss, flatTimes.Iterate, flatTimes.Erase);
+		printf("%10s %-14s %9.3f ms %9.3f ms %9.3f ms %9.3f ms %9.3f ms\n", "", "unordered_map", stdTimes.Insert, stdTimes.FindHit, stdTimes.FindMiss, stdTimes.Iterate, stdTimes.Erase);
+	}
+
+	printf("(checksum %llu)\n", checksum);
+}
+
+} // End of namespace Benchmarks
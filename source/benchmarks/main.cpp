@@ -0,0 +1,65 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "benchmarks/benchmarks.h"
+
+#include <cstdio>
+#include <cstring>
+
+
+struct Benchmark {
+	const char *Name;
+	void (*Run)();
+};
+
+const Benchmark kBenchmarks[] = {
+	{"radix_sort", Benchmarks::RunRadixSortBenchmark},
+	{"flat_hash_map", Benchmarks::RunFlatHashMapBenchmark}
+};
+const uint kNumBenchmarks = sizeof(kBenchmarks) / sizeof(kBenchmarks[0]);
+
+const Benchmark *FindBenchmark(const char *name) {
+	for (uint i = 0; i < kNumBenchmarks; ++i) {
+		if (strcmp(kBenchmarks[i].Name, name) == 0) {
+			return &kBenchmarks[i];
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Runs the micro-benchmarks of the engine's containers and algorithms. Build it in Release, and
+ * run it from a console, so the numbers can be compared between changes
+ */
+int main(int argc, char *argv[]) {
+	// Check all the names first, so a typo doesn't cost a full run
+	for (int i = 1; i < argc; ++i) {
+		if (FindBenchmark(argv[i]) == nullptr) {
+			printf("Unknown benchmark: %s\n\n", argv[i]);
+			printf("Usage: Benchmarks.exe [benchmark ...]\n");
+			printf("    Runs the given benchmarks, or all of them if none are given. The benchmarks are:\n");
+			for (uint j = 0; j < kNumBenchmarks; ++j) {
+				printf("    %s\n", kBenchmarks[j].Name);
+			}
+			return 1;
+		}
+	}
+
+	if (argc < 2) {
+		for (uint i = 0; i < kNumBenchmarks; ++i) {
+			kBenchmarks[i].Run();
+			printf("\n");
+		}
+	} else {
+		for (int i = 1; i < argc; ++i) {
+			FindBenchmark(argv[i])->Run();
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "benchmarks/benchmarks.h"
+
+#include "common/radix_sort.h"
+#include "common/worker_pool.h"
+
+#include "graphics/command_bucket.h"
+
+#include <cstdio>
+#include <random>
+#include <thread>
+
+
+namespace Benchmarks {
+
+typedef Graphics::CommandPacket<uint64> Packet;
+
+void RunRadixSortBenchmark() {
+	const uint kRepetitions = 51u;
+
+	uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	Common::WorkerPool workerPool(hardwareThreads - 1u);
+
+	printf("Radix sort - CommandPacket<uint64>, random 64-bit keys, median of %u runs, %u threads\n", kRepetitions, workerPool.GetNumThreads());
+	printf("%10s %14s %14s %14s %14s\n", "Packets", "std::sort", "stable_sort", "Radix", "Radix (pool)");
+
+	std::mt19937_64 random(12345u);
+
+	for (uint i = 0; i < sizeof(kBenchmarkSizes) / sizeof(kBenchmarkSizes[0]); ++i) {
+		uint count = kBenchmarkSizes[i];
+
+		std::vector<Packet> input(count);
+		for (uint j = 0; j < count; ++j) {
+			input[j] = Packet(random(), nullptr);
+		}
+
+		std::vector<Packet> packets(count);
+		std::vector<Packet> scratch(count);
+		Packet *sorted = nullptr;
+		auto reset = [&]() {
+			std::copy(input.begin(), input.end(), packets.begin());
+		};
+
+		double sortTime = MedianTime(kRepetitions, reset, [&]() {
+			std::sort(packets.begin(), packets.end(), Graphics::CommandSortFunction<uint64>);
+		});
+		double stableSortTime = MedianTime(kRepetitions, reset, [&]() {
+			std::stable_sort(packets.begin(), packets.end(), Graphics::CommandSortFunction<uint64>);
+		});
+		std::vector<Packet> expected(packets);
+
+		double radixTime = MedianTime(kRepetitions, reset, [&]() {
+			sorted = Common::RadixSort<uint64>(packets.data(), scratch.data(), count, Graphics::GetCommandPacketKey<uint64>);
+		});
+		double pooledRadixTime = MedianTime(kRepetitions, reset, [&]() {
+			sorted = Common::RadixSort<uint64>(packets.data(), scratch.data(), count, Graphics::GetCommandPacketKey<uint64>, &workerPool);
+		});
+
+		for (uint j = 0; j < count; ++j) {
+			if (sorted[j].Key != expected[j].Key) {
+				printf("Radix sort produced a different order than std::stable_sort at %u packets\n", count);
+				return;
+			}
+		}
+
+		printf("%10u %11.3f ms %11.3f ms %11.3f ms %11.3f ms\n", count, sortTime, stableSortTime, radixTime, pooledRadixTime);
+	}
+}
+
+} // End of namespace Benchmarks
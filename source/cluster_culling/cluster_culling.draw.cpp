@@ -124,7 +124,8 @@ void ClusterCulling::RenderMainPass() {
 	// Draw instanced models
 	if (m_instancedModels.size() > 0) {
 		DirectX::XMVECTOR *instanceBuffer = m_instanceBuffer->MapDiscard(m_immediateContext);
-		std::vector<uint> offsets;
+		Common::FrameVector<uint> offsets(&m_frameAllocator);
+		offsets.reserve(m_instancedModels.size());
 		uint bufferOffset = 0;
 		for (auto iter = m_instancedModels.begin(); iter != m_instancedModels.end(); ++iter) {
 			assert(bufferOffset < static_cast<uint>(m_instanceBuffer->NumElements()));
@@ -307,11 +308,10 @@ void ClusterCulling::UpdateLightCullingPlanes() {
 		Common::float4 c1(projMatrix._11 * tileScale.X, 0.0f, tileBiasX, 0.0f);
 
 		m_lightCullingPlanes_X[x] = c4 + c1;
-		m_lightCullingPlanes_X[x] /= Common::float3(m_lightCullingPlanes_X[x].X, m_lightCullingPlanes_X[x].Y, m_lightCullingPlanes_X[x].Z).Length();
-
 		m_lightCullingPlanes_X[x + 1] = c4 - c1;
-		m_lightCullingPlanes_X[x + 1] /= Common::float3(m_lightCullingPlanes_X[x + 1].X, m_lightCullingPlanes_X[x + 1].Y, m_lightCullingPlanes_X[x + 1].Z).Length();
 	}
+	// Normalize all the planes in one batch
+	Common::NormalizePlanes(&m_lightCullingPlanes_X[0], m_lightCullingPlanes_X.size() & ~size_t(1));
 
 	for (uint y = 0; y < m_lightCullingPlanes_Y.size() - 1; y+=2) {
 		float tileBiasY = tileScale.Y - y;
@@ -321,11 +321,9 @@ void ClusterCulling::UpdateLightCullingPlanes() {
 		Common::float4 c2(0.0f, -projMatrix._22 * tileScale.Y, tileBiasY, 0.0f);
 
 		m_lightCullingPlanes_Y[y] = c4 - c2;
-		m_lightCullingPlanes_Y[y] /= Common::float3(m_lightCullingPlanes_Y[y].X, m_lightCullingPlanes_Y[y].Y, m_lightCullingPlanes_Y[y].Z).Length();
-
 		m_lightCullingPlanes_Y[y + 1] = c4 + c2;
-		m_lightCullingPlanes_Y[y + 1] /=  Common::float3(m_lightCullingPlanes_Y[y + 1].X, m_lightCullingPlanes_Y[y + 1].Y, m_lightCullingPlanes_Y[y + 1].Z).Length();
 	}
+	Common::NormalizePlanes(&m_lightCullingPlanes_Y[0], m_lightCullingPlanes_Y.size() & ~size_t(1));
 
 	m_lightCullingPlanes_Z[0] = Common::float4(0.0f, 0.0f, 1.0f, 0.0f);
 	for (uint z = 1; z < m_lightCullingPlanes_Z.size(); ++z) {
@@ -439,7 +437,7 @@ void ClusterCulling::RenderHUD() {
 	m_immediateContext->OMSetRenderTargets(1, &m_backbufferRTV, nullptr);
 
 	m_spriteRenderer.Begin(m_immediateContext, Graphics::SpriteRenderer::Point);
-	std::wstring output;
+	Common::FrameWString output(&m_frameAllocator);
 	fastformat::write(output, L"FPS: ", m_fps, L"\nFrame Time: ", m_frameTime, L" (ms)");
 	
 	DirectX::XMFLOAT4X4 transform {1, 0, 0, 0,
@@ -12,6 +12,7 @@
 
 #include "common/vector.h"
 #include "common/allocator_16_byte_aligned.h"
+#include "common/object_pool.h"
 #include "common/math.h"
 
 #include "scene/camera.h"
@@ -68,6 +69,7 @@ private:
 
 	std::vector<std::pair<Scene::Model *, DirectX::XMMATRIX>, Common::Allocator16ByteAligned<std::pair<Scene::Model *, DirectX::XMMATRIX> > > m_models;
 	std::vector<std::pair<Scene::Model *, std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *> > m_instancedModels;
+	Common::ObjectPool<std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > > m_instanceVectorPool;
 
 	Graphics::StructuredBuffer<DirectX::XMVECTOR> *m_instanceBuffer;
 
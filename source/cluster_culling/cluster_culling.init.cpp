@@ -10,8 +10,7 @@
 
 #include "common/math.h"
 #include "common/string_util.h"
-#include "common/file_io_util.h"
-#include "common/memory_stream.h"
+#include "common/mapped_file.h"
 
 #include "scene/halfling_model_file.h"
 #include "scene/model.h"
@@ -93,18 +92,15 @@ bool ClusterCulling::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint
 }
 
 void ClusterCulling::LoadSceneJson() {
-	// Read the entire file into memory
-	DWORD bytesRead;
-	char *fileBuffer = Common::ReadWholeFile(L"scene.json", &bytesRead);
+	// Map the file and parse straight out of the mapping
+	Common::MappedFile file(L"scene.json");
 	
 	// TODO: Add error handling
-	assert(fileBuffer != NULL);
-
-	Common::MemoryInputStream fin(fileBuffer, bytesRead);
+	assert(file.IsOpen());
 	
 	Json::Reader reader;
 	Json::Value root;
-	reader.parse(fin, root, false);
+	reader.parse(file.GetChars(), file.GetChars() + file.GetSize(), root, false);
 
 	m_nearClip = root.get("NearClip", m_nearClip).asSingle();
 	m_farClip = root.get("FarClip", m_farClip).asSingle();
@@ -121,12 +117,12 @@ void ClusterCulling::LoadSceneJson() {
 		std::string materialName = materials[i]["Name"].asString();
 
 		Scene::ModelToLoadMaterial material;
-		material.HMATFilePath = Common::ToWideStr(materials[i]["HMATFilePath"].asString());
+		material.HMATFilePath = Common::InternString(materials[i]["HMATFilePath"].asString());
 
 		Json::Value textureDefinitions = materials[i]["TextureDefinitions"];
 		for (uint j = 0; j < textureDefinitions.size(); ++j) {
 			Scene::TextureDescription description;
-			description.FilePath = Common::ToWideStr(textureDefinitions[j]["FilePath"].asString());
+			description.FilePath = Common::InternString(textureDefinitions[j]["FilePath"].asString());
 			description.Sampler = Scene::ParseSamplerTypeFromString(textureDefinitions[j]["Sampler"].asString(), Scene::LINEAR_WRAP);
 
 			material.Textures.push_back(description);
@@ -138,7 +134,7 @@ void ClusterCulling::LoadSceneJson() {
 	Json::Value models = root["Models"];
 	for (uint i = 0; i < models.size(); ++i) {
 		Json::Value instances = models[i]["Instances"];
-		auto *instanceVector = new std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> >();
+		auto *instanceVector = m_instanceVectorPool.Get(m_instanceVectorPool.Create());
 		for (uint j = 0; j < instances.size(); ++j) {
 			instanceVector->push_back(DirectX::XMMatrixSet(instances[j][0u].asSingle(), instances[j][1u].asSingle(), instances[j][2u].asSingle(), instances[j][3u].asSingle(),
 				instances[j][4u].asSingle(), instances[j][5u].asSingle(), instances[j][6u].asSingle(), instances[j][7u].asSingle(),
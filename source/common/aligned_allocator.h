@@ -0,0 +1,146 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+/*
+ * The allocator interface follows the example code presented
+ * in this Microsoft blog post:
+ * http://blogs.msdn.com/b/vcblog/archive/2008/08/28/the-mallocator.aspx
+ */
+
+
+#pragma once
+
+#include <stddef.h>  // Required for size_t and ptrdiff_t
+#include <malloc.h>  // For _aligned_malloc() and _aligned_free()
+#include <new>       // Required for placement new and std::bad_alloc
+#include <stdexcept> // Required for std::length_error
+#include <utility>   // For std::forward
+
+
+namespace Common {
+
+/** The size of a cache line on all the CPUs we target. Align per-thread data to this to avoid false sharing */
+const size_t kCacheLineSize = 64;
+
+/**
+ * A stateless STL allocator that aligns every allocation to 'Alignment' bytes
+ *
+ * Use 16 for SSE types like XMVECTOR / XMMATRIX, 32 for AVX, and kCacheLineSize for
+ * data that is written by different threads
+ *
+ * @tparam T            The type of object to allocate
+ * @tparam Alignment    The alignment of each allocation. Must be a power of two
+ */
+template <typename T, size_t Alignment = 16>
+class AlignedAllocator {
+	static_assert(Alignment != 0 && (Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+public:
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef T value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	static const size_t kAlignment = Alignment;
+
+	T *address(T &r) const {
+		return &r;
+	}
+
+	const T *address(const T &s) const {
+		return &s;
+	}
+
+	size_t max_size() const {
+		// The following has been carefully written to be independent of
+		// the definition of size_t and to avoid signed/unsigned warnings.
+		return (static_cast<size_t>(0) - static_cast<size_t>(1)) / sizeof(T);
+	}
+
+
+	// The following must be the same for all allocators.
+	template <typename U>
+	struct rebind {
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	bool operator!=(const AlignedAllocator &other) const {
+		return !(*this == other);
+	}
+
+	template <typename U, typename... TArgs>
+	void construct(U *const p, TArgs&&... args) const {
+		void * const pv = static_cast<void *>(p);
+
+		new (pv)U(std::forward<TArgs>(args)...);
+	}
+
+	template <typename U>
+	void destroy(U *const p) const {
+		p->~U();
+	}
+
+
+	// Returns true if and only if storage allocated from *this
+	// can be deallocated from other, and vice versa.
+	// Always returns true for stateless allocators.
+	bool operator==(const AlignedAllocator &/* other */) const {
+		return true;
+	}
+
+	// Default constructor, copy constructor, rebinding constructor, and destructor.
+	// Empty for stateless allocators.
+	AlignedAllocator() {}
+	AlignedAllocator(const AlignedAllocator &) {}
+	template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+	~AlignedAllocator() {}
+
+	T *allocate(const size_t n) const {
+		// The return value of allocate(0) is unspecified.
+		// We return nullptr in order to avoid depending
+		// on malloc(0)'s implementation-defined behavior
+		if (n == 0) {
+			return nullptr;
+		}
+
+		// All allocators should contain an integer overflow check.
+		// The Standardization Committee recommends that std::length_error
+		// be thrown in the case of integer overflow.
+		if (n > max_size()) {
+			throw std::length_error("AlignedAllocator<T>::allocate() - Integer overflow.");
+		}
+
+		void *const pv = _aligned_malloc(n * sizeof(T), Alignment);
+
+		// Allocators should throw std::bad_alloc in the case of memory allocation failure.
+		if (pv == nullptr) {
+			throw std::bad_alloc();
+		}
+
+		return static_cast<T *>(pv);
+	}
+
+	void deallocate(T *const p, const size_t /* n */) const {
+		_aligned_free(p);
+	}
+
+
+	// The following will be the same for all allocators that ignore hints.
+	template <typename U> T *allocate(const size_t n, const U * /* const hint */) const {
+		return allocate(n);
+	}
+
+private:
+	// Allocators are not required to be assignable, so
+	// all allocators should have a private unimplemented
+	// assignment operator.
+	AlignedAllocator &operator=(const AlignedAllocator &);
+};
+
+} // End of namespace Common
@@ -0,0 +1,228 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/async_file_reader.h"
+
+#if defined(_WIN32)
+	#include "common/halfling_sys.h"
+#else
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <stdlib.h>
+#endif
+
+#include <stdint.h>
+#include <cassert>
+#include <algorithm>
+
+
+namespace Common {
+
+// Reads are issued in chunks, so a single huge file doesn't need one giant system call
+static const uint64 kReadChunkSize = 64 * 1024 * 1024;
+
+AsyncFileReader::AsyncFileReader(uint maxOutstandingReads)
+		: m_pendingRequests(0u),
+		  m_shuttingDown(false) {
+	assert(maxOutstandingReads > 0u);
+
+	for (uint i = 0; i < maxOutstandingReads; ++i) {
+		m_ioThreads.push_back(std::thread(&AsyncFileReader::IOThreadMain, this));
+	}
+}
+
+AsyncFileReader::~AsyncFileReader() {
+	{
+		std::lock_guard<std::mutex> guard(m_queueLock);
+		m_shuttingDown = true;
+	}
+	m_requestAvailable.notify_all();
+
+	for (auto iter = m_ioThreads.begin(); iter != m_ioThreads.end(); ++iter) {
+		iter->join();
+	}
+}
+
+std::future<AsyncReadResult> AsyncFileReader::Read(const std::wstring &filePath) {
+	Request request;
+	request.FilePath = filePath;
+	request.Promise = std::make_shared<std::promise<AsyncReadResult> >();
+
+	std::future<AsyncReadResult> future = request.Promise->get_future();
+	QueueRequest(request);
+
+	return future;
+}
+
+void AsyncFileReader::Read(const std::wstring &filePath, CompletionCallback callback) {
+	Request request;
+	request.FilePath = filePath;
+	request.Callback = callback;
+
+	QueueRequest(request);
+}
+
+void AsyncFileReader::WaitForAll() {
+	std::unique_lock<std::mutex> lock(m_queueLock);
+	while (m_pendingRequests > 0u) {
+		m_allRequestsDone.wait(lock);
+	}
+}
+
+void AsyncFileReader::QueueRequest(Request &request) {
+	{
+		std::lock_guard<std::mutex> guard(m_queueLock);
+		m_requestQueue.push_back(request);
+		++m_pendingRequests;
+	}
+	m_requestAvailable.notify_one();
+}
+
+void AsyncFileReader::IOThreadMain() {
+	for (;;) {
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(m_queueLock);
+			while (m_requestQueue.empty() && !m_shuttingDown) {
+				m_requestAvailable.wait(lock);
+			}
+
+			// Finish any queued work before shutting down
+			if (m_requestQueue.empty()) {
+				return;
+			}
+
+			request = m_requestQueue.front();
+			m_requestQueue.pop_front();
+		}
+
+		// A failed allocation mustn't escape the thread, or leave the promise without a value
+		AsyncReadResult result;
+		std::exception_ptr readException;
+		try {
+			ReadWholeFile(request.FilePath, &result);
+		} catch (...) {
+			readException = std::current_exception();
+			result.FilePath = request.FilePath;
+			result.Success = false;
+			result.Data.reset();
+			result.Size = 0u;
+		}
+
+		if (request.Callback) {
+			request.Callback(result);
+		}
+		if (request.Promise) {
+			if (readException) {
+				request.Promise->set_exception(readException);
+			} else {
+				request.Promise->set_value(std::move(result));
+			}
+		}
+
+		bool allDone;
+		{
+			std::lock_guard<std::mutex> guard(m_queueLock);
+			allDone = --m_pendingRequests == 0u;
+		}
+		if (allDone) {
+			m_allRequestsDone.notify_all();
+		}
+	}
+}
+
+#if defined(_WIN32)
+
+void AsyncFileReader::ReadWholeFile(const std::wstring &filePath, AsyncReadResult *result) {
+	result->FilePath = filePath;
+	result->Success = false;
+
+	HANDLE fileHandle = CreateFile(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || static_cast<uint64>(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(fileHandle);
+		return;
+	}
+
+	uint64 fileSize = static_cast<uint64>(size.QuadPart);
+	std::unique_ptr<byte[]> data(fileSize > 0u ? new byte[static_cast<size_t>(fileSize)] : nullptr);
+
+	uint64 totalRead = 0u;
+	while (totalRead < fileSize) {
+		DWORD bytesToRead = static_cast<DWORD>(std::min(fileSize - totalRead, kReadChunkSize));
+		DWORD bytesRead = 0;
+		if (!ReadFile(fileHandle, data.get() + totalRead, bytesToRead, &bytesRead, NULL) || bytesRead == 0) {
+			CloseHandle(fileHandle);
+			return;
+		}
+		totalRead += bytesRead;
+	}
+
+	CloseHandle(fileHandle);
+
+	result->Data = std::move(data);
+	result->Size = fileSize;
+	result->Success = true;
+}
+
+#else
+
+void AsyncFileReader::ReadWholeFile(const std::wstring &filePath, AsyncReadResult *result) {
+	result->FilePath = filePath;
+	result->Success = false;
+
+	// Convert the path to the multi-byte encoding of the current locale
+	size_t pathLength = wcstombs(nullptr, filePath.c_str(), 0);
+	if (pathLength == static_cast<size_t>(-1)) {
+		return;
+	}
+	std::string narrowPath(pathLength, '\0');
+	wcstombs(&narrowPath[0], filePath.c_str(), pathLength);
+
+	int fileDescriptor = open(narrowPath.c_str(), O_RDONLY);
+	if (fileDescriptor == -1) {
+		return;
+	}
+
+	struct stat fileStats;
+	if (fstat(fileDescriptor, &fileStats) != 0 || static_cast<uint64>(fileStats.st_size) > SIZE_MAX) {
+		close(fileDescriptor);
+		return;
+	}
+
+	#if defined(POSIX_FADV_SEQUENTIAL)
+		posix_fadvise(fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+	#endif
+
+	uint64 fileSize = static_cast<uint64>(fileStats.st_size);
+	std::unique_ptr<byte[]> data(fileSize > 0u ? new byte[static_cast<size_t>(fileSize)] : nullptr);
+
+	uint64 totalRead = 0u;
+	while (totalRead < fileSize) {
+		size_t bytesToRead = static_cast<size_t>(std::min(fileSize - totalRead, kReadChunkSize));
+		ssize_t bytesRead = pread(fileDescriptor, data.get() + totalRead, bytesToRead, static_cast<off_t>(totalRead));
+		if (bytesRead <= 0) {
+			close(fileDescriptor);
+			return;
+		}
+		totalRead += static_cast<uint64>(bytesRead);
+	}
+
+	close(fileDescriptor);
+
+	result->Data = std::move(data);
+	result->Size = fileSize;
+	result->Success = true;
+}
+
+#endif
+
+} // End of namespace Common
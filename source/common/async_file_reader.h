@@ -0,0 +1,144 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace Common {
+
+/** The result of an asynchronous file read */
+struct AsyncReadResult {
+	AsyncReadResult()
+		: Success(false),
+		  Size(0u) {
+	}
+	AsyncReadResult(AsyncReadResult &&other)
+		: FilePath(std::move(other.FilePath)),
+		  Success(other.Success),
+		  Data(std::move(other.Data)),
+		  Size(other.Size) {
+	}
+	AsyncReadResult &operator=(AsyncReadResult &&other) {
+		FilePath = std::move(other.FilePath);
+		Success = other.Success;
+		Data = std::move(other.Data);
+		Size = other.Size;
+
+		return *this;
+	}
+
+	std::wstring FilePath;
+	bool Success;
+	/** The contents of the file. Null if the read failed or the file is empty */
+	std::unique_ptr<byte[]> Data;
+	uint64 Size;
+
+private:
+	// Not implemented
+	AsyncReadResult(const AsyncReadResult &);
+	AsyncReadResult &operator=(const AsyncReadResult &);
+};
+
+/**
+ * A service that reads whole files in the background
+ *
+ * Requests are queued and serviced by a pool of I/O threads. The number of threads
+ * is the maximum number of reads in flight at once. This keeps the disk busy while the
+ * caller parses the files that have already arrived on other cores.
+ *
+ * Completion can be observed either through a std::future, or a callback. Callbacks are
+ * invoked on the I/O thread that did the read, so they should hand off any heavy work
+ * rather than stall the I/O slot. If a read throws, the future re-throws the exception
+ * from get(), and the callback gets a result with Success set to false.
+ *
+ * Every completed read holds the whole file in memory until its result is released. Callers
+ * reading many files should only keep a few reads queued ahead of where they consume them.
+ *
+ * The destructor finishes all queued requests before joining the I/O threads.
+ */
+class AsyncFileReader {
+public:
+	typedef std::function<void(AsyncReadResult &result)> CompletionCallback;
+
+	/**
+	 * Create a new AsyncFileReader
+	 *
+	 * @param maxOutstandingReads    The maximum number of reads in flight at once
+	 */
+	AsyncFileReader(uint maxOutstandingReads = kDefaultMaxOutstandingReads);
+	~AsyncFileReader();
+
+public:
+	static const uint kDefaultMaxOutstandingReads = 4u;
+
+private:
+	struct Request {
+		std::wstring FilePath;
+		std::shared_ptr<std::promise<AsyncReadResult> > Promise;
+		CompletionCallback Callback;
+	};
+
+	std::vector<std::thread> m_ioThreads;
+	std::deque<Request> m_requestQueue;
+	std::mutex m_queueLock;
+	std::condition_variable m_requestAvailable;
+	std::condition_variable m_allRequestsDone;
+
+	uint m_pendingRequests;
+	bool m_shuttingDown;
+
+public:
+	/**
+	 * Queues a read of a whole file
+	 *
+	 * @param filePath    The path of the file to read
+	 * @return            A future that will hold the file contents once the read completes
+	 */
+	std::future<AsyncReadResult> Read(const std::wstring &filePath);
+	/**
+	 * Queues a read of a whole file
+	 *
+	 * @param filePath    The path of the file to read
+	 * @param callback    Called on an I/O thread once the read completes
+	 */
+	void Read(const std::wstring &filePath, CompletionCallback callback);
+
+	/** Blocks until every queued read has completed */
+	void WaitForAll();
+
+	inline uint GetMaxOutstandingReads() const { return static_cast<uint>(m_ioThreads.size()); }
+
+	/**
+	 * Synchronously reads a whole file. This is what the I/O threads use to service requests
+	 *
+	 * @param filePath    The path of the file to read
+	 * @param result      Will be filled with the file contents
+	 */
+	static void ReadWholeFile(const std::wstring &filePath, AsyncReadResult *result);
+
+private:
+	void QueueRequest(Request &request);
+	void IOThreadMain();
+
+	// Not implemented
+	AsyncFileReader(const AsyncFileReader &);
+	AsyncFileReader &operator=(const AsyncFileReader &);
+};
+
+} // End of namespace Common
@@ -0,0 +1,158 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+
+namespace Common {
+
+/**
+ * A bounds-checked cursor over a block of memory
+ *
+ * Unlike MemoryInputStream, reads are plain memcpys with no streambuf or sentry overhead.
+ * Large blobs can be viewed in place with View(), which returns a pointer into the
+ * underlying buffer instead of copying it.
+ *
+ * Any read that would go past the end of the buffer fails, leaves the output untouched,
+ * and puts the reader into an error state. Once in the error state, all subsequent reads fail.
+ * So a parser can do a series of reads and only check HasError() once at the end.
+ *
+ * NOTE: The reader does not own the buffer. The buffer must outlive the reader and any views into it
+ */
+class BinaryReader {
+public:
+	BinaryReader(const void *data, size_t size)
+		: m_begin(static_cast<const byte *>(data)),
+		  m_current(static_cast<const byte *>(data)),
+		  m_end(static_cast<const byte *>(data) + size),
+		  m_error(false) {
+	}
+
+private:
+	const byte *m_begin;
+	const byte *m_current;
+	const byte *m_end;
+	bool m_error;
+
+public:
+	/**
+	 * Reads a single trivially copyable value
+	 *
+	 * @param value    Will be filled with the value read
+	 * @return         False if there was not enough data left
+	 */
+	template <typename T>
+	inline bool Read(T *value) {
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryReader can only read trivially copyable types");
+		return ReadBytes(value, sizeof(T));
+	}
+
+	/**
+	 * Reads an array of trivially copyable values
+	 *
+	 * @param values    The array to fill. Must have room for at least 'count' elements
+	 * @param count     The number of elements to read
+	 * @return          False if there was not enough data left
+	 */
+	template <typename T>
+	inline bool ReadArray(T *values, size_t count) {
+		static_assert(std::is_trivially_copyable<T>::value, "BinaryReader can only read trivially copyable types");
+		if (count > Remaining() / sizeof(T)) {
+			m_error = true;
+			return false;
+		}
+		return ReadBytes(values, sizeof(T) * count);
+	}
+
+	/**
+	 * Returns a pointer to 'count' elements inside the buffer and advances past them. No data is copied.
+	 *
+	 * NOTE: The returned pointer has the alignment of the data within the buffer. It is not
+	 *       guaranteed to be aligned to __alignof(T)
+	 *
+	 * @param count    The number of elements to view
+	 * @return         A pointer into the buffer, or nullptr if there was not enough data left
+	 */
+	template <typename T>
+	inline const T *View(size_t count) {
+		if (m_error || count > Remaining() / sizeof(T)) {
+			m_error = true;
+			return nullptr;
+		}
+
+		const T *view = reinterpret_cast<const T *>(m_current);
+		m_current += sizeof(T) * count;
+
+		return view;
+	}
+
+	/**
+	 * Reads a string that is prefixed by its length
+	 *
+	 * @param value    Will be filled with the string read
+	 * @return         False if there was not enough data left
+	 */
+	template <typename LengthType>
+	inline bool ReadLengthPrefixedString(std::string *value) {
+		LengthType length;
+		if (!Read(&length)) {
+			return false;
+		}
+
+		const char *chars = View<char>(length);
+		if (chars == nullptr) {
+			return false;
+		}
+
+		value->assign(chars, length);
+		return true;
+	}
+
+	inline bool ReadInt64(int64 *value) { return Read(value); }
+	inline bool ReadUInt64(uint64 *value) { return Read(value); }
+	inline bool ReadInt32(int32 *value) { return Read(value); }
+	inline bool ReadUInt32(uint32 *value) { return Read(value); }
+	inline bool ReadInt16(int16 *value) { return Read(value); }
+	inline bool ReadUInt16(uint16 *value) { return Read(value); }
+	inline bool ReadByte(byte *value) { return Read(value); }
+
+	/**
+	 * Advances the cursor without reading
+	 *
+	 * @param numBytes    The number of bytes to skip
+	 * @return            False if there was not enough data left
+	 */
+	inline bool Skip(size_t numBytes) {
+		return View<byte>(numBytes) != nullptr;
+	}
+
+	inline size_t Tell() const { return m_current - m_begin; }
+	inline size_t Size() const { return m_end - m_begin; }
+	inline size_t Remaining() const { return m_end - m_current; }
+	inline bool IsAtEnd() const { return m_current == m_end; }
+	inline bool HasError() const { return m_error; }
+
+private:
+	inline bool ReadBytes(void *dest, size_t numBytes) {
+		if (m_error || numBytes > Remaining()) {
+			m_error = true;
+			return false;
+		}
+
+		memcpy(dest, m_current, numBytes);
+		m_current += numBytes;
+
+		return true;
+	}
+};
+
+} // End of namespace Common
@@ -20,10 +20,18 @@ char *ReadWholeFile(const wchar *name, DWORD *bytesRead) {
 		return NULL; // error condition, could call GetLastError to find out more
 	}
 
-	DWORD fileSize = (DWORD)size.QuadPart;
+	// ReadFile() can only read DWORD sized chunks. Larger files should use MappedFile
+	if (size.QuadPart > MAXDWORD) {
+		CloseHandle(hFile);
+		return NULL;
+	}
+
+	DWORD fileSize = static_cast<DWORD>(size.QuadPart);
 	char *fileBuffer = new char[fileSize];
 	if (!ReadFile(hFile, fileBuffer, fileSize, bytesRead, NULL)) {
-		return nullptr;
+		delete[] fileBuffer;
+		CloseHandle(hFile);
+		return NULL;
 	}
 
 	CloseHandle(hFile);
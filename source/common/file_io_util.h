@@ -13,6 +13,16 @@
 
 namespace Common {
 
+/**
+ * Reads a whole file into a new heap buffer. The caller owns the buffer and must delete[] it
+ *
+ * NOTE: Files larger than 4GB can not be read with this function. Prefer Common::MappedFile,
+ *       which avoids the copy and supports 64-bit sizes
+ *
+ * @param name         The path of the file to read
+ * @param bytesRead    Will be filled with the number of bytes read
+ * @return             The file contents, or NULL on failure
+ */
 char *ReadWholeFile(const wchar *name, DWORD *bytesRead);
 
 /**
@@ -0,0 +1,377 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/hash.h"
+
+#include <malloc.h>
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+
+namespace Common {
+
+/**
+ * An open addressing hash map, using Robin Hood linear probing
+ *
+ * All the entries live in one contiguous array, so a lookup is usually a single cache miss,
+ * and inserting doesn't allocate unless the table has to grow. On insert, an entry that is
+ * further from its ideal slot than the resident entry takes the slot, and the resident is
+ * moved further along. This keeps probe sequences short and even, even at high load.
+ * Erase uses backward shifting, so there are no tombstones.
+ *
+ * The probe distance of each slot is stored in a separate array, so probing only touches
+ * the entries when the distances match.
+ *
+ * The hasher must spread entropy into the low bits, since the table size is a power of two.
+ * Common::Hash does this.
+ *
+ * NOTE: Unlike std::unordered_map, inserting or erasing may move other entries. So pointers,
+ *       references and iterators into the map are invalidated by any insert or erase. If the
+ *       values need stable addresses, store pointers to them instead.
+ * NOTE: The key is not const in value_type, so that entries can be moved around. Don't modify it.
+ * NOTE: This class is not thread-safe
+ *
+ * @tparam KeyType      The type of the keys
+ * @tparam ValueType    The type of the mapped values
+ * @tparam Hasher       A functor returning a 64-bit hash of a key
+ * @tparam KeyEqual     A functor comparing two keys for equality
+ */
+template <typename KeyType, typename ValueType, typename Hasher = Hash<KeyType>, typename KeyEqual = std::equal_to<KeyType> >
+class FlatHashMap {
+public:
+	typedef std::pair<KeyType, ValueType> value_type;
+
+private:
+	template <typename MapType, typename EntryType>
+	class IteratorBase {
+	public:
+		// Declared directly, since deriving from std::iterator is deprecated
+		typedef std::forward_iterator_tag iterator_category;
+		typedef typename std::remove_const<EntryType>::type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef EntryType *pointer;
+		typedef EntryType &reference;
+
+		IteratorBase() : m_map(nullptr), m_index(0) {}
+		IteratorBase(MapType *map, size_t index) : m_map(map), m_index(index) { SkipEmpty(); }
+
+	private:
+		MapType *m_map;
+		size_t m_index;
+
+	public:
+		inline EntryType &operator*() const { return m_map->m_entries[m_index]; }
+		inline EntryType *operator->() const { return m_map->m_entries + m_index; }
+
+		inline IteratorBase &operator++() {
+			++m_index;
+			SkipEmpty();
+			return *this;
+		}
+		inline IteratorBase operator++(int) {
+			IteratorBase previous(*this);
+			++(*this);
+			return previous;
+		}
+
+		inline bool operator==(const IteratorBase &other) const { return m_index == other.m_index; }
+		inline bool operator!=(const IteratorBase &other) const { return m_index != other.m_index; }
+
+	private:
+		inline void SkipEmpty() {
+			while (m_index < m_map->m_capacity && m_map->m_distances[m_index] == 0u) {
+				++m_index;
+			}
+		}
+	};
+
+public:
+	typedef IteratorBase<FlatHashMap, value_type> iterator;
+	typedef IteratorBase<const FlatHashMap, const value_type> const_iterator;
+
+public:
+	/**
+	 * Create a new FlatHashMap
+	 *
+	 * @param initialSize    The number of entries to reserve space for
+	 */
+	FlatHashMap(size_t initialSize = 0u)
+		: m_entries(nullptr),
+		  m_distances(nullptr),
+		  m_capacity(0u),
+		  m_size(0u) {
+		reserve(initialSize);
+	}
+	FlatHashMap(FlatHashMap &&other)
+		: m_entries(other.m_entries),
+		  m_distances(other.m_distances),
+		  m_capacity(other.m_capacity),
+		  m_size(other.m_size),
+		  m_hasher(std::move(other.m_hasher)),
+		  m_keyEqual(std::move(other.m_keyEqual)) {
+		other.m_entries = nullptr;
+		other.m_distances = nullptr;
+		other.m_capacity = 0u;
+		other.m_size = 0u;
+	}
+	~FlatHashMap() {
+		clear();
+		_aligned_free(m_entries);
+		delete[] m_distances;
+	}
+
+private:
+	static const size_t kMinCapacity = 8u;
+	static const size_t kEntryAlignment = __alignof(value_type) > 16 ? __alignof(value_type) : 16;
+
+	/** Storage for m_capacity entries. Raw memory; entries are constructed in place */
+	value_type *m_entries;
+	/** The probe distance + 1 of the entry in each slot. 0 means the slot is empty */
+	uint *m_distances;
+	/** Always 0, or a power of two */
+	size_t m_capacity;
+	size_t m_size;
+
+	Hasher m_hasher;
+	KeyEqual m_keyEqual;
+
+	static const size_t kNotFound = ~size_t(0);
+
+public:
+	inline iterator begin() { return iterator(this, 0u); }
+	inline iterator end() { return iterator(this, m_capacity); }
+	inline const_iterator begin() const { return const_iterator(this, 0u); }
+	inline const_iterator end() const { return const_iterator(this, m_capacity); }
+
+	inline size_t size() const { return m_size; }
+	inline bool empty() const { return m_size == 0u; }
+	inline size_t capacity() const { return m_capacity; }
+
+	iterator find(const KeyType &key) {
+		size_t index = FindIndex(key);
+		return iterator(this, index == kNotFound ? m_capacity : index);
+	}
+	const_iterator find(const KeyType &key) const {
+		size_t index = FindIndex(key);
+		return const_iterator(this, index == kNotFound ? m_capacity : index);
+	}
+	inline size_t count(const KeyType &key) const {
+		return FindIndex(key) == kNotFound ? 0u : 1u;
+	}
+
+	/**
+	 * Inserts an entry, if the key doesn't already exist
+	 *
+	 * @param entry    The entry to insert
+	 * @return         An iterator to the entry with the key, and whether the entry was inserted
+	 */
+	std::pair<iterator, bool> insert(const value_type &entry) {
+		return try_emplace(entry.first, entry.second);
+	}
+
+	/**
+	 * Constructs a value in place, if the key doesn't already exist.
+	 * If it does exist, 'args' are left untouched
+	 *
+	 * @param key     The key of the entry
+	 * @param args    The arguments to forward to the constructor of ValueType
+	 * @return        An iterator to the entry with the key, and whether the entry was inserted
+	 */
+	template <typename... TArgs>
+	std::pair<iterator, bool> try_emplace(const KeyType &key, TArgs&&... args) {
+		uint64 hash = m_hasher(key);
+
+		size_t index = FindIndex(key, hash);
+		if (index != kNotFound) {
+			return std::make_pair(iterator(this, index), false);
+		}
+
+		if ((m_size + 1u) * 8u > m_capacity * 7u) {
+			Rehash(m_capacity == 0u ? kMinCapacity : m_capacity * 2u);
+		}
+
+		value_type entry(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<TArgs>(args)...));
+		index = InsertNew(hash, entry);
+
+		return std::make_pair(iterator(this, index), true);
+	}
+
+	/**
+	 * Returns the value for the key. If the key doesn't exist, a default
+	 * constructed value is inserted
+	 *
+	 * @param key    The key to look up
+	 * @return       The value for the key
+	 */
+	inline ValueType &operator[](const KeyType &key) {
+		return try_emplace(key).first->second;
+	}
+
+	/**
+	 * Removes the entry with the key, if it exists
+	 *
+	 * @param key    The key to remove
+	 * @return       The number of entries removed
+	 */
+	size_t erase(const KeyType &key) {
+		size_t index = FindIndex(key);
+		if (index == kNotFound) {
+			return 0u;
+		}
+
+		m_entries[index].~value_type();
+
+		// Shift the following entries of the cluster back by one slot, until we hit
+		// an empty slot, or an entry that is already in its ideal slot
+		size_t mask = m_capacity - 1u;
+		size_t next = (index + 1u) & mask;
+		while (m_distances[next] > 1u) {
+			new (m_entries + index) value_type(std::move(m_entries[next]));
+			m_entries[next].~value_type();
+			m_distances[index] = m_distances[next] - 1u;
+
+			index = next;
+			next = (next + 1u) & mask;
+		}
+
+		m_distances[index] = 0u;
+		--m_size;
+
+		return 1u;
+	}
+
+	/** Destroys all the entries. The memory is kept for re-use */
+	void clear() {
+		for (size_t i = 0; i < m_capacity; ++i) {
+			if (m_distances[i] != 0u) {
+				m_entries[i].~value_type();
+				m_distances[i] = 0u;
+			}
+		}
+		m_size = 0u;
+	}
+
+	/**
+	 * Grows the table, so 'size' entries can be stored without rehashing
+	 *
+	 * @param size    The number of entries to reserve space for
+	 */
+	void reserve(size_t size) {
+		size_t capacity = m_capacity == 0u ? kMinCapacity : m_capacity;
+		while (size * 8u > capacity * 7u) {
+			capacity *= 2u;
+		}
+
+		if (size != 0u && capacity > m_capacity) {
+			Rehash(capacity);
+		}
+	}
+
+private:
+	inline size_t FindIndex(const KeyType &key) const {
+		return m_size == 0u ? kNotFound : FindIndex(key, m_hasher(key));
+	}
+
+	size_t FindIndex(const KeyType &key, uint64 hash) const {
+		if (m_size == 0u) {
+			return kNotFound;
+		}
+
+		size_t mask = m_capacity - 1u;
+		size_t index = static_cast<size_t>(hash) & mask;
+
+		// An entry with a shorter probe distance than ours means the key would have been
+		// placed before it, so the key can't be in the table. This includes empty slots
+		for (uint distance = 1u; distance <= m_distances[index]; ++distance) {
+			if (m_distances[index] == distance && m_keyEqual(m_entries[index].first, key)) {
+				return index;
+			}
+			index = (index + 1u) & mask;
+		}
+
+		return kNotFound;
+	}
+
+	/**
+	 * Inserts an entry whose key is known not to be in the table. There must be at least one free slot
+	 *
+	 * @param hash     The hash of the entry's key
+	 * @param entry    The entry to insert. This is used as scratch space, and is left in an unspecified state
+	 * @return         The slot index the entry was placed in
+	 */
+	size_t InsertNew(uint64 hash, value_type &entry) {
+		size_t mask = m_capacity - 1u;
+		size_t index = static_cast<size_t>(hash) & mask;
+		uint distance = 1u;
+		size_t insertedIndex = kNotFound;
+
+		for (;;) {
+			if (m_distances[index] == 0u) {
+				new (m_entries + index) value_type(std::move(entry));
+				m_distances[index] = distance;
+				++m_size;
+
+				return insertedIndex == kNotFound ? index : insertedIndex;
+			}
+
+			if (m_distances[index] < distance) {
+				// Take the slot from the resident, and carry the resident forward instead
+				std::swap(entry, m_entries[index]);
+				std::swap(distance, m_distances[index]);
+
+				if (insertedIndex == kNotFound) {
+					insertedIndex = index;
+				}
+			}
+
+			index = (index + 1u) & mask;
+			++distance;
+		}
+	}
+
+	void Rehash(size_t newCapacity) {
+		assert((newCapacity & (newCapacity - 1u)) == 0u);
+
+		value_type *oldEntries = m_entries;
+		uint *oldDistances = m_distances;
+		size_t oldCapacity = m_capacity;
+
+		m_entries = static_cast<value_type *>(_aligned_malloc(newCapacity * sizeof(value_type), kEntryAlignment));
+		if (m_entries == nullptr) {
+			throw std::bad_alloc();
+		}
+		m_distances = new uint[newCapacity];
+		memset(m_distances, 0, newCapacity * sizeof(uint));
+		m_capacity = newCapacity;
+		m_size = 0u;
+
+		for (size_t i = 0; i < oldCapacity; ++i) {
+			if (oldDistances[i] != 0u) {
+				InsertNew(m_hasher(oldEntries[i].first), oldEntries[i]);
+				oldEntries[i].~value_type();
+			}
+		}
+
+		_aligned_free(oldEntries);
+		delete[] oldDistances;
+	}
+
+	// Not implemented
+	FlatHashMap(const FlatHashMap &);
+	FlatHashMap &operator=(const FlatHashMap &);
+};
+
+} // End of namespace Common
@@ -0,0 +1,35 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/frame_allocator.h"
+
+#include <cassert>
+
+
+namespace Common {
+
+FrameAllocator::FrameAllocator(size_t pageSize, uint numFrames)
+		: m_numFrames(numFrames),
+		  m_currentFrame(0u) {
+	assert(numFrames > 0u && numFrames <= kMaxFrames);
+
+	for (uint i = 0; i < kMaxFrames; ++i) {
+		m_frameAllocators[i] = i < m_numFrames ? new LinearAllocator(pageSize) : nullptr;
+	}
+}
+
+FrameAllocator::~FrameAllocator() {
+	for (uint i = 0; i < m_numFrames; ++i) {
+		delete m_frameAllocators[i];
+	}
+}
+
+void FrameAllocator::BeginFrame() {
+	m_currentFrame = (m_currentFrame + 1u) % m_numFrames;
+	m_frameAllocators[m_currentFrame]->Reset();
+}
+
+} // End of namespace Common
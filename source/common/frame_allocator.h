@@ -0,0 +1,173 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/linear_allocator.h"
+
+#include <stddef.h>
+#include <new>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace Common {
+
+/**
+ * An allocator for transient per-frame data
+ *
+ * Internally, it rotates through 'numFrames' LinearAllocators. BeginFrame() moves to the next
+ * allocator and resets it. So memory allocated during frame N stays valid until BeginFrame()
+ * has been called 'numFrames' more times. This lets data safely outlive its frame when
+ * a consumer (ie. a render thread) lags behind the producer.
+ *
+ * Once the pages have grown to fit the largest frame, the steady state does no heap allocations.
+ *
+ * NOTE: This class is not thread-safe
+ */
+class FrameAllocator {
+public:
+	/**
+	 * Create a new FrameAllocator
+	 *
+	 * @param pageSize     The page size of each of the internal LinearAllocators
+	 * @param numFrames    The number of frames an allocation stays valid. Must be between 1 and kMaxFrames
+	 */
+	FrameAllocator(size_t pageSize, uint numFrames = kDefaultNumFrames);
+	~FrameAllocator();
+
+public:
+	static const uint kDefaultNumFrames = 2u;
+	static const uint kMaxFrames = 4u;
+
+private:
+	LinearAllocator *m_frameAllocators[kMaxFrames];
+	uint m_numFrames;
+	uint m_currentFrame;
+
+public:
+	/**
+	 * Rotates to the next frame's allocator and resets it. Any memory allocated
+	 * 'numFrames' calls ago becomes invalid.
+	 */
+	void BeginFrame();
+	/**
+	 * Allocates transient memory for the current frame
+	 *
+	 * @param size         The number of bytes to allocate
+	 * @param alignment    The alignment of the returned memory. Must be a power of two
+	 * @return             The newly allocated memory
+	 */
+	inline void *Allocate(size_t size, size_t alignment = LinearAllocator::kDefaultAlignment) {
+		return m_frameAllocators[m_currentFrame]->Allocate(size, alignment);
+	}
+
+	inline uint GetNumFrames() const { return m_numFrames; }
+	/** Returns the usage statistics of the current frame's allocator */
+	inline const LinearAllocatorStats &GetStats() const { return m_frameAllocators[m_currentFrame]->GetStats(); }
+
+private:
+	// Not implemented
+	FrameAllocator(const FrameAllocator &);
+	FrameAllocator &operator=(const FrameAllocator &);
+};
+
+
+/**
+ * An STL compatible allocator that hands out memory from a FrameAllocator
+ *
+ * deallocate() is a no-op. The memory is recycled when the FrameAllocator rotates back around.
+ * Therefore, containers using this allocator must not live longer than the FrameAllocator's frame count.
+ */
+template <typename T>
+class FrameAllocatorAdapter {
+public:
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef T value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <typename U>
+	struct rebind {
+		typedef FrameAllocatorAdapter<U> other;
+	};
+
+	FrameAllocatorAdapter(FrameAllocator *frameAllocator)
+		: m_frameAllocator(frameAllocator) {
+	}
+	FrameAllocatorAdapter(const FrameAllocatorAdapter &other)
+		: m_frameAllocator(other.m_frameAllocator) {
+	}
+	template <typename U>
+	FrameAllocatorAdapter(const FrameAllocatorAdapter<U> &other)
+		: m_frameAllocator(other.GetFrameAllocator()) {
+	}
+
+private:
+	FrameAllocator *m_frameAllocator;
+
+public:
+	inline FrameAllocator *GetFrameAllocator() const { return m_frameAllocator; }
+
+	T *allocate(size_t n) const {
+		if (n == 0) {
+			return nullptr;
+		}
+		if (n > max_size()) {
+			throw std::length_error("FrameAllocatorAdapter<T>::allocate() - Integer overflow.");
+		}
+
+		return static_cast<T *>(m_frameAllocator->Allocate(n * sizeof(T), __alignof(T) > LinearAllocator::kDefaultAlignment ? __alignof(T) : LinearAllocator::kDefaultAlignment));
+	}
+	template <typename U>
+	T *allocate(size_t n, const U * /* hint */) const {
+		return allocate(n);
+	}
+
+	void deallocate(T * /* p */, size_t /* n */) const {
+		// No-op. The memory is reclaimed when the FrameAllocator rotates
+	}
+
+	size_t max_size() const {
+		return (std::numeric_limits<size_t>::max)() / sizeof(T);
+	}
+
+	void construct(T *const p, const T &t) const {
+		new (static_cast<void *>(p)) T(t);
+	}
+	template <typename U, typename... TArgs>
+	void construct(U *p, TArgs&&... args) const {
+		new (static_cast<void *>(p)) U(std::forward<TArgs>(args)...);
+	}
+	template <typename U>
+	void destroy(U *p) const {
+		p->~U();
+	}
+
+	template <typename U>
+	bool operator==(const FrameAllocatorAdapter<U> &other) const {
+		return m_frameAllocator == other.GetFrameAllocator();
+	}
+	template <typename U>
+	bool operator!=(const FrameAllocatorAdapter<U> &other) const {
+		return m_frameAllocator != other.GetFrameAllocator();
+	}
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocatorAdapter<T> >;
+
+typedef std::basic_string<char, std::char_traits<char>, FrameAllocatorAdapter<char> > FrameString;
+typedef std::basic_string<wchar, std::char_traits<wchar>, FrameAllocatorAdapter<wchar> > FrameWString;
+
+} // End of namespace Common
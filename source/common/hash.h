@@ -6,34 +6,157 @@
 
 #pragma once
 
-#include <tuple>
+#include "common/typedefs.h"
+
+#include <cstring>
 #include <functional>
-#include <type_traits>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <stdint.h>
 
-inline size_t hash_combiner(size_t left, size_t right) {
-	return left ^ right + 0x9e3779b9ull + (left << 6) + (left >> 2);
+
+namespace Common {
+
+/**
+ * Scrambles all 64 bits of the input, so that every input bit affects every output bit.
+ * This is the finalizer from SplitMix64
+ *
+ * @param value    The value to mix
+ * @return         The mixed value
+ */
+inline uint64 HashMix64(uint64 value) {
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ull;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebull;
+	value ^= value >> 31;
+
+	return value;
 }
 
-namespace std {
+/**
+ * Combines the hash of a new value into an existing hash. The result depends on the order
+ * the values are combined in
+ *
+ * @param seed     The hash so far
+ * @param value    The hash of the value to add
+ * @return         The combined hash
+ */
+inline uint64 HashCombine(uint64 seed, uint64 value) {
+	return HashMix64(seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
 
-template<typename... TTypes>
-class hash<std::tuple<TTypes...>> {
-private:
-	typedef std::tuple<TTypes...> Tuple;
+/**
+ * Hashes a block of memory. This is MurmurHash64A, by Austin Appleby
+ *
+ * @param data     The memory to hash
+ * @param size     The size of the memory in bytes
+ * @param seed     The starting value of the hash
+ * @return         The hash
+ */
+inline uint64 HashBytes(const void *data, size_t size, uint64 seed = 0xe17a1465ull) {
+	const uint64 m = 0xc6a4a7935bd1e995ull;
+	const int r = 47;
+
+	const byte *bytes = static_cast<const byte *>(data);
+	const byte *end = bytes + (size & ~size_t(7));
 
-	template<int N>
-	size_t operator()(Tuple value) const { return 0; }
+	uint64 hash = seed ^ (size * m);
 
-	template<int N, typename THead, typename... TTail>
-	size_t operator()(Tuple value) const {
-		const int Index = N - sizeof...(TTail)-1;
-		return hash_combiner(hash<THead>()(std::get<Index>(value)), operator()<N, TTail...>(value));
+	for (; bytes != end; bytes += 8) {
+		// memcpy, since 'data' may not be 8 byte aligned
+		uint64 k;
+		memcpy(&k, bytes, sizeof(uint64));
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		hash ^= k;
+		hash *= m;
 	}
 
-public:
-	size_t operator()(Tuple value) const {
-		return operator()<sizeof...(TTypes), TTypes...>(value);
+	// Mix in the 1 - 7 trailing bytes. Every case intentionally falls through to the next
+	switch (size & 7) {
+	case 7: hash ^= uint64(bytes[6]) << 48; // Fall through
+	case 6: hash ^= uint64(bytes[5]) << 40; // Fall through
+	case 5: hash ^= uint64(bytes[4]) << 32; // Fall through
+	case 4: hash ^= uint64(bytes[3]) << 24; // Fall through
+	case 3: hash ^= uint64(bytes[2]) << 16; // Fall through
+	case 2: hash ^= uint64(bytes[1]) << 8;  // Fall through
+	case 1: hash ^= uint64(bytes[0]);
+		hash *= m;
+	}
+
+	hash ^= hash >> r;
+	hash *= m;
+	hash ^= hash >> r;
+
+	return hash;
+}
+
+/**
+ * A 64-bit hash functor with good bit dispersion in all bits, so it can be used directly
+ * with power-of-two sized tables.
+ *
+ * The default falls back to std::hash, and mixes the result. std::hash on integers and
+ * pointers is usually the identity, which would be a poor choice for open addressing
+ */
+template <typename T>
+struct Hash {
+	inline uint64 operator()(const T &value) const {
+		return HashMix64(static_cast<uint64>(std::hash<T>()(value)));
+	}
+};
+
+template <typename T>
+struct Hash<T *> {
+	inline uint64 operator()(T *value) const {
+		return HashMix64(static_cast<uint64>(reinterpret_cast<uintptr_t>(value)));
+	}
+};
+
+template <typename CharType, typename Traits, typename Allocator>
+struct Hash<std::basic_string<CharType, Traits, Allocator> > {
+	inline uint64 operator()(const std::basic_string<CharType, Traits, Allocator> &value) const {
+		return HashBytes(value.data(), value.size() * sizeof(CharType));
+	}
+};
+
+template <typename First, typename Second>
+struct Hash<std::pair<First, Second> > {
+	inline uint64 operator()(const std::pair<First, Second> &value) const {
+		return HashCombine(Hash<First>()(value.first), Hash<Second>()(value.second));
+	}
+};
+
+template <size_t Index, size_t Count>
+struct TupleHasher {
+	template <typename Tuple>
+	static inline uint64 Combine(uint64 seed, const Tuple &value) {
+		typedef typename std::tuple_element<Index, Tuple>::type Element;
+		return TupleHasher<Index + 1, Count>::Combine(HashCombine(seed, Hash<Element>()(std::get<Index>(value))), value);
+	}
+};
+
+template <size_t Count>
+struct TupleHasher<Count, Count> {
+	template <typename Tuple>
+	static inline uint64 Combine(uint64 seed, const Tuple &/* value */) {
+		return seed;
 	}
 };
 
-} // End of namespace std
+template <typename... TTypes>
+struct Hash<std::tuple<TTypes...> > {
+	inline uint64 operator()(const std::tuple<TTypes...> &value) const {
+		return TupleHasher<0, sizeof...(TTypes)>::Combine(0u, value);
+	}
+};
+
+} // End of namespace Common
+
+inline size_t hash_combiner(size_t left, size_t right) {
+	return static_cast<size_t>(Common::HashCombine(left, right));
+}
@@ -6,18 +6,30 @@
 
 #include "common/linear_allocator.h"
 
+#include <malloc.h>
+#include <new>
+#include <cassert>
+#include <algorithm>
+
 
 namespace Common {
 
 LinearAllocator::LinearAllocator(size_t pageSize)
 		: m_pageSize(pageSize),
-		  m_numPages(1u) {
+		  m_numPages(1u),
+		  m_largeAllocations(nullptr) {
 	m_currentPage = m_firstPage = new Page(pageSize);
 	m_current = reinterpret_cast<byte *>(m_currentPage->Data);
 	m_end = m_current + m_pageSize;
+
+	m_stats.NumPages = m_numPages;
+	m_stats.HighWaterMark = 0u;
+	ResetFrameStats();
 }
 
 LinearAllocator::~LinearAllocator() {
+	FreeLargeAllocations();
+
 	Page *currentPage = m_firstPage;
 	Page *pageToDelete;
 
@@ -29,8 +41,22 @@ LinearAllocator::~LinearAllocator() {
 	} while (currentPage != nullptr);
 }
 
-void *LinearAllocator::Allocate(size_t size) {
-    if (m_current + size >= m_end) {
+void *LinearAllocator::Allocate(size_t size, size_t alignment) {
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	// Requests that can't fit in a page, even in the worst alignment case, get their own block of memory.
+	// Pages start at kPageAlignment, so smaller alignments never need padding on a fresh page
+	size_t worstCasePadding = alignment > kPageAlignment ? alignment - 1 : 0;
+	if (size + worstCasePadding > m_pageSize) {
+		return AllocateLarge(size, alignment);
+	}
+
+	byte *userPtr = AlignPointer(m_current, alignment);
+
+	if (userPtr + size > m_end) {
+		// The remainder of the page is lost
+		m_stats.BytesWasted += m_end - m_current;
+
 		// Check if we already have a new page allocated
 		if (m_currentPage->NextPage != nullptr) {
 			m_currentPage = m_currentPage->NextPage;
@@ -42,16 +68,71 @@ void *LinearAllocator::Allocate(size_t size) {
 			m_currentPage = newPage;
 
 			++m_numPages;
+			m_stats.NumPages = m_numPages;
 		}
-        
-        m_current = reinterpret_cast<byte *>(m_currentPage->Data);
-        m_end = m_current + m_pageSize;
-    }
-    
-    void* userPtr = m_current;
-    m_current += size;
-    
-    return userPtr;
+		++m_stats.PagesInUse;
+
+		m_current = reinterpret_cast<byte *>(m_currentPage->Data);
+		m_end = m_current + m_pageSize;
+
+		userPtr = AlignPointer(m_current, alignment);
+	}
+
+	m_stats.BytesWasted += userPtr - m_current;
+	m_stats.BytesAllocated += size;
+
+	m_current = userPtr + size;
+
+	return userPtr;
+}
+
+void LinearAllocator::Reset() {
+	size_t frameUsage = m_stats.BytesAllocated + m_stats.BytesWasted + m_stats.LargeAllocationBytes;
+	m_stats.HighWaterMark = std::max(m_stats.HighWaterMark, frameUsage);
+
+	FreeLargeAllocations();
+
+	m_currentPage = m_firstPage;
+	m_current = reinterpret_cast<byte *>(m_currentPage->Data);
+	m_end = m_current + m_pageSize;
+
+	ResetFrameStats();
+}
+
+void *LinearAllocator::AllocateLarge(size_t size, size_t alignment) {
+	void *data = _aligned_malloc(size, alignment);
+	if (data == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	// The bookkeeping node comes from the pages, so it is recycled along with everything else
+	LargeAllocation *allocation = reinterpret_cast<LargeAllocation *>(Allocate(sizeof(LargeAllocation), __alignof(LargeAllocation)));
+	allocation->Data = data;
+	allocation->NextAllocation = m_largeAllocations;
+	m_largeAllocations = allocation;
+
+	++m_stats.LargeAllocations;
+	m_stats.LargeAllocationBytes += size;
+
+	return data;
+}
+
+void LinearAllocator::FreeLargeAllocations() {
+	LargeAllocation *allocation = m_largeAllocations;
+	while (allocation != nullptr) {
+		_aligned_free(allocation->Data);
+		allocation = allocation->NextAllocation;
+	}
+
+	m_largeAllocations = nullptr;
+}
+
+void LinearAllocator::ResetFrameStats() {
+	m_stats.BytesAllocated = 0u;
+	m_stats.BytesWasted = 0u;
+	m_stats.PagesInUse = 1u;
+	m_stats.LargeAllocations = 0u;
+	m_stats.LargeAllocationBytes = 0u;
 }
 
 } // End of namespace Common
@@ -7,43 +7,133 @@
 #pragma once
 
 #include "common/typedefs.h"
+#include "common/aligned_allocator.h"
+
+#include <stddef.h>
+#include <stdint.h>
 
 
 namespace Common {
 
+/**
+ * Usage statistics for a LinearAllocator
+ *
+ * All the 'frame' values are counted since the last call to Reset(). The
+ * remaining values persist for the lifetime of the allocator
+ */
+struct LinearAllocatorStats {
+	/** The number of bytes handed out to the user since the last Reset() */
+	size_t BytesAllocated;
+	/** The number of bytes lost to alignment padding and to unused page tails since the last Reset() */
+	size_t BytesWasted;
+	/** The number of pages touched since the last Reset() */
+	uint PagesInUse;
+	/** The number of allocations that were too large for a page since the last Reset() */
+	uint LargeAllocations;
+	/** The number of bytes handed out through the large allocation path since the last Reset() */
+	size_t LargeAllocationBytes;
+
+	/** The total number of pages owned by the allocator */
+	uint NumPages;
+	/** The largest value of (BytesAllocated + BytesWasted + LargeAllocationBytes) seen in any single frame */
+	size_t HighWaterMark;
+};
+
+/**
+ * A simple bump allocator that hands out memory from a chain of fixed size pages.
+ * Individual allocations can not be freed. Instead, Reset() recycles all the pages at once.
+ *
+ * Allocations larger than a page are served by a dedicated large allocation path. That memory
+ * is freed on Reset()
+ *
+ * NOTE: This class is not thread-safe
+ */
 class LinearAllocator {
 public:
-    LinearAllocator(size_t pageSize);
+	LinearAllocator(size_t pageSize);
 	~LinearAllocator();
 
+public:
+	/** The alignment used by Allocate() when none is specified. Large enough for XMVECTOR / XMMATRIX */
+	static const size_t kDefaultAlignment = 16;
+	/**
+	 * The alignment of the start of each page. Allocations with an alignment up to this never
+	 * need padding at the start of a page, and data in different pages never shares a cache line
+	 */
+	static const size_t kPageAlignment = kCacheLineSize;
+
 private:
-    struct Page {
-        Page(size_t pageSize)
-            : NextPage(nullptr),
-              Data(::operator new(pageSize)) {
-        }
-    
-        Page *NextPage;
-        void *Data;
-    };
-
-    size_t m_pageSize;
-    
+	typedef AlignedAllocator<byte, kPageAlignment> PageAllocator;
+
+	struct Page {
+		Page(size_t pageSize)
+			: NextPage(nullptr),
+			  Data(PageAllocator().allocate(pageSize)),
+			  Size(pageSize) {
+		}
+		~Page() {
+			PageAllocator().deallocate(static_cast<byte *>(Data), Size);
+		}
+
+		Page *NextPage;
+		void *Data;
+		size_t Size;
+	};
+
+	struct LargeAllocation {
+		LargeAllocation *NextAllocation;
+		void *Data;
+	};
+
+	size_t m_pageSize;
+
 	uint m_numPages;
 
-    Page *m_firstPage;
-    Page *m_currentPage;
-    
-    byte *m_end;
-    byte *m_current;
-    
+	Page *m_firstPage;
+	Page *m_currentPage;
+
+	byte *m_end;
+	byte *m_current;
+
+	LargeAllocation *m_largeAllocations;
+
+	LinearAllocatorStats m_stats;
+
 public:
-    void *Allocate(size_t size);
-    inline void Reset() {  
-		m_currentPage = m_firstPage; 
-		m_current = reinterpret_cast<byte *>(m_currentPage->Data);
-		m_end = m_current + m_pageSize;
+	/**
+	 * Allocates a block of memory from the current page. If the current page doesn't have
+	 * enough room, the allocator moves on to the next page, creating it if necessary
+	 *
+	 * @param size         The number of bytes to allocate
+	 * @param alignment    The alignment of the returned memory. Must be a power of two
+	 * @return             The newly allocated memory
+	 */
+	void *Allocate(size_t size, size_t alignment = kDefaultAlignment);
+	/**
+	 * Recycles all the pages and frees any large allocations. All memory previously returned
+	 * by Allocate() becomes invalid
+	 */
+	void Reset();
+
+	inline size_t GetPageSize() const { return m_pageSize; }
+	/**
+	 * Returns the usage statistics of the allocator. Read this before calling Reset()
+	 * to get the usage of the current frame
+	 */
+	inline const LinearAllocatorStats &GetStats() const { return m_stats; }
+
+private:
+	void *AllocateLarge(size_t size, size_t alignment);
+	void FreeLargeAllocations();
+	void ResetFrameStats();
+
+	inline static byte *AlignPointer(byte *ptr, size_t alignment) {
+		return reinterpret_cast<byte *>((reinterpret_cast<uintptr_t>(ptr) + (alignment - 1)) & ~(static_cast<uintptr_t>(alignment) - 1));
 	}
+
+	// Not implemented
+	LinearAllocator(const LinearAllocator &);
+	LinearAllocator &operator=(const LinearAllocator &);
 };
 
 } // End of namespace Common
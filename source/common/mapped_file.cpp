@@ -0,0 +1,225 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/mapped_file.h"
+
+#if defined(_WIN32)
+	#include "common/halfling_sys.h"
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <stdlib.h>
+	#include <string>
+#endif
+
+#include <stdint.h>
+
+
+namespace Common {
+
+MappedFile::MappedFile()
+		: m_data(nullptr),
+		  m_size(0u),
+		  m_isOpen(false),
+		#if defined(_WIN32)
+		  m_fileHandle(INVALID_HANDLE_VALUE),
+		  m_mappingHandle(nullptr) {
+		#else
+		  m_fileDescriptor(-1) {
+		#endif
+}
+
+MappedFile::MappedFile(const wchar *filePath, AccessPattern accessPattern)
+		: m_data(nullptr),
+		  m_size(0u),
+		  m_isOpen(false),
+		#if defined(_WIN32)
+		  m_fileHandle(INVALID_HANDLE_VALUE),
+		  m_mappingHandle(nullptr) {
+		#else
+		  m_fileDescriptor(-1) {
+		#endif
+	Open(filePath, accessPattern);
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+#if defined(_WIN32)
+
+// PrefetchVirtualMemory() only exists on Windows 8 and up, so we look it up at runtime
+struct PrefetchMemoryRange {
+	void *VirtualAddress;
+	SIZE_T NumberOfBytes;
+};
+typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE process, ULONG_PTR numberOfEntries, PrefetchMemoryRange *virtualAddresses, ULONG flags);
+
+static PrefetchVirtualMemoryFunc GetPrefetchVirtualMemory() {
+	static PrefetchVirtualMemoryFunc prefetchFunc = reinterpret_cast<PrefetchVirtualMemoryFunc>(GetProcAddress(GetModuleHandle(L"kernel32.dll"), "PrefetchVirtualMemory"));
+	return prefetchFunc;
+}
+
+bool MappedFile::Open(const wchar *filePath, AccessPattern accessPattern) {
+	Close();
+
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | (accessPattern == ACCESS_SEQUENTIAL ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+	HANDLE fileHandle = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || static_cast<uint64>(size.QuadPart) > SIZE_MAX) {
+		// The file is too big to fit in the address space
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	m_fileHandle = fileHandle;
+	m_size = static_cast<uint64>(size.QuadPart);
+	m_isOpen = true;
+
+	// Empty files can't be mapped
+	if (m_size == 0u) {
+		return true;
+	}
+
+	m_mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mappingHandle == nullptr) {
+		Close();
+		return false;
+	}
+
+	m_data = reinterpret_cast<const byte *>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (m_data == nullptr) {
+		Close();
+		return false;
+	}
+
+	if (accessPattern == ACCESS_SEQUENTIAL) {
+		WillNeed(0u, m_size);
+	}
+
+	return true;
+}
+
+void MappedFile::Close() {
+	if (m_data != nullptr) {
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mappingHandle != nullptr) {
+		CloseHandle(m_mappingHandle);
+	}
+	if (m_fileHandle != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_fileHandle);
+	}
+
+	m_data = nullptr;
+	m_size = 0u;
+	m_isOpen = false;
+	m_fileHandle = INVALID_HANDLE_VALUE;
+	m_mappingHandle = nullptr;
+}
+
+void MappedFile::WillNeed(uint64 offset, uint64 size) const {
+	if (m_data == nullptr || offset >= m_size) {
+		return;
+	}
+
+	PrefetchVirtualMemoryFunc prefetchFunc = GetPrefetchVirtualMemory();
+	if (prefetchFunc == nullptr) {
+		return;
+	}
+
+	PrefetchMemoryRange range;
+	range.VirtualAddress = const_cast<byte *>(m_data + offset);
+	range.NumberOfBytes = static_cast<SIZE_T>(size < m_size - offset ? size : m_size - offset);
+	prefetchFunc(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+bool MappedFile::Open(const wchar *filePath, AccessPattern accessPattern) {
+	Close();
+
+	// Convert the path to the multi-byte encoding of the current locale
+	size_t pathLength = wcstombs(nullptr, filePath, 0);
+	if (pathLength == static_cast<size_t>(-1)) {
+		return false;
+	}
+	std::string narrowPath(pathLength, '\0');
+	wcstombs(&narrowPath[0], filePath, pathLength);
+
+	int fileDescriptor = open(narrowPath.c_str(), O_RDONLY);
+	if (fileDescriptor == -1) {
+		return false;
+	}
+
+	struct stat fileStats;
+	if (fstat(fileDescriptor, &fileStats) != 0 || static_cast<uint64>(fileStats.st_size) > SIZE_MAX) {
+		close(fileDescriptor);
+		return false;
+	}
+
+	m_fileDescriptor = fileDescriptor;
+	m_size = static_cast<uint64>(fileStats.st_size);
+	m_isOpen = true;
+
+	// Empty files can't be mapped
+	if (m_size == 0u) {
+		return true;
+	}
+
+	void *data = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (data == MAP_FAILED) {
+		Close();
+		return false;
+	}
+	m_data = reinterpret_cast<const byte *>(data);
+
+	if (accessPattern == ACCESS_SEQUENTIAL) {
+		madvise(data, static_cast<size_t>(m_size), MADV_SEQUENTIAL);
+		WillNeed(0u, m_size);
+	} else {
+		madvise(data, static_cast<size_t>(m_size), MADV_RANDOM);
+	}
+
+	return true;
+}
+
+void MappedFile::Close() {
+	if (m_data != nullptr) {
+		munmap(const_cast<byte *>(m_data), static_cast<size_t>(m_size));
+	}
+	if (m_fileDescriptor != -1) {
+		close(m_fileDescriptor);
+	}
+
+	m_data = nullptr;
+	m_size = 0u;
+	m_isOpen = false;
+	m_fileDescriptor = -1;
+}
+
+void MappedFile::WillNeed(uint64 offset, uint64 size) const {
+	if (m_data == nullptr || offset >= m_size) {
+		return;
+	}
+
+	// madvise() requires a page aligned address
+	size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	size_t alignedOffset = static_cast<size_t>(offset) & ~(pageSize - 1);
+	size_t end = static_cast<size_t>(size < m_size - offset ? offset + size : m_size);
+
+	madvise(const_cast<byte *>(m_data + alignedOffset), end - alignedOffset, MADV_WILLNEED);
+}
+
+#endif
+
+} // End of namespace Common
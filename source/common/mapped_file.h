@@ -0,0 +1,89 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <stddef.h>
+
+
+namespace Common {
+
+/**
+ * A read-only memory mapping of a whole file
+ *
+ * The file contents can be parsed directly out of GetData(), without copying them into
+ * a heap buffer first. Sizes are 64-bit. The mapping is released when the
+ * MappedFile is destroyed or Close() is called. Any pointers into the data become invalid then.
+ *
+ * Win32 uses CreateFileMapping / MapViewOfFile. Other platforms use mmap.
+ */
+class MappedFile {
+public:
+	/** Tells the OS how the mapping will be read, so it can schedule read-ahead */
+	enum AccessPattern {
+		/** The file will be read front to back. Pages are read ahead aggressively */
+		ACCESS_SEQUENTIAL,
+		/** The file will be read in no particular order. Read-ahead is reduced */
+		ACCESS_RANDOM
+	};
+
+	MappedFile();
+	/**
+	 * Opens and maps a file
+	 *
+	 * @param filePath         The path of the file to map
+	 * @param accessPattern    A hint for how the file will be read
+	 */
+	MappedFile(const wchar *filePath, AccessPattern accessPattern = ACCESS_SEQUENTIAL);
+	~MappedFile();
+
+private:
+	const byte *m_data;
+	uint64 m_size;
+	bool m_isOpen;
+
+	#if defined(_WIN32)
+		void *m_fileHandle;
+		void *m_mappingHandle;
+	#else
+		int m_fileDescriptor;
+	#endif
+
+public:
+	/**
+	 * Opens and maps a file. Any previously mapped file is closed first
+	 *
+	 * @param filePath         The path of the file to map
+	 * @param accessPattern    A hint for how the file will be read
+	 * @return                 True if the file was mapped successfully
+	 */
+	bool Open(const wchar *filePath, AccessPattern accessPattern = ACCESS_SEQUENTIAL);
+	/** Unmaps the file and closes it */
+	void Close();
+
+	/**
+	 * Asks the OS to start paging in a range of the file in the background
+	 *
+	 * @param offset    The offset of the range, in bytes
+	 * @param size      The size of the range, in bytes
+	 */
+	void WillNeed(uint64 offset, uint64 size) const;
+
+	/** Returns true if a file is mapped. Empty files are reported as open, with a null data pointer */
+	inline bool IsOpen() const { return m_isOpen; }
+	inline const byte *GetData() const { return m_data; }
+	inline const char *GetChars() const { return reinterpret_cast<const char *>(m_data); }
+	inline uint64 GetSize() const { return m_size; }
+
+private:
+	// Not implemented
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
+
+} // End of namespace Common
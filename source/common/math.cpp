@@ -6,327 +6,165 @@
 
 #include "common/math.h"
 
+#include <algorithm>
+#include <cassert>
 
-namespace Common {
-
-float2 &float2::operator+=(const float2 &rhs) {
-	X += rhs.X;
-	Y += rhs.Y;
-
-	return *this;
-}
-
-float2 &float2::operator-=(const float2 &rhs) {
-	X -= rhs.X;
-	Y -= rhs.Y;
-
-	return *this;
-}
-
-float2 &float2::operator*=(const float2 &rhs) {
-	X *= rhs.X;
-	Y *= rhs.Y;
-
-	return *this;
-}
-
-float2 &float2::operator/=(const float2 &rhs) {
-	X /= rhs.X;
-	Y /= rhs.Y;
-
-	return *this;
-}
-
-float2 &float2::operator+=(float rhs) {
-	X += rhs;
-	Y += rhs;
 
-	return *this;
-}
-
-float2 &float2::operator-=(float rhs) {
-	X -= rhs;
-	Y -= rhs;
-
-	return *this;
-}
-
-float2 &float2::operator*=(float rhs) {
-	X *= rhs;
-	Y *= rhs;
-
-	return *this;
-}
-
-float2 &float2::operator/=(float rhs) {
-	X /= rhs;
-	Y /= rhs;
-
-	return *this;
-}
+namespace Common {
 
-float2 &float2::operator=(const float2 &rhs) {
-	if (this != &rhs) {
-		X = rhs.X;
-		Y = rhs.Y;
+void NormalizePlanes(float4 *planes, size_t count) {
+	size_t i = 0;
+
+	#if HALFLING_MATH_SSE
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		for (; i + 4 <= count; i += 4) {
+			// Transpose 4 planes into A, B, C, D registers, so each lane holds one plane
+			__m128 a = planes[i + 0].Load();
+			__m128 b = planes[i + 1].Load();
+			__m128 c = planes[i + 2].Load();
+			__m128 d = planes[i + 3].Load();
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), _mm_mul_ps(b, b)), _mm_mul_ps(c, c));
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+			a = _mm_mul_ps(a, invLength);
+			b = _mm_mul_ps(b, invLength);
+			c = _mm_mul_ps(c, invLength);
+			d = _mm_mul_ps(d, invLength);
+
+			_MM_TRANSPOSE4_PS(a, b, c, d);
+			planes[i + 0].Store(a);
+			planes[i + 1].Store(b);
+			planes[i + 2].Store(c);
+			planes[i + 3].Store(d);
+		}
+	#endif
+
+	for (; i < count; ++i) {
+		planes[i] /= planes[i].XYZ().Length();
 	}
-
-	return *this;
 }
 
-float2 operator+(const float2 &lhs, const float2 &rhs) {
-	return float2(lhs.X + rhs.X, lhs.Y + rhs.Y);
-}
+void NormalizePlanesSoA(float *a, float *b, float *c, float *d, size_t count) {
+	size_t i = 0;
 
-float2 operator-(const float2 &lhs, const float2 &rhs) {
-	return float2(lhs.X - rhs.X, lhs.Y - rhs.Y);
-}
+	#if HALFLING_MATH_AVX
+		const __m256 one8 = _mm256_set1_ps(1.0f);
 
-float2 operator*(const float2 &lhs, const float2 &rhs) {
-	return float2(lhs.X * rhs.X, lhs.Y * rhs.Y);
-}
-
-float2 operator/(const float2 &lhs, const float2 &rhs) {
-	return float2(lhs.X / rhs.X, lhs.Y / rhs.Y);
-}
-
-float2 operator+(float lhs, const float2 &rhs) {
-	return float2(lhs + rhs.X, lhs + rhs.Y);
-}
-
-float2 operator-(float lhs, const float2 &rhs) {
-	return float2(lhs - rhs.X, lhs - rhs.Y);
-}
+		for (; i + 8 <= count; i += 8) {
+			__m256 A = _mm256_loadu_ps(a + i);
+			__m256 B = _mm256_loadu_ps(b + i);
+			__m256 C = _mm256_loadu_ps(c + i);
 
-float2 operator*(float lhs, const float2 &rhs) {
-	return float2(lhs * rhs.X, lhs * rhs.Y);
-}
-
-float2 operator/(float lhs, const float2 &rhs) {
-	return float2(lhs / rhs.X, lhs / rhs.Y);
-}
+			__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(A, A), _mm256_mul_ps(B, B)), _mm256_mul_ps(C, C));
+			__m256 invLength = _mm256_div_ps(one8, _mm256_sqrt_ps(lengthSq));
 
+			_mm256_storeu_ps(a + i, _mm256_mul_ps(A, invLength));
+			_mm256_storeu_ps(b + i, _mm256_mul_ps(B, invLength));
+			_mm256_storeu_ps(c + i, _mm256_mul_ps(C, invLength));
+			_mm256_storeu_ps(d + i, _mm256_mul_ps(_mm256_loadu_ps(d + i), invLength));
+		}
+	#endif
 
-float3 &float3::operator+=(const float3 &rhs) {
-	X += rhs.X;
-	Y += rhs.Y;
-	Z += rhs.Z;
+	#if HALFLING_MATH_SSE
+		const __m128 one = _mm_set1_ps(1.0f);
 
-	return *this;
-}
-
-float3 &float3::operator-=(const float3 &rhs) {
-	X -= rhs.X;
-	Y -= rhs.Y;
-	Z -= rhs.Z;
-
-	return *this;
-}
+		for (; i + 4 <= count; i += 4) {
+			__m128 A = _mm_loadu_ps(a + i);
+			__m128 B = _mm_loadu_ps(b + i);
+			__m128 C = _mm_loadu_ps(c + i);
 
-float3 &float3::operator*=(const float3 &rhs) {
-	X *= rhs.X;
-	Y *= rhs.Y;
-	Z *= rhs.Z;
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(A, A), _mm_mul_ps(B, B)), _mm_mul_ps(C, C));
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
 
-	return *this;
-}
-
-float3 &float3::operator/=(const float3 &rhs) {
-	X /= rhs.X;
-	Y /= rhs.Y;
-	Z /= rhs.Z;
-
-	return *this;
-}
-
-float3 &float3::operator+=(float rhs) {
-	X += rhs;
-	Y += rhs;
-	Z += rhs;
-
-	return *this;
-}
-
-float3 &float3::operator-=(float rhs) {
-	X -= rhs;
-	Y -= rhs;
-	Z -= rhs;
-
-	return *this;
-}
-
-float3 &float3::operator*=(float rhs) {
-	X *= rhs;
-	Y *= rhs;
-	Z *= rhs;
-
-	return *this;
-}
+			_mm_storeu_ps(a + i, _mm_mul_ps(A, invLength));
+			_mm_storeu_ps(b + i, _mm_mul_ps(B, invLength));
+			_mm_storeu_ps(c + i, _mm_mul_ps(C, invLength));
+			_mm_storeu_ps(d + i, _mm_mul_ps(_mm_loadu_ps(d + i), invLength));
+		}
+	#endif
 
-float3 &float3::operator/=(float rhs) {
-	X /= rhs;
-	Y /= rhs;
-	Z /= rhs;
-
-	return *this;
-}
-
-float3 &float3::operator=(const float3 &rhs) {
-	if (this != &rhs) {
-		X = rhs.X;
-		Y = rhs.Y;
-		Z = rhs.Z;
+	for (; i < count; ++i) {
+		float invLength = 1.0f / std::sqrt(a[i] * a[i] + b[i] * b[i] + c[i] * c[i]);
+		a[i] *= invLength;
+		b[i] *= invLength;
+		c[i] *= invLength;
+		d[i] *= invLength;
 	}
-
-	return *this;
-}
-
-float3 operator+(const float3 &lhs, const float3 &rhs) {
-	return float3(lhs.X + rhs.X, lhs.Y + rhs.Y, lhs.Z + rhs.Z);
-}
-
-float3 operator-(const float3 &lhs, const float3 &rhs) {
-	return float3(lhs.X - rhs.X, lhs.Y - rhs.Y, lhs.Z - rhs.Z);
-}
-
-float3 operator*(const float3 &lhs, const float3 &rhs) {
-	return float3(lhs.X * rhs.X, lhs.Y * rhs.Y, lhs.Z * rhs.Z);
-}
-
-float3 operator/(const float3 &lhs, const float3 &rhs) {
-	return float3(lhs.X / rhs.X, lhs.Y / rhs.Y, lhs.Z / rhs.Z);
-}
-
-float3 operator+(float lhs, const float3 &rhs) {
-	return float3(lhs + rhs.X, lhs + rhs.Y, lhs + rhs.Z);
-}
-
-float3 operator-(float lhs, const float3 &rhs) {
-	return float3(lhs - rhs.X, lhs - rhs.Y, lhs - rhs.Z);
-}
-
-float3 operator*(float lhs, const float3 &rhs) {
-	return float3(lhs * rhs.X, lhs * rhs.Y, lhs * rhs.Z);
-}
-
-float3 operator/(float lhs, const float3 &rhs) {
-	return float3(lhs / rhs.X, lhs / rhs.Y, lhs / rhs.Z);
-}
-
-
-float4 &float4::operator+=(const float4 &rhs) {
-	X += rhs.X;
-	Y += rhs.Y;
-	Z += rhs.Z;
-	W += rhs.W;
-
-	return *this;
-}
-
-float4 &float4::operator-=(const float4 &rhs) {
-	X -= rhs.X;
-	Y -= rhs.Y;
-	Z -= rhs.Z;
-	W -= rhs.W;
-
-	return *this;
 }
 
-float4 &float4::operator*=(const float4 &rhs) {
-	X *= rhs.X;
-	Y *= rhs.Y;
-	Z *= rhs.Z;
-	W *= rhs.W;
-
-	return *this;
-}
-
-float4 &float4::operator/=(const float4 &rhs) {
-	X /= rhs.X;
-	Y /= rhs.Y;
-	Z /= rhs.Z;
-	W /= rhs.W;
-
-	return *this;
-}
-
-float4 &float4::operator+=(float rhs) {
-	X += rhs;
-	Y += rhs;
-	Z += rhs;
-	W += rhs;
-
-	return *this;
-}
-
-float4 &float4::operator-=(float rhs) {
-	X -= rhs;
-	Y -= rhs;
-	Z -= rhs;
-	W -= rhs;
-
-	return *this;
-}
-
-float4 &float4::operator*=(float rhs) {
-	X *= rhs;
-	Y *= rhs;
-	Z *= rhs;
-	W *= rhs;
-
-	return *this;
-}
-
-float4 &float4::operator/=(float rhs) {
-	X /= rhs;
-	Y /= rhs;
-	Z /= rhs;
-	W /= rhs;
-
-	return *this;
-}
-
-float4 &float4::operator=(const float4 &rhs) {
-	if (this != &rhs) {
-		X = rhs.X;
-		Y = rhs.Y;
-		Z = rhs.Z;
-		W = rhs.W;
+void Dot3SoA(const float *x, const float *y, const float *z, const float3 &vector, float *out, size_t count) {
+	size_t i = 0;
+
+	#if HALFLING_MATH_AVX
+		const __m256 vx8 = _mm256_set1_ps(vector.X);
+		const __m256 vy8 = _mm256_set1_ps(vector.Y);
+		const __m256 vz8 = _mm256_set1_ps(vector.Z);
+
+		for (; i + 8 <= count; i += 8) {
+			__m256 dot = _mm256_mul_ps(_mm256_loadu_ps(x + i), vx8);
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(y + i), vy8));
+			dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_loadu_ps(z + i), vz8));
+			_mm256_storeu_ps(out + i, dot);
+		}
+	#endif
+
+	#if HALFLING_MATH_SSE
+		const __m128 vx = _mm_set1_ps(vector.X);
+		const __m128 vy = _mm_set1_ps(vector.Y);
+		const __m128 vz = _mm_set1_ps(vector.Z);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 dot = _mm_mul_ps(_mm_loadu_ps(x + i), vx);
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(y + i), vy));
+			dot = _mm_add_ps(dot, _mm_mul_ps(_mm_loadu_ps(z + i), vz));
+			_mm_storeu_ps(out + i, dot);
+		}
+	#endif
+
+	for (; i < count; ++i) {
+		out[i] = x[i] * vector.X + y[i] * vector.Y + z[i] * vector.Z;
 	}
-
-	return *this;
 }
 
-float4 operator+(const float4 &lhs, const float4 &rhs) {
-	return float4(lhs.X + rhs.X, lhs.Y + rhs.Y, lhs.Z + rhs.Z, lhs.W + rhs.W);
-}
+void MinMax(const float *values, size_t count, float *outMin, float *outMax) {
+	assert(count > 0);
 
-float4 operator-(const float4 &lhs, const float4 &rhs) {
-	return float4(lhs.X - rhs.X, lhs.Y - rhs.Y, lhs.Z - rhs.Z, lhs.W - rhs.W);
-}
+	float minValue = values[0];
+	float maxValue = values[0];
+	size_t i = 0;
 
-float4 operator*(const float4 &lhs, const float4 &rhs) {
-	return float4(lhs.X * rhs.X, lhs.Y * rhs.Y, lhs.Z * rhs.Z, lhs.W * rhs.W);
-}
+	#if HALFLING_MATH_SSE
+		if (count >= 4) {
+			__m128 minVector = _mm_loadu_ps(values);
+			__m128 maxVector = minVector;
 
-float4 operator/(const float4 &lhs, const float4 &rhs) {
-	return float4(lhs.X / rhs.X, lhs.Y / rhs.Y, lhs.Z / rhs.Z, lhs.W / rhs.W);
-}
+			for (i = 4; i + 4 <= count; i += 4) {
+				__m128 v = _mm_loadu_ps(values + i);
+				minVector = _mm_min_ps(minVector, v);
+				maxVector = _mm_max_ps(maxVector, v);
+			}
 
-float4 operator+(float lhs, const float4 &rhs) {
-	return float4(lhs + rhs.X, lhs + rhs.Y, lhs + rhs.Z, lhs + rhs.W);
-}
+			// Horizontal reduction of the 4 lanes
+			minVector = _mm_min_ps(minVector, _mm_shuffle_ps(minVector, minVector, _MM_SHUFFLE(1, 0, 3, 2)));
+			minVector = _mm_min_ps(minVector, _mm_shuffle_ps(minVector, minVector, _MM_SHUFFLE(2, 3, 0, 1)));
+			maxVector = _mm_max_ps(maxVector, _mm_shuffle_ps(maxVector, maxVector, _MM_SHUFFLE(1, 0, 3, 2)));
+			maxVector = _mm_max_ps(maxVector, _mm_shuffle_ps(maxVector, maxVector, _MM_SHUFFLE(2, 3, 0, 1)));
 
-float4 operator-(float lhs, const float4 &rhs) {
-	return float4(lhs - rhs.X, lhs - rhs.Y, lhs - rhs.Z, lhs - rhs.W);
-}
+			minValue = _mm_cvtss_f32(minVector);
+			maxValue = _mm_cvtss_f32(maxVector);
+		}
+	#endif
 
-float4 operator*(float lhs, const float4 &rhs) {
-	return float4(lhs * rhs.X, lhs * rhs.Y, lhs * rhs.Z, lhs * rhs.W);
-}
+	for (; i < count; ++i) {
+		minValue = std::min(minValue, values[i]);
+		maxValue = std::max(maxValue, values[i]);
+	}
 
-float4 operator/(float lhs, const float4 &rhs) {
-	return float4(lhs / rhs.X, lhs / rhs.Y, lhs / rhs.Z, lhs / rhs.W);
+	*outMin = minValue;
+	*outMax = maxValue;
 }
 
 } // End of namespace Common
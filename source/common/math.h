@@ -8,6 +8,25 @@
 
 #include "common/halfling_sys.h"
 
+#include <cmath>
+#include <stddef.h>
+
+// SSE is used whenever the target guarantees it. Define HALFLING_MATH_NO_SIMD to force the scalar fallback
+#if !defined(HALFLING_MATH_NO_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__))
+	#define HALFLING_MATH_SSE 1
+	#include <xmmintrin.h>
+#else
+	#define HALFLING_MATH_SSE 0
+#endif
+
+// The batch kernels use 8-wide AVX when the compiler is allowed to emit it (/arch:AVX)
+#if HALFLING_MATH_SSE && defined(__AVX__)
+	#define HALFLING_MATH_AVX 1
+	#include <immintrin.h>
+#else
+	#define HALFLING_MATH_AVX 0
+#endif
+
 
 namespace Common {
 
@@ -16,37 +35,38 @@ public:
 	float2(float x, float y) : X(x), Y(y) {}
 	float2() : X(0.0f), Y(0.0f) {}
 
-	float2(const float2 &rhs) : X(rhs.X), Y(rhs.Y) {}
-
 public:
 	float X;
 	float Y;
 
 public:
-	float2 &operator+=(const float2 &rhs);
-	float2 &operator-=(const float2 &rhs);
-	float2 &operator*=(const float2 &rhs);
-	float2 &operator/=(const float2 &rhs);
-
-	float2 &operator+=(float rhs);
-	float2 &operator-=(float rhs);
-	float2 &operator*=(float rhs);
-	float2 &operator/=(float rhs);
+	inline float2 &operator+=(const float2 &rhs) { X += rhs.X; Y += rhs.Y; return *this; }
+	inline float2 &operator-=(const float2 &rhs) { X -= rhs.X; Y -= rhs.Y; return *this; }
+	inline float2 &operator*=(const float2 &rhs) { X *= rhs.X; Y *= rhs.Y; return *this; }
+	inline float2 &operator/=(const float2 &rhs) { X /= rhs.X; Y /= rhs.Y; return *this; }
 
-	float2 &operator=(const float2 &rhs);
+	inline float2 &operator+=(float rhs) { X += rhs; Y += rhs; return *this; }
+	inline float2 &operator-=(float rhs) { X -= rhs; Y -= rhs; return *this; }
+	inline float2 &operator*=(float rhs) { X *= rhs; Y *= rhs; return *this; }
+	inline float2 &operator/=(float rhs) { X /= rhs; Y /= rhs; return *this; }
 
-	inline float Length() { return std::sqrt(X * X + Y * Y); }
+	inline float Length() const { return std::sqrt(X * X + Y * Y); }
 };
 
-float2 operator+(const float2 &lhs, const float2 &rhs);
-float2 operator-(const float2 &lhs, const float2 &rhs);
-float2 operator*(const float2 &lhs, const float2 &rhs);
-float2 operator/(const float2 &lhs, const float2 &rhs);
+inline float2 operator+(const float2 &lhs, const float2 &rhs) { return float2(lhs.X + rhs.X, lhs.Y + rhs.Y); }
+inline float2 operator-(const float2 &lhs, const float2 &rhs) { return float2(lhs.X - rhs.X, lhs.Y - rhs.Y); }
+inline float2 operator*(const float2 &lhs, const float2 &rhs) { return float2(lhs.X * rhs.X, lhs.Y * rhs.Y); }
+inline float2 operator/(const float2 &lhs, const float2 &rhs) { return float2(lhs.X / rhs.X, lhs.Y / rhs.Y); }
 
-float2 operator+(float lhs, const float2 &rhs);
-float2 operator-(float lhs, const float2 &rhs);
-float2 operator*(float lhs, const float2 &rhs);
-float2 operator/(float lhs, const float2 &rhs);
+inline float2 operator+(float lhs, const float2 &rhs) { return float2(lhs + rhs.X, lhs + rhs.Y); }
+inline float2 operator-(float lhs, const float2 &rhs) { return float2(lhs - rhs.X, lhs - rhs.Y); }
+inline float2 operator*(float lhs, const float2 &rhs) { return float2(lhs * rhs.X, lhs * rhs.Y); }
+inline float2 operator/(float lhs, const float2 &rhs) { return float2(lhs / rhs.X, lhs / rhs.Y); }
+
+inline float2 operator+(const float2 &lhs, float rhs) { return float2(lhs.X + rhs, lhs.Y + rhs); }
+inline float2 operator-(const float2 &lhs, float rhs) { return float2(lhs.X - rhs, lhs.Y - rhs); }
+inline float2 operator*(const float2 &lhs, float rhs) { return float2(lhs.X * rhs, lhs.Y * rhs); }
+inline float2 operator/(const float2 &lhs, float rhs) { return float2(lhs.X / rhs, lhs.Y / rhs); }
 
 
 class float3 {
@@ -54,46 +74,59 @@ public:
 	float3(float x, float y, float z) : X(x), Y(y), Z(z) {}
 	float3() : X(0.0f), Y(0.0f), Z(0.0f) {}
 
-	float3(const float3 &rhs) : X(rhs.X), Y(rhs.Y), Z(rhs.Z) {}
-
 public:
 	float X;
 	float Y;
 	float Z;
 
 public:
-	float3 &operator+=(const float3 &rhs);
-	float3 &operator-=(const float3 &rhs);
-	float3 &operator*=(const float3 &rhs);
-	float3 &operator/=(const float3 &rhs);
-
-	float3 &operator+=(float rhs);
-	float3 &operator-=(float rhs);
-	float3 &operator*=(float rhs);
-	float3 &operator/=(float rhs);
+	inline float3 &operator+=(const float3 &rhs) { X += rhs.X; Y += rhs.Y; Z += rhs.Z; return *this; }
+	inline float3 &operator-=(const float3 &rhs) { X -= rhs.X; Y -= rhs.Y; Z -= rhs.Z; return *this; }
+	inline float3 &operator*=(const float3 &rhs) { X *= rhs.X; Y *= rhs.Y; Z *= rhs.Z; return *this; }
+	inline float3 &operator/=(const float3 &rhs) { X /= rhs.X; Y /= rhs.Y; Z /= rhs.Z; return *this; }
 
-	float3 &operator=(const float3 &rhs);
+	inline float3 &operator+=(float rhs) { X += rhs; Y += rhs; Z += rhs; return *this; }
+	inline float3 &operator-=(float rhs) { X -= rhs; Y -= rhs; Z -= rhs; return *this; }
+	inline float3 &operator*=(float rhs) { X *= rhs; Y *= rhs; Z *= rhs; return *this; }
+	inline float3 &operator/=(float rhs) { X /= rhs; Y /= rhs; Z /= rhs; return *this; }
 
-	inline float Length() { return std::sqrt(X * X + Y * Y + Z * Z); }
+	inline float Length() const { return std::sqrt(X * X + Y * Y + Z * Z); }
 };
 
-float3 operator+(const float3 &lhs, const float3 &rhs);
-float3 operator-(const float3 &lhs, const float3 &rhs);
-float3 operator*(const float3 &lhs, const float3 &rhs);
-float3 operator/(const float3 &lhs, const float3 &rhs);
+inline float3 operator+(const float3 &lhs, const float3 &rhs) { return float3(lhs.X + rhs.X, lhs.Y + rhs.Y, lhs.Z + rhs.Z); }
+inline float3 operator-(const float3 &lhs, const float3 &rhs) { return float3(lhs.X - rhs.X, lhs.Y - rhs.Y, lhs.Z - rhs.Z); }
+inline float3 operator*(const float3 &lhs, const float3 &rhs) { return float3(lhs.X * rhs.X, lhs.Y * rhs.Y, lhs.Z * rhs.Z); }
+inline float3 operator/(const float3 &lhs, const float3 &rhs) { return float3(lhs.X / rhs.X, lhs.Y / rhs.Y, lhs.Z / rhs.Z); }
 
-float3 operator+(float lhs, const float3 &rhs);
-float3 operator-(float lhs, const float3 &rhs);
-float3 operator*(float lhs, const float3 &rhs);
-float3 operator/(float lhs, const float3 &rhs);
+inline float3 operator+(float lhs, const float3 &rhs) { return float3(lhs + rhs.X, lhs + rhs.Y, lhs + rhs.Z); }
+inline float3 operator-(float lhs, const float3 &rhs) { return float3(lhs - rhs.X, lhs - rhs.Y, lhs - rhs.Z); }
+inline float3 operator*(float lhs, const float3 &rhs) { return float3(lhs * rhs.X, lhs * rhs.Y, lhs * rhs.Z); }
+inline float3 operator/(float lhs, const float3 &rhs) { return float3(lhs / rhs.X, lhs / rhs.Y, lhs / rhs.Z); }
 
+inline float3 operator+(const float3 &lhs, float rhs) { return float3(lhs.X + rhs, lhs.Y + rhs, lhs.Z + rhs); }
+inline float3 operator-(const float3 &lhs, float rhs) { return float3(lhs.X - rhs, lhs.Y - rhs, lhs.Z - rhs); }
+inline float3 operator*(const float3 &lhs, float rhs) { return float3(lhs.X * rhs, lhs.Y * rhs, lhs.Z * rhs); }
+inline float3 operator/(const float3 &lhs, float rhs) { return float3(lhs.X / rhs, lhs.Y / rhs, lhs.Z / rhs); }
 
+inline float Dot(const float3 &lhs, const float3 &rhs) { return lhs.X * rhs.X + lhs.Y * rhs.Y + lhs.Z * rhs.Z; }
+
+
+/**
+ * A 4 component vector
+ *
+ * The storage is 4 plain floats, so the type has no alignment requirements and can be stored
+ * in any container or constant buffer. When SSE is available, the operators do unaligned loads
+ * and stores, and the arithmetic runs as a single SIMD instruction.
+ */
 class float4 {
 public:
 	float4(float x, float y, float z, float w) : X(x), Y(y), Z(z), W(w) {}
 	float4() : X(0.0f), Y(0.0f), Z(0.0f), W(0.0f) {}
+	float4(const float3 &xyz, float w) : X(xyz.X), Y(xyz.Y), Z(xyz.Z), W(w) {}
 
-	float4(const float4 &rhs) : X(rhs.X), Y(rhs.Y), Z(rhs.Z), W(rhs.W) {}
+	#if HALFLING_MATH_SSE
+		explicit float4(__m128 value) { _mm_storeu_ps(&X, value); }
+	#endif
 
 public:
 	float X;
@@ -102,30 +135,97 @@ public:
 	float W;
 
 public:
-	float4 &operator+=(const float4 &rhs);
-	float4 &operator-=(const float4 &rhs);
-	float4 &operator*=(const float4 &rhs);
-	float4 &operator/=(const float4 &rhs);
+	#if HALFLING_MATH_SSE
+		inline __m128 Load() const { return _mm_loadu_ps(&X); }
+		inline void Store(__m128 value) { _mm_storeu_ps(&X, value); }
+
+		inline float4 &operator+=(const float4 &rhs) { Store(_mm_add_ps(Load(), rhs.Load())); return *this; }
+		inline float4 &operator-=(const float4 &rhs) { Store(_mm_sub_ps(Load(), rhs.Load())); return *this; }
+		inline float4 &operator*=(const float4 &rhs) { Store(_mm_mul_ps(Load(), rhs.Load())); return *this; }
+		inline float4 &operator/=(const float4 &rhs) { Store(_mm_div_ps(Load(), rhs.Load())); return *this; }
+
+		inline float4 &operator+=(float rhs) { Store(_mm_add_ps(Load(), _mm_set1_ps(rhs))); return *this; }
+		inline float4 &operator-=(float rhs) { Store(_mm_sub_ps(Load(), _mm_set1_ps(rhs))); return *this; }
+		inline float4 &operator*=(float rhs) { Store(_mm_mul_ps(Load(), _mm_set1_ps(rhs))); return *this; }
+		inline float4 &operator/=(float rhs) { Store(_mm_div_ps(Load(), _mm_set1_ps(rhs))); return *this; }
+	#else
+		inline float4 &operator+=(const float4 &rhs) { X += rhs.X; Y += rhs.Y; Z += rhs.Z; W += rhs.W; return *this; }
+		inline float4 &operator-=(const float4 &rhs) { X -= rhs.X; Y -= rhs.Y; Z -= rhs.Z; W -= rhs.W; return *this; }
+		inline float4 &operator*=(const float4 &rhs) { X *= rhs.X; Y *= rhs.Y; Z *= rhs.Z; W *= rhs.W; return *this; }
+		inline float4 &operator/=(const float4 &rhs) { X /= rhs.X; Y /= rhs.Y; Z /= rhs.Z; W /= rhs.W; return *this; }
+
+		inline float4 &operator+=(float rhs) { X += rhs; Y += rhs; Z += rhs; W += rhs; return *this; }
+		inline float4 &operator-=(float rhs) { X -= rhs; Y -= rhs; Z -= rhs; W -= rhs; return *this; }
+		inline float4 &operator*=(float rhs) { X *= rhs; Y *= rhs; Z *= rhs; W *= rhs; return *this; }
+		inline float4 &operator/=(float rhs) { X /= rhs; Y /= rhs; Z /= rhs; W /= rhs; return *this; }
+	#endif
+
+	inline float3 XYZ() const { return float3(X, Y, Z); }
+	inline float Length() const { return std::sqrt(X * X + Y * Y + Z * Z + W * W); }
+};
 
-	float4 &operator+=(float rhs);
-	float4 &operator-=(float rhs);
-	float4 &operator*=(float rhs);
-	float4 &operator/=(float rhs);
+inline float4 operator+(const float4 &lhs, const float4 &rhs) { float4 result(lhs); return result += rhs; }
+inline float4 operator-(const float4 &lhs, const float4 &rhs) { float4 result(lhs); return result -= rhs; }
+inline float4 operator*(const float4 &lhs, const float4 &rhs) { float4 result(lhs); return result *= rhs; }
+inline float4 operator/(const float4 &lhs, const float4 &rhs) { float4 result(lhs); return result /= rhs; }
 
-	float4 &operator=(const float4 &rhs);
+inline float4 operator+(float lhs, const float4 &rhs) { return float4(lhs, lhs, lhs, lhs) + rhs; }
+inline float4 operator-(float lhs, const float4 &rhs) { return float4(lhs, lhs, lhs, lhs) - rhs; }
+inline float4 operator*(float lhs, const float4 &rhs) { return float4(lhs, lhs, lhs, lhs) * rhs; }
+inline float4 operator/(float lhs, const float4 &rhs) { return float4(lhs, lhs, lhs, lhs) / rhs; }
 
-	inline float Length() { return std::sqrt(X * X + Y * Y + Z * Z + W * W); }
-};
+inline float4 operator+(const float4 &lhs, float rhs) { float4 result(lhs); return result += rhs; }
+inline float4 operator-(const float4 &lhs, float rhs) { float4 result(lhs); return result -= rhs; }
+inline float4 operator*(const float4 &lhs, float rhs) { float4 result(lhs); return result *= rhs; }
+inline float4 operator/(const float4 &lhs, float rhs) { float4 result(lhs); return result /= rhs; }
 
-float4 operator+(const float4 &lhs, const float4 &rhs);
-float4 operator-(const float4 &lhs, const float4 &rhs);
-float4 operator*(const float4 &lhs, const float4 &rhs);
-float4 operator/(const float4 &lhs, const float4 &rhs);
+inline float Dot(const float4 &lhs, const float4 &rhs) { return lhs.X * rhs.X + lhs.Y * rhs.Y + lhs.Z * rhs.Z + lhs.W * rhs.W; }
 
-float4 operator+(float lhs, const float4 &rhs);
-float4 operator-(float lhs, const float4 &rhs);
-float4 operator*(float lhs, const float4 &rhs);
-float4 operator/(float lhs, const float4 &rhs);
+
+/**
+ * Batch kernels
+ *
+ * These work on whole arrays at once, 4 (SSE) or 8 (AVX) elements per instruction, with a scalar
+ * loop for the remainder. The 'SoA' variants take each component as a separate array.
+ */
+
+/**
+ * Normalizes planes of the form (A, B, C, D) by the length of their normal (A, B, C)
+ *
+ * @param planes    The planes to normalize in place
+ * @param count     The number of planes
+ */
+void NormalizePlanes(float4 *planes, size_t count);
+/**
+ * Normalizes planes stored as separate component arrays by the length of their normal (A, B, C)
+ *
+ * @param a        The A components
+ * @param b        The B components
+ * @param c        The C components
+ * @param d        The D components
+ * @param count    The number of planes
+ */
+void NormalizePlanesSoA(float *a, float *b, float *c, float *d, size_t count);
+/**
+ * Computes the dot product of 'count' 3D vectors against a single vector
+ *
+ * @param x         The X components of the vectors
+ * @param y         The Y components of the vectors
+ * @param z         The Z components of the vectors
+ * @param vector    The vector to dot against
+ * @param out       Will be filled with the 'count' dot products
+ * @param count     The number of vectors
+ */
+void Dot3SoA(const float *x, const float *y, const float *z, const float3 &vector, float *out, size_t count);
+/**
+ * Finds the minimum and maximum of an array
+ *
+ * @param values     The values to reduce
+ * @param count      The number of values. Must be greater than 0
+ * @param outMin     Will be filled with the minimum
+ * @param outMax     Will be filled with the maximum
+ */
+void MinMax(const float *values, size_t count, float *outMin, float *outMax);
 
 
 template<typename T>
@@ -0,0 +1,237 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <malloc.h>
+#include <new>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+
+namespace Common {
+
+/**
+ * A handle to an object inside an ObjectPool
+ *
+ * Handles stay valid for the lifetime of the object they reference. Once the object is destroyed,
+ * the slot's generation changes, so any stale handles will resolve to nullptr instead of the
+ * object that re-uses the slot
+ */
+struct PoolHandle {
+	PoolHandle()
+		: Index(kInvalidIndex),
+		  Generation(0u) {
+	}
+	PoolHandle(uint index, uint generation)
+		: Index(index),
+		  Generation(generation) {
+	}
+
+	static const uint kInvalidIndex = 0xFFFFFFFF;
+
+	uint Index;
+	uint Generation;
+
+	inline bool IsValid() const { return Index != kInvalidIndex; }
+	inline bool operator==(const PoolHandle &other) const { return Index == other.Index && Generation == other.Generation; }
+	inline bool operator!=(const PoolHandle &other) const { return !(*this == other); }
+};
+
+/**
+ * A typed slab allocator
+ *
+ * Objects are constructed in place inside contiguous slabs of 'SlabSize' objects. Slabs are never
+ * moved or freed until the pool is destroyed, so pointers to the objects are stable. Create() and
+ * Destroy() are O(1). Free slots are recycled through an intrusive free list.
+ *
+ * Walking the live objects with ForEach() touches memory linearly, one slab at a time.
+ *
+ * Any objects still alive when the pool is destroyed are destructed.
+ *
+ * NOTE: This class is not thread-safe
+ *
+ * @tparam T           The type of object to store
+ * @tparam SlabSize    The number of objects in a slab
+ */
+template <typename T, uint SlabSize = 64u>
+class ObjectPool {
+public:
+	ObjectPool()
+		: m_freeListHead(PoolHandle::kInvalidIndex),
+		  m_liveCount(0u) {
+	}
+	~ObjectPool() {
+		Clear();
+
+		for (auto iter = m_slabs.begin(); iter != m_slabs.end(); ++iter) {
+			_aligned_free((*iter)->Objects);
+			delete *iter;
+		}
+	}
+
+private:
+	static const size_t kSlabAlignment = __alignof(T) > 16 ? __alignof(T) : 16;
+
+	struct Slab {
+		/** Storage for SlabSize objects. Raw memory; objects are constructed in place */
+		T *Objects;
+		/** Odd generations are alive. Even generations are free */
+		uint Generations[SlabSize];
+		/** The index of the next free slot, if this slot is free */
+		uint NextFree[SlabSize];
+	};
+
+	std::vector<Slab *> m_slabs;
+	uint m_freeListHead;
+	uint m_liveCount;
+
+public:
+	/**
+	 * Constructs a new object in the pool
+	 *
+	 * @param args    The arguments to forward to the constructor of T
+	 * @return        A handle to the new object
+	 */
+	template <typename... TArgs>
+	PoolHandle Create(TArgs&&... args) {
+		if (m_freeListHead == PoolHandle::kInvalidIndex) {
+			AddSlab();
+		}
+
+		uint index = m_freeListHead;
+		Slab *slab = m_slabs[index / SlabSize];
+		uint slot = index % SlabSize;
+
+		new (slab->Objects + slot) T(std::forward<TArgs>(args)...);
+
+		m_freeListHead = slab->NextFree[slot];
+		++slab->Generations[slot];
+		++m_liveCount;
+
+		return PoolHandle(index, slab->Generations[slot]);
+	}
+
+	/**
+	 * Destroys the object referenced by the handle. Stale handles are ignored
+	 *
+	 * @param handle    The handle of the object to destroy
+	 */
+	void Destroy(PoolHandle handle) {
+		if (Get(handle) == nullptr) {
+			return;
+		}
+
+		Slab *slab = m_slabs[handle.Index / SlabSize];
+		uint slot = handle.Index % SlabSize;
+
+		slab->Objects[slot].~T();
+
+		++slab->Generations[slot];
+		slab->NextFree[slot] = m_freeListHead;
+		m_freeListHead = handle.Index;
+		--m_liveCount;
+	}
+
+	/**
+	 * Resolves a handle to the object
+	 *
+	 * @param handle    The handle to resolve
+	 * @return          The object, or nullptr if the handle is stale or invalid
+	 */
+	inline T *Get(PoolHandle handle) const {
+		if (handle.Index >= m_slabs.size() * SlabSize) {
+			return nullptr;
+		}
+
+		Slab *slab = m_slabs[handle.Index / SlabSize];
+		uint slot = handle.Index % SlabSize;
+
+		return slab->Generations[slot] == handle.Generation ? slab->Objects + slot : nullptr;
+	}
+
+	/**
+	 * Finds the handle of an object in the pool. This is O(number of slabs)
+	 *
+	 * @param object    A pointer to an object created by this pool
+	 * @return          The handle of the object, or an invalid handle if the object doesn't belong to this pool
+	 */
+	PoolHandle GetHandle(const T *object) const {
+		for (uint i = 0; i < m_slabs.size(); ++i) {
+			const Slab *slab = m_slabs[i];
+			if (object >= slab->Objects && object < slab->Objects + SlabSize) {
+				uint slot = static_cast<uint>(object - slab->Objects);
+				if ((slab->Generations[slot] & 1u) == 1u) {
+					return PoolHandle(i * SlabSize + slot, slab->Generations[slot]);
+				}
+				break;
+			}
+		}
+
+		return PoolHandle();
+	}
+
+	/**
+	 * Calls 'func' on every live object, in memory order
+	 *
+	 * @param func    A callable taking a T &
+	 */
+	template <typename Func>
+	void ForEach(Func func) {
+		for (auto iter = m_slabs.begin(); iter != m_slabs.end(); ++iter) {
+			Slab *slab = *iter;
+			for (uint slot = 0; slot < SlabSize; ++slot) {
+				if ((slab->Generations[slot] & 1u) == 1u) {
+					func(slab->Objects[slot]);
+				}
+			}
+		}
+	}
+
+	/** Destroys all the live objects. The slabs are kept for re-use */
+	void Clear() {
+		for (uint i = 0; i < m_slabs.size(); ++i) {
+			Slab *slab = m_slabs[i];
+			for (uint slot = 0; slot < SlabSize; ++slot) {
+				if ((slab->Generations[slot] & 1u) == 1u) {
+					Destroy(PoolHandle(i * SlabSize + slot, slab->Generations[slot]));
+				}
+			}
+		}
+	}
+
+	inline uint Size() const { return m_liveCount; }
+	inline uint Capacity() const { return static_cast<uint>(m_slabs.size()) * SlabSize; }
+
+private:
+	void AddSlab() {
+		Slab *slab = new Slab();
+		slab->Objects = static_cast<T *>(_aligned_malloc(sizeof(T) * SlabSize, kSlabAlignment));
+		if (slab->Objects == nullptr) {
+			delete slab;
+			throw std::bad_alloc();
+		}
+
+		// Thread the new slots onto the free list in order, so consecutive Create() calls are contiguous
+		uint baseIndex = static_cast<uint>(m_slabs.size()) * SlabSize;
+		for (uint slot = 0; slot < SlabSize; ++slot) {
+			slab->Generations[slot] = 0u;
+			slab->NextFree[slot] = slot + 1 < SlabSize ? baseIndex + slot + 1 : m_freeListHead;
+		}
+		m_freeListHead = baseIndex;
+
+		m_slabs.push_back(slab);
+	}
+
+	// Not implemented
+	ObjectPool(const ObjectPool &);
+	ObjectPool &operator=(const ObjectPool &);
+};
+
+} // End of namespace Common
@@ -0,0 +1,131 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/worker_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+
+namespace Common {
+
+/**
+ * Calculates the 8-bit digit histograms of all the keys in [begin, end)
+ *
+ * @param histograms    [sizeof(KeyType)][256] counts. Must be zeroed by the caller
+ */
+template <typename KeyType, typename T, typename KeyFunc>
+void RadixHistograms(const T *begin, const T *end, KeyFunc keyFunc, size_t (*histograms)[256]) {
+	typedef typename std::make_unsigned<KeyType>::type UnsignedKeyType;
+	// Flipping the sign bit makes signed keys sort correctly as unsigned
+	const UnsignedKeyType signFlip = std::is_signed<KeyType>::value ? UnsignedKeyType(1) << (sizeof(KeyType) * 8 - 1) : 0;
+
+	for (const T *iter = begin; iter != end; ++iter) {
+		UnsignedKeyType key = static_cast<UnsignedKeyType>(keyFunc(*iter)) ^ signFlip;
+		for (uint digit = 0; digit < sizeof(KeyType); ++digit) {
+			++histograms[digit][(key >> (digit * 8)) & 0xFF];
+		}
+	}
+}
+
+/**
+ * A stable LSD radix sort, 8 bits per pass, for items with an integral sort key
+ *
+ * All the digit histograms are built in a single read of the input. Any digit that is the same
+ * for every key is skipped entirely, so keys that leave some bits unused (like sort keys packed
+ * into the high bits of a uint64) only pay for the bytes they use.
+ *
+ * The items ping-pong between 'data' and 'scratch', so the sorted result can end up in either
+ * buffer. Both buffers always hold all of the items, in some order.
+ *
+ * @tparam KeyType        The integral type of the key
+ * @param data            The items to sort
+ * @param scratch         A buffer at least 'count' items long
+ * @param count           The number of items
+ * @param keyFunc         A callable returning the KeyType key of an item
+ * @param workerPool      The pool to build the histograms on. If nullptr, they are built on the calling thread.
+ *                        The scatter passes are always serial
+ * @return                The buffer holding the sorted items. Either 'data' or 'scratch'
+ */
+template <typename KeyType, typename T, typename KeyFunc>
+T *RadixSort(T *data, T *scratch, size_t count, KeyFunc keyFunc, WorkerPool *workerPool = nullptr) {
+	static_assert(std::is_integral<KeyType>::value, "RadixSort requires an integral key type");
+
+	typedef typename std::make_unsigned<KeyType>::type UnsignedKeyType;
+	const UnsignedKeyType signFlip = std::is_signed<KeyType>::value ? UnsignedKeyType(1) << (sizeof(KeyType) * 8 - 1) : 0;
+	const uint kNumDigits = sizeof(KeyType);
+
+	if (count < 2u) {
+		return data;
+	}
+
+	size_t histograms[kNumDigits][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	// Only split the histogram pass if each thread gets a decent amount of work
+	const size_t kMinItemsPerThread = 16 * 1024;
+	uint numThreads = workerPool != nullptr ? workerPool->GetNumThreads() : 1u;
+	numThreads = static_cast<uint>(std::min<size_t>(numThreads, std::max<size_t>(count / kMinItemsPerThread, 1u)));
+
+	if (numThreads == 1u) {
+		RadixHistograms<KeyType>(data, data + count, keyFunc, histograms);
+	} else {
+		std::vector<size_t> threadHistograms(numThreads * kNumDigits * 256, 0u);
+		size_t itemsPerThread = (count + numThreads - 1u) / numThreads;
+
+		workerPool->ParallelFor(numThreads, [data, count, itemsPerThread, keyFunc, &threadHistograms](uint task) {
+			const T *begin = data + std::min(count, task * itemsPerThread);
+			const T *end = data + std::min(count, (task + 1u) * itemsPerThread);
+			size_t (*threadHistogram)[256] = reinterpret_cast<size_t (*)[256]>(&threadHistograms[task * sizeof(KeyType) * 256]);
+
+			RadixHistograms<KeyType>(begin, end, keyFunc, threadHistogram);
+		});
+
+		for (uint i = 0; i < numThreads; ++i) {
+			const size_t *threadHistogram = &threadHistograms[i * kNumDigits * 256];
+			for (uint j = 0; j < kNumDigits * 256; ++j) {
+				histograms[j / 256][j % 256] += threadHistogram[j];
+			}
+		}
+	}
+
+	T *source = data;
+	T *destination = scratch;
+
+	for (uint digit = 0; digit < kNumDigits; ++digit) {
+		size_t *histogram = histograms[digit];
+
+		// If every key has the same value for this digit, the pass wouldn't change the order
+		UnsignedKeyType firstDigit = ((static_cast<UnsignedKeyType>(keyFunc(source[0])) ^ signFlip) >> (digit * 8)) & 0xFF;
+		if (histogram[firstDigit] == count) {
+			continue;
+		}
+
+		// Turn the counts into starting offsets
+		size_t offset = 0u;
+		for (uint i = 0; i < 256; ++i) {
+			size_t digitCount = histogram[i];
+			histogram[i] = offset;
+			offset += digitCount;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			UnsignedKeyType key = static_cast<UnsignedKeyType>(keyFunc(source[i])) ^ signFlip;
+			destination[histogram[(key >> (digit * 8)) & 0xFF]++] = source[i];
+		}
+
+		std::swap(source, destination);
+	}
+
+	return source;
+}
+
+} // End of namespace Common
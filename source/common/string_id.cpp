@@ -0,0 +1,221 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/string_id.h"
+
+#include <cassert>
+#include <cstring>
+#include <cwchar>
+#include <mutex>
+#include <vector>
+
+
+namespace Common {
+
+/**
+ * The storage behind InternString()
+ *
+ * The characters of all the strings are packed back to back in large pages, which are never
+ * freed or moved. The id of a string is its index in the entry table. The entry table is split
+ * into fixed size blocks, which are also never moved, so an id can be resolved without locking.
+ *
+ * Interning looks the string up in an open addressing table of ids, keyed by the hash of the characters
+ */
+class StringTable {
+public:
+	StringTable()
+		: m_currentPage(nullptr),
+		  m_currentPageRemaining(0u),
+		  m_count(0u) {
+		memset(m_entryBlocks, 0, sizeof(m_entryBlocks));
+	}
+	~StringTable() {
+		for (uint i = 0; i < kMaxBlocks; ++i) {
+			delete[] m_entryBlocks[i];
+		}
+		for (auto iter = m_pages.begin(); iter != m_pages.end(); ++iter) {
+			delete[] *iter;
+		}
+	}
+
+private:
+	struct Entry {
+		const wchar *Chars;
+		size_t Length;
+	};
+
+	struct Slot {
+		uint64 Hash;
+		uint Id;
+	};
+
+	static const uint kEntriesPerBlock = 4096u;
+	static const uint kMaxBlocks = 4096u;
+	/** In characters */
+	static const size_t kPageSize = 64u * 1024u;
+
+	Entry *m_entryBlocks[kMaxBlocks];
+
+	std::vector<wchar *> m_pages;
+	wchar *m_currentPage;
+	size_t m_currentPageRemaining;
+
+	/** Always empty, or a power of two in size */
+	std::vector<Slot> m_slots;
+	uint m_count;
+
+	std::mutex m_lock;
+
+public:
+	StringId Intern(const wchar *str, size_t length) {
+		uint64 hash = HashBytes(str, length * sizeof(wchar));
+
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		size_t index = FindSlot(str, length, hash);
+		if (index < m_slots.size() && m_slots[index].Id != StringId::kInvalidValue) {
+			return StringId(m_slots[index].Id);
+		}
+
+		if ((m_count + 1u) * 8u > m_slots.size() * 7u) {
+			Rehash(m_slots.empty() ? 1024u : m_slots.size() * 2u);
+			index = FindSlot(str, length, hash);
+		}
+
+		assert(m_count < kEntriesPerBlock * kMaxBlocks);
+		uint id = m_count++;
+
+		Entry *&block = m_entryBlocks[id / kEntriesPerBlock];
+		if (block == nullptr) {
+			block = new Entry[kEntriesPerBlock];
+		}
+
+		wchar *chars = AllocateChars(length + 1u);
+		wmemcpy(chars, str, length);
+		chars[length] = L'\0';
+
+		block[id % kEntriesPerBlock].Chars = chars;
+		block[id % kEntriesPerBlock].Length = length;
+
+		m_slots[index].Hash = hash;
+		m_slots[index].Id = id;
+
+		return StringId(id);
+	}
+
+	inline const Entry &GetEntry(StringId id) const {
+		assert(id.IsValid() && id.Value / kEntriesPerBlock < kMaxBlocks && m_entryBlocks[id.Value / kEntriesPerBlock] != nullptr);
+		return m_entryBlocks[id.Value / kEntriesPerBlock][id.Value % kEntriesPerBlock];
+	}
+
+private:
+	/**
+	 * Finds the slot holding the string, or the empty slot it would be inserted in
+	 * m_lock must be held
+	 *
+	 * @return    The index of the slot, or m_slots.size() if the table is empty
+	 */
+	size_t FindSlot(const wchar *str, size_t length, uint64 hash) const {
+		if (m_slots.empty()) {
+			return 0u;
+		}
+
+		size_t mask = m_slots.size() - 1u;
+		size_t index = static_cast<size_t>(hash) & mask;
+		while (m_slots[index].Id != StringId::kInvalidValue) {
+			if (m_slots[index].Hash == hash) {
+				const Entry &entry = GetEntry(StringId(m_slots[index].Id));
+				if (entry.Length == length && wmemcmp(entry.Chars, str, length) == 0) {
+					break;
+				}
+			}
+			index = (index + 1u) & mask;
+		}
+
+		return index;
+	}
+
+	void Rehash(size_t newSize) {
+		Slot emptySlot = {0u, StringId::kInvalidValue};
+		std::vector<Slot> newSlots(newSize, emptySlot);
+
+		size_t mask = newSize - 1u;
+		for (auto iter = m_slots.begin(); iter != m_slots.end(); ++iter) {
+			if (iter->Id == StringId::kInvalidValue) {
+				continue;
+			}
+
+			size_t index = static_cast<size_t>(iter->Hash) & mask;
+			while (newSlots[index].Id != StringId::kInvalidValue) {
+				index = (index + 1u) & mask;
+			}
+			newSlots[index] = *iter;
+		}
+
+		m_slots.swap(newSlots);
+	}
+
+	wchar *AllocateChars(size_t count) {
+		// Strings that wouldn't fit in a page get a page of their own
+		if (count > kPageSize) {
+			wchar *page = new wchar[count];
+			m_pages.push_back(page);
+			return page;
+		}
+
+		if (count > m_currentPageRemaining) {
+			m_currentPage = new wchar[kPageSize];
+			m_currentPageRemaining = kPageSize;
+			m_pages.push_back(m_currentPage);
+		}
+
+		wchar *chars = m_currentPage;
+		m_currentPage += count;
+		m_currentPageRemaining -= count;
+
+		return chars;
+	}
+
+	// Not implemented
+	StringTable(const StringTable &);
+	StringTable &operator=(const StringTable &);
+};
+
+// A namespace scope static rather than a function local one, since VS2013 doesn't
+// initialize function local statics in a thread-safe way
+static StringTable stringTable;
+
+StringId InternString(const wchar *str, size_t length) {
+	return stringTable.Intern(str, length);
+}
+
+StringId InternString(const char *str, size_t length) {
+	// Widen into a stack buffer to avoid a heap allocation for typical paths
+	wchar stackBuffer[260];
+	std::wstring heapBuffer;
+
+	wchar *buffer = stackBuffer;
+	if (length > sizeof(stackBuffer) / sizeof(wchar)) {
+		heapBuffer.resize(length);
+		buffer = &heapBuffer[0];
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		buffer[i] = static_cast<wchar>(static_cast<unsigned char>(str[i]));
+	}
+
+	return stringTable.Intern(buffer, length);
+}
+
+const wchar *GetInternedString(StringId id) {
+	return stringTable.GetEntry(id).Chars;
+}
+
+size_t GetInternedStringLength(StringId id) {
+	return stringTable.GetEntry(id).Length;
+}
+
+} // End of namespace Common
@@ -0,0 +1,91 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/hash.h"
+
+#include <string>
+
+
+namespace Common {
+
+/**
+ * A compact handle to an interned string
+ *
+ * Interning the same string twice returns the same id, so two ids compare equal
+ * if and only if their strings are equal. This makes ids cheap cache keys. The
+ * string itself can be fetched with GetInternedString()
+ *
+ * Ids stay valid for the lifetime of the program
+ */
+struct StringId {
+	StringId()
+		: Value(kInvalidValue) {
+	}
+	explicit StringId(uint value)
+		: Value(value) {
+	}
+
+	static const uint kInvalidValue = 0xFFFFFFFF;
+
+	uint Value;
+
+	inline bool IsValid() const { return Value != kInvalidValue; }
+	inline bool operator==(const StringId &other) const { return Value == other.Value; }
+	inline bool operator!=(const StringId &other) const { return Value != other.Value; }
+	inline bool operator<(const StringId &other) const { return Value < other.Value; }
+};
+
+template <>
+struct Hash<StringId> {
+	inline uint64 operator()(const StringId &value) const {
+		return HashMix64(value.Value);
+	}
+};
+
+/**
+ * Returns the id for a string, adding it to the global string table if it's new
+ *
+ * The string table is thread-safe. The characters are copied into a contiguous arena,
+ * so the caller's string doesn't need to outlive the call
+ *
+ * @param str       The characters of the string. They don't need to be null terminated
+ * @param length    The number of characters in the string
+ * @return          The id of the string
+ */
+StringId InternString(const wchar *str, size_t length);
+/**
+ * Returns the id for a narrow string, adding it to the global string table if it's new
+ *
+ * Each byte of the string is widened to one character, so this is only suitable for ASCII / Latin-1
+ *
+ * @param str       The characters of the string. They don't need to be null terminated
+ * @param length    The number of characters in the string
+ * @return          The id of the string
+ */
+StringId InternString(const char *str, size_t length);
+
+inline StringId InternString(const std::wstring &str) { return InternString(str.c_str(), str.size()); }
+inline StringId InternString(const std::string &str) { return InternString(str.c_str(), str.size()); }
+
+/**
+ * Returns the string for an id. Lookups don't lock
+ *
+ * @param id    A valid id, returned from InternString()
+ * @return      The null terminated string. The memory is valid for the lifetime of the program
+ */
+const wchar *GetInternedString(StringId id);
+/**
+ * Returns the length of the string for an id
+ *
+ * @param id    A valid id, returned from InternString()
+ * @return      The number of characters in the string, not counting the null terminator
+ */
+size_t GetInternedStringLength(StringId id);
+
+} // End of namespace Common
@@ -0,0 +1,152 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/virtual_linear_allocator.h"
+
+#if defined(_WIN32)
+	#include "common/halfling_sys.h"
+#else
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+#include <new>
+#include <cassert>
+#include <algorithm>
+
+
+namespace Common {
+
+// Transparent huge pages are 2MB on x86-64
+static const size_t kLargePageSize = 2 * 1024 * 1024;
+// Committing in chunks keeps the number of calls into the OS down
+static const size_t kMinCommitSize = 64 * 1024;
+
+VirtualLinearAllocator::VirtualLinearAllocator(size_t reserveSize, size_t retainSize, bool useLargePages)
+		: m_retainSize(retainSize) {
+	#if defined(_WIN32)
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		size_t osPageSize = systemInfo.dwPageSize;
+	#else
+		size_t osPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	#endif
+
+	m_commitGranularity = std::max(osPageSize, useLargePages ? kLargePageSize : kMinCommitSize);
+	reserveSize = (reserveSize + m_commitGranularity - 1) & ~(m_commitGranularity - 1);
+
+	#if defined(_WIN32)
+		// Large pages on Windows require SeLockMemoryPrivilege and must be committed all at once,
+		// so we only use the larger commit granularity there
+		void *base = VirtualAlloc(nullptr, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+		if (base == nullptr) {
+			throw std::bad_alloc();
+		}
+	#else
+		void *base = mmap(nullptr, reserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (base == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		#if defined(MADV_HUGEPAGE)
+			if (useLargePages) {
+				madvise(base, reserveSize, MADV_HUGEPAGE);
+			}
+		#endif
+	#endif
+
+	m_base = m_current = m_committedEnd = reinterpret_cast<byte *>(base);
+	m_reservedEnd = m_base + reserveSize;
+
+	m_stats.BytesAllocated = 0u;
+	m_stats.BytesWasted = 0u;
+	m_stats.PagesInUse = 0u;
+	m_stats.LargeAllocations = 0u;
+	m_stats.LargeAllocationBytes = 0u;
+	m_stats.NumPages = 0u;
+	m_stats.HighWaterMark = 0u;
+}
+
+VirtualLinearAllocator::~VirtualLinearAllocator() {
+	#if defined(_WIN32)
+		VirtualFree(m_base, 0, MEM_RELEASE);
+	#else
+		munmap(m_base, m_reservedEnd - m_base);
+	#endif
+}
+
+void *VirtualLinearAllocator::Allocate(size_t size, size_t alignment) {
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	byte *userPtr = reinterpret_cast<byte *>((reinterpret_cast<uintptr_t>(m_current) + (alignment - 1)) & ~(static_cast<uintptr_t>(alignment) - 1));
+
+	if (size > static_cast<size_t>(m_reservedEnd - userPtr)) {
+		// We've run out of address space. The reserve size needs to be increased
+		throw std::bad_alloc();
+	}
+
+	byte *end = userPtr + size;
+	if (end > m_committedEnd) {
+		Commit(AlignToCommitGranularity(end));
+	}
+
+	m_stats.BytesWasted += userPtr - m_current;
+	m_stats.BytesAllocated += size;
+	m_stats.PagesInUse = static_cast<uint>((AlignToCommitGranularity(end) - m_base) / m_commitGranularity);
+
+	m_current = end;
+
+	return userPtr;
+}
+
+void VirtualLinearAllocator::Reset() {
+	size_t frameUsage = m_current - m_base;
+	m_stats.HighWaterMark = std::max(m_stats.HighWaterMark, frameUsage);
+
+	m_current = m_base;
+
+	// Give back anything above the watermark
+	byte *retainEnd = AlignToCommitGranularity(m_base + std::min(m_retainSize, static_cast<size_t>(m_reservedEnd - m_base)));
+	if (m_committedEnd > retainEnd) {
+		Decommit(retainEnd);
+	}
+
+	m_stats.BytesAllocated = 0u;
+	m_stats.BytesWasted = 0u;
+	m_stats.PagesInUse = 0u;
+}
+
+void VirtualLinearAllocator::Commit(byte *newCommittedEnd) {
+	size_t commitSize = newCommittedEnd - m_committedEnd;
+
+	#if defined(_WIN32)
+		if (VirtualAlloc(m_committedEnd, commitSize, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+			throw std::bad_alloc();
+		}
+	#else
+		if (mprotect(m_committedEnd, commitSize, PROT_READ | PROT_WRITE) != 0) {
+			throw std::bad_alloc();
+		}
+	#endif
+
+	m_committedEnd = newCommittedEnd;
+	m_stats.NumPages = static_cast<uint>((m_committedEnd - m_base) / m_commitGranularity);
+}
+
+void VirtualLinearAllocator::Decommit(byte *newCommittedEnd) {
+	size_t decommitSize = m_committedEnd - newCommittedEnd;
+
+	#if defined(_WIN32)
+		VirtualFree(newCommittedEnd, decommitSize, MEM_DECOMMIT);
+	#else
+		madvise(newCommittedEnd, decommitSize, MADV_DONTNEED);
+		mprotect(newCommittedEnd, decommitSize, PROT_NONE);
+	#endif
+
+	m_committedEnd = newCommittedEnd;
+	m_stats.NumPages = static_cast<uint>((m_committedEnd - m_base) / m_commitGranularity);
+}
+
+} // End of namespace Common
@@ -0,0 +1,104 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/linear_allocator.h"
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+
+
+namespace Common {
+
+/**
+ * A bump allocator backed by a single contiguous range of virtual memory.
+ *
+ * The whole range is reserved up front, but physical memory is only committed as the
+ * allocations reach it. Therefore, everything allocated between two calls to Reset() is
+ * contiguous in memory, which keeps the TLB and the hardware prefetcher happy when the
+ * data is walked linearly.
+ *
+ * On Reset(), any committed memory above the retain size is handed back to the OS.
+ *
+ * It has the same interface as LinearAllocator, so it can be used as a drop-in replacement
+ *
+ * NOTE: This class is not thread-safe
+ */
+class VirtualLinearAllocator {
+public:
+	/**
+	 * Create a new VirtualLinearAllocator
+	 *
+	 * @param reserveSize      The size of the virtual address range to reserve. This is the maximum number of bytes that can be allocated between calls to Reset()
+	 * @param retainSize       The number of committed bytes that are kept on Reset(). Anything above this is de-committed
+	 * @param useLargePages    If true, the allocator will commit in large page sized chunks and ask the OS to back the range with transparent huge pages, when the OS supports it
+	 */
+	VirtualLinearAllocator(size_t reserveSize, size_t retainSize = kDefaultRetainSize, bool useLargePages = false);
+	~VirtualLinearAllocator();
+
+public:
+	static const size_t kDefaultAlignment = LinearAllocator::kDefaultAlignment;
+	static const size_t kDefaultRetainSize = 4 * 1024 * 1024;
+
+private:
+	byte *m_base;
+	byte *m_current;
+	byte *m_committedEnd;
+	byte *m_reservedEnd;
+
+	size_t m_commitGranularity;
+	size_t m_retainSize;
+
+	LinearAllocatorStats m_stats;
+
+public:
+	/**
+	 * Allocates a block of memory from the arena, committing more memory if necessary
+	 *
+	 * @param size         The number of bytes to allocate
+	 * @param alignment    The alignment of the returned memory. Must be a power of two
+	 * @return             The newly allocated memory
+	 */
+	void *Allocate(size_t size, size_t alignment = kDefaultAlignment);
+	/**
+	 * Rewinds the arena to the beginning and de-commits any memory above the retain size.
+	 * All memory previously returned by Allocate() becomes invalid
+	 */
+	void Reset();
+
+	inline size_t GetReservedSize() const { return m_reservedEnd - m_base; }
+	inline size_t GetCommittedSize() const { return m_committedEnd - m_base; }
+	inline void SetRetainSize(size_t retainSize) { m_retainSize = retainSize; }
+	/**
+	 * Returns the usage statistics of the allocator. Read this before calling Reset()
+	 * to get the usage of the current frame
+	 *
+	 * NOTE: 'Pages' are counted in units of the commit granularity
+	 */
+	inline const LinearAllocatorStats &GetStats() const { return m_stats; }
+
+private:
+	void Commit(byte *newCommittedEnd);
+	void Decommit(byte *newCommittedEnd);
+
+	/**
+	 * Rounds up to the next commit boundary. The boundaries are relative to m_base, since the OS
+	 * only aligns the reservation to its allocation granularity, which can be smaller than ours
+	 */
+	inline byte *AlignToCommitGranularity(byte *ptr) const {
+		size_t offset = (static_cast<size_t>(ptr - m_base) + (m_commitGranularity - 1)) & ~(m_commitGranularity - 1);
+		return m_base + std::min(offset, static_cast<size_t>(m_reservedEnd - m_base));
+	}
+
+	// Not implemented
+	VirtualLinearAllocator(const VirtualLinearAllocator &);
+	VirtualLinearAllocator &operator=(const VirtualLinearAllocator &);
+};
+
+} // End of namespace Common
@@ -0,0 +1,138 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "common/worker_pool.h"
+
+
+namespace Common {
+
+WorkerPool::WorkerPool(uint numWorkers)
+		: m_batchRunning(false),
+		  m_generation(0u),
+		  m_shuttingDown(false),
+		  m_function(nullptr),
+		  m_context(nullptr),
+		  m_taskCount(0u),
+		  m_nextTask(0u),
+		  m_tasksRemaining(0u),
+		  m_activeWorkers(0u) {
+	for (uint i = 0; i < numWorkers; ++i) {
+		m_workers.push_back(std::thread(&WorkerPool::WorkerMain, this));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> guard(m_batchLock);
+		m_shuttingDown = true;
+	}
+	m_batchAvailable.notify_all();
+
+	for (auto iter = m_workers.begin(); iter != m_workers.end(); ++iter) {
+		iter->join();
+	}
+}
+
+void WorkerPool::Run(TaskFunction function, void *context, uint taskCount) {
+	if (taskCount == 0u) {
+		return;
+	}
+
+	bool expected = false;
+	if (m_workers.empty() || taskCount == 1u || !m_batchRunning.compare_exchange_strong(expected, true)) {
+		for (uint i = 0; i < taskCount; ++i) {
+			function(context, i);
+		}
+		return;
+	}
+
+	{
+		// A worker can wake up late for the previous batch, after it already finished. Let it
+		// leave RunTasks() before the batch is overwritten
+		std::unique_lock<std::mutex> lock(m_batchLock);
+		while (m_activeWorkers > 0u) {
+			m_batchDone.wait(lock);
+		}
+
+		m_function = function;
+		m_context = context;
+		m_taskCount = taskCount;
+		m_nextTask.store(0u, std::memory_order_relaxed);
+		m_tasksRemaining = taskCount;
+		m_exception = nullptr;
+		++m_generation;
+	}
+	m_batchAvailable.notify_all();
+
+	RunTasks();
+
+	std::exception_ptr exception;
+	{
+		// Wait for the workers that joined the batch to leave RunTasks() too
+		std::unique_lock<std::mutex> lock(m_batchLock);
+		while (m_tasksRemaining > 0u || m_activeWorkers > 0u) {
+			m_batchDone.wait(lock);
+		}
+
+		exception = m_exception;
+		m_exception = nullptr;
+	}
+
+	m_batchRunning.store(false);
+
+	if (exception) {
+		std::rethrow_exception(exception);
+	}
+}
+
+void WorkerPool::RunTasks() {
+	uint completed = 0u;
+	for (uint task = m_nextTask.fetch_add(1u); task < m_taskCount; task = m_nextTask.fetch_add(1u)) {
+		try {
+			m_function(m_context, task);
+		} catch (...) {
+			std::lock_guard<std::mutex> guard(m_batchLock);
+			if (!m_exception) {
+				m_exception = std::current_exception();
+			}
+		}
+		++completed;
+	}
+
+	if (completed > 0u) {
+		std::lock_guard<std::mutex> guard(m_batchLock);
+		m_tasksRemaining -= completed;
+	}
+}
+
+void WorkerPool::WorkerMain() {
+	uint seenGeneration = 0u;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_batchLock);
+			while (m_generation == seenGeneration && !m_shuttingDown) {
+				m_batchAvailable.wait(lock);
+			}
+			if (m_shuttingDown) {
+				return;
+			}
+
+			seenGeneration = m_generation;
+			++m_activeWorkers;
+		}
+
+		RunTasks();
+
+		{
+			std::lock_guard<std::mutex> guard(m_batchLock);
+			--m_activeWorkers;
+		}
+		m_batchDone.notify_all();
+	}
+}
+
+} // End of namespace Common
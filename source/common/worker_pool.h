@@ -0,0 +1,97 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Common {
+
+/**
+ * A fixed set of worker threads for splitting per-frame work across cores
+ *
+ * The threads are created once, and sleep between batches, so a batch only costs a wake-up
+ * instead of a thread creation per task. The calling thread always runs tasks as well.
+ *
+ * Only one batch runs at a time. If ParallelFor() is called from inside a task, or from another
+ * thread while a batch is running, the tasks of the new batch run on the calling thread. So
+ * nesting can never deadlock, it just doesn't add parallelism.
+ */
+class WorkerPool {
+public:
+	/**
+	 * Create a new WorkerPool
+	 *
+	 * @param numWorkers    The number of threads to create. The calling thread of ParallelFor() comes on top of these
+	 */
+	explicit WorkerPool(uint numWorkers);
+	~WorkerPool();
+
+private:
+	typedef void (*TaskFunction)(void *context, uint task);
+
+	std::vector<std::thread> m_workers;
+
+	/** Set for the whole of a batch. A flag rather than a mutex, since the batch's own thread can ask again from a task */
+	std::atomic<bool> m_batchRunning;
+
+	/** Guards the batch below. The batch is only changed while no worker is inside RunTasks() */
+	std::mutex m_batchLock;
+	std::condition_variable m_batchAvailable;
+	std::condition_variable m_batchDone;
+	uint m_generation;
+	bool m_shuttingDown;
+
+	TaskFunction m_function;
+	void *m_context;
+	uint m_taskCount;
+	std::atomic<uint> m_nextTask;
+	uint m_tasksRemaining;
+	uint m_activeWorkers;
+	/** The first exception thrown by a task of the current batch */
+	std::exception_ptr m_exception;
+
+public:
+	/**
+	 * Calls 'func(uint task)' for every task in [0, taskCount), spread across the workers and the
+	 * calling thread. Tasks are handed out one at a time, so uneven tasks balance themselves.
+	 * Returns once every task has finished, and re-throws the first exception a task threw
+	 *
+	 * @param taskCount    The number of tasks
+	 * @param func         The task. It is called concurrently from several threads
+	 */
+	template <typename Func>
+	void ParallelFor(uint taskCount, Func func) {
+		Run(&InvokeTask<Func>, &func, taskCount);
+	}
+
+	/** Returns the number of threads that run the tasks of a batch, counting the calling thread */
+	inline uint GetNumThreads() const { return static_cast<uint>(m_workers.size()) + 1u; }
+
+private:
+	template <typename Func>
+	static void InvokeTask(void *context, uint task) {
+		(*static_cast<Func *>(context))(task);
+	}
+
+	void Run(TaskFunction function, void *context, uint taskCount);
+	void RunTasks();
+	void WorkerMain();
+
+	// Not implemented
+	WorkerPool(const WorkerPool &);
+	WorkerPool &operator=(const WorkerPool &);
+};
+
+} // End of namespace Common
@@ -7,6 +7,7 @@
 #include "halfling_engine.h"
 
 #include "graphics/d3d_util.h"
+#include "graphics/d3d11_render_backend.h"
 
 
 LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
@@ -22,6 +23,7 @@ HalflingEngine::HalflingEngine(HINSTANCE hinstance)
 		  m_updatePeriod(30.0),
 		  m_fps(0),
 		  m_frameTime(0.0f),
+		  m_frameAllocator(64 * 1024),
 		  m_mainWndCaption(WINDOW_CLASS_NAME),
 		  m_appPaused(false),
 		  m_isMinOrMaximized(false),
@@ -30,6 +32,7 @@ HalflingEngine::HalflingEngine(HINSTANCE hinstance)
 		  m_device(nullptr),
 		  m_immediateContext(nullptr),
 		  m_swapChain(nullptr),
+		  m_renderBackend(nullptr),
 		  m_d3dInitialized(false),
 		  m_msaaCount(1u),
 		  m_stencil(false) {
@@ -83,6 +86,8 @@ bool HalflingEngine::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint
 		return false;
 	}
 
+	m_renderBackend = new Graphics::D3D11RenderBackend(m_device, m_immediateContext);
+
 	// Use MSAA?
 	if (m_msaaCount > 1) {
 		uint msaaQuality;
@@ -133,6 +138,9 @@ void HalflingEngine::Shutdown() {
 	// Shutdown in reverse order
 	ReleaseCOM(m_swapChain);
 
+	delete m_renderBackend;
+	m_renderBackend = nullptr;
+
 	// Restore all default settings.
 	if (m_immediateContext) {
 		m_immediateContext->ClearState();
@@ -189,6 +197,7 @@ void HalflingEngine::Run() {
 			}
 
 			CalculateFrameStats(deltaTime);
+			m_frameAllocator.BeginFrame();
 			DrawFrame(deltaTime);
 		}
 	}
@@ -7,9 +7,12 @@
 #pragma once
 
 #include "common/halfling_sys.h"
+#include "common/frame_allocator.h"
 
 #include "engine/clock.h"
 
+#include "graphics/render_backend.h"
+
 #include <d3d11.h>
 
 
@@ -41,9 +44,14 @@ protected:
 	uint m_fps;
 	float m_frameTime;
 
+	/** Scratch memory for data that only lives for the current frame. It is rotated right before DrawFrame() */
+	Common::FrameAllocator m_frameAllocator;
+
 	ID3D11Device *m_device;
 	ID3D11DeviceContext *m_immediateContext;
 	IDXGISwapChain *m_swapChain;
+	/** Wraps m_device and m_immediateContext. Pass this to the systems that render through a Graphics::RenderBackend */
+	Graphics::RenderBackend *m_renderBackend;
 
 	bool m_d3dInitialized;
 
@@ -81,7 +89,8 @@ public:
 	 *        Update()
 	 *    }
 	 * 4. CalculateFrameStats()
-	 * 5. DrawFrame()
+	 * 5. m_frameAllocator.BeginFrame()
+	 * 6. DrawFrame()
 	 */
 	void Run();
 
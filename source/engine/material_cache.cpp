@@ -6,14 +6,30 @@
 
 #include "engine/material_cache.h"
 
+#include "graphics/commands.h"
+
 
 namespace Engine {
 
 const Scene::Material *MaterialCache::getMaterial(Graphics::MaterialShader *shader, std::vector<ID3D11ShaderResourceView *> &textureSRVs, std::vector<ID3D11SamplerState *> &textureSamplers) {
+	if (textureSRVs.size() > Graphics::Commands::DrawCommandBase::kMaxTextureBindings || textureSamplers.size() > Graphics::Commands::DrawCommandBase::kMaxTextureBindings) {
+		return nullptr;
+	}
+
 	// Lock the cache
 	std::lock_guard<std::mutex> guard(m_cacheLock);
 
-	return &(*(m_materialCache.emplace(shader, textureSRVs, textureSamplers).first));
+	Scene::Material key(shader, textureSRVs, textureSamplers);
+	auto iter = m_materialCache.find(&key);
+	if (iter != m_materialCache.end()) {
+		return iter->first;
+	}
+
+	Common::PoolHandle handle = m_materialPool.Create(shader, textureSRVs, textureSamplers, m_nextSortId++);
+	const Scene::Material *newMaterial = m_materialPool.Get(handle);
+	m_materialCache.try_emplace(newMaterial, handle);
+
+	return newMaterial;
 
 	// The mutex will unlock when 'guard' goes out of scope and destructs
 }
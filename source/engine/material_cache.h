@@ -6,20 +6,37 @@
 
 #pragma once
 
+#include "common/flat_hash_map.h"
+#include "common/object_pool.h"
+
 #include "scene/materials.h"
 
-#include <unordered_set>
 #include <mutex>
 
 
 namespace Engine {
 
 class MaterialCache {
+public:
+	MaterialCache()
+		: m_nextSortId(0u) {
+	}
+
 private:
-	std::unordered_set<Scene::Material, Scene::MaterialHasher> m_materialCache;
+	/** The materials themselves. Pooled, so the pointers handed out stay valid as the cache grows */
+	Common::ObjectPool<Scene::Material> m_materialPool;
+	/** Maps the contents of a material to its pooled copy */
+	Common::FlatHashMap<const Scene::Material *, Common::PoolHandle, Scene::MaterialHasher, Scene::MaterialPointerEqual> m_materialCache;
 	std::mutex m_cacheLock;
+	/** The SortId for the next new material. Ids are never reused */
+	uint m_nextSortId;
 
 public:
+	/**
+	 * Returns the cached material with the given shader and textures, creating it if it doesn't exist yet
+	 *
+	 * @return    The material, or nullptr if it has more textures or samplers than a draw command can bind
+	 */
 	const Scene::Material *getMaterial(Graphics::MaterialShader *shader, std::vector<ID3D11ShaderResourceView *> &textureSRVs, std::vector<ID3D11SamplerState *> &textureSamplers);
 };
 
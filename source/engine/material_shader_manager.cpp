@@ -9,28 +9,29 @@
 
 namespace Engine {
 
-void MaterialShaderManager::Initialize(ID3D11Device *device, const wchar *defaultMaterialShaderFilePath) {
-	m_defaultMaterialShader = new Graphics::MaterialShader(defaultMaterialShaderFilePath, device, false, false);
+void MaterialShaderManager::Initialize(Graphics::RenderBackend *backend, const wchar *defaultMaterialShaderFilePath) {
+	m_defaultMaterialShader = new Graphics::MaterialShader(defaultMaterialShaderFilePath, backend, false, false);
+
+	std::lock_guard<std::mutex> guard(m_cacheLock);
+	m_defaultMaterialShader->SetSortId(m_nextSortId++);
 }
 
-Graphics::MaterialShader *MaterialShaderManager::GetShader(ID3D11Device *device, const std::wstring &filePath) {
+Graphics::MaterialShader *MaterialShaderManager::GetShader(Graphics::RenderBackend *backend, Common::StringId filePath) {
+	// Lock the cache. Inserting can move the entries of the map, so lookups need the lock too
+	std::lock_guard<std::mutex> guard(m_cacheLock);
+
 	// First check the cache
 	auto iter = m_shaderCache.find(filePath);
 	if (iter != m_shaderCache.end()) {
-		return &iter->second;
+		return iter->second;
 	}
 
 	// Else create it from scratch
-	// Lock the cache before writing
-	std::lock_guard<std::mutex> guard(m_cacheLock);
-
-	// Write
-	auto returnArg = m_shaderCache.emplace(std::piecewise_construct,
-										   std::forward_as_tuple(filePath),
-										   std::forward_as_tuple(filePath.c_str(), device, false, false));
+	Graphics::MaterialShader *newShader = m_shaderPool.Get(m_shaderPool.Create(Common::GetInternedString(filePath), backend, false, false));
+	newShader->SetSortId(m_nextSortId++);
+	m_shaderCache.try_emplace(filePath, newShader);
 
-	// Return the created element
-	return &((*returnArg.first).second);
+	return newShader;
 
 	// The mutex will unlock when 'guard' goes out of scope and destructs
 }
@@ -6,32 +6,49 @@
 
 #pragma once
 
+#include "common/flat_hash_map.h"
+#include "common/object_pool.h"
+#include "common/string_id.h"
+
 #include "graphics/shader.h"
 
-#include <unordered_map>
 #include <mutex>
+#include <string>
 
 
 namespace Engine {
 
 class MaterialShaderManager {
+public:
+	MaterialShaderManager()
+		: m_defaultMaterialShader(nullptr),
+		  m_nextSortId(0u) {
+	}
+
 private:
 	Graphics::MaterialShader *m_defaultMaterialShader;
 
-	std::unordered_map<std::wstring, Graphics::MaterialShader> m_shaderCache;
+	/** The shaders themselves. Pooled, so the pointers handed out stay valid as the cache grows */
+	Common::ObjectPool<Graphics::MaterialShader> m_shaderPool;
+	Common::FlatHashMap<Common::StringId, Graphics::MaterialShader *> m_shaderCache;
 	std::mutex m_cacheLock;
+	/** The sort id for the next new shader. Ids are never reused */
+	uint m_nextSortId;
 
 public:
-	void Initialize(ID3D11Device *device, const wchar *defaultMaterialShaderFilePath);
+	void Initialize(Graphics::RenderBackend *backend, const wchar *defaultMaterialShaderFilePath);
 	/**
 	 * Returns the shader for the given filePath. If the shader does not exist, 
 	 * it creates a MaterialShader from the filePath
 	 *
-	 * @param device      The DirectX device
+	 * @param backend     The render backend to create the shader with
 	 * @param filePath    The path to the shader file
 	 * @return            The MaterialShader
 	 */
-	Graphics::MaterialShader *GetShader(ID3D11Device *device, const std::wstring &filePath);
+	Graphics::MaterialShader *GetShader(Graphics::RenderBackend *backend, Common::StringId filePath);
+	inline Graphics::MaterialShader *GetShader(Graphics::RenderBackend *backend, const std::wstring &filePath) {
+		return GetShader(backend, Common::InternString(filePath));
+	}
 };
 
 } // End of namespace Engine
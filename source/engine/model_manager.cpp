@@ -14,28 +14,54 @@
 
 #include <fastformat/fastformat.hpp>
 
+#include <new>
+
 
 namespace Engine {
 
 ModelManager::~ModelManager() {
-	for (auto iter = m_modelCache.begin(); iter != m_modelCache.end(); ++iter) {
-		delete iter->second;
-	}
+	// The models are destroyed along with m_modelPool
 }
 
-Scene::Model *ModelManager::GetModel(ID3D11Device *device, TextureManager *textureManager, MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, std::wstring filePath) {
+Scene::Model *ModelManager::GetModel(Graphics::RenderBackend *backend, TextureManager *textureManager, MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, Common::StringId filePath, const Common::AsyncReadResult *preloadedFile) {
 	// First check the cache
-	auto iter = m_modelCache.find(filePath);
-	if (iter != m_modelCache.end()) {
-		return iter->second;
+	{
+		// Inserting can move the entries of the map, so lookups need the lock too
+		std::lock_guard<std::mutex> guard(m_cacheLock);
+
+		auto iter = m_modelCache.find(filePath);
+		if (iter != m_modelCache.end()) {
+			return iter->second;
+		}
 	}
 
 	// Else create it from scratch
-	Scene::Model *newModel = Scene::HalflingModelFile::Load(device, textureManager, materialShaderManager, materialCache, samplerStateManager, filePath.c_str());
+	// Create() can grow the pool's slab table, so Get() has to be under the lock as well. The
+	// slabs themselves never move, so the model can be used without the lock afterwards
+	Common::PoolHandle handle;
+	Scene::Model *newModel;
+	{
+		std::lock_guard<std::mutex> guard(m_cacheLock);
+		handle = m_modelPool.Create();
+		newModel = m_modelPool.Get(handle);
+		newModel->SortId = m_nextSortId++;
+	}
+
+	bool loaded;
+	if (preloadedFile != nullptr && preloadedFile->Success) {
+		loaded = Scene::HalflingModelFile::LoadFromMemory(backend, textureManager, this, materialShaderManager, materialCache, samplerStateManager, reinterpret_cast<const char *>(preloadedFile->Data.get()), static_cast<size_t>(preloadedFile->Size), newModel);
+	} else {
+		loaded = Scene::HalflingModelFile::Load(backend, textureManager, this, materialShaderManager, materialCache, samplerStateManager, Common::GetInternedString(filePath), newModel);
+	}
 
 	// Lock the cache before writing
 	std::lock_guard<std::mutex> guard(m_cacheLock);
 
+	if (!loaded) {
+		m_modelPool.Destroy(handle);
+		return nullptr;
+	}
+
 	// Write
 	m_modelCache[filePath] = newModel;
 
@@ -52,13 +78,36 @@ Scene::Model *ModelManager::CreateUnnamedModel() {
 	std::wstring newModelName;
 	fastformat::write(newModelName, L"unnamedModel", m_unnamedModelIncrementer++);
 
-	Scene::Model *newModel = new Scene::Model();
+	Scene::Model *newModel = m_modelPool.Get(m_modelPool.Create());
+	newModel->SortId = m_nextSortId++;
 
-	m_modelCache[newModelName] = newModel;
+	m_modelCache[Common::InternString(newModelName)] = newModel;
 
 	// The mutex will unlock when 'guard' goes out of scope and destructs
 
 	return newModel;
 }
 
+bool ModelManager::ReserveFileRead(Common::StringId filePath) {
+	std::lock_guard<std::mutex> guard(m_cacheLock);
+
+	if (m_modelCache.find(filePath) != m_modelCache.end() || m_reservedFileReads.find(filePath) != m_reservedFileReads.end()) {
+		return false;
+	}
+
+	m_reservedFileReads[filePath] = true;
+	return true;
+}
+
+Scene::ModelSubset *ModelManager::AllocateSubsets(uint subsetCount) {
+	std::lock_guard<std::mutex> guard(m_cacheLock);
+
+	Scene::ModelSubset *subsets = static_cast<Scene::ModelSubset *>(m_subsetAllocator.Allocate(sizeof(Scene::ModelSubset) * subsetCount, __alignof(Scene::ModelSubset)));
+	for (uint i = 0; i < subsetCount; ++i) {
+		new (&subsets[i]) Scene::ModelSubset();
+	}
+
+	return subsets;
+}
+
 } // End of namespace Engine
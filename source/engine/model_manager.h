@@ -6,9 +6,14 @@
 
 #pragma once
 
+#include "common/async_file_reader.h"
+#include "common/flat_hash_map.h"
+#include "common/object_pool.h"
+#include "common/string_id.h"
+#include "common/linear_allocator.h"
+
 #include "scene/model.h"
 
-#include <unordered_map>
 #include <mutex>
 
 
@@ -21,19 +26,53 @@ class MaterialCache;
 class ModelManager {
 public:
 	ModelManager()
-		: m_unnamedModelIncrementer(0u) {
+		: m_subsetAllocator(16 * 1024),
+		  m_unnamedModelIncrementer(0u),
+		  m_nextSortId(0u) {
 	}
 	~ModelManager();
 
 private:
-	std::unordered_map<std::wstring, Scene::Model *> m_modelCache;
+	Common::FlatHashMap<Common::StringId, Scene::Model *> m_modelCache;
+	/** The model files that ReserveFileRead() has handed out, so each file is only read once */
+	Common::FlatHashMap<Common::StringId, bool> m_reservedFileReads;
 	std::mutex m_cacheLock;
 
+	/** Backing storage for all the models, so walking them during culling and submission stays cache-friendly */
+	Common::ObjectPool<Scene::Model> m_modelPool;
+	/** Backing storage for the models' subset arrays. Subsets live as long as the manager */
+	Common::LinearAllocator m_subsetAllocator;
+
 	uint m_unnamedModelIncrementer;
+	/** The SortId for the next new model. Ids are never reused, even if the model fails to load */
+	uint m_nextSortId;
 
 public:
-	Scene::Model *GetModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, std::wstring filePath);
+	/**
+	 * Returns the model for a Halfling Model File, loading it if it isn't cached yet
+	 *
+	 * @param filePath        The path of the model file. Also used as the cache key
+	 * @param preloadedFile   [Optional] The contents of the file, if they were already read with an AsyncFileReader
+	 * @return                The model, or nullptr if it failed to load
+	 */
+	Scene::Model *GetModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, Common::StringId filePath, const Common::AsyncReadResult *preloadedFile = nullptr);
 	Scene::Model *CreateUnnamedModel();
+	/**
+	 * Checks whether a model file is worth reading ahead of GetModel(). Returns false if the model
+	 * is already cached, or if the file was reserved before, so duplicate paths aren't read twice
+	 *
+	 * @param filePath    The path of the model file
+	 * @return            Whether the caller should read the file
+	 */
+	bool ReserveFileRead(Common::StringId filePath);
+	/**
+	 * Allocates a contiguous array of subsets. The memory is owned by the ModelManager, so
+	 * models must be given the array with DisposeAfterUse::NO
+	 *
+	 * @param subsetCount    The number of subsets to allocate
+	 * @return               The new array of default constructed subsets
+	 */
+	Scene::ModelSubset *AllocateSubsets(uint subsetCount);
 };
 
 } // End of namespace Engine
@@ -7,6 +7,7 @@
 #include "engine/texture_manager.h"
 
 #include "common/halfling_sys.h"
+#include "common/mapped_file.h"
 
 #include "graphics/d3d_util.h"
 
@@ -23,34 +24,43 @@ TextureManager::~TextureManager() {
 	}
 }
 
-ID3D11ShaderResourceView * TextureManager::GetSRVFromFile(ID3D11Device *device, const std::wstring filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB) {
-	size_t offset = filePath.find_last_of(L".");
-	if (_wcsicmp(filePath.c_str() + offset, L".dds") == 0) {
+ID3D11ShaderResourceView * TextureManager::GetSRVFromFile(ID3D11Device *device, Common::StringId filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB) {
+	const wchar *extension = wcsrchr(Common::GetInternedString(filePath), L'.');
+	if (extension != nullptr && _wcsicmp(extension, L".dds") == 0) {
 		return GetSRVFromDDSFile(device, filePath, usage, bindFlags, cpuAccessFlags, miscFlags, forceSRGB);
 	} else {
 		return nullptr;
 	}
 }
 
-ID3D11ShaderResourceView *TextureManager::GetSRVFromDDSFile(ID3D11Device *device, const std::wstring filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB) {
+ID3D11ShaderResourceView *TextureManager::GetSRVFromDDSFile(ID3D11Device *device, Common::StringId filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB) {
 	// First check the cache
-	auto bucket = m_textureCache.find(filePath);
-	if (bucket != m_textureCache.end()) {
-		for (auto iter = bucket->second.begin(); iter != bucket->second.end(); ++iter) {
-			if (usage == iter->first.Usage &&
-				bindFlags == iter->first.BindFlags &&
-				cpuAccessFlags == iter->first.CpuAccessFlags &&
-				miscFlags == iter->first.MiscFlags &&
-				forceSRGB == iter->first.ForceSRGB) {
-
-				return iter->second;
+	{
+		// Inserting can move the entries of the map, so lookups need the lock too
+		std::lock_guard<std::mutex> guard(m_cacheLock);
+
+		auto bucket = m_textureCache.find(filePath);
+		if (bucket != m_textureCache.end()) {
+			for (auto iter = bucket->second.begin(); iter != bucket->second.end(); ++iter) {
+				if (usage == iter->first.Usage &&
+					bindFlags == iter->first.BindFlags &&
+					cpuAccessFlags == iter->first.CpuAccessFlags &&
+					miscFlags == iter->first.MiscFlags &&
+					forceSRGB == iter->first.ForceSRGB) {
+
+					return iter->second;
+				}
 			}
 		}
 	}
 
 	// Else create it from scratch
+	// Create the texture straight from a mapping of the file, rather than having the loader copy it into a heap buffer
+	Common::MappedFile file(Common::GetInternedString(filePath));
+	AssertMsg(file.IsOpen(), L"Failed to open texture: " << Common::GetInternedString(filePath));
+
 	ID3D11ShaderResourceView *newSRV;
-	HR(DirectX::CreateDDSTextureFromFileEx(device, filePath.c_str(), 0, usage, bindFlags, cpuAccessFlags, miscFlags, forceSRGB, nullptr, &newSRV));
+	HR(DirectX::CreateDDSTextureFromMemoryEx(device, file.GetData(), static_cast<size_t>(file.GetSize()), 0, usage, bindFlags, cpuAccessFlags, miscFlags, forceSRGB, nullptr, &newSRV));
 
 	// Lock the cache before writing
 	std::lock_guard<std::mutex> guard(m_cacheLock);
@@ -7,8 +7,10 @@
 #pragma once
 
 #include "common/typedefs.h"
+#include "common/flat_hash_map.h"
+#include "common/string_id.h"
 
-#include <unordered_map>
+#include <vector>
 #include <mutex>
 #include <string>
 #include <d3d11.h>
@@ -30,14 +32,17 @@ public:
 	~TextureManager();
 
 private:
-	std::unordered_map<std::wstring, std::vector<std::pair<TextureParams, ID3D11ShaderResourceView *> > > m_textureCache;
+	Common::FlatHashMap<Common::StringId, std::vector<std::pair<TextureParams, ID3D11ShaderResourceView *> > > m_textureCache;
 	std::mutex m_cacheLock;
 
 public:
-	ID3D11ShaderResourceView *GetSRVFromFile(ID3D11Device *device, const std::wstring filePath, D3D11_USAGE usage, uint bindFlags = D3D11_BIND_SHADER_RESOURCE, uint cpuAccessFlags = 0, uint miscFlags = 0, bool forceSRGB = false);
+	ID3D11ShaderResourceView *GetSRVFromFile(ID3D11Device *device, Common::StringId filePath, D3D11_USAGE usage, uint bindFlags = D3D11_BIND_SHADER_RESOURCE, uint cpuAccessFlags = 0, uint miscFlags = 0, bool forceSRGB = false);
+	inline ID3D11ShaderResourceView *GetSRVFromFile(ID3D11Device *device, const std::wstring &filePath, D3D11_USAGE usage, uint bindFlags = D3D11_BIND_SHADER_RESOURCE, uint cpuAccessFlags = 0, uint miscFlags = 0, bool forceSRGB = false) {
+		return GetSRVFromFile(device, Common::InternString(filePath), usage, bindFlags, cpuAccessFlags, miscFlags, forceSRGB);
+	}
 
 private:
-	ID3D11ShaderResourceView *GetSRVFromDDSFile(ID3D11Device *device, const std::wstring filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB);
+	ID3D11ShaderResourceView *GetSRVFromDDSFile(ID3D11Device *device, Common::StringId filePath, D3D11_USAGE usage, uint bindFlags, uint cpuAccessFlags, uint miscFlags, bool forceSRGB);
 };
 
 } // End of namespace Engine
@@ -8,27 +8,81 @@
 
 #include "common/halfling_sys.h"
 #include "common/linear_allocator.h"
+#include "common/aligned_allocator.h"
+#include "common/radix_sort.h"
+#include "common/worker_pool.h"
 
-struct ID3D11Device;
-struct ID3D11DeviceContext;
+#include "graphics/command_capture.h"
+#include "graphics/command_context.h"
 
+#include <algorithm>
+#include <atomic>
+#include <malloc.h>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <vector>
 
-namespace Graphics {
+#include <xmmintrin.h>
 
-struct GraphicsState;
 
-typedef void (*CommandExecuteFunctionPtr)(ID3D11Device *device, ID3D11DeviceContext *context, 
-                                          BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, 
-                                          GraphicsState *currentGraphicsState, 
-                                          const void *data);
-typedef void (*CommandDisposeFunctionPtr)(const void *data);
+namespace Graphics {
 
 struct CommandNode {
 	CommandNode *NextNode;
 	CommandExecuteFunctionPtr ExecuteFunction;
+	/** Executes a run of consecutive commands of the same type. See CommandBatchExecutor */
+	CommandExecuteBatchFunctionPtr ExecuteBatchFunction;
+	/** nullptr if the command doesn't need to be disposed */
 	CommandDisposeFunctionPtr DisposeFunction;
 };
 
+/**
+ * Whether a command can be dropped without calling its Dispose function. Commands that are
+ * trivially destructible qualify by default. Specialize this to std::false_type for a command
+ * that has to release something in Dispose() even though its destructor is trivial
+ *
+ * If no command in a bucket needs disposing, CommandBucket::Clear() just resets the allocators
+ */
+template <typename T>
+struct IsTriviallyDisposable : std::is_trivially_destructible<T> {};
+
+/** The number of commands ahead of the current one to prefetch when executing */
+const uint kCommandPrefetchDistance = 8u;
+
+/** Starts loading the first two cache lines at 'address', which covers a node and the start of its command */
+inline void PrefetchCommand(const void *address) {
+	_mm_prefetch(reinterpret_cast<const char *>(address), _MM_HINT_T0);
+	_mm_prefetch(reinterpret_cast<const char *>(address) + Common::kCacheLineSize, _MM_HINT_T0);
+}
+
+/**
+ * The batched entry point of a command type. The bucket calls it once for each run of
+ * consecutive commands of type U, so a run costs a single indirect call, and U::Execute
+ * can be inlined into the loop
+ *
+ * @param context     The context to execute the commands with
+ * @param commands    The command data of each command in the run
+ * @param count       The number of commands in the run
+ */
+template <typename U>
+void ExecuteCommandBatch(const CommandContext &context, const void * const *commands, uint count) {
+	for (uint i = 0; i < count; ++i) {
+		if (i + kCommandPrefetchDistance < count) {
+			PrefetchCommand(commands[i + kCommandPrefetchDistance]);
+		}
+
+		U::Execute(context, commands[i]);
+	}
+}
+
+template <typename U>
+struct CommandBatchExecutor {
+	static void ExecuteBatch(const CommandContext &context, const void * const *commands, uint count) {
+		ExecuteCommandBatch<U>(context, commands, count);
+	}
+};
+
 template <typename SortKeyType>
 struct CommandPacket {
 	CommandPacket()
@@ -48,6 +102,27 @@ bool CommandSortFunction(CommandPacket<SortKeyType> const& lhs, CommandPacket<So
 	return lhs.Key < rhs.Key;
 }
 
+template <typename SortKeyType>
+inline SortKeyType GetCommandPacketKey(CommandPacket<SortKeyType> const& packet) {
+	return packet.Key;
+}
+
+/** Packet capacity usage of a CommandBucket. Use it to tune the initial capacity of each pass */
+struct CommandBucketStats {
+	/** The number of packets the bucket can hold before recording spills into overflow chunks */
+	uint Capacity;
+	/** The number of packets recorded since the last Clear() */
+	uint CommandCount;
+	/** The number of persistent packets. They aren't part of CommandCount or the capacity */
+	uint PersistentCommandCount;
+	/** The largest number of packets recorded between two calls to Clear() */
+	uint HighWaterMark;
+	/** The number of times the capacity had to grow */
+	uint NumGrows;
+	/** The number of packets dropped since the last Clear(), because they didn't fit in the overflow chunks either */
+	uint DroppedCommandCount;
+};
+
 /**
  * A bucket for sending graphics commands to. Submitted commands are not immediately
  * sent to the GPU. Rather, they are cached. When Submit() is called, the commands
@@ -55,47 +130,216 @@ bool CommandSortFunction(CommandPacket<SortKeyType> const& lhs, CommandPacket<So
  *
  * NOTE: Commands can be grouped into 'packets' using AppendCommand(). The packet as
  * a whole will be sorted, but the order inside the packet will be preserved.
+ *
+ * Integral sort keys are sorted with a radix sort. Other key types fall back to std::sort.
+ *
+ * Commands can be recorded from several threads at once. Each recording thread is identified
+ * by a thread index in [0, numRecordingThreads), and allocates its command data from its own
+ * allocator, so threads never contend on the allocator. Packet slots are reserved with an atomic
+ * increment. A thread index must only be used by one thread at a time. RecordParallel() handles
+ * the thread indices for you. Submit() and Clear() must not overlap with recording.
+ *
+ * Packets are stored in a contiguous array. If recording runs past its capacity, the extra
+ * packets spill into fixed size overflow chunks, which are allocated on demand and never
+ * move, so concurrent recording stays safe. The next Submit() or Clear() grows the array to
+ * fit, so the following frames record contiguously again. GetStats() reports the capacity use.
+ * If even the overflow chunks run out, further packets are dropped. Their commands are still
+ * returned, so the caller can fill them in as usual, but they are never executed or disposed.
+ *
+ * Submit() prefetches the nodes of the packets a few slots ahead of the one it executes. With the
+ * execution stream enabled (see SetExecutionStreamEnabled()), it instead flattens the sorted packets,
+ * a chunk at a time, into a contiguous array of command pointers, grouped into runs of the same
+ * command type. Each run is then executed with a single call to the type's CommandBatchExecutor.
+ * That pays off when long runs of the same command type are common, like single command packets.
+ * It's also what lets a command merge with its neighbours, like DrawIndexedInstanceable does
+ *
+ * Packets added with AddPersistentCommand() are kept across frames. Clear() leaves them alone, and
+ * every Submit() merges them with the packets recorded for that frame. They're sorted once, when
+ * they change, so a static scene can be recorded once instead of every frame. Each persistent packet
+ * has up to two owners, like the model and the material it draws. InvalidatePersistentCommands()
+ * drops the packets of an owner, so only those have to be recorded again
  */
-template <typename SortKeyType, size_t Size>
+template <typename SortKeyType, typename AllocatorType = Common::LinearAllocator>
 class CommandBucket { 
 public:
     /**
      * Create a new CommandBucket
 	 *
-	 * @tparam SortKeyType    The type of the key used to sort
-     * @tparam Size           The maximum number of command 'packets' the bucket can store
-     * @param  allocator      An allocator to use for internal memory allocations
+	 * @tparam SortKeyType            The type of the key used to sort
+	 * @tparam AllocatorType          The allocator used for the command data. Either Common::LinearAllocator or Common::VirtualLinearAllocator
+     * @param  allocatorSize          The size passed to each allocator. The page size for LinearAllocator, the reserve size for VirtualLinearAllocator
+	 * @param  numRecordingThreads    The maximum number of threads that can record commands at once. Each gets its own allocator
+	 * @param  initialCapacity        The number of command 'packets' the bucket can store before it has to grow
+	 * @param  workerPool             [Optional] The threads RecordParallel() runs on. If null, and there's more than one recording thread, the bucket creates its own pool
 	 *
 	 * NOTE: T must have operator< implemented in order for the sort to function properly
      */
-    CommandBucket(size_t allocatorPageSize) 
-        : m_allocator(allocatorPageSize),
-          m_nextFreeCommand(0u) {
+    CommandBucket(size_t allocatorSize, uint numRecordingThreads = 1u, uint initialCapacity = kDefaultInitialCapacity, Common::WorkerPool *workerPool = nullptr)
+        : m_numRecordingThreads(numRecordingThreads),
+          m_workerPool(workerPool),
+          m_ownedWorkerPool(nullptr),
+          m_commands(initialCapacity),
+          m_capacity(initialCapacity),
+          m_nextFreeCommand(0u),
+          m_needsDispose(false),
+          m_highWaterMark(0u),
+          m_numGrows(0u),
+          m_persistentCommandsDirty(false),
+          m_useExecutionStream(false),
+          m_capture(nullptr) {
+		AssertMsg(numRecordingThreads > 0u && numRecordingThreads <= kMaxRecordingThreads, L"A CommandBucket supports between 1 and " << kMaxRecordingThreads << L" recording threads");
+
+		for (uint i = 0; i < kMaxOverflowChunks; ++i) {
+			m_overflowChunks[i].store(nullptr, std::memory_order_relaxed);
+		}
+
+		// The allocators are laid out one per cache line, so the bump pointers of
+		// different recording threads never share a line
+		m_allocatorStorage = Common::AlignedAllocator<byte, Common::kCacheLineSize>().allocate(kAllocatorStride * m_numRecordingThreads);
+		for (uint i = 0; i < m_numRecordingThreads; ++i) {
+			new(m_allocatorStorage + i * kAllocatorStride) AllocatorType(allocatorSize);
+		}
+
+		if (m_workerPool == nullptr && m_numRecordingThreads > 1u) {
+			m_ownedWorkerPool = new Common::WorkerPool(m_numRecordingThreads - 1u);
+			m_workerPool = m_ownedWorkerPool;
+		}
     }
+	~CommandBucket() {
+		for (uint i = 0; i < m_numRecordingThreads; ++i) {
+			GetAllocator(i)->~AllocatorType();
+		}
+		Common::AlignedAllocator<byte, Common::kCacheLineSize>().deallocate(m_allocatorStorage, kAllocatorStride * m_numRecordingThreads);
+
+		for (uint i = 0; i < kMaxOverflowChunks; ++i) {
+			delete[] m_overflowChunks[i].load(std::memory_order_relaxed);
+		}
+
+		ClearPersistentCommands();
+
+		delete m_ownedWorkerPool;
+	}
+
+public:
+	static const uint kMaxRecordingThreads = 32u;
+	static const uint kDefaultInitialCapacity = 1024u;
+
+	/**
+	 * A handle for recording commands from a single thread. Get one from GetRecorder(), or from RecordParallel()
+	 */
+	class Recorder {
+	public:
+		Recorder(CommandBucket *bucket, uint threadIndex)
+			: m_bucket(bucket),
+			  m_threadIndex(threadIndex) {
+		}
+
+	private:
+		CommandBucket *m_bucket;
+		uint m_threadIndex;
+
+	public:
+		template <typename U>
+		inline U *AddCommand(SortKeyType key) {
+			return m_bucket->template AddCommand<U>(key, m_threadIndex);
+		}
+		template <typename U>
+		inline U *AppendCommand(void *previousCommand) {
+			return m_bucket->template AppendCommand<U>(previousCommand, m_threadIndex);
+		}
+
+		inline uint GetThreadIndex() const { return m_threadIndex; }
+	};
     
 private:
-    Common::LinearAllocator m_allocator;
+	/** The alignment of all command data. Large enough for commands that contain XMVECTOR / XMMATRIX */
+	static const size_t kCommandAlignment = 16;
+	/** The offset from the start of a CommandNode to its command data. Rounded up so the data stays aligned */
+	static const size_t kCommandDataOffset = (sizeof(CommandNode) + kCommandAlignment - 1) & ~(kCommandAlignment - 1);
+	/** The distance between the per-thread allocators in m_allocatorStorage */
+	static const size_t kAllocatorStride = (sizeof(AllocatorType) + Common::kCacheLineSize - 1) & ~(Common::kCacheLineSize - 1);
+	/** The number of commands gathered into the execution stream before they're executed */
+	static const uint kExecutionStreamChunkSize = 256u;
+	/** The number of packets in each overflow chunk */
+	static const uint kOverflowChunkSize = 1024u;
+	/** The maximum number of packets that can spill past the capacity in one frame is kOverflowChunkSize * kMaxOverflowChunks */
+	static const uint kMaxOverflowChunks = 1024u;
+
+	/** Storage for one AllocatorType per recording thread */
+	byte *m_allocatorStorage;
+	uint m_numRecordingThreads;
+	/** The threads RecordParallel() runs on. Null if there's a single recording thread */
+	Common::WorkerPool *m_workerPool;
+	/** Set if the bucket created m_workerPool itself */
+	Common::WorkerPool *m_ownedWorkerPool;
+
+	/** The main packet storage. Its size is the capacity. Only resized in Submit() and Clear() */
+	std::vector<CommandPacket<SortKeyType> > m_commands;
+	uint m_capacity;
+    std::atomic<uint> m_nextFreeCommand;
+
+	/** Packets recorded past the capacity. Allocated on demand, and kept for re-use */
+	std::atomic<CommandPacket<SortKeyType> *> m_overflowChunks[kMaxOverflowChunks];
+	std::mutex m_overflowLock;
+
+	/** Set when a command that isn't trivially disposable is recorded */
+	std::atomic<bool> m_needsDispose;
+
+	uint m_highWaterMark;
+	uint m_numGrows;
 
-	CommandPacket<SortKeyType> m_commands[Size];
-    uint m_nextFreeCommand;
+	/** The ping-pong buffer for the radix sort. Only used for integral key types */
+	std::vector<CommandPacket<SortKeyType> > m_sortScratch;
+
+	/** A packet that is kept across frames, and the owners that can invalidate it */
+	struct PersistentCommandPacket {
+		CommandPacket<SortKeyType> Packet;
+		const void *Owners[2];
+	};
+
+	/** The persistent packets, in the order they were added. Their nodes are allocated individually, so they can be freed individually */
+	std::vector<PersistentCommandPacket> m_persistentCommands;
+	/** The persistent packets, sorted. Rebuilt in Submit() when m_persistentCommandsDirty is set */
+	std::vector<CommandPacket<SortKeyType> > m_sortedPersistentCommands;
+	bool m_persistentCommandsDirty;
+	/** The sorted frame packets merged with the sorted persistent packets */
+	std::vector<CommandPacket<SortKeyType> > m_mergedCommands;
+
+	/** A run of consecutive commands of the same type in the execution stream */
+	struct CommandRun {
+		CommandExecuteBatchFunctionPtr ExecuteBatchFunction;
+		uint Start;
+		uint Count;
+	};
+
+	bool m_useExecutionStream;
+	/** The command data of all the commands, in execution order. Kept between frames to avoid re-allocating */
+	std::vector<const void *> m_executionStream;
+	std::vector<CommandRun> m_executionRuns;
+
+	/** If set, every submitted frame is written to it */
+	CommandCapture *m_capture;
     
 public:
     /**
      * Allocates a new command
 	 * 
-     * @tparam U      The type of the command to create. U must derive from 'CommandBase'
-     * @param  key    The sort key for the new command
-     * @return        The newly allocated command
+     * @tparam U              The type of the command to create. U must derive from 'CommandBase'
+     * @param  key            The sort key for the new command
+	 * @param  threadIndex    The index of the recording thread. See the class comment
+     * @return                The newly allocated command
      */
     template <typename U>
-	U *AddCommand(SortKeyType key) {
-		CommandNode *node = AllocateCommand<U>();
+	U *AddCommand(SortKeyType key, uint threadIndex = 0u) {
+		CommandNode *node = AllocateCommand<U>(threadIndex);
 
-		// Store key and pointer to the node
-		// TODO: Atomic this:
-		uint currentPos = m_nextFreeCommand++;
-		m_commands[currentPos].Key = key;
-		m_commands[currentPos].FirstNode = node;
+		// Reserve a packet slot and store key and pointer to the node
+		uint currentPos = m_nextFreeCommand.fetch_add(1u, std::memory_order_relaxed);
+		CommandPacket<SortKeyType> *packet = currentPos < m_capacity ? &m_commands[currentPos] : GetOverflowPacket(currentPos - m_capacity);
+		if (packet != nullptr) {
+			packet->Key = key;
+			packet->FirstNode = node;
+		}
 
 		return new(GetCommandData(node)) U;
 	}
@@ -106,76 +350,359 @@ public:
 	 * 
 	 * @tparam U                 The type of the command to create. U must derive from 'CommandBase'
 	 * @param  previousCommand   The command to append the new command to
+	 * @param  threadIndex       The index of the recording thread. See the class comment
 	 * @return                   The newly allocated command
 	 */
 	template <typename U>
-	U *AppendCommand(void *previousCommand) {
-		CommandNode *newNode = AllocateCommand<U>();
+	U *AppendCommand(void *previousCommand, uint threadIndex = 0u) {
+		CommandNode *newNode = AllocateCommand<U>(threadIndex);
+		LinkCommand(previousCommand, newNode);
 
-		CommandNode *previousNode = reinterpret_cast<CommandNode *>(reinterpret_cast<byte *>(previousCommand) - sizeof(CommandNode));
-		// Make sure this command hasn't already been appended to
-		AssertMsg(previousNode->NextNode == nullptr, "This Command has already had another command appended to it. Only append to the last Command created");
-		previousNode->NextNode = newNode;
+		return new(GetCommandData(newNode)) U;
+	}
+
+	/**
+	 * Allocates a new command in a persistent packet. The packet is kept, and executed by every
+	 * Submit(), until one of its owners is invalidated, or the persistent packets are cleared
+	 *
+	 * Persistent commands must not be added, appended, or invalidated while commands are being
+	 * recorded, or while the bucket is submitting
+	 *
+	 * @tparam U                 The type of the command to create. U must derive from 'CommandBase'
+	 * @param  key               The sort key for the new command
+	 * @param  owner             The object the packet draws, like a model. Invalidating it drops the packet
+	 * @param  secondaryOwner    [Optional] A second object that invalidates the packet, like a material
+	 * @return                   The newly allocated command
+	 */
+	template <typename U>
+	U *AddPersistentCommand(SortKeyType key, const void *owner, const void *secondaryOwner = nullptr) {
+		CommandNode *node = AllocatePersistentCommand<U>();
+
+		PersistentCommandPacket packet;
+		packet.Packet.Key = key;
+		packet.Packet.FirstNode = node;
+		packet.Owners[0] = owner;
+		packet.Owners[1] = secondaryOwner;
+		m_persistentCommands.push_back(packet);
+		m_persistentCommandsDirty = true;
+
+		return new(GetCommandData(node)) U;
+	}
+
+	/**
+	 * Allocates a new command and appends it to the end of a persistent packet. See AddPersistentCommand()
+	 *
+	 * @tparam U                 The type of the command to create. U must derive from 'CommandBase'
+	 * @param  previousCommand   The persistent command to append the new command to
+	 * @return                   The newly allocated command
+	 */
+	template <typename U>
+	U *AppendPersistentCommand(void *previousCommand) {
+		CommandNode *newNode = AllocatePersistentCommand<U>();
+		LinkCommand(previousCommand, newNode);
 
 		return new(GetCommandData(newNode)) U;
 	}
 
 	/**
-	 * Sorts all the command packets and executes them in the sorted order
+	 * Disposes and frees every persistent packet that 'owner' was passed to, as either owner
+	 *
+	 * @param owner    The owner to invalidate
+	 */
+	void InvalidatePersistentCommands(const void *owner) {
+		uint keptCount = 0u;
+		for (uint i = 0; i < m_persistentCommands.size(); ++i) {
+			PersistentCommandPacket &packet = m_persistentCommands[i];
+			if (packet.Owners[0] == owner || packet.Owners[1] == owner) {
+				FreePersistentPacket(packet.Packet);
+			} else {
+				m_persistentCommands[keptCount++] = packet;
+			}
+		}
+
+		if (keptCount != m_persistentCommands.size()) {
+			m_persistentCommands.resize(keptCount);
+			m_persistentCommandsDirty = true;
+		}
+	}
+
+	/** Disposes and frees all the persistent packets */
+	void ClearPersistentCommands() {
+		for (auto iter = m_persistentCommands.begin(); iter != m_persistentCommands.end(); ++iter) {
+			FreePersistentPacket(iter->Packet);
+		}
+
+		m_persistentCommands.clear();
+		m_persistentCommandsDirty = true;
+	}
+
+	/**
+	 * Returns a recorder bound to a recording thread index
 	 *
-	 * @param device     The device to use for executing the commands
-	 * @param context    the context to use for executing the commands
+	 * @param threadIndex    The index of the recording thread. See the class comment
 	 */
-	void Submit(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState) {
+	inline Recorder GetRecorder(uint threadIndex) {
+		assert(threadIndex < m_numRecordingThreads);
+		return Recorder(this, threadIndex);
+	}
+
+	/**
+	 * Splits [0, itemCount) into contiguous ranges, one per recording thread, and calls
+	 * 'func' on each range in parallel on the worker pool. The calling thread records ranges
+	 * as well. Returns once all the ranges have been recorded
+	 *
+	 * @param itemCount    The number of items to record commands for
+	 * @param func         A callable taking (Recorder &recorder, uint begin, uint end). It is called concurrently from several threads
+	 */
+	template <typename Func>
+	void RecordParallel(uint itemCount, Func func) {
+		uint numTasks = std::min(m_numRecordingThreads, itemCount);
+		if (numTasks <= 1u) {
+			Recorder recorder(this, 0u);
+			func(recorder, 0u, itemCount);
+			return;
+		}
+
+		uint itemsPerTask = (itemCount + numTasks - 1u) / numTasks;
+		numTasks = (itemCount + itemsPerTask - 1u) / itemsPerTask;
+
+		// Each range has its own recorder, so a thread that picks up several ranges still
+		// records each into the allocator of that range. ParallelFor() re-throws any exception
+		m_workerPool->ParallelFor(numTasks, [this, &func, itemsPerTask, itemCount](uint task) {
+			uint begin = task * itemsPerTask;
+
+			Recorder recorder(this, task);
+			func(recorder, begin, std::min(begin + itemsPerTask, itemCount));
+		});
+	}
+
+	/**
+	 * Sorts all the command packets and executes them in the sorted order, along with the persistent packets
+	 *
+	 * @param context    The context to execute the commands with
+	 */
+	void Submit(const CommandContext &context) {
+		uint commandCount = GetCommandCount();
+		GrowToFit(commandCount);
+
+		if (m_persistentCommandsDirty) {
+			SortPersistentCommands();
+		}
+
+		// Capture the packets in the order they were recorded, so replays include the sort
+		if (m_capture != nullptr && m_capture->IsOpen()) {
+			CaptureCommands(commandCount, typename std::is_integral<SortKeyType>::type());
+		}
+
 		// Sort the commands
-		std::sort(m_commands, m_commands + m_nextFreeCommand, CommandSortFunction<SortKeyType>);
+		CommandPacket<SortKeyType> *sortedCommands = SortCommands(commandCount, typename std::is_integral<SortKeyType>::type());
 
-		// Execute the commands
-		for (uint i = 0; i < m_nextFreeCommand; ++i) {
-			CommandNode *node = m_commands[i].FirstNode;
+		// Merge in the persistent packets. They're already sorted, so this is a single linear pass
+		if (!m_sortedPersistentCommands.empty()) {
+			sortedCommands = MergePersistentCommands(sortedCommands, commandCount);
+			commandCount += static_cast<uint>(m_sortedPersistentCommands.size());
+		}
 
-			do {
-				node->ExecuteFunction(device, context, blendStateManager, rasterizerStateManager, depthStencilStateManager, currentGraphicsState, GetCommandData(node));
-				node = node->NextNode;
-			} while (node != nullptr);
+		// Execute the commands
+		if (m_useExecutionStream) {
+			ExecuteStream(context, sortedCommands, commandCount);
+		} else {
+			ExecutePackets(context, sortedCommands, commandCount);
 		}
 	}
 
 	/**
-	 * Clears the bucket of all commands        
+	 * Chooses whether Submit() flattens the packets into an execution stream and executes it in
+	 * same type runs, or executes the packets directly. Off by default
+	 */
+	inline void SetExecutionStreamEnabled(bool enabled) { m_useExecutionStream = enabled; }
+	inline bool GetExecutionStreamEnabled() const { return m_useExecutionStream; }
+
+	/**
+	 * Starts writing every submitted frame to a capture. Only integral sort keys of up to 64 bits can be captured
+	 *
+	 * @param capture    The capture to write to, or nullptr to stop capturing. It must outlive the bucket, or be unset first
+	 */
+	inline void SetCapture(CommandCapture *capture) { m_capture = capture; }
+
+	/**
+	 * Clears the bucket of all commands, except the persistent packets
 	 */
 	void Clear() {
-		// Dispose the commands
-		for (uint i = 0; i < m_nextFreeCommand; ++i) {
-			CommandNode *node = m_commands[i].FirstNode;
+		uint commandCount = GetCommandCount();
+		GrowToFit(commandCount);
+		m_highWaterMark = std::max(m_highWaterMark, commandCount);
 
-			do {
-				node->DisposeFunction(GetCommandData(node));
-				node = node->NextNode;
-			} while (node != nullptr);
+		// Dispose the commands. If they were all trivially disposable, we only need to reset the allocators
+		if (m_needsDispose.load(std::memory_order_relaxed)) {
+			for (uint i = 0; i < commandCount; ++i) {
+				CommandNode *node = m_commands[i].FirstNode;
+
+				do {
+					if (node->DisposeFunction != nullptr) {
+						node->DisposeFunction(GetCommandData(node));
+					}
+					node = node->NextNode;
+				} while (node != nullptr);
+			}
+
+			m_needsDispose.store(false, std::memory_order_relaxed);
 		}
 
-		m_allocator.Reset();
-		m_nextFreeCommand = 0u;
+		for (uint i = 0; i < m_numRecordingThreads; ++i) {
+			GetAllocator(i)->Reset();
+		}
+		m_nextFreeCommand.store(0u, std::memory_order_relaxed);
 	}
+
+	/**
+	 * Grows the capacity, so at least 'capacity' packets can be recorded contiguously.
+	 * Must not be called while commands are being recorded
+	 *
+	 * @param capacity    The number of packets to provision for
+	 */
+	void Reserve(uint capacity) {
+		uint commandCount = GetCommandCount();
+		GrowToFit(commandCount);
+
+		if (capacity > m_capacity) {
+			m_commands.resize(capacity);
+			m_capacity = capacity;
+		}
+	}
+
+	/** Returns the number of command packets recorded since the last Clear(). Dropped packets aren't counted */
+	inline uint GetCommandCount() const { return std::min(m_nextFreeCommand.load(std::memory_order_relaxed), GetMaxCommandCount()); }
+	/** Returns the number of persistent packets */
+	inline uint GetPersistentCommandCount() const { return static_cast<uint>(m_persistentCommands.size()); }
+	inline uint GetNumRecordingThreads() const { return m_numRecordingThreads; }
+
+	/** Returns the packet capacity usage. Call this before Clear() to include the current frame */
+	CommandBucketStats GetStats() const {
+		uint commandCount = GetCommandCount();
+
+		CommandBucketStats stats;
+		stats.Capacity = m_capacity;
+		stats.CommandCount = commandCount;
+		stats.PersistentCommandCount = GetPersistentCommandCount();
+		stats.HighWaterMark = std::max(m_highWaterMark, commandCount);
+		stats.NumGrows = m_numGrows;
+		stats.DroppedCommandCount = m_nextFreeCommand.load(std::memory_order_relaxed) - commandCount;
+
+		return stats;
+	}
+
+	/**
+	 * Returns the usage statistics of a recording thread's allocator. Call this before Clear()
+	 * to get the memory used by the current frame's commands
+	 *
+	 * @param threadIndex    The index of the recording thread
+	 */
+	inline const Common::LinearAllocatorStats &GetAllocatorStats(uint threadIndex = 0u) const { return GetAllocator(threadIndex)->GetStats(); }
     
 private:
     /**
      * A helper function to allocate a new CommandNode and initialize it
      *
-     * @return        
+     * @param threadIndex    The index of the recording thread, which selects the allocator
+     * @return               The new node. The command data directly follows it
      */
     template <typename U>
-	CommandNode *AllocateCommand() {
+	CommandNode *AllocateCommand(uint threadIndex) {
+		static_assert(__alignof(U) <= kCommandAlignment, "Command data requires a larger alignment than the CommandBucket provides");
+		assert(threadIndex < m_numRecordingThreads);
+
 		// We have to allocate enough room to fit all of the data of U. 
-		CommandNode *newNode = reinterpret_cast<CommandNode *>(m_allocator.Allocate(sizeof(CommandNode) + sizeof(U)));
-		newNode->NextNode = nullptr;
-		newNode->ExecuteFunction = &U::Execute;
-		newNode->DisposeFunction = &U::Dispose;
+		// The node is aligned such that the command data directly after it is also aligned
+		CommandNode *newNode = reinterpret_cast<CommandNode *>(GetAllocator(threadIndex)->Allocate(kCommandDataOffset + sizeof(U), kCommandAlignment));
+		InitializeNode<U>(newNode);
+
+		// Only write if necessary, so recording threads don't fight over the cache line
+		if (newNode->DisposeFunction != nullptr && !m_needsDispose.load(std::memory_order_relaxed)) {
+			m_needsDispose.store(true, std::memory_order_relaxed);
+		}
+
+		return newNode;
+	}
+
+	/**
+	 * Allocates a CommandNode for a persistent packet. Persistent nodes are allocated from
+	 * the heap, rather than the recording allocators, so they survive Clear(), and can be
+	 * freed one packet at a time. Their Dispose functions are called by FreePersistentPacket()
+	 */
+	template <typename U>
+	CommandNode *AllocatePersistentCommand() {
+		static_assert(__alignof(U) <= kCommandAlignment, "Command data requires a larger alignment than the CommandBucket provides");
+
+		CommandNode *newNode = reinterpret_cast<CommandNode *>(_aligned_malloc(kCommandDataOffset + sizeof(U), kCommandAlignment));
+		if (newNode == nullptr) {
+			throw std::bad_alloc();
+		}
+		InitializeNode<U>(newNode);
 
 		return newNode;
 	}
 
+	template <typename U>
+	static void InitializeNode(CommandNode *node) {
+		node->NextNode = nullptr;
+		node->ExecuteFunction = &U::Execute;
+		node->ExecuteBatchFunction = &CommandBatchExecutor<U>::ExecuteBatch;
+		node->DisposeFunction = IsTriviallyDisposable<U>::value ? nullptr : &U::Dispose;
+	}
+
+	/** Appends 'newNode' to the packet that ends with 'previousCommand' */
+	static void LinkCommand(void *previousCommand, CommandNode *newNode) {
+		CommandNode *previousNode = reinterpret_cast<CommandNode *>(reinterpret_cast<byte *>(previousCommand) - kCommandDataOffset);
+		// Make sure this command hasn't already been appended to
+		AssertMsg(previousNode->NextNode == nullptr, "This Command has already had another command appended to it. Only append to the last Command created");
+		previousNode->NextNode = newNode;
+	}
+
+	/** Disposes the commands of a persistent packet and frees their nodes */
+	static void FreePersistentPacket(const CommandPacket<SortKeyType> &packet) {
+		CommandNode *node = packet.FirstNode;
+		do {
+			CommandNode *nextNode = node->NextNode;
+			if (node->DisposeFunction != nullptr) {
+				node->DisposeFunction(GetCommandData(node));
+			}
+			_aligned_free(node);
+
+			node = nextNode;
+		} while (node != nullptr);
+	}
+
+	/** Rebuilds m_sortedPersistentCommands. Only runs when the persistent packets change */
+	void SortPersistentCommands() {
+		m_sortedPersistentCommands.clear();
+		m_sortedPersistentCommands.reserve(m_persistentCommands.size());
+		for (auto iter = m_persistentCommands.begin(); iter != m_persistentCommands.end(); ++iter) {
+			m_sortedPersistentCommands.push_back(iter->Packet);
+		}
+
+		// Stable, so persistent packets with the same key keep the order they were added in
+		std::stable_sort(m_sortedPersistentCommands.begin(), m_sortedPersistentCommands.end(), CommandSortFunction<SortKeyType>);
+		m_persistentCommandsDirty = false;
+	}
+
+	/**
+	 * Merges the sorted frame packets with the sorted persistent packets. Where the keys are equal,
+	 * the persistent packets execute first
+	 *
+	 * @return    The merged packets
+	 */
+	CommandPacket<SortKeyType> *MergePersistentCommands(const CommandPacket<SortKeyType> *sortedCommands, uint commandCount) {
+		size_t mergedCount = m_sortedPersistentCommands.size() + commandCount;
+		if (m_mergedCommands.size() < mergedCount) {
+			m_mergedCommands.resize(mergedCount);
+		}
+
+		std::merge(m_sortedPersistentCommands.begin(), m_sortedPersistentCommands.end(), sortedCommands, sortedCommands + commandCount, m_mergedCommands.begin(), CommandSortFunction<SortKeyType>);
+
+		return m_mergedCommands.data();
+	}
+
 	/**
 	 * A helper function to get the data for a command
 	 *
@@ -183,8 +710,190 @@ private:
 	 * @return        The data for the command
 	 */
 	inline static void *GetCommandData(CommandNode *node) {
-		return reinterpret_cast<byte *>(node) + sizeof(CommandNode);
+		return reinterpret_cast<byte *>(node) + kCommandDataOffset;
 	}
+
+	/** Returns the number of packets that can be recorded before packets are dropped */
+	inline uint GetMaxCommandCount() const { return m_capacity + kOverflowChunkSize * kMaxOverflowChunks; }
+
+	/**
+	 * Returns a packet slot past the end of the capacity, allocating its overflow chunk if necessary
+	 *
+	 * @param overflowIndex    The index of the packet, relative to the end of the capacity
+	 * @return                 The packet, or nullptr if all the overflow chunks are used. The packet must then be dropped
+	 */
+	CommandPacket<SortKeyType> *GetOverflowPacket(uint overflowIndex) {
+		uint chunkIndex = overflowIndex / kOverflowChunkSize;
+		if (chunkIndex >= kMaxOverflowChunks) {
+			// Only report the first dropped packet, rather than one message box per packet
+			if (overflowIndex == kOverflowChunkSize * kMaxOverflowChunks) {
+				AssertMsg(false, L"CommandBucket overflow. More than " << kOverflowChunkSize * kMaxOverflowChunks << L" packets were recorded past the capacity of " << m_capacity << L". The rest of the frame's packets are dropped");
+			}
+			return nullptr;
+		}
+
+		CommandPacket<SortKeyType> *chunk = m_overflowChunks[chunkIndex].load(std::memory_order_acquire);
+		if (chunk == nullptr) {
+			std::lock_guard<std::mutex> guard(m_overflowLock);
+
+			// Another thread may have allocated the chunk while we were waiting for the lock
+			chunk = m_overflowChunks[chunkIndex].load(std::memory_order_relaxed);
+			if (chunk == nullptr) {
+				chunk = new CommandPacket<SortKeyType>[kOverflowChunkSize];
+				m_overflowChunks[chunkIndex].store(chunk, std::memory_order_release);
+			}
+		}
+
+		return &chunk[overflowIndex % kOverflowChunkSize];
+	}
+
+	/**
+	 * If recording spilled into the overflow chunks, grows the main storage and moves the spilled
+	 * packets into it, so all the packets are contiguous again
+	 *
+	 * @param commandCount    The number of packets recorded
+	 */
+	void GrowToFit(uint commandCount) {
+		if (commandCount <= m_capacity) {
+			return;
+		}
+
+		// Grow geometrically, so a scene that keeps growing doesn't pay for a copy every frame
+		uint oldCapacity = m_capacity;
+		uint newCapacity = std::max(oldCapacity * 2u, commandCount);
+		newCapacity = (newCapacity + kOverflowChunkSize - 1u) & ~(kOverflowChunkSize - 1u);
+
+		m_commands.resize(newCapacity);
+		for (uint i = oldCapacity; i < commandCount; ++i) {
+			m_commands[i] = *GetOverflowPacket(i - oldCapacity);
+		}
+
+		m_capacity = newCapacity;
+		++m_numGrows;
+	}
+
+	/**
+	 * Sorts the packets with a radix sort
+	 *
+	 * @return    The sorted packets. Either m_commands or the scratch buffer. Both still hold all the packets
+	 */
+	CommandPacket<SortKeyType> *SortCommands(uint commandCount, std::true_type /* isIntegral */) {
+		if (m_sortScratch.size() < commandCount) {
+			m_sortScratch.resize(m_capacity);
+		}
+
+		return Common::RadixSort<SortKeyType>(m_commands.data(), m_sortScratch.data(), commandCount, GetCommandPacketKey<SortKeyType>, m_workerPool);
+	}
+
+	/**
+	 * Sorts the packets with std::sort, for key types that only provide operator<
+	 *
+	 * @return    The sorted packets
+	 */
+	CommandPacket<SortKeyType> *SortCommands(uint commandCount, std::false_type /* isIntegral */) {
+		std::sort(m_commands.begin(), m_commands.begin() + commandCount, CommandSortFunction<SortKeyType>);
+		return m_commands.data();
+	}
+
+	/** Writes the packets to m_capture */
+	void CaptureCommands(uint commandCount, std::true_type /* isIntegral */) {
+		static_assert(sizeof(SortKeyType) <= sizeof(uint64), "Only sort keys of up to 64 bits can be captured");
+
+		// The persistent packets are captured with every frame, so each frame replays on its own
+		m_capture->BeginFrame(commandCount + static_cast<uint>(m_sortedPersistentCommands.size()));
+		for (uint i = 0; i < commandCount; ++i) {
+			CapturePacket(m_commands[i]);
+		}
+		for (auto iter = m_sortedPersistentCommands.begin(); iter != m_sortedPersistentCommands.end(); ++iter) {
+			CapturePacket(*iter);
+		}
+		m_capture->EndFrame();
+	}
+
+	void CapturePacket(const CommandPacket<SortKeyType> &packet) {
+		m_capture->BeginPacket(static_cast<uint64>(packet.Key));
+
+		CommandNode *node = packet.FirstNode;
+		do {
+			m_capture->CaptureCommand(node->ExecuteFunction, GetCommandData(node));
+			node = node->NextNode;
+		} while (node != nullptr);
+
+		m_capture->EndPacket();
+	}
+
+	void CaptureCommands(uint commandCount, std::false_type /* isIntegral */) {
+		AssertMsg(false, L"Only integral sort keys can be captured");
+	}
+
+	/** Executes the packets in order, one command at a time */
+	void ExecutePackets(const CommandContext &context, const CommandPacket<SortKeyType> *sortedCommands, uint commandCount) {
+		for (uint i = 0; i < commandCount; ++i) {
+			// The nodes are scattered through the allocator pages, so start fetching them early
+			if (i + kCommandPrefetchDistance < commandCount) {
+				PrefetchCommand(sortedCommands[i + kCommandPrefetchDistance].FirstNode);
+			}
+
+			CommandNode *node = sortedCommands[i].FirstNode;
+			do {
+				node->ExecuteFunction(context, GetCommandData(node));
+				node = node->NextNode;
+			} while (node != nullptr);
+		}
+	}
+
+	/**
+	 * Flattens the packets into m_executionStream, splitting it into runs of the same command type,
+	 * and then executes each run with one call to its batched entry point. The packets are streamed
+	 * in chunks of about kExecutionStreamChunkSize commands, so the commands gathered are still in
+	 * cache when they execute
+	 */
+	void ExecuteStream(const CommandContext &context, const CommandPacket<SortKeyType> *sortedCommands, uint commandCount) {
+		m_executionStream.reserve(kExecutionStreamChunkSize + 64u);
+
+		for (uint i = 0; i < commandCount; ++i) {
+			if (i + kCommandPrefetchDistance < commandCount) {
+				PrefetchCommand(sortedCommands[i + kCommandPrefetchDistance].FirstNode);
+			}
+
+			CommandNode *node = sortedCommands[i].FirstNode;
+			do {
+				if (m_executionRuns.empty() || m_executionRuns.back().ExecuteBatchFunction != node->ExecuteBatchFunction) {
+					CommandRun run = {node->ExecuteBatchFunction, static_cast<uint>(m_executionStream.size()), 0u};
+					m_executionRuns.push_back(run);
+				}
+
+				m_executionStream.push_back(GetCommandData(node));
+				++m_executionRuns.back().Count;
+
+				node = node->NextNode;
+			} while (node != nullptr);
+
+			if (m_executionStream.size() >= kExecutionStreamChunkSize) {
+				ExecuteRuns(context);
+			}
+		}
+
+		ExecuteRuns(context);
+	}
+
+	/** Executes and then clears the runs gathered into the execution stream */
+	void ExecuteRuns(const CommandContext &context) {
+		for (auto iter = m_executionRuns.begin(); iter != m_executionRuns.end(); ++iter) {
+			iter->ExecuteBatchFunction(context, &m_executionStream[iter->Start], iter->Count);
+		}
+
+		m_executionStream.clear();
+		m_executionRuns.clear();
+	}
+
+	inline AllocatorType *GetAllocator(uint threadIndex) const {
+		return reinterpret_cast<AllocatorType *>(m_allocatorStorage + threadIndex * kAllocatorStride);
+	}
+
+	// Not implemented
+	CommandBucket(const CommandBucket &);
+	CommandBucket &operator=(const CommandBucket &);
 };
 
 }// End of namespace Graphics
@@ -0,0 +1,415 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "graphics/command_capture.h"
+
+#include "common/endian.h"
+#include "common/file_io_util.h"
+#include "common/radix_sort.h"
+
+#include <cassert>
+#include <cstring>
+
+
+namespace Graphics {
+
+struct CaptureCommandType {
+	CommandCaptureFunctionPtr CaptureFunction;
+	uint16 TypeId;
+};
+
+// A namespace scope static rather than a function local one, since VS2013 doesn't
+// initialize function local statics in a thread-safe way
+static Common::FlatHashMap<CommandExecuteFunctionPtr, CaptureCommandType> captureCommandTypes;
+/** The type each id was registered for, to catch two types sharing an id */
+static Common::FlatHashMap<uint16, CommandExecuteFunctionPtr> captureCommandTypeIds;
+
+static const uint32 kCaptureFileTag = MKTAG('H', 'C', 'A', 'P');
+static const uint32 kCaptureFrameTag = MKTAG('F', 'R', 'M', 'E');
+
+void RegisterCaptureCommandType(CommandExecuteFunctionPtr executeFunction, CommandCaptureFunctionPtr captureFunction, uint16 typeId) {
+	assert(typeId != kUnknownCommandTypeId);
+
+	auto result = captureCommandTypeIds.try_emplace(typeId, executeFunction);
+	assert(result.second || result.first->second == executeFunction);
+
+	CaptureCommandType type = {captureFunction, typeId};
+	captureCommandTypes[executeFunction] = type;
+}
+
+static void WriteVarint(std::vector<byte> &output, size_t value) {
+	while (value >= 0x80) {
+		output.push_back(static_cast<byte>(value | 0x80));
+		value >>= 7;
+	}
+	output.push_back(static_cast<byte>(value));
+}
+
+static bool ReadVarint(const byte *&current, const byte *end, size_t *value) {
+	*value = 0u;
+	for (uint shift = 0u; current != end && shift < sizeof(size_t) * 8u; shift += 7u) {
+		byte b = *current++;
+		*value |= static_cast<size_t>(b & 0x7F) << shift;
+		if ((b & 0x80) == 0u) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+CommandCapture::CommandCapture()
+	: m_deltaCompress(true),
+	  m_nextResourceId(kNullResourceId + 1u),
+	  m_packetCommandCountOffset(0u),
+	  m_packetCommandCount(0u),
+	  m_commandSizeOffset(0u),
+	  m_numFramesCaptured(0u),
+	  m_numUnknownCommands(0u),
+	  m_numBytesWritten(0u) {
+}
+
+CommandCapture::~CommandCapture() {
+	Close();
+}
+
+bool CommandCapture::Open(const wchar *filePath, bool deltaCompress) {
+	Close();
+
+	m_file.open(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!m_file.is_open()) {
+		return false;
+	}
+
+	m_deltaCompress = deltaCompress;
+	m_previousFrame.clear();
+	m_resourceIds.clear();
+	m_nextResourceId = kNullResourceId + 1u;
+	m_numFramesCaptured = 0u;
+	m_numUnknownCommands = 0u;
+
+	Common::BinaryWriteUInt32(m_file, kCaptureFileTag);
+	Common::BinaryWriteUInt32(m_file, static_cast<uint32>(kVersion));
+	m_numBytesWritten = sizeof(uint32) * 2u;
+
+	return true;
+}
+
+void CommandCapture::Close() {
+	if (m_file.is_open()) {
+		m_file.close();
+	}
+}
+
+void CommandCapture::BeginFrame(uint packetCount) {
+	m_frame.clear();
+	Write(static_cast<uint32>(packetCount));
+}
+
+void CommandCapture::BeginPacket(uint64 sortKey) {
+	Write(sortKey);
+
+	// The command count is patched in EndPacket()
+	m_packetCommandCountOffset = m_frame.size();
+	m_packetCommandCount = 0u;
+	Write(static_cast<uint16>(0u));
+}
+
+void CommandCapture::CaptureCommand(CommandExecuteFunctionPtr executeFunction, const void *data) {
+	auto iter = captureCommandTypes.find(executeFunction);
+	bool isKnown = iter != captureCommandTypes.end();
+
+	Write(isKnown ? iter->second.TypeId : kUnknownCommandTypeId);
+
+	// The payload size is patched once the payload is written
+	m_commandSizeOffset = m_frame.size();
+	Write(static_cast<uint16>(0u));
+
+	if (isKnown) {
+		iter->second.CaptureFunction(data, *this);
+	} else {
+		++m_numUnknownCommands;
+	}
+
+	size_t payloadSize = m_frame.size() - m_commandSizeOffset - sizeof(uint16);
+	assert(payloadSize <= 0xFFFF);
+	uint16 size16 = static_cast<uint16>(payloadSize);
+	memcpy(&m_frame[m_commandSizeOffset], &size16, sizeof(uint16));
+
+	++m_packetCommandCount;
+}
+
+void CommandCapture::EndPacket() {
+	assert(m_packetCommandCount <= 0xFFFF);
+	uint16 count16 = static_cast<uint16>(m_packetCommandCount);
+	memcpy(&m_frame[m_packetCommandCountOffset], &count16, sizeof(uint16));
+}
+
+void CommandCapture::EndFrame() {
+	if (!m_file.is_open()) {
+		return;
+	}
+
+	bool isKeyFrame = !m_deltaCompress || m_previousFrame.empty() || m_numFramesCaptured % kKeyFrameInterval == 0u;
+
+	FrameEncoding encoding = FRAME_ENCODING_RAW;
+	const std::vector<byte> *output = &m_frame;
+	if (!isKeyFrame) {
+		EncodeDelta();
+
+		// A frame that changed completely can come out larger than the raw frame
+		if (m_encodedFrame.size() < m_frame.size()) {
+			encoding = FRAME_ENCODING_DELTA;
+			output = &m_encodedFrame;
+		}
+	}
+
+	Common::BinaryWriteUInt32(m_file, kCaptureFrameTag);
+	Common::BinaryWriteUInt32(m_file, static_cast<uint32>(encoding));
+	Common::BinaryWriteUInt32(m_file, static_cast<uint32>(m_frame.size()));
+	Common::BinaryWriteUInt32(m_file, static_cast<uint32>(output->size()));
+	if (!output->empty()) {
+		m_file.write(reinterpret_cast<const char *>(output->data()), output->size());
+	}
+	m_numBytesWritten += sizeof(uint32) * 4u + output->size();
+
+	m_previousFrame.swap(m_frame);
+	++m_numFramesCaptured;
+}
+
+void CommandCapture::WriteBytes(const void *data, size_t size) {
+	const byte *bytes = static_cast<const byte *>(data);
+	m_frame.insert(m_frame.end(), bytes, bytes + size);
+}
+
+void CommandCapture::WriteResource(const void *resource) {
+	uint32 id = kNullResourceId;
+	if (resource != nullptr) {
+		auto result = m_resourceIds.try_emplace(resource, m_nextResourceId);
+		if (result.second) {
+			++m_nextResourceId;
+		}
+		id = result.first->second;
+	}
+
+	Write(id);
+}
+
+void CommandCapture::EncodeDelta() {
+	m_encodedFrame.clear();
+
+	size_t size = m_frame.size();
+	size_t previousSize = m_previousFrame.size();
+
+	size_t i = 0u;
+	while (i < size) {
+		// Count the bytes that didn't change
+		size_t zeroStart = i;
+		while (i < size && i < previousSize && m_frame[i] == m_previousFrame[i]) {
+			++i;
+		}
+		size_t zeroCount = i - zeroStart;
+
+		// Then the bytes that did. Short unchanged gaps are cheaper to store as literals
+		size_t literalStart = i;
+		while (i < size) {
+			if (i < previousSize && m_frame[i] == m_previousFrame[i]) {
+				size_t gapEnd = i;
+				while (gapEnd < size && gapEnd < previousSize && m_frame[gapEnd] == m_previousFrame[gapEnd] && gapEnd - i < 4u) {
+					++gapEnd;
+				}
+				if (gapEnd - i >= 4u || gapEnd == size) {
+					break;
+				}
+				i = gapEnd;
+			} else {
+				++i;
+			}
+		}
+		size_t literalCount = i - literalStart;
+
+		WriteVarint(m_encodedFrame, zeroCount);
+		WriteVarint(m_encodedFrame, literalCount);
+		for (size_t j = literalStart; j < literalStart + literalCount; ++j) {
+			m_encodedFrame.push_back(m_frame[j] ^ (j < previousSize ? m_previousFrame[j] : 0u));
+		}
+	}
+}
+
+
+CommandCaptureReader::CommandCaptureReader()
+	: m_offset(0u),
+	  m_frameIndex(0u) {
+}
+
+bool CommandCaptureReader::Open(const wchar *filePath) {
+	m_offset = 0u;
+	m_frameIndex = 0u;
+	m_previousFrame.clear();
+
+	if (!m_file.Open(filePath, Common::MappedFile::ACCESS_SEQUENTIAL)) {
+		return false;
+	}
+
+	Common::BinaryReader reader(m_file.GetData(), static_cast<size_t>(m_file.GetSize()));
+	uint32 tag = 0u;
+	uint32 version = 0u;
+	if (!reader.Read(&tag) || !reader.Read(&version) || tag != kCaptureFileTag || version != CommandCapture::kVersion) {
+		m_file.Close();
+		return false;
+	}
+
+	m_offset = sizeof(uint32) * 2u;
+	return true;
+}
+
+bool CommandCaptureReader::ReadFrame() {
+	if (!m_file.IsOpen()) {
+		return false;
+	}
+
+	size_t fileSize = static_cast<size_t>(m_file.GetSize());
+	Common::BinaryReader reader(m_file.GetData() + m_offset, fileSize - m_offset);
+
+	uint32 tag = 0u;
+	uint32 encoding = 0u;
+	uint32 decodedSize = 0u;
+	uint32 encodedSize = 0u;
+	reader.Read(&tag);
+	reader.Read(&encoding);
+	reader.Read(&decodedSize);
+	reader.Read(&encodedSize);
+	const byte *encoded = reader.View<byte>(encodedSize);
+	if (reader.HasError() || tag != kCaptureFrameTag) {
+		return false;
+	}
+
+	if (encoding == CommandCapture::FRAME_ENCODING_RAW) {
+		if (encodedSize != decodedSize) {
+			return false;
+		}
+		m_frame.assign(encoded, encoded + encodedSize);
+	} else if (encoding == CommandCapture::FRAME_ENCODING_DELTA) {
+		if (!DecodeDelta(encoded, encodedSize, decodedSize)) {
+			return false;
+		}
+	} else {
+		return false;
+	}
+
+	m_offset = fileSize - reader.Remaining();
+	m_previousFrame = m_frame;
+	++m_frameIndex;
+
+	return true;
+}
+
+bool CommandCaptureReader::DecodeDelta(const byte *encoded, size_t encodedSize, size_t decodedSize) {
+	m_frame.resize(decodedSize);
+
+	size_t previousSize = m_previousFrame.size();
+	const byte *current = encoded;
+	const byte *end = encoded + encodedSize;
+
+	size_t i = 0u;
+	while (current != end) {
+		size_t zeroCount;
+		size_t literalCount;
+		if (!ReadVarint(current, end, &zeroCount) || !ReadVarint(current, end, &literalCount)) {
+			return false;
+		}
+		if (zeroCount > decodedSize - i || i + zeroCount > previousSize || literalCount > decodedSize - i - zeroCount || literalCount > static_cast<size_t>(end - current)) {
+			return false;
+		}
+
+		memcpy(&m_frame[i], &m_previousFrame[i], zeroCount);
+		i += zeroCount;
+
+		for (size_t j = 0u; j < literalCount; ++j, ++i) {
+			m_frame[i] = *current++ ^ (i < previousSize ? m_previousFrame[i] : 0u);
+		}
+	}
+
+	return i == decodedSize;
+}
+
+bool CommandCaptureReader::ReplayFrame(CommandReplayExecutor *executor) {
+	Common::BinaryReader reader(m_frame.data(), m_frame.size());
+
+	uint32 packetCount = 0u;
+	if (!reader.Read(&packetCount)) {
+		return false;
+	}
+
+	// Index the packets, so they can be sorted without moving the commands
+	m_packets.clear();
+	m_packets.reserve(packetCount);
+	for (uint32 i = 0; i < packetCount; ++i) {
+		PacketRef packet;
+		uint16 commandCount = 0u;
+		if (!reader.Read(&packet.SortKey)) {
+			return false;
+		}
+		packet.Offset = static_cast<uint>(m_frame.size() - reader.Remaining());
+		if (!reader.Read(&commandCount)) {
+			return false;
+		}
+
+		for (uint16 j = 0; j < commandCount; ++j) {
+			uint16 typeId = 0u;
+			uint16 payloadSize = 0u;
+			reader.Read(&typeId);
+			reader.Read(&payloadSize);
+			if (!reader.Skip(payloadSize)) {
+				return false;
+			}
+		}
+
+		m_packets.push_back(packet);
+	}
+
+	m_sortScratch.resize(m_packets.size());
+	const PacketRef *sortedPackets = Common::RadixSort<uint64>(m_packets.data(), m_sortScratch.data(), m_packets.size(), [](const PacketRef &packet) { return packet.SortKey; });
+
+	executor->BeginFrame(GetFrameIndex());
+	for (size_t i = 0; i < m_packets.size(); ++i) {
+		Common::BinaryReader packetReader(m_frame.data() + sortedPackets[i].Offset, m_frame.size() - sortedPackets[i].Offset);
+
+		uint16 commandCount = 0u;
+		packetReader.Read(&commandCount);
+		executor->BeginPacket(sortedPackets[i].SortKey);
+		for (uint16 j = 0; j < commandCount; ++j) {
+			uint16 typeId = 0u;
+			uint16 payloadSize = 0u;
+			packetReader.Read(&typeId);
+			packetReader.Read(&payloadSize);
+
+			Common::BinaryReader payload(packetReader.View<byte>(payloadSize), payloadSize);
+			executor->ExecuteCommand(typeId, payload);
+		}
+		executor->EndPacket();
+	}
+	executor->EndFrame();
+
+	return true;
+}
+
+uint ReplayCapture(const wchar *filePath, CommandReplayExecutor *executor) {
+	CommandCaptureReader reader;
+	if (!reader.Open(filePath)) {
+		return 0u;
+	}
+
+	uint numFrames = 0u;
+	while (reader.ReadFrame() && reader.ReplayFrame(executor)) {
+		++numFrames;
+	}
+
+	return numFrames;
+}
+
+} // End of namespace Graphics
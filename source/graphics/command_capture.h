@@ -0,0 +1,271 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/binary_reader.h"
+#include "common/flat_hash_map.h"
+#include "common/mapped_file.h"
+
+#include "graphics/command_context.h"
+#include "graphics/shader.h"
+
+#include <fstream>
+#include <type_traits>
+#include <vector>
+
+
+namespace Graphics {
+
+namespace Commands {
+struct InstanceStream;
+}
+
+class CommandCapture;
+
+typedef void (*CommandCaptureFunctionPtr)(const void *data, CommandCapture &capture);
+
+/** The type id written for commands whose type was never registered. Their payload is empty */
+const uint16 kUnknownCommandTypeId = 0xFFFF;
+/** The resource id written for null resource pointers */
+const uint32 kNullResourceId = 0u;
+
+/**
+ * Registers a command type, so CommandCapture can serialize it. Register all the command types
+ * at startup, before any capture is started. Registration is not thread-safe
+ *
+ * @param executeFunction    The Execute function of the command. Identifies the type in the CommandNodes
+ * @param captureFunction    Writes the payload of a command to a capture
+ * @param typeId             The id written to the capture. Each type needs an id of its own, since the id is what tells a replay how to read the payload
+ */
+void RegisterCaptureCommandType(CommandExecuteFunctionPtr executeFunction, CommandCaptureFunctionPtr captureFunction, uint16 typeId);
+
+/**
+ * Registers command type U, so CommandCapture can serialize it
+ *
+ * @tparam U         The type of the command. It must have a static Capture(const void *data, CommandCapture &capture) function
+ * @param  typeId    The id written to the capture
+ */
+template <typename U>
+inline void RegisterCaptureCommandType(uint16 typeId) {
+	RegisterCaptureCommandType(&U::Execute, &U::Capture, typeId);
+}
+
+
+/**
+ * Streams the packets submitted to a CommandBucket into a capture file, so the frames can be
+ * replayed offline with CommandCaptureReader
+ *
+ * Each frame stores the sort key of every packet, and the type id and payload of every command in
+ * the packet. The packets are stored in the order they were recorded, so replays re-do the sort.
+ * Resource pointers in the payloads are replaced with ids, which are stable for the lifetime of the
+ * capture. Ids are assigned in the order the resources are first seen, starting at 1.
+ *
+ * With delta compression, each frame is stored as the run-length encoded XOR against the previous
+ * frame, so a mostly static scene costs a few bytes per frame. Every kKeyFrameInterval frames
+ * are stored whole, so a damaged file can be recovered from the next key frame
+ *
+ * File layout:
+ *     File header:   uint32 tag 'HCAP', uint32 version
+ *     Each frame:    uint32 tag 'FRME', uint32 encoding, uint32 decoded size, uint32 encoded size, encoded bytes
+ *     Decoded frame: uint32 packet count, then for each packet:
+ *                        uint64 sort key, uint16 command count, then for each command:
+ *                            uint16 type id, uint16 payload size, payload
+ */
+class CommandCapture {
+public:
+	CommandCapture();
+	~CommandCapture();
+
+	static const uint32 kVersion = 2u;
+	static const uint kKeyFrameInterval = 120u;
+
+	enum FrameEncoding {
+		FRAME_ENCODING_RAW = 0,
+		FRAME_ENCODING_DELTA = 1
+	};
+
+private:
+	std::ofstream m_file;
+	bool m_deltaCompress;
+
+	std::vector<byte> m_frame;
+	std::vector<byte> m_previousFrame;
+	std::vector<byte> m_encodedFrame;
+
+	Common::FlatHashMap<const void *, uint32> m_resourceIds;
+	uint32 m_nextResourceId;
+
+	size_t m_packetCommandCountOffset;
+	uint m_packetCommandCount;
+	size_t m_commandSizeOffset;
+
+	uint m_numFramesCaptured;
+	uint m_numUnknownCommands;
+	uint64 m_numBytesWritten;
+
+public:
+	/**
+	 * Creates the capture file. Any previously open capture is closed first
+	 *
+	 * @param filePath         The path of the file to create
+	 * @param deltaCompress    Whether to store each frame as a delta against the previous one
+	 * @return                 True if the file was created
+	 */
+	bool Open(const wchar *filePath, bool deltaCompress = true);
+	void Close();
+	inline bool IsOpen() const { return m_file.is_open(); }
+
+	// Called by CommandBucket::Submit()
+	void BeginFrame(uint packetCount);
+	void BeginPacket(uint64 sortKey);
+	void CaptureCommand(CommandExecuteFunctionPtr executeFunction, const void *data);
+	void EndPacket();
+	void EndFrame();
+
+	// Used by the Capture() functions of the commands to write their payloads
+
+	/** Writes a trivially copyable value. Don't use this for pointers. Use WriteResource() */
+	template <typename T>
+	inline void Write(const T &value) {
+		static_assert(std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value, "CommandCapture can only write trivially copyable, non-pointer values");
+		WriteBytes(&value, sizeof(T));
+	}
+	void WriteBytes(const void *data, size_t size);
+	/** Writes the stable uint32 id of a resource pointer. nullptr is written as kNullResourceId */
+	void WriteResource(const void *resource);
+
+	inline uint GetNumFramesCaptured() const { return m_numFramesCaptured; }
+	/** The number of commands that were captured without a payload, because their type wasn't registered */
+	inline uint GetNumUnknownCommands() const { return m_numUnknownCommands; }
+	inline uint64 GetNumBytesWritten() const { return m_numBytesWritten; }
+
+private:
+	/**
+	 * Run-length encodes the XOR of m_frame and m_previousFrame into m_encodedFrame
+	 * The encoding is a series of (varint zero count, varint literal count, literal bytes)
+	 */
+	void EncodeDelta();
+
+	// Not implemented
+	CommandCapture(const CommandCapture &);
+	CommandCapture &operator=(const CommandCapture &);
+};
+
+
+/**
+ * The receiving end of a replay. Implement this to re-execute captured commands, for example
+ * against a real device, or to just measure or validate them
+ */
+class CommandReplayExecutor {
+public:
+	virtual ~CommandReplayExecutor() {}
+
+	virtual void BeginFrame(uint frameIndex) {}
+	/** Called before the commands of each packet, in sorted order */
+	virtual void BeginPacket(uint64 sortKey) {}
+	/**
+	 * Executes a single command
+	 *
+	 * @param typeId     The type id the command was registered with, or kUnknownCommandTypeId
+	 * @param payload    A reader over the bytes the command's Capture() function wrote. Resources are uint32 ids
+	 */
+	virtual void ExecuteCommand(uint16 typeId, Common::BinaryReader &payload) = 0;
+	virtual void EndPacket() {}
+	virtual void EndFrame() {}
+};
+
+
+/**
+ * Maps the resource ids of a capture back to pointers, for the Restore() functions of the commands.
+ * The same id must always resolve to the same pointer, so the replay skips the same redundant binds
+ * the captured frame did. kNullResourceId resolves to nullptr
+ */
+class CommandResourceResolver {
+public:
+	virtual ~CommandResourceResolver() {}
+
+	virtual MaterialShader *GetMaterialShader(uint32 id) = 0;
+	/**
+	 * @param id              The resource id of the buffer
+	 * @param mappedSize      The number of bytes the command writes with MapDiscard(), or 0 if it doesn't map the buffer
+	 */
+	virtual ID3D11Buffer *GetBuffer(uint32 id, uint mappedSize) = 0;
+	virtual ID3D11ShaderResourceView *GetShaderResourceView(uint32 id) = 0;
+	virtual ID3D11SamplerState *GetSamplerState(uint32 id) = 0;
+	/** Returns an InstanceStream equal to 'stream' that lives as long as the resolver. Equal streams give the same pointer */
+	virtual Commands::InstanceStream *GetInstanceStream(const Commands::InstanceStream &stream) = 0;
+};
+
+
+/**
+ * Reads the frames of a file written by CommandCapture, and replays them
+ */
+class CommandCaptureReader {
+public:
+	CommandCaptureReader();
+
+private:
+	struct PacketRef {
+		uint64 SortKey;
+		/** The offset of the packet's command count in m_frame */
+		uint Offset;
+	};
+
+	Common::MappedFile m_file;
+	size_t m_offset;
+	uint m_frameIndex;
+
+	std::vector<byte> m_frame;
+	std::vector<byte> m_previousFrame;
+	std::vector<PacketRef> m_packets;
+	std::vector<PacketRef> m_sortScratch;
+
+public:
+	/**
+	 * Opens a capture file, and checks its header
+	 *
+	 * @param filePath    The path of the capture
+	 * @return            False if the file couldn't be opened, or isn't a capture
+	 */
+	bool Open(const wchar *filePath);
+
+	/**
+	 * Decodes the next frame
+	 *
+	 * @return    False at the end of the file, or if the frame is corrupt
+	 */
+	bool ReadFrame();
+
+	/**
+	 * Sorts the packets of the current frame by their keys, and then passes each command to the executor in order
+	 *
+	 * @param executor    The executor to replay the commands with
+	 * @return            False if the frame is corrupt
+	 */
+	bool ReplayFrame(CommandReplayExecutor *executor);
+
+	/** Returns the index of the frame last read with ReadFrame() */
+	inline uint GetFrameIndex() const { return m_frameIndex - 1u; }
+	/** Returns the number of packets in the frame last replayed */
+	inline uint GetPacketCount() const { return static_cast<uint>(m_packets.size()); }
+
+private:
+	/** Reverses CommandCapture::EncodeDelta(), applying the delta to m_previousFrame */
+	bool DecodeDelta(const byte *encoded, size_t encodedSize, size_t decodedSize);
+};
+
+/**
+ * Replays every frame of a capture file
+ *
+ * @param filePath    The path of the capture
+ * @param executor    The executor to replay the commands with
+ * @return            The number of frames replayed
+ */
+uint ReplayCapture(const wchar *filePath, CommandReplayExecutor *executor);
+
+} // End of namespace Graphics
@@ -0,0 +1,58 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+
+namespace Graphics {
+
+class RenderBackend;
+class BlendStateManager;
+class RasterizerStateManager;
+class DepthStencilStateManager;
+struct GraphicsState;
+
+/**
+ * Everything a command needs in order to execute. Commands get it by reference, so
+ * the execute functions stay cheap to call, and adding to it doesn't change every command
+ */
+struct CommandContext {
+	CommandContext(RenderBackend *backend,
+	               BlendStateManager *blendStates, RasterizerStateManager *rasterizerStates, DepthStencilStateManager *depthStencilStates,
+	               GraphicsState *currentGraphicsState)
+		: Backend(backend),
+		  BlendStates(blendStates),
+		  RasterizerStates(rasterizerStates),
+		  DepthStencilStates(depthStencilStates),
+		  CurrentGraphicsState(currentGraphicsState) {
+	}
+
+	/** All the device calls go through the backend, so commands can execute without a GPU */
+	RenderBackend *Backend;
+
+	BlendStateManager *BlendStates;
+	RasterizerStateManager *RasterizerStates;
+	DepthStencilStateManager *DepthStencilStates;
+
+	/** The state bound by the commands executed so far. Used to skip redundant binds */
+	GraphicsState *CurrentGraphicsState;
+};
+
+typedef void (*CommandExecuteFunctionPtr)(const CommandContext &context, const void *data);
+typedef void (*CommandExecuteBatchFunctionPtr)(const CommandContext &context, const void * const *commands, uint count);
+typedef void (*CommandDisposeFunctionPtr)(const void *data);
+
+/**
+ * Picks the batched entry point a CommandBucket uses for command type U. The default, defined
+ * in command_bucket.h, executes the commands of a run one at a time. Specialize it with a static
+ * ExecuteBatch() for a command that can combine a run of itself into fewer device calls
+ */
+template <typename U>
+struct CommandBatchExecutor;
+
+} // End of namespace Graphics
@@ -0,0 +1,190 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "graphics/command_replayer.h"
+
+#include "graphics/commands.h"
+#include "graphics/d3d_util.h"
+
+
+namespace Graphics {
+
+/** Stands in for a captured material shader. Binds a stub pixel shader created on the replay backend */
+class ReplayMaterialShader : public MaterialShader {
+public:
+	ReplayMaterialShader(RenderBackend *backend)
+			// There's no file to load. The stub shader is created below instead
+			: MaterialShader(L"", backend, false, false) {
+		backend->CreatePixelShader(nullptr, 0u, &m_d3dShader);
+	}
+};
+
+
+CommandReplayer::CommandReplayer(NullRenderBackend *backend, size_t allocatorSize)
+	: m_backend(backend),
+	  m_bucket(allocatorSize),
+	  m_packetSortKey(0ull),
+	  m_previousCommand(nullptr),
+	  m_viewResource(nullptr),
+	  m_numFramesReplayed(0u),
+	  m_numCommandsReplayed(0u),
+	  m_numCommandsSkipped(0u) {
+	D3D11_BUFFER_DESC desc;
+	desc.ByteWidth = 16u;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0u;
+	desc.MiscFlags = 0u;
+	desc.StructureByteStride = 0u;
+	m_backend->CreateBuffer(&desc, nullptr, &m_viewResource);
+}
+
+CommandReplayer::~CommandReplayer() {
+	for (auto iter = m_materialShaders.begin(); iter != m_materialShaders.end(); ++iter) {
+		delete iter->second;
+	}
+	for (auto iter = m_buffers.begin(); iter != m_buffers.end(); ++iter) {
+		ReleaseCOM(iter->second.Buffer);
+	}
+	for (uint i = 0; i < m_retiredBuffers.size(); ++i) {
+		ReleaseCOM(m_retiredBuffers[i]);
+	}
+	for (auto iter = m_shaderResourceViews.begin(); iter != m_shaderResourceViews.end(); ++iter) {
+		ReleaseCOM(iter->second);
+	}
+	for (auto iter = m_samplerStates.begin(); iter != m_samplerStates.end(); ++iter) {
+		ReleaseCOM(iter->second);
+	}
+	for (auto iter = m_instanceStreams.begin(); iter != m_instanceStreams.end(); ++iter) {
+		delete *iter;
+	}
+	ReleaseCOM(m_viewResource);
+}
+
+void CommandReplayer::BeginFrame(uint frameIndex) {
+	m_bucket.Clear();
+
+	// Start every frame from a clean pipeline, like the captured frame did
+	m_graphicsState.Invalidate();
+	m_graphicsState.Stats.Reset();
+	for (auto iter = m_instanceStreams.begin(); iter != m_instanceStreams.end(); ++iter) {
+		(*iter)->InvalidateStartVector();
+	}
+}
+
+void CommandReplayer::BeginPacket(uint64 sortKey) {
+	m_packetSortKey = sortKey;
+	m_previousCommand = nullptr;
+}
+
+void CommandReplayer::ExecuteCommand(uint16 typeId, Common::BinaryReader &payload) {
+	auto iter = m_commandTypes.find(typeId);
+	if (iter != m_commandTypes.end() && iter->second(*this, payload)) {
+		++m_numCommandsReplayed;
+	} else {
+		++m_numCommandsSkipped;
+	}
+}
+
+void CommandReplayer::EndPacket() {
+	m_previousCommand = nullptr;
+}
+
+void CommandReplayer::EndFrame() {
+	CommandContext context(m_backend, &m_blendStates, &m_rasterizerStates, &m_depthStencilStates, &m_graphicsState);
+	m_bucket.Submit(context);
+	m_bucket.Clear();
+
+	++m_numFramesReplayed;
+}
+
+MaterialShader *CommandReplayer::GetMaterialShader(uint32 id) {
+	if (id == kNullResourceId) {
+		return nullptr;
+	}
+
+	auto result = m_materialShaders.try_emplace(id, nullptr);
+	if (result.second) {
+		result.first->second = new ReplayMaterialShader(m_backend);
+	}
+
+	return result.first->second;
+}
+
+ID3D11Buffer *CommandReplayer::GetBuffer(uint32 id, uint mappedSize) {
+	if (id == kNullResourceId) {
+		return nullptr;
+	}
+
+	StandInBuffer empty = {nullptr, 0u};
+	auto result = m_buffers.try_emplace(id, empty);
+	StandInBuffer &standIn = result.first->second;
+	if (!result.second && mappedSize <= standIn.MappedSize) {
+		return standIn.Buffer;
+	}
+
+	// The commands recorded so far this frame can still use the old buffer, so it's kept until the replayer is destroyed
+	if (standIn.Buffer != nullptr) {
+		m_retiredBuffers.push_back(standIn.Buffer);
+	}
+
+	// Only buffers that are mapped need backing memory. See NullRenderBackend
+	D3D11_BUFFER_DESC desc;
+	desc.ByteWidth = mappedSize > 0u ? mappedSize : 16u;
+	desc.Usage = mappedSize > 0u ? D3D11_USAGE_DYNAMIC : D3D11_USAGE_DEFAULT;
+	desc.BindFlags = 0u;
+	desc.CPUAccessFlags = mappedSize > 0u ? D3D11_CPU_ACCESS_WRITE : 0u;
+	desc.MiscFlags = 0u;
+	desc.StructureByteStride = 0u;
+	m_backend->CreateBuffer(&desc, nullptr, &standIn.Buffer);
+	standIn.MappedSize = mappedSize;
+
+	return standIn.Buffer;
+}
+
+ID3D11ShaderResourceView *CommandReplayer::GetShaderResourceView(uint32 id) {
+	if (id == kNullResourceId) {
+		return nullptr;
+	}
+
+	auto result = m_shaderResourceViews.try_emplace(id, nullptr);
+	if (result.second) {
+		m_backend->CreateShaderResourceView(m_viewResource, nullptr, &result.first->second);
+	}
+
+	return result.first->second;
+}
+
+ID3D11SamplerState *CommandReplayer::GetSamplerState(uint32 id) {
+	if (id == kNullResourceId) {
+		return nullptr;
+	}
+
+	auto result = m_samplerStates.try_emplace(id, nullptr);
+	if (result.second) {
+		m_backend->CreateSamplerState(nullptr, &result.first->second);
+	}
+
+	return result.first->second;
+}
+
+Commands::InstanceStream *CommandReplayer::GetInstanceStream(const Commands::InstanceStream &stream) {
+	// There's rarely more than a couple of streams, so a linear search is fine
+	for (auto iter = m_instanceStreams.begin(); iter != m_instanceStreams.end(); ++iter) {
+		Commands::InstanceStream *existing = *iter;
+		if (existing->InstanceBuffer == stream.InstanceBuffer &&
+		    existing->NumVectors == stream.NumVectors &&
+		    existing->StartVectorConstantBuffer == stream.StartVectorConstantBuffer &&
+		    existing->StartVectorSlot == stream.StartVectorSlot) {
+			return existing;
+		}
+	}
+
+	m_instanceStreams.push_back(new Commands::InstanceStream(stream));
+	return m_instanceStreams.back();
+}
+
+} // End of namespace Graphics
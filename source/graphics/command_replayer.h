@@ -0,0 +1,154 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/binary_reader.h"
+#include "common/flat_hash_map.h"
+
+#include "graphics/command_bucket.h"
+#include "graphics/command_capture.h"
+#include "graphics/command_context.h"
+#include "graphics/device_states.h"
+#include "graphics/graphics_state.h"
+#include "graphics/null_render_backend.h"
+
+#include <vector>
+
+
+namespace Graphics {
+
+namespace Commands {
+struct InstanceStream;
+}
+
+/**
+ * Replays a capture on a NullRenderBackend, so the captured frames can be profiled and checked
+ * without a GPU.
+ *
+ * Each command is rebuilt from its payload with the Restore() function of its type, and recorded into
+ * a CommandBucket with the sort key of its packet. The bucket is submitted at the end of every frame,
+ * so the replay goes through the same sort, redundant state filtering, and batching as the captured
+ * frame. The backend's stats and GetGraphicsStateStats() then show what the frame cost.
+ *
+ * The resources of the capture are replaced with stand-ins created on the backend, the first time
+ * their id is seen. The stand-ins have no contents, so a replay only reproduces the calls, not the
+ * image. A buffer that is first seen unmapped, and then mapped, is re-created at the mapped size,
+ * so the frame it happens in can bind it twice. Resource ids are only unique within a capture, so
+ * use a replayer for a single capture
+ *
+ * Command types that aren't registered, and payloads that can't be read, are skipped and counted
+ */
+class CommandReplayer : public CommandReplayExecutor, public CommandResourceResolver {
+public:
+	CommandReplayer(NullRenderBackend *backend, size_t allocatorSize = 1024u * 1024u);
+	~CommandReplayer();
+
+private:
+	typedef bool (*CommandReplayFunctionPtr)(CommandReplayer &replayer, Common::BinaryReader &payload);
+
+	NullRenderBackend *m_backend;
+
+	BlendStateManager m_blendStates;
+	RasterizerStateManager m_rasterizerStates;
+	DepthStencilStateManager m_depthStencilStates;
+	GraphicsState m_graphicsState;
+
+	CommandBucket<uint64> m_bucket;
+	Common::FlatHashMap<uint16, CommandReplayFunctionPtr> m_commandTypes;
+
+	/** The sort key of the packet being replayed */
+	uint64 m_packetSortKey;
+	/** The last command recorded for the current packet, or nullptr if none has been yet */
+	void *m_previousCommand;
+
+	struct StandInBuffer {
+		ID3D11Buffer *Buffer;
+		/** The number of bytes MapDiscard() returns, or 0 if the buffer can't be mapped */
+		uint MappedSize;
+	};
+
+	Common::FlatHashMap<uint32, MaterialShader *> m_materialShaders;
+	Common::FlatHashMap<uint32, StandInBuffer> m_buffers;
+	/** Buffers that were re-created at a larger size. Commands of the current frame can still point to them */
+	std::vector<ID3D11Buffer *> m_retiredBuffers;
+	Common::FlatHashMap<uint32, ID3D11ShaderResourceView *> m_shaderResourceViews;
+	Common::FlatHashMap<uint32, ID3D11SamplerState *> m_samplerStates;
+	std::vector<Commands::InstanceStream *> m_instanceStreams;
+	/** The resource the stand-in shader resource views are created on */
+	ID3D11Buffer *m_viewResource;
+
+	uint m_numFramesReplayed;
+	uint m_numCommandsReplayed;
+	uint m_numCommandsSkipped;
+
+public:
+	/**
+	 * Registers a command type, so it can be replayed. Use the same id the type was captured with
+	 *
+	 * @tparam U         The type of the command. It must have a static Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) function
+	 * @param  typeId    The id the type was registered with for capture
+	 */
+	template <typename U>
+	inline void RegisterCommandType(uint16 typeId) {
+		m_commandTypes[typeId] = &ReplayCommand<U>;
+	}
+
+	/** Chooses whether the bucket executes the commands as an execution stream. See CommandBucket::SetExecutionStreamEnabled() */
+	inline void SetExecutionStreamEnabled(bool enabled) { m_bucket.SetExecutionStreamEnabled(enabled); }
+
+	// CommandReplayExecutor
+	void BeginFrame(uint frameIndex);
+	void BeginPacket(uint64 sortKey);
+	void ExecuteCommand(uint16 typeId, Common::BinaryReader &payload);
+	void EndPacket();
+	void EndFrame();
+
+	// CommandResourceResolver
+	MaterialShader *GetMaterialShader(uint32 id);
+	ID3D11Buffer *GetBuffer(uint32 id, uint mappedSize);
+	ID3D11ShaderResourceView *GetShaderResourceView(uint32 id);
+	ID3D11SamplerState *GetSamplerState(uint32 id);
+	Commands::InstanceStream *GetInstanceStream(const Commands::InstanceStream &stream);
+
+	/** The binds made and skipped by the frame last replayed */
+	inline const GraphicsStateStats &GetGraphicsStateStats() const { return m_graphicsState.Stats; }
+	inline uint GetNumFramesReplayed() const { return m_numFramesReplayed; }
+	inline uint GetNumCommandsReplayed() const { return m_numCommandsReplayed; }
+	/** The number of commands that weren't replayed, because their type wasn't registered, or their payload couldn't be read */
+	inline uint GetNumCommandsSkipped() const { return m_numCommandsSkipped; }
+
+private:
+	/**
+	 * Restores a command of type U from its payload, and records it into the bucket. The command is
+	 * restored into a temporary first, so a payload that can't be read never reaches the bucket
+	 */
+	template <typename U>
+	static bool ReplayCommand(CommandReplayer &replayer, Common::BinaryReader &payload) {
+		U command;
+		if (!U::Restore(&command, payload, replayer) || !payload.IsAtEnd()) {
+			return false;
+		}
+
+		U *recorded;
+		if (replayer.m_previousCommand == nullptr) {
+			recorded = replayer.m_bucket.template AddCommand<U>(replayer.m_packetSortKey);
+		} else {
+			recorded = replayer.m_bucket.template AppendCommand<U>(replayer.m_previousCommand);
+		}
+
+		*recorded = command;
+		replayer.m_previousCommand = recorded;
+		return true;
+	}
+
+	// Not implemented
+	CommandReplayer(const CommandReplayer &);
+	CommandReplayer &operator=(const CommandReplayer &);
+};
+
+} // End of namespace Graphics
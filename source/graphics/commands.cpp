@@ -6,6 +6,8 @@
 
 #include "graphics/commands.h"
 
+#include "graphics/command_bucket.h"
+#include "graphics/command_replayer.h"
 #include "graphics/d3d_util.h"
 #include "graphics/graphics_state.h"
 
@@ -16,57 +18,189 @@ namespace Graphics {
 
 namespace Commands {
 
-void DrawCommandBase::CheckAndSubmitChangedState(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState) const {
+// Draw commands are recorded every frame, so make sure they stay free to dispose
+static_assert(IsTriviallyDisposable<Draw>::value, "Draw must be trivially destructible");
+static_assert(IsTriviallyDisposable<DrawIndexed>::value, "DrawIndexed must be trivially destructible");
+static_assert(IsTriviallyDisposable<DrawIndexedInstanced>::value, "DrawIndexedInstanced must be trivially destructible");
+
+/**
+ * Calls bindFunc(startSlot, numSlots) once for each contiguous run of set bits in dirtyMask
+ *
+ * @return    The number of times bindFunc was called
+ */
+template <typename BindFunc>
+static inline uint BindDirtySlotRanges(uint dirtyMask, BindFunc bindFunc) {
+	uint numCalls = 0u;
+	uint slot = 0u;
+
+	while (dirtyMask != 0u) {
+		// Skip to the start of the next run
+		while ((dirtyMask & 1u) == 0u) {
+			dirtyMask >>= 1;
+			++slot;
+		}
+
+		uint startSlot = slot;
+		while ((dirtyMask & 1u) != 0u) {
+			dirtyMask >>= 1;
+			++slot;
+		}
+
+		bindFunc(startSlot, slot - startSlot);
+		++numCalls;
+	}
+
+	return numCalls;
+}
+
+void RegisterCommandCaptureTypes() {
+	RegisterCaptureCommandType<Draw>(COMMAND_TYPE_DRAW);
+	RegisterCaptureCommandType<DrawIndexed>(COMMAND_TYPE_DRAW_INDEXED);
+	RegisterCaptureCommandType<DrawIndexedInstanced>(COMMAND_TYPE_DRAW_INDEXED_INSTANCED);
+	RegisterCaptureCommandType<BindConstantBufferToVS>(COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_VS);
+	RegisterCaptureCommandType<BindConstantBufferToPS>(COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_PS);
+}
+
+void RegisterCommandReplayTypes(CommandReplayer *replayer) {
+	replayer->RegisterCommandType<Draw>(COMMAND_TYPE_DRAW);
+	replayer->RegisterCommandType<DrawIndexed>(COMMAND_TYPE_DRAW_INDEXED);
+	replayer->RegisterCommandType<DrawIndexedInstanced>(COMMAND_TYPE_DRAW_INDEXED_INSTANCED);
+	replayer->RegisterCommandType<BindConstantBufferToVS>(COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_VS);
+	replayer->RegisterCommandType<BindConstantBufferToPS>(COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_PS);
+}
+
+void BindConstantBufferToVSSlot(const CommandContext &context, ID3D11Buffer *buffer, uint slot) {
+	assert(slot < GraphicsState::kMaxConstantBufferSlots);
+
+	if (context.CurrentGraphicsState->VSConstantBuffers[slot] == buffer) {
+		context.CurrentGraphicsState->Stats.AddSkippedBinds(StateBindType::CONSTANT_BUFFERS, 1u);
+		return;
+	}
+
+	context.Backend->VSSetConstantBuffers(slot, 1u, &buffer);
+
+	// Update the current graphics state
+	context.CurrentGraphicsState->VSConstantBuffers[slot] = buffer;
+	context.CurrentGraphicsState->Stats.AddBinds(StateBindType::CONSTANT_BUFFERS, 1u);
+}
+
+bool DrawCommandBase::HasSameState(const DrawCommandBase &other) const {
+	if (m_materialShader != other.m_materialShader ||
+		m_numVertexBuffers != other.m_numVertexBuffers ||
+		m_indexBuffer != other.m_indexBuffer ||
+		m_indexBufferFormat != other.m_indexBufferFormat ||
+		m_textureSRVMask != other.m_textureSRVMask ||
+		m_textureSamplerMask != other.m_textureSamplerMask ||
+		m_blendState != other.m_blendState ||
+		m_sampleMask != other.m_sampleMask ||
+		m_rasterizerState != other.m_rasterizerState ||
+		m_depthStencilState != other.m_depthStencilState) {
+		return false;
+	}
+
+	for (uint i = 0; i < m_numVertexBuffers; ++i) {
+		if (m_vertexBuffers[i] != other.m_vertexBuffers[i] || m_vertexBufferStrides[i] != other.m_vertexBufferStrides[i]) {
+			return false;
+		}
+	}
+
+	// The masks are equal, so only the slots in use have to be compared
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSRVMask & (1u << slot)) != 0u && m_textureSRVs[slot] != other.m_textureSRVs[slot]) {
+			return false;
+		}
+		if ((m_textureSamplerMask & (1u << slot)) != 0u && m_textureSamplers[slot] != other.m_textureSamplers[slot]) {
+			return false;
+		}
+	}
+
+	return m_blendFactor[0] == other.m_blendFactor[0] &&
+	       m_blendFactor[1] == other.m_blendFactor[1] &&
+	       m_blendFactor[2] == other.m_blendFactor[2] &&
+	       m_blendFactor[3] == other.m_blendFactor[3];
+}
+
+void DrawCommandBase::CheckAndSubmitChangedState(const CommandContext &commandContext) const {
+	RenderBackend *backend = commandContext.Backend;
+	GraphicsState *currentGraphicsState = commandContext.CurrentGraphicsState;
+	GraphicsStateStats &stats = currentGraphicsState->Stats;
+
 	// Check material shader
 	if (currentGraphicsState->MaterialShader != m_materialShader) {
-		m_materialShader->BindToPipeline(context);
+		m_materialShader->BindToPipeline(backend);
 
 		// Update the current graphics state
 		currentGraphicsState->MaterialShader = m_materialShader;
+		stats.AddBinds(StateBindType::MATERIAL_SHADER, 1u);
+	} else {
+		stats.AddSkippedBinds(StateBindType::MATERIAL_SHADER, 1u);
 	}
 	
 	// Check vertex buffers
 	if (m_numVertexBuffers == 1 && currentGraphicsState->VertexBuffers[0] != m_vertexBuffers[0]) {
 		uint offsets = 0;
-		context->IASetVertexBuffers(0, 1u, m_vertexBuffers, m_vertexBufferStrides, &offsets);
+		backend->IASetVertexBuffers(0, 1u, m_vertexBuffers, m_vertexBufferStrides, &offsets);
 
 		// Update the current graphics state
 		currentGraphicsState->VertexBuffers[0] = m_vertexBuffers[0];
+		stats.AddBinds(StateBindType::VERTEX_BUFFERS, 1u);
 	} else if (m_numVertexBuffers == 2 && (currentGraphicsState->VertexBuffers[0] != m_vertexBuffers[0] || currentGraphicsState->VertexBuffers[1] != m_vertexBuffers[1])) {
 		uint offsets[] = {0, 0};
-		context->IASetVertexBuffers(0, 2u, m_vertexBuffers, m_vertexBufferStrides, offsets);
+		backend->IASetVertexBuffers(0, 2u, m_vertexBuffers, m_vertexBufferStrides, offsets);
 
 		// Update the current graphics state
 		memcpy(currentGraphicsState->VertexBuffers, m_vertexBuffers, sizeof(ID3D11Buffer *) * 2ull);
+		stats.AddBinds(StateBindType::VERTEX_BUFFERS, 1u);
+	} else if (m_numVertexBuffers != 0) {
+		stats.AddSkippedBinds(StateBindType::VERTEX_BUFFERS, 1u);
 	}
 
 	// Check index buffer
 	if (m_indexBuffer != currentGraphicsState->IndexBuffer) {
-		context->IASetIndexBuffer(m_indexBuffer, m_indexBufferFormat, 0u);
+		backend->IASetIndexBuffer(m_indexBuffer, m_indexBufferFormat, 0u);
 
 		// Update the current graphics state
 		currentGraphicsState->IndexBuffer = m_indexBuffer;
+		stats.AddBinds(StateBindType::INDEX_BUFFER, 1u);
+	} else {
+		stats.AddSkippedBinds(StateBindType::INDEX_BUFFER, 1u);
 	}
 
-	// TODO: Do an element by element search and replace. Preferably optimizing to as few calls as possible (by grouping textures into an array)
-	if (m_textureSRVs.size() != 0 && (currentGraphicsState->TextureSRVs.size() == 0 || m_textureSRVs.begin()->second != currentGraphicsState->TextureSRVs.begin()->second)) {
-		for (auto iter = m_textureSRVs.begin(); iter != m_textureSRVs.end(); ++iter) {
-			context->PSSetShaderResources(iter->first, 1u, &iter->second);
+	// Check textures slot by slot, then bind each run of changed slots with a single call
+	uint dirtySRVs = 0u;
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSRVMask & (1u << slot)) == 0u) {
+			continue;
 		}
 
-		// Update the current graphics state
-		currentGraphicsState->TextureSRVs = m_textureSRVs;
+		if (currentGraphicsState->TextureSRVs[slot] != m_textureSRVs[slot]) {
+			currentGraphicsState->TextureSRVs[slot] = m_textureSRVs[slot];
+			dirtySRVs |= 1u << slot;
+		} else {
+			stats.AddSkippedBinds(StateBindType::TEXTURE_SRVS, 1u);
+		}
 	}
-
-	// TODO: Do an element by element search and replace. Preferably optimizing to as few calls as possible (by grouping samplers into an array)
-	if (m_textureSamplers.size() != 0 && (currentGraphicsState->TextureSamplers.size() == 0 || m_textureSamplers.begin()->second != currentGraphicsState->TextureSamplers.begin()->second)) {
-		for (auto iter = m_textureSamplers.begin(); iter != m_textureSamplers.end(); ++iter) {
-			context->PSSetSamplers(iter->first, 1u, &iter->second);
+	stats.AddBinds(StateBindType::TEXTURE_SRVS, BindDirtySlotRanges(dirtySRVs, [backend, currentGraphicsState](uint startSlot, uint numSlots) {
+		backend->PSSetShaderResources(startSlot, numSlots, &currentGraphicsState->TextureSRVs[startSlot]);
+	}));
+
+	// Check samplers the same way
+	uint dirtySamplers = 0u;
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSamplerMask & (1u << slot)) == 0u) {
+			continue;
 		}
 
-		// Update the current graphics state
-		currentGraphicsState->TextureSamplers = m_textureSamplers;
+		if (currentGraphicsState->TextureSamplers[slot] != m_textureSamplers[slot]) {
+			currentGraphicsState->TextureSamplers[slot] = m_textureSamplers[slot];
+			dirtySamplers |= 1u << slot;
+		} else {
+			stats.AddSkippedBinds(StateBindType::TEXTURE_SAMPLERS, 1u);
+		}
 	}
+	stats.AddBinds(StateBindType::TEXTURE_SAMPLERS, BindDirtySlotRanges(dirtySamplers, [backend, currentGraphicsState](uint startSlot, uint numSlots) {
+		backend->PSSetSamplers(startSlot, numSlots, &currentGraphicsState->TextureSamplers[startSlot]);
+	}));
 
 	// Check blend state
 	if (m_blendState != currentGraphicsState->BlendState ||
@@ -75,36 +209,141 @@ void DrawCommandBase::CheckAndSubmitChangedState(ID3D11Device *device, ID3D11Dev
 		m_blendFactor[2] != currentGraphicsState->BlendFactor[2] ||
 		m_blendFactor[3] != currentGraphicsState->BlendFactor[3] ||
 		m_sampleMask != currentGraphicsState->SampleMask) {
-		context->OMSetBlendState(blendStateManager->GetD3DState(m_blendState), m_blendFactor, m_sampleMask);
+		backend->OMSetBlendState(commandContext.BlendStates->GetD3DState(m_blendState), m_blendFactor, m_sampleMask);
 
 		// Update the current graphics state
 		currentGraphicsState->BlendState = m_blendState;
 		memcpy(currentGraphicsState->BlendFactor, m_blendFactor, sizeof(float) * 4ull);
 		currentGraphicsState->SampleMask = m_sampleMask;
+		stats.AddBinds(StateBindType::BLEND_STATE, 1u);
+	} else {
+		stats.AddSkippedBinds(StateBindType::BLEND_STATE, 1u);
 	}
 
 	// Check rasterizer state
 	if (m_rasterizerState != currentGraphicsState->RasterizerState) {
-		context->RSSetState(rasterizerStateManager->GetD3DState(m_rasterizerState));
+		backend->RSSetState(commandContext.RasterizerStates->GetD3DState(m_rasterizerState));
 
 		// Update the current graphics state
 		currentGraphicsState->RasterizerState = m_rasterizerState;
+		stats.AddBinds(StateBindType::RASTERIZER_STATE, 1u);
+	} else {
+		stats.AddSkippedBinds(StateBindType::RASTERIZER_STATE, 1u);
 	}
 
 	// Check depth stencil state
 	if (m_depthStencilState != currentGraphicsState->DepthStencilState) {
-		context->OMSetDepthStencilState(depthStencilStateManager->GetD3DState(m_depthStencilState), 0u);
+		backend->OMSetDepthStencilState(commandContext.DepthStencilStates->GetD3DState(m_depthStencilState), 0u);
 
 		// Update the current graphics state
 		currentGraphicsState->DepthStencilState = m_depthStencilState;
+		stats.AddBinds(StateBindType::DEPTH_STENCIL_STATE, 1u);
+	} else {
+		stats.AddSkippedBinds(StateBindType::DEPTH_STENCIL_STATE, 1u);
 	}
 }
 
-void Draw::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void DrawCommandBase::CaptureState(CommandCapture &capture) const {
+	capture.WriteResource(m_materialShader);
+
+	capture.Write(static_cast<uint8>(m_numVertexBuffers));
+	for (uint i = 0; i < m_numVertexBuffers; ++i) {
+		capture.WriteResource(m_vertexBuffers[i]);
+		capture.Write(static_cast<uint32>(m_vertexBufferStrides[i]));
+	}
+	capture.WriteResource(m_indexBuffer);
+	capture.Write(static_cast<uint32>(m_indexBufferFormat));
+
+	// Only the slots that are in use are written
+	capture.Write(m_textureSRVMask);
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSRVMask & (1u << slot)) != 0u) {
+			capture.WriteResource(m_textureSRVs[slot]);
+		}
+	}
+	capture.Write(m_textureSamplerMask);
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSamplerMask & (1u << slot)) != 0u) {
+			capture.WriteResource(m_textureSamplers[slot]);
+		}
+	}
+
+	capture.Write(static_cast<uint32>(m_blendState));
+	capture.Write(m_blendFactor);
+	capture.Write(static_cast<uint32>(m_sampleMask));
+	capture.Write(static_cast<uint32>(m_rasterizerState));
+	capture.Write(static_cast<uint32>(m_depthStencilState));
+}
+
+bool DrawCommandBase::RestoreState(Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	uint32 materialShaderId = kNullResourceId;
+	payload.Read(&materialShaderId);
+	m_materialShader = resolver.GetMaterialShader(materialShaderId);
+
+	uint8 numVertexBuffers = 0u;
+	payload.Read(&numVertexBuffers);
+	if (numVertexBuffers > 2u) {
+		return false;
+	}
+	m_numVertexBuffers = numVertexBuffers;
+	for (uint i = 0; i < m_numVertexBuffers; ++i) {
+		uint32 bufferId = kNullResourceId;
+		payload.Read(&bufferId);
+		payload.Read(&m_vertexBufferStrides[i]);
+		m_vertexBuffers[i] = resolver.GetBuffer(bufferId, 0u);
+	}
+
+	uint32 indexBufferId = kNullResourceId;
+	uint32 indexBufferFormat = 0u;
+	payload.Read(&indexBufferId);
+	payload.Read(&indexBufferFormat);
+	m_indexBuffer = resolver.GetBuffer(indexBufferId, 0u);
+	m_indexBufferFormat = static_cast<DXGI_FORMAT>(indexBufferFormat);
+
+	payload.Read(&m_textureSRVMask);
+	if ((m_textureSRVMask >> kMaxTextureBindings) != 0u) {
+		return false;
+	}
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSRVMask & (1u << slot)) != 0u) {
+			uint32 srvId = kNullResourceId;
+			payload.Read(&srvId);
+			m_textureSRVs[slot] = resolver.GetShaderResourceView(srvId);
+		}
+	}
+	payload.Read(&m_textureSamplerMask);
+	if ((m_textureSamplerMask >> kMaxTextureBindings) != 0u) {
+		return false;
+	}
+	for (uint slot = 0; slot < kMaxTextureBindings; ++slot) {
+		if ((m_textureSamplerMask & (1u << slot)) != 0u) {
+			uint32 samplerId = kNullResourceId;
+			payload.Read(&samplerId);
+			m_textureSamplers[slot] = resolver.GetSamplerState(samplerId);
+		}
+	}
+
+	uint32 blendState = 0u;
+	uint32 rasterizerState = 0u;
+	uint32 depthStencilState = 0u;
+	payload.Read(&blendState);
+	payload.Read(&m_blendFactor);
+	payload.Read(&m_sampleMask);
+	payload.Read(&rasterizerState);
+	payload.Read(&depthStencilState);
+	m_blendState = static_cast<BlendState>(blendState);
+	m_rasterizerState = static_cast<RasterizerState>(rasterizerState);
+	m_depthStencilState = static_cast<DepthStencilState>(depthStencilState);
+
+	// Every draw binds a material shader, so a null one means the payload is corrupt
+	return !payload.HasError() && m_materialShader != nullptr;
+}
+
+void Draw::Execute(const CommandContext &context, const void *data) {
 	const Draw *command = reinterpret_cast<const Draw *>(data);
 
-	command->CheckAndSubmitChangedState(device, context, blendStateManager, rasterizerStateManager, depthStencilStateManager, currentGraphicsState);
-	context->Draw(command->m_vertexCount, command->m_vertexStart);
+	command->CheckAndSubmitChangedState(context);
+	context.Backend->Draw(command->m_vertexCount, command->m_vertexStart);
 }
 
 void Draw::Dispose(const void *data) {
@@ -113,11 +352,31 @@ void Draw::Dispose(const void *data) {
 	command->~Draw();
 }
 
-void DrawIndexed::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void Draw::Capture(const void *data, CommandCapture &capture) {
+	const Draw *command = reinterpret_cast<const Draw *>(data);
+
+	command->CaptureState(capture);
+	capture.Write(static_cast<uint32>(command->m_vertexCount));
+	capture.Write(static_cast<uint32>(command->m_vertexStart));
+}
+
+bool Draw::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	Draw *command = reinterpret_cast<Draw *>(data);
+
+	if (!command->RestoreState(payload, resolver)) {
+		return false;
+	}
+	payload.Read(&command->m_vertexCount);
+	payload.Read(&command->m_vertexStart);
+
+	return !payload.HasError();
+}
+
+void DrawIndexed::Execute(const CommandContext &context, const void *data) {
 	const DrawIndexed *command = reinterpret_cast<const DrawIndexed *>(data);
 
-	command->CheckAndSubmitChangedState(device, context, blendStateManager, rasterizerStateManager, depthStencilStateManager, currentGraphicsState);
-	context->DrawIndexed(command->m_indexCount, command->m_indexStart, command->m_vertexStart);
+	command->CheckAndSubmitChangedState(context);
+	context.Backend->DrawIndexed(command->m_indexCount, command->m_indexStart, command->m_vertexStart);
 }
 
 void DrawIndexed::Dispose(const void *data) {
@@ -126,11 +385,33 @@ void DrawIndexed::Dispose(const void *data) {
 	command->~DrawIndexed();
 }
 
-void DrawIndexedInstanced::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void DrawIndexed::Capture(const void *data, CommandCapture &capture) {
+	const DrawIndexed *command = reinterpret_cast<const DrawIndexed *>(data);
+
+	command->CaptureState(capture);
+	capture.Write(static_cast<uint32>(command->m_indexCount));
+	capture.Write(static_cast<uint32>(command->m_indexStart));
+	capture.Write(static_cast<uint32>(command->m_vertexStart));
+}
+
+bool DrawIndexed::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	DrawIndexed *command = reinterpret_cast<DrawIndexed *>(data);
+
+	if (!command->RestoreState(payload, resolver)) {
+		return false;
+	}
+	payload.Read(&command->m_indexCount);
+	payload.Read(&command->m_indexStart);
+	payload.Read(&command->m_vertexStart);
+
+	return !payload.HasError();
+}
+
+void DrawIndexedInstanced::Execute(const CommandContext &context, const void *data) {
 	const DrawIndexedInstanced *command = reinterpret_cast<const DrawIndexedInstanced *>(data);
 
-	command->CheckAndSubmitChangedState(device, context, blendStateManager, rasterizerStateManager, depthStencilStateManager, currentGraphicsState);
-	context->DrawIndexedInstanced(command->m_indexCountPerInstance, command->m_instanceCount, command->m_indexStart, command->m_vertexStart, command->m_instanceStart);
+	command->CheckAndSubmitChangedState(context);
+	context.Backend->DrawIndexedInstanced(command->m_indexCountPerInstance, command->m_instanceCount, command->m_indexStart, command->m_vertexStart, command->m_instanceStart);
 }
 
 void DrawIndexedInstanced::Dispose(const void *data) {
@@ -139,26 +420,98 @@ void DrawIndexedInstanced::Dispose(const void *data) {
 	command->~DrawIndexedInstanced();
 }
 
-void BindConstantBufferToVS::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void DrawIndexedInstanced::Capture(const void *data, CommandCapture &capture) {
+	const DrawIndexedInstanced *command = reinterpret_cast<const DrawIndexedInstanced *>(data);
+
+	command->CaptureState(capture);
+	capture.Write(static_cast<uint32>(command->m_indexCountPerInstance));
+	capture.Write(static_cast<uint32>(command->m_instanceCount));
+	capture.Write(static_cast<uint32>(command->m_instanceStart));
+	capture.Write(static_cast<uint32>(command->m_indexStart));
+	capture.Write(static_cast<uint32>(command->m_vertexStart));
+}
+
+bool DrawIndexedInstanced::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	DrawIndexedInstanced *command = reinterpret_cast<DrawIndexedInstanced *>(data);
+
+	if (!command->RestoreState(payload, resolver)) {
+		return false;
+	}
+	payload.Read(&command->m_indexCountPerInstance);
+	payload.Read(&command->m_instanceCount);
+	payload.Read(&command->m_instanceStart);
+	payload.Read(&command->m_indexStart);
+	payload.Read(&command->m_vertexStart);
+
+	return !payload.HasError();
+}
+
+void BindConstantBufferToVS::Execute(const CommandContext &context, const void *data) {
 	const BindConstantBufferToVS *command = reinterpret_cast<const BindConstantBufferToVS *>(data);
-	
-	context->VSSetConstantBuffers(command->m_slot, 1u, &command->m_constantBuffer);
+
+	BindConstantBufferToVSSlot(context, command->m_constantBuffer, command->m_slot);
 }
 
 void BindConstantBufferToVS::Dispose(const void *data) {
 	// No Op since class is a POS
 }
 
-void BindConstantBufferToPS::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void BindConstantBufferToVS::Capture(const void *data, CommandCapture &capture) {
+	const BindConstantBufferToVS *command = reinterpret_cast<const BindConstantBufferToVS *>(data);
+
+	capture.WriteResource(command->m_constantBuffer);
+	capture.Write(static_cast<uint32>(command->m_slot));
+}
+
+bool BindConstantBufferToVS::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	BindConstantBufferToVS *command = reinterpret_cast<BindConstantBufferToVS *>(data);
+
+	uint32 bufferId = kNullResourceId;
+	payload.Read(&bufferId);
+	payload.Read(&command->m_slot);
+	command->m_constantBuffer = resolver.GetBuffer(bufferId, 0u);
+
+	return !payload.HasError() && command->m_slot < GraphicsState::kMaxConstantBufferSlots;
+}
+
+void BindConstantBufferToPS::Execute(const CommandContext &context, const void *data) {
 	const BindConstantBufferToPS *command = reinterpret_cast<const BindConstantBufferToPS *>(data);
+	assert(command->m_slot < GraphicsState::kMaxConstantBufferSlots);
+
+	if (context.CurrentGraphicsState->PSConstantBuffers[command->m_slot] == command->m_constantBuffer) {
+		context.CurrentGraphicsState->Stats.AddSkippedBinds(StateBindType::CONSTANT_BUFFERS, 1u);
+		return;
+	}
 
-	context->PSSetConstantBuffers(command->m_slot, 1u, &command->m_constantBuffer);
+	context.Backend->PSSetConstantBuffers(command->m_slot, 1u, &command->m_constantBuffer);
+
+	// Update the current graphics state
+	context.CurrentGraphicsState->PSConstantBuffers[command->m_slot] = command->m_constantBuffer;
+	context.CurrentGraphicsState->Stats.AddBinds(StateBindType::CONSTANT_BUFFERS, 1u);
 }
 
 void BindConstantBufferToPS::Dispose(const void *data) {
 	// No Op since class is a POS
 }
 
+void BindConstantBufferToPS::Capture(const void *data, CommandCapture &capture) {
+	const BindConstantBufferToPS *command = reinterpret_cast<const BindConstantBufferToPS *>(data);
+
+	capture.WriteResource(command->m_constantBuffer);
+	capture.Write(static_cast<uint32>(command->m_slot));
+}
+
+bool BindConstantBufferToPS::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	BindConstantBufferToPS *command = reinterpret_cast<BindConstantBufferToPS *>(data);
+
+	uint32 bufferId = kNullResourceId;
+	payload.Read(&bufferId);
+	payload.Read(&command->m_slot);
+	command->m_constantBuffer = resolver.GetBuffer(bufferId, 0u);
+
+	return !payload.HasError() && command->m_slot < GraphicsState::kMaxConstantBufferSlots;
+}
+
 } // End of namespace Commands
 
 } // End of namespace Graphics
@@ -6,16 +6,19 @@
 
 #pragma once
 
+#include "common/halfling_sys.h"
 #include "common/typedefs.h"
 
+#include "graphics/command_capture.h"
+#include "graphics/command_context.h"
 #include "graphics/device_states.h"
 #include "graphics/d3d_util.h"
 #include "graphics/graphics_state.h"
+#include "graphics/render_backend.h"
 
 #include <d3d11.h>
 
 #include <cassert>
-#include <map>
 
 
 struct ID3D11Device;
@@ -26,23 +29,53 @@ struct ID3D11Buffer;
 
 namespace Graphics {
 
+class CommandReplayer;
+
 namespace Commands {
 
+/** The ids the built-in commands are captured with. See CommandCapture */
+enum CommandTypeId : uint16 {
+	COMMAND_TYPE_DRAW = 1,
+	COMMAND_TYPE_DRAW_INDEXED = 2,
+	COMMAND_TYPE_DRAW_INDEXED_INSTANCED = 3,
+	COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_VS = 4,
+	COMMAND_TYPE_BIND_CONSTANT_BUFFER_TO_PS = 5,
+	/**
+	 * The first id for the application's types. Every instantiation of MapDataToConstantBuffer<T>
+	 * and DrawIndexedInstanceable<T> has a payload layout of its own, so each needs its own id
+	 */
+	COMMAND_TYPE_USER = 256
+};
+
+/**
+ * Registers the built-in commands with the command capture. MapDataToConstantBuffer<T> and
+ * DrawIndexedInstanceable<T> have to be registered separately for each T, with ids from COMMAND_TYPE_USER up
+ */
+void RegisterCommandCaptureTypes();
+/** Registers the built-in commands with a replayer, with the same ids RegisterCommandCaptureTypes() uses */
+void RegisterCommandReplayTypes(CommandReplayer *replayer);
+
+/** Binds 'buffer' to a vertex shader constant buffer slot, unless it's already bound there */
+void BindConstantBufferToVSSlot(const CommandContext &context, ID3D11Buffer *buffer, uint slot);
+
 template <typename Derived>
 class CommandBase {
 public:
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context, 
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, 
-	                    GraphicsState *currentGraphicsState, 
-	                    const void *data) {
-		static_cast<Derived *>(this)->Execute(device, context, data);
+	static void Execute(const CommandContext &context, const void *data) {
+		Derived::Execute(context, data);
 	}
 
 	static void Dispose(const void *data) {
-		static_cast<Derived *>(this)->Dispose(data);
+		Derived::Dispose(data);
 	}
 };
 
+/**
+ * The state shared by all the draw commands
+ *
+ * Everything is stored inline, so draw commands are trivially destructible and
+ * never touch the heap. See IsTriviallyDisposable
+ */
 class DrawCommandBase {
 public:
 	DrawCommandBase()
@@ -50,6 +83,8 @@ public:
 			  m_numVertexBuffers(0u),
 			  m_indexBuffer(nullptr),
 			  m_indexBufferFormat(DXGI_FORMAT_R32_UINT),
+			  m_textureSRVMask(0u),
+			  m_textureSamplerMask(0u),
 			  m_blendState(BlendState::BLEND_DISABLED),
 			  m_sampleMask(0xFFFFFFFF),
 			  m_rasterizerState(RasterizerState::CULL_BACKFACES),
@@ -67,6 +102,10 @@ public:
 		m_blendFactor[3] = 1.0f;
 	}
 
+	/** The number of texture and sampler slots a draw command can bind */
+	static const uint kMaxTextureBindings = 8u;
+	static_assert(kMaxTextureBindings <= GraphicsState::kMaxTextureSlots && kMaxTextureBindings <= GraphicsState::kMaxSamplerSlots, "GraphicsState can't track all the texture bindings of a draw command");
+
 protected:
 	MaterialShader *m_materialShader;
 
@@ -76,8 +115,11 @@ protected:
 	ID3D11Buffer *m_indexBuffer;
 	DXGI_FORMAT m_indexBufferFormat;
 
-	std::map<uint, ID3D11ShaderResourceView *> m_textureSRVs;
-	std::map<uint, ID3D11SamplerState *> m_textureSamplers;
+	// Only the slots with their bit set in the matching mask are valid
+	ID3D11ShaderResourceView *m_textureSRVs[kMaxTextureBindings];
+	ID3D11SamplerState *m_textureSamplers[kMaxTextureBindings];
+	uint16 m_textureSRVMask;
+	uint16 m_textureSamplerMask;
 
 	BlendState m_blendState;
 	float m_blendFactor[4];
@@ -121,8 +163,25 @@ public:
 		m_indexBufferFormat = format;
 	}
 
-	inline void SetTextureSRV(ID3D11ShaderResourceView *srv, uint slot) { m_textureSRVs[slot] = srv; }
-	inline void SetTextureSampler(ID3D11SamplerState *sampler, uint slot) { m_textureSamplers[slot] = sampler; }
+	inline void SetTextureSRV(ID3D11ShaderResourceView *srv, uint slot) {
+		// Materials with more textures are rejected when they're loaded, so this should never fire
+		if (slot >= kMaxTextureBindings) {
+			AssertMsg(false, L"Texture slot " << slot << L" is out of range. A draw command can bind " << kMaxTextureBindings << L" textures");
+			return;
+		}
+
+		m_textureSRVs[slot] = srv;
+		m_textureSRVMask |= static_cast<uint16>(1u << slot);
+	}
+	inline void SetTextureSampler(ID3D11SamplerState *sampler, uint slot) {
+		if (slot >= kMaxTextureBindings) {
+			AssertMsg(false, L"Sampler slot " << slot << L" is out of range. A draw command can bind " << kMaxTextureBindings << L" samplers");
+			return;
+		}
+
+		m_textureSamplers[slot] = sampler;
+		m_textureSamplerMask |= static_cast<uint16>(1u << slot);
+	}
 
 	inline void SetBlendState(BlendState blendState, float *blendFactor, uint sampleMask) {
 		m_blendState = blendState;
@@ -137,10 +196,15 @@ public:
 	inline void SetRasterizerState(RasterizerState rasterizerState) { m_rasterizerState = rasterizerState; }
 	inline void SetDepthStencilState(DepthStencilState depthStencilState) { m_depthStencilState = depthStencilState; }
 
+	/** Whether the two commands bind exactly the same state. Unused texture slots are ignored */
+	bool HasSameState(const DrawCommandBase &other) const;
+
 protected:
-	void CheckAndSubmitChangedState(ID3D11Device *device, ID3D11DeviceContext *context, 
-	                                BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, 
-	                                GraphicsState *currentGraphicsState) const;
+	void CheckAndSubmitChangedState(const CommandContext &context) const;
+	/** Writes the state to a capture, replacing the resource pointers with ids */
+	void CaptureState(CommandCapture &capture) const;
+	/** Reads the state written by CaptureState() */
+	bool RestoreState(Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 
@@ -159,12 +223,11 @@ public:
 	inline void SetVertexCount(uint vertexCount) { m_vertexCount = vertexCount; }
 	inline void SetVertexStart(uint vertexStart) { m_vertexStart = vertexStart; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context, 
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, 
-	                    GraphicsState *currentGraphicsState, 
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 
@@ -186,12 +249,11 @@ public:
 	inline void SetIndexStart(uint indexStart) { m_indexStart = indexStart; }
 	inline void SetVertexStart(uint vertexStart) { m_vertexStart = vertexStart; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context,
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager,
-	                    GraphicsState *currentGraphicsState,
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 
@@ -222,12 +284,11 @@ public:
 	inline void SetIndexStart(uint indexStart) { m_indexStart = indexStart; }
 	inline void SetVertexStart(uint vertexStart) { m_vertexStart = vertexStart; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context,
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager,
-	                    GraphicsState *currentGraphicsState,
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 template <typename T>
@@ -245,28 +306,25 @@ public:
 	inline void SetConstantBuffer(ID3D11Buffer *buffer) { m_constantBuffer = buffer; }
 	inline void SetData(T &data) { m_constantBufferData = data; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context,
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager,
-	                    GraphicsState *currentGraphicsState,
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 template <typename T>
-void Graphics::Commands::MapDataToConstantBuffer<T>::Execute(ID3D11Device *device, ID3D11DeviceContext *context, BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager, GraphicsState *currentGraphicsState, const void *data) {
+void Graphics::Commands::MapDataToConstantBuffer<T>::Execute(const CommandContext &context, const void *data) {
 	const MapDataToConstantBuffer *command = reinterpret_cast<const MapDataToConstantBuffer *>(data);
 
 	// Make sure the buffer even exists
 	assert(command->m_constantBuffer != nullptr);
 
-	// Map the data
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-
 	// Lock the constant buffer so it can be written to.
-	HR(context->Map(command->m_constantBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource));
-	memcpy(mappedResource.pData, &command->m_constantBufferData, sizeof(command->m_constantBufferData));
-	context->Unmap(command->m_constantBuffer, 0);
+	void *mappedData = context.Backend->MapDiscard(command->m_constantBuffer);
+	assert(mappedData != nullptr);
+	memcpy(mappedData, &command->m_constantBufferData, sizeof(command->m_constantBufferData));
+	context.Backend->Unmap(command->m_constantBuffer);
 }
 
 template <typename T>
@@ -274,6 +332,26 @@ void Graphics::Commands::MapDataToConstantBuffer<T>::Dispose(const void *data) {
 	// No Op since class is a POS
 }
 
+template <typename T>
+void Graphics::Commands::MapDataToConstantBuffer<T>::Capture(const void *data, CommandCapture &capture) {
+	const MapDataToConstantBuffer *command = reinterpret_cast<const MapDataToConstantBuffer *>(data);
+
+	capture.WriteResource(command->m_constantBuffer);
+	capture.Write(command->m_constantBufferData);
+}
+
+template <typename T>
+bool Graphics::Commands::MapDataToConstantBuffer<T>::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	MapDataToConstantBuffer *command = reinterpret_cast<MapDataToConstantBuffer *>(data);
+
+	uint32 bufferId;
+	payload.Read(&bufferId);
+	payload.Read(&command->m_constantBufferData);
+
+	command->m_constantBuffer = resolver.GetBuffer(bufferId, sizeof(T));
+	return !payload.HasError() && command->m_constantBuffer != nullptr;
+}
+
 
 class BindConstantBufferToVS : public CommandBase<BindConstantBufferToVS> {
 public:
@@ -288,12 +366,11 @@ private:
 public:
 	inline void SetConstantBuffer(ID3D11Buffer *buffer, uint slot) { m_constantBuffer = buffer; m_slot = slot; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context,
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager,
-	                    GraphicsState *currentGraphicsState,
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
 
@@ -310,14 +387,244 @@ private:
 public:
 	inline void SetConstantBuffer(ID3D11Buffer *buffer, uint slot) { m_constantBuffer = buffer; m_slot = slot; }
 
-	static void Execute(ID3D11Device *device, ID3D11DeviceContext *context,
-	                    BlendStateManager *blendStateManager, RasterizerStateManager *rasterizerStateManager, DepthStencilStateManager *depthStencilStateManager,
-	                    GraphicsState *currentGraphicsState,
-	                    const void *data);
+	static void Execute(const CommandContext &context, const void *data);
+
+	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
+};
+
+
+/**
+ * Where DrawIndexedInstanceable commands put the per-object data of the draws they merge. The vertex
+ * shader reads the data of each instance from the buffer, starting at the vector held in the
+ * constant buffer, plus the instance id.
+ *
+ * The merged draws append their data to the buffer with MapNoOverwrite(), so the GPU can still read
+ * the data of the earlier draws. The buffer is only discarded when it's full, and the constant
+ * buffer is only re-written when the start vector changes. Anything else that writes to the constant
+ * buffer must call InvalidateStartVector() before the next instanced draw
+ */
+struct InstanceStream {
+	InstanceStream()
+		: InstanceBuffer(nullptr),
+		  NumVectors(0u),
+		  StartVectorConstantBuffer(nullptr),
+		  StartVectorSlot(0u),
+		  NextVector(0u),
+		  StartVector(kUnknownStartVector) {
+	}
+
+	/** StartVector, when the contents of the constant buffer aren't known */
+	static const uint kUnknownStartVector = ~0u;
+
+	/** A dynamic buffer of 16 byte vectors */
+	ID3D11Buffer *InstanceBuffer;
+	/** The number of vectors InstanceBuffer can hold */
+	uint NumVectors;
+	/** A dynamic constant buffer. The first uint is set to the vector the instance data starts at */
+	ID3D11Buffer *StartVectorConstantBuffer;
+	/** The vertex shader slot to bind StartVectorConstantBuffer to */
+	uint StartVectorSlot;
+
+	/** The first vector of InstanceBuffer that hasn't been written since it was last discarded. 0 if it was never written */
+	uint NextVector;
+	/** The start vector last written to StartVectorConstantBuffer, or kUnknownStartVector */
+	uint StartVector;
+
+	/** Makes the next instanced draw re-write StartVectorConstantBuffer */
+	inline void InvalidateStartVector() { StartVector = kUnknownStartVector; }
+};
+
+/**
+ * An indexed draw of a single object, that can be merged with its neighbours in the bucket.
+ *
+ * When the bucket executes a run of these commands (see CommandBucket::SetExecutionStreamEnabled()),
+ * consecutive commands that draw the same index range with the same state and instance stream
+ * are merged. Their InstanceData is written to the InstanceStream, and they're drawn with a single
+ * DrawIndexedInstanced() call. So the sort keys should put the commands that can merge next to each
+ * other. Without the execution stream, every command is drawn as an instanced draw of one instance.
+ *
+ * The vertex shader has to fetch the per-object data from the instance stream, rather than from
+ * a per-object constant buffer. See instanced_gbuffer_vs.hlsl in the pbr_demo.
+ *
+ * @tparam InstanceData    The per-object data. Its size must be a multiple of 16 bytes
+ */
+template <typename InstanceData>
+class DrawIndexedInstanceable : public CommandBase<DrawIndexedInstanceable<InstanceData> >, public DrawCommandBase {
+	static_assert(sizeof(InstanceData) % 16u == 0u, "The instance data must be a whole number of 16 byte vectors");
+
+public:
+	DrawIndexedInstanceable()
+		: m_instanceStream(nullptr),
+		  m_indexCount(0u),
+		  m_indexStart(0u),
+		  m_vertexStart(0u) {
+	}
+
+	static const uint kVectorsPerInstance = sizeof(InstanceData) / 16u;
+
+private:
+	InstanceStream *m_instanceStream;
+	uint m_indexCount;
+	uint m_indexStart;
+	uint m_vertexStart;
+	InstanceData m_instanceData;
+
+public:
+	inline void SetInstanceStream(InstanceStream *instanceStream) { m_instanceStream = instanceStream; }
+	inline void SetIndexCount(uint indexCount) { m_indexCount = indexCount; }
+	inline void SetIndexStart(uint indexStart) { m_indexStart = indexStart; }
+	inline void SetVertexStart(uint vertexStart) { m_vertexStart = vertexStart; }
+	inline void SetInstanceData(const InstanceData &instanceData) { m_instanceData = instanceData; }
+
+	/** Whether 'other' can be drawn as another instance of this command's draw */
+	inline bool CanMergeWith(const DrawIndexedInstanceable &other) const {
+		return m_instanceStream == other.m_instanceStream &&
+		       m_indexCount == other.m_indexCount &&
+		       m_indexStart == other.m_indexStart &&
+		       m_vertexStart == other.m_vertexStart &&
+		       HasSameState(other);
+	}
+
+	static void Execute(const CommandContext &context, const void *data);
+	/** Executes a run of these commands, merging the neighbours that can be drawn together */
+	static void ExecuteBatch(const CommandContext &context, const void * const *commands, uint count);
 
 	static void Dispose(const void *data);
+	static void Capture(const void *data, CommandCapture &capture);
+	static bool Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver);
 };
 
+template <typename InstanceData>
+void Graphics::Commands::DrawIndexedInstanceable<InstanceData>::Execute(const CommandContext &context, const void *data) {
+	ExecuteBatch(context, &data, 1u);
+}
+
+template <typename InstanceData>
+void Graphics::Commands::DrawIndexedInstanceable<InstanceData>::ExecuteBatch(const CommandContext &context, const void * const *commands, uint count) {
+	RenderBackend *backend = context.Backend;
+
+	uint i = 0;
+	while (i < count) {
+		const DrawIndexedInstanceable *first = reinterpret_cast<const DrawIndexedInstanceable *>(commands[i]);
+		InstanceStream *stream = first->m_instanceStream;
+		assert(stream != nullptr);
+
+		// Gather the neighbours that can be drawn as instances of the first command
+		uint maxInstances = stream->NumVectors / kVectorsPerInstance;
+		assert(maxInstances > 0u);
+
+		uint end = i + 1u;
+		while (end < count && end - i < maxInstances && first->CanMergeWith(*reinterpret_cast<const DrawIndexedInstanceable *>(commands[end]))) {
+			++end;
+		}
+		uint instanceCount = end - i;
+		uint vectorCount = instanceCount * kVectorsPerInstance;
+
+		// Append the per-object data of the merged commands after the data of the earlier draws.
+		// The buffer is only discarded the first time it's written, and when the data doesn't fit
+		// in what's left of it
+		byte *instanceData;
+		if (stream->NextVector == 0u || stream->NextVector + vectorCount > stream->NumVectors) {
+			instanceData = reinterpret_cast<byte *>(backend->MapDiscard(stream->InstanceBuffer));
+			stream->NextVector = 0u;
+		} else {
+			instanceData = reinterpret_cast<byte *>(backend->MapNoOverwrite(stream->InstanceBuffer));
+		}
+		assert(instanceData != nullptr);
+
+		uint startVector = stream->NextVector;
+		instanceData += startVector * 16u;
+		for (uint j = i; j < end; ++j) {
+			memcpy(instanceData, &reinterpret_cast<const DrawIndexedInstanceable *>(commands[j])->m_instanceData, sizeof(InstanceData));
+			instanceData += sizeof(InstanceData);
+		}
+		backend->Unmap(stream->InstanceBuffer);
+		stream->NextVector += vectorCount;
+
+		if (stream->StartVector != startVector) {
+			uint *startVectorData = reinterpret_cast<uint *>(backend->MapDiscard(stream->StartVectorConstantBuffer));
+			assert(startVectorData != nullptr);
+			*startVectorData = startVector;
+			backend->Unmap(stream->StartVectorConstantBuffer);
+			stream->StartVector = startVector;
+		}
+		BindConstantBufferToVSSlot(context, stream->StartVectorConstantBuffer, stream->StartVectorSlot);
+
+		first->CheckAndSubmitChangedState(context);
+		backend->DrawIndexedInstanced(first->m_indexCount, instanceCount, first->m_indexStart, first->m_vertexStart, 0u);
+		context.CurrentGraphicsState->Stats.AddInstancedDraw(instanceCount);
+
+		i = end;
+	}
+}
+
+template <typename InstanceData>
+void Graphics::Commands::DrawIndexedInstanceable<InstanceData>::Dispose(const void *data) {
+	// No Op since class is a POS
+}
+
+template <typename InstanceData>
+void Graphics::Commands::DrawIndexedInstanceable<InstanceData>::Capture(const void *data, CommandCapture &capture) {
+	const DrawIndexedInstanceable *command = reinterpret_cast<const DrawIndexedInstanceable *>(data);
+
+	command->CaptureState(capture);
+	capture.WriteResource(command->m_instanceStream->InstanceBuffer);
+	capture.Write(static_cast<uint32>(command->m_instanceStream->NumVectors));
+	capture.WriteResource(command->m_instanceStream->StartVectorConstantBuffer);
+	capture.Write(static_cast<uint32>(command->m_instanceStream->StartVectorSlot));
+	capture.Write(static_cast<uint32>(command->m_indexCount));
+	capture.Write(static_cast<uint32>(command->m_indexStart));
+	capture.Write(static_cast<uint32>(command->m_vertexStart));
+	capture.Write(command->m_instanceData);
+}
+
+template <typename InstanceData>
+bool Graphics::Commands::DrawIndexedInstanceable<InstanceData>::Restore(void *data, Common::BinaryReader &payload, CommandResourceResolver &resolver) {
+	DrawIndexedInstanceable *command = reinterpret_cast<DrawIndexedInstanceable *>(data);
+
+	if (!command->RestoreState(payload, resolver)) {
+		return false;
+	}
+
+	uint32 instanceBufferId;
+	uint32 numVectors;
+	uint32 startVectorBufferId;
+	uint32 startVectorSlot;
+	payload.Read(&instanceBufferId);
+	payload.Read(&numVectors);
+	payload.Read(&startVectorBufferId);
+	payload.Read(&startVectorSlot);
+	payload.Read(&command->m_indexCount);
+	payload.Read(&command->m_indexStart);
+	payload.Read(&command->m_vertexStart);
+	payload.Read(&command->m_instanceData);
+	if (payload.HasError() || numVectors < kVectorsPerInstance || startVectorSlot >= GraphicsState::kMaxConstantBufferSlots) {
+		return false;
+	}
+
+	InstanceStream stream;
+	stream.InstanceBuffer = resolver.GetBuffer(instanceBufferId, numVectors * 16u);
+	stream.NumVectors = numVectors;
+	stream.StartVectorConstantBuffer = resolver.GetBuffer(startVectorBufferId, sizeof(uint));
+	stream.StartVectorSlot = startVectorSlot;
+	if (stream.InstanceBuffer == nullptr || stream.StartVectorConstantBuffer == nullptr) {
+		return false;
+	}
+
+	command->m_instanceStream = resolver.GetInstanceStream(stream);
+	return true;
+}
+
 } // End of namespace Commands
 
+/** Lets the bucket hand whole runs of DrawIndexedInstanceable to ExecuteBatch(), so they can be merged */
+template <typename InstanceData>
+struct CommandBatchExecutor<Commands::DrawIndexedInstanceable<InstanceData> > {
+	static void ExecuteBatch(const CommandContext &context, const void * const *commands, uint count) {
+		Commands::DrawIndexedInstanceable<InstanceData>::ExecuteBatch(context, commands, count);
+	}
+};
+
 } // End of namespace Graphics
\ No newline at end of file
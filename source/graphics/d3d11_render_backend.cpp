@@ -0,0 +1,149 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "graphics/d3d11_render_backend.h"
+
+#include <cstring>
+
+
+namespace Graphics {
+
+ID3D11Device *D3D11RenderBackend::GetDevice() {
+	return m_device;
+}
+
+HRESULT D3D11RenderBackend::CreateBuffer(const D3D11_BUFFER_DESC *desc, const D3D11_SUBRESOURCE_DATA *initialData, ID3D11Buffer **buffer) {
+	return m_device->CreateBuffer(desc, initialData, buffer);
+}
+
+HRESULT D3D11RenderBackend::CreateShaderResourceView(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, ID3D11ShaderResourceView **view) {
+	return m_device->CreateShaderResourceView(resource, desc, view);
+}
+
+HRESULT D3D11RenderBackend::CreateUnorderedAccessView(ID3D11Resource *resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, ID3D11UnorderedAccessView **view) {
+	return m_device->CreateUnorderedAccessView(resource, desc, view);
+}
+
+HRESULT D3D11RenderBackend::CreateVertexShader(const void *bytecode, size_t bytecodeLength, ID3D11VertexShader **vertexShader) {
+	return m_device->CreateVertexShader(bytecode, bytecodeLength, nullptr, vertexShader);
+}
+
+HRESULT D3D11RenderBackend::CreatePixelShader(const void *bytecode, size_t bytecodeLength, ID3D11PixelShader **pixelShader) {
+	return m_device->CreatePixelShader(bytecode, bytecodeLength, nullptr, pixelShader);
+}
+
+HRESULT D3D11RenderBackend::CreateComputeShader(const void *bytecode, size_t bytecodeLength, ID3D11ComputeShader **computeShader) {
+	return m_device->CreateComputeShader(bytecode, bytecodeLength, nullptr, computeShader);
+}
+
+HRESULT D3D11RenderBackend::CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *elementDescs, uint numElements, const void *bytecode, size_t bytecodeLength, ID3D11InputLayout **inputLayout) {
+	return m_device->CreateInputLayout(elementDescs, numElements, bytecode, bytecodeLength, inputLayout);
+}
+
+void *D3D11RenderBackend::MapDiscard(ID3D11Buffer *buffer) {
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(m_context->Map(buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource))) {
+		return nullptr;
+	}
+
+	return mappedResource.pData;
+}
+
+void *D3D11RenderBackend::MapNoOverwrite(ID3D11Buffer *buffer) {
+	if (!m_checkedMapNoOverwrite) {
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options;
+		memset(&options, 0, sizeof(options));
+		m_mapNoOverwriteOnBufferSRVs = SUCCEEDED(m_device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) && options.MapNoOverwriteOnDynamicBufferSRV;
+		m_checkedMapNoOverwrite = true;
+	}
+
+	// Vertex and index buffers can always be mapped without overwriting. Anything else has to be a
+	// shader resource, and needs D3D 11.1
+	D3D11_BUFFER_DESC desc;
+	buffer->GetDesc(&desc);
+	bool isVertexOrIndexBuffer = (desc.BindFlags & (D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER)) != 0;
+	bool isShaderResource = (desc.BindFlags & D3D11_BIND_SHADER_RESOURCE) != 0;
+	if (!isVertexOrIndexBuffer && !(isShaderResource && m_mapNoOverwriteOnBufferSRVs)) {
+		return MapDiscard(buffer);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(m_context->Map(buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &mappedResource))) {
+		return nullptr;
+	}
+
+	return mappedResource.pData;
+}
+
+void D3D11RenderBackend::Unmap(ID3D11Buffer *buffer) {
+	m_context->Unmap(buffer, 0);
+}
+
+void D3D11RenderBackend::IASetVertexBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers, const uint *strides, const uint *offsets) {
+	m_context->IASetVertexBuffers(startSlot, numBuffers, buffers, strides, offsets);
+}
+
+void D3D11RenderBackend::IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, uint offset) {
+	m_context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void D3D11RenderBackend::VSSetShader(ID3D11VertexShader *vertexShader) {
+	m_context->VSSetShader(vertexShader, nullptr, 0);
+}
+
+void D3D11RenderBackend::PSSetShader(ID3D11PixelShader *pixelShader) {
+	m_context->PSSetShader(pixelShader, nullptr, 0);
+}
+
+void D3D11RenderBackend::CSSetShader(ID3D11ComputeShader *computeShader) {
+	m_context->CSSetShader(computeShader, nullptr, 0);
+}
+
+void D3D11RenderBackend::VSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	m_context->VSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderBackend::PSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	m_context->PSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderBackend::CSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	m_context->CSSetConstantBuffers(startSlot, numBuffers, buffers);
+}
+
+void D3D11RenderBackend::PSSetShaderResources(uint startSlot, uint numViews, ID3D11ShaderResourceView * const *views) {
+	m_context->PSSetShaderResources(startSlot, numViews, views);
+}
+
+void D3D11RenderBackend::PSSetSamplers(uint startSlot, uint numSamplers, ID3D11SamplerState * const *samplers) {
+	m_context->PSSetSamplers(startSlot, numSamplers, samplers);
+}
+
+void D3D11RenderBackend::OMSetBlendState(ID3D11BlendState *blendState, const float blendFactor[4], uint sampleMask) {
+	m_context->OMSetBlendState(blendState, blendFactor, sampleMask);
+}
+
+void D3D11RenderBackend::RSSetState(ID3D11RasterizerState *rasterizerState) {
+	m_context->RSSetState(rasterizerState);
+}
+
+void D3D11RenderBackend::OMSetDepthStencilState(ID3D11DepthStencilState *depthStencilState, uint stencilRef) {
+	m_context->OMSetDepthStencilState(depthStencilState, stencilRef);
+}
+
+void D3D11RenderBackend::Draw(uint vertexCount, uint startVertex) {
+	m_context->Draw(vertexCount, startVertex);
+}
+
+void D3D11RenderBackend::DrawIndexed(uint indexCount, uint startIndex, int baseVertex) {
+	m_context->DrawIndexed(indexCount, startIndex, baseVertex);
+}
+
+void D3D11RenderBackend::DrawIndexedInstanced(uint indexCountPerInstance, uint instanceCount, uint startIndex, int baseVertex, uint startInstance) {
+	m_context->DrawIndexedInstanced(indexCountPerInstance, instanceCount, startIndex, baseVertex, startInstance);
+}
+
+} // End of namespace Graphics
@@ -0,0 +1,81 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "graphics/render_backend.h"
+
+
+namespace Graphics {
+
+/**
+ * Forwards every call to a D3D11 device and immediate context. The backend doesn't own them,
+ * so it's cheap to create one on the stack around an existing device
+ */
+class D3D11RenderBackend : public RenderBackend {
+public:
+	D3D11RenderBackend(ID3D11Device *device, ID3D11DeviceContext *context)
+		: m_device(device),
+		  m_context(context),
+		  m_checkedMapNoOverwrite(false),
+		  m_mapNoOverwriteOnBufferSRVs(false) {
+	}
+
+private:
+	ID3D11Device *m_device;
+	ID3D11DeviceContext *m_context;
+
+	/** Whether the device was already asked about m_mapNoOverwriteOnBufferSRVs. It's only asked on the first MapNoOverwrite() */
+	bool m_checkedMapNoOverwrite;
+	/** Shader resource buffers can only be mapped without overwriting on D3D 11.1 */
+	bool m_mapNoOverwriteOnBufferSRVs;
+
+public:
+	inline ID3D11DeviceContext *GetContext() { return m_context; }
+
+	ID3D11Device *GetDevice();
+
+	HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc, const D3D11_SUBRESOURCE_DATA *initialData, ID3D11Buffer **buffer);
+	HRESULT CreateShaderResourceView(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, ID3D11ShaderResourceView **view);
+	HRESULT CreateUnorderedAccessView(ID3D11Resource *resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, ID3D11UnorderedAccessView **view);
+	HRESULT CreateVertexShader(const void *bytecode, size_t bytecodeLength, ID3D11VertexShader **vertexShader);
+	HRESULT CreatePixelShader(const void *bytecode, size_t bytecodeLength, ID3D11PixelShader **pixelShader);
+	HRESULT CreateComputeShader(const void *bytecode, size_t bytecodeLength, ID3D11ComputeShader **computeShader);
+	HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *elementDescs, uint numElements, const void *bytecode, size_t bytecodeLength, ID3D11InputLayout **inputLayout);
+
+	void *MapDiscard(ID3D11Buffer *buffer);
+	void *MapNoOverwrite(ID3D11Buffer *buffer);
+	void Unmap(ID3D11Buffer *buffer);
+
+	void IASetVertexBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers, const uint *strides, const uint *offsets);
+	void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, uint offset);
+
+	void VSSetShader(ID3D11VertexShader *vertexShader);
+	void PSSetShader(ID3D11PixelShader *pixelShader);
+	void CSSetShader(ID3D11ComputeShader *computeShader);
+
+	void VSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+	void PSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+	void CSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+
+	void PSSetShaderResources(uint startSlot, uint numViews, ID3D11ShaderResourceView * const *views);
+	void PSSetSamplers(uint startSlot, uint numSamplers, ID3D11SamplerState * const *samplers);
+
+	void OMSetBlendState(ID3D11BlendState *blendState, const float blendFactor[4], uint sampleMask);
+	void RSSetState(ID3D11RasterizerState *rasterizerState);
+	void OMSetDepthStencilState(ID3D11DepthStencilState *depthStencilState, uint stencilRef);
+
+	void Draw(uint vertexCount, uint startVertex);
+	void DrawIndexed(uint indexCount, uint startIndex, int baseVertex);
+	void DrawIndexedInstanced(uint indexCountPerInstance, uint instanceCount, uint startIndex, int baseVertex, uint startInstance);
+
+private:
+	// Not implemented
+	D3D11RenderBackend(const D3D11RenderBackend &);
+	D3D11RenderBackend &operator=(const D3D11RenderBackend &);
+};
+
+} // End of namespace Graphics
@@ -8,54 +8,71 @@
 
 #include "common/file_io_util.h"
 
+#include "graphics/d3d11_render_backend.h"
+
 
 namespace Graphics {
 
-HRESULT LoadVertexShader(const wchar *fileName, ID3D11Device *device, ID3D11VertexShader **vertexShader, ID3D11InputLayout **inputLayout, D3D11_INPUT_ELEMENT_DESC *vertexDesc, uint numElements) {
+HRESULT LoadVertexShader(const wchar *fileName, RenderBackend *backend, ID3D11VertexShader **vertexShader, ID3D11InputLayout **inputLayout, D3D11_INPUT_ELEMENT_DESC *vertexDesc, uint numElements) {
 	DWORD bytesRead;
 	char *fileBuffer = Common::ReadWholeFile(fileName, &bytesRead);
 	if (fileBuffer == nullptr) {
 		return -1;
 	}
 
-	HRESULT result = device->CreateVertexShader(fileBuffer, bytesRead, nullptr, vertexShader);
+	HRESULT result = backend->CreateVertexShader(fileBuffer, bytesRead, vertexShader);
 	if (result != S_OK) {
 		return result;
 	}
 
 	if (inputLayout != nullptr) {
 		// Create the vertex input layout.
-		result = device->CreateInputLayout(vertexDesc, numElements, fileBuffer, bytesRead, inputLayout);
+		result = backend->CreateInputLayout(vertexDesc, numElements, fileBuffer, bytesRead, inputLayout);
 	}
 
 	delete[] fileBuffer;
 	return result;
 }
 
-HRESULT LoadPixelShader(const wchar *fileName, ID3D11Device *device, ID3D11PixelShader **pixelShader) {
+HRESULT LoadPixelShader(const wchar *fileName, RenderBackend *backend, ID3D11PixelShader **pixelShader) {
 	DWORD bytesRead;
 	char *fileBuffer = Common::ReadWholeFile(fileName, &bytesRead);
 	if (fileBuffer == nullptr) {
 		return -1;
 	}
 
-	HRESULT result = device->CreatePixelShader(fileBuffer, bytesRead, NULL, pixelShader);
+	HRESULT result = backend->CreatePixelShader(fileBuffer, bytesRead, pixelShader);
 
 	delete[] fileBuffer;
 	return result;
 }
 
-HRESULT LoadComputeShader(const wchar *fileName, ID3D11Device *device, ID3D11ComputeShader **computeShader) {
+HRESULT LoadComputeShader(const wchar *fileName, RenderBackend *backend, ID3D11ComputeShader **computeShader) {
 	DWORD bytesRead;
 	char *fileBuffer = Common::ReadWholeFile(fileName, &bytesRead);
 	if (fileBuffer == nullptr) {
 		return -1;
 	}
 
-	HRESULT result = device->CreateComputeShader(fileBuffer, bytesRead, NULL, computeShader);
+	HRESULT result = backend->CreateComputeShader(fileBuffer, bytesRead, computeShader);
 
 	delete[] fileBuffer;
 	return result;
 }
 
+HRESULT LoadVertexShader(const wchar *fileName, ID3D11Device *device, ID3D11VertexShader **vertexShader, ID3D11InputLayout **inputLayout, D3D11_INPUT_ELEMENT_DESC *vertexDesc, uint numElements) {
+	D3D11RenderBackend backend(device, nullptr);
+	return LoadVertexShader(fileName, &backend, vertexShader, inputLayout, vertexDesc, numElements);
+}
+
+HRESULT LoadPixelShader(const wchar *fileName, ID3D11Device *device, ID3D11PixelShader **pixelShader) {
+	D3D11RenderBackend backend(device, nullptr);
+	return LoadPixelShader(fileName, &backend, pixelShader);
+}
+
+HRESULT LoadComputeShader(const wchar *fileName, ID3D11Device *device, ID3D11ComputeShader **computeShader) {
+	D3D11RenderBackend backend(device, nullptr);
+	return LoadComputeShader(fileName, &backend, computeShader);
+}
+
 } // End of namespace Graphics
@@ -41,6 +41,13 @@
 
 namespace Graphics {
 
+class RenderBackend;
+
+HRESULT LoadVertexShader(const wchar *fileName, RenderBackend *backend, ID3D11VertexShader **vertexShader, ID3D11InputLayout **inputLayout = nullptr, D3D11_INPUT_ELEMENT_DESC *vertexDesc = nullptr, uint numElements = 0);
+HRESULT LoadPixelShader(const wchar *fileName, RenderBackend *backend, ID3D11PixelShader **pixelShader);
+HRESULT LoadComputeShader(const wchar *fileName, RenderBackend *backend, ID3D11ComputeShader **computeShader);
+
+// Convenience overloads for creating shaders directly on a device
 HRESULT LoadVertexShader(const wchar *fileName, ID3D11Device *device, ID3D11VertexShader **vertexShader, ID3D11InputLayout **inputLayout = nullptr, D3D11_INPUT_ELEMENT_DESC *vertexDesc = nullptr, uint numElements = 0);
 HRESULT LoadPixelShader(const wchar *fileName, ID3D11Device *device, ID3D11PixelShader **pixelShader);
 HRESULT LoadComputeShader(const wchar *fileName, ID3D11Device *device, ID3D11ComputeShader **computeShader);
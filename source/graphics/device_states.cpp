@@ -20,6 +20,16 @@
 
 namespace Graphics {
 
+BlendStateManager::BlendStateManager()
+	: m_blendDisabled(nullptr),
+	  m_additiveBlend(nullptr),
+	  m_alphaBlend(nullptr),
+	  m_pmAlphaBlend(nullptr),
+	  m_noColor(nullptr),
+	  m_alphaToCoverage(nullptr),
+	  m_opacityBlend(nullptr) {
+}
+
 void BlendStateManager::Initialize(ID3D11Device *device) {
 	HR(device->CreateBlendState(&BlendDisabledDesc(), &m_blendDisabled));
 	HR(device->CreateBlendState(&AdditiveBlendDesc(), &m_additiveBlend));
@@ -168,6 +178,17 @@ D3D11_BLEND_DESC BlendStateManager::OpacityBlendDesc() {
 	return blendDesc;
 }
 
+RasterizerStateManager::RasterizerStateManager()
+	: m_noCull(nullptr),
+	  m_cullBackFaces(nullptr),
+	  m_cullBackFacesScissor(nullptr),
+	  m_cullFrontFaces(nullptr),
+	  m_cullFrontFacesScissor(nullptr),
+	  m_noCullNoMS(nullptr),
+	  m_noCullScissor(nullptr),
+	  m_wireframe(nullptr) {
+}
+
 void RasterizerStateManager::Initialize(ID3D11Device *device) {
 	HR(device->CreateRasterizerState(&NoCullDesc(), &m_noCull));
 	HR(device->CreateRasterizerState(&FrontFaceCullDesc(), &m_cullFrontFaces));
@@ -326,6 +347,16 @@ D3D11_RASTERIZER_DESC RasterizerStateManager::WireframeDesc() {
 	return rastDesc;
 }
 
+DepthStencilStateManager::DepthStencilStateManager()
+	: m_depthDisabled(nullptr),
+	  m_depthEnabled(nullptr),
+	  m_revDepthEnabled(nullptr),
+	  m_depthWriteEnabled(nullptr),
+	  m_revDepthWriteEnabled(nullptr),
+	  m_depthStencilWriteEnabled(nullptr),
+	  m_stencilEnabled(nullptr) {
+}
+
 void DepthStencilStateManager::Initialize(ID3D11Device *device) {
 	HR(device->CreateDepthStencilState(&DepthDisabledDesc(), &m_depthDisabled));
 	HR(device->CreateDepthStencilState(&DepthEnabledDesc(), &m_depthEnabled));
@@ -465,6 +496,17 @@ D3D11_DEPTH_STENCIL_DESC DepthStencilStateManager::StencilEnabledDesc() {
 	return dsDesc;
 }
 
+SamplerStateManager::SamplerStateManager()
+	: m_linear(nullptr),
+	  m_linearClamp(nullptr),
+	  m_linearBorder(nullptr),
+	  m_point(nullptr),
+	  m_pointWrap(nullptr),
+	  m_anisotropic(nullptr),
+	  m_shadowMap(nullptr),
+	  m_shadowMapPCF(nullptr) {
+}
+
 void SamplerStateManager::Initialize(ID3D11Device *device) {
 	HR(device->CreateSamplerState(&LinearDesc(), &m_linear));
 	HR(device->CreateSamplerState(&LinearClampDesc(), &m_linearClamp));
@@ -31,6 +31,7 @@ enum class BlendState {
 
 class BlendStateManager {
 public:
+	BlendStateManager();
 	~BlendStateManager();
 
 private:
@@ -97,6 +98,7 @@ enum class  RasterizerState {
 
 class RasterizerStateManager {
 public:
+	RasterizerStateManager();
 	~RasterizerStateManager();
 
 private:
@@ -167,6 +169,7 @@ enum class DepthStencilState {
 
 class DepthStencilStateManager {
 public:
+	DepthStencilStateManager();
 	~DepthStencilStateManager();
 
 private:
@@ -233,6 +236,7 @@ enum class SamplerState {
 
 class SamplerStateManager {
 public:
+	SamplerStateManager();
 	~SamplerStateManager();
 
 private:
@@ -8,41 +8,138 @@
 
 #include "graphics/shader.h"
 
-#include <map>
+#include <cstring>
 
 
 namespace Graphics {
 
-struct GraphicsState {
-	GraphicsState()
-			: MaterialShader(nullptr),
-			  IndexBuffer(nullptr),
-			  BlendState(BlendState::BLEND_DISABLED),
-			  SampleMask(0xFFFFFFFF),
-			  RasterizerState(RasterizerState::CULL_BACKFACES),
-			  DepthStencilState(DepthStencilState::REVERSE_DEPTH_WRITE_ENABLED) {
-		// WORKAROUND: We have to manually initialize because VS 2013 compiler doesn't support array initialization in the class initializer list
-		VertexBuffers[0] = nullptr;
-		VertexBuffers[1] = nullptr;
+/** The kinds of state a command can bind. Used to index GraphicsStateStats */
+enum class StateBindType {
+	MATERIAL_SHADER,
+	VERTEX_BUFFERS,
+	INDEX_BUFFER,
+	TEXTURE_SRVS,
+	TEXTURE_SAMPLERS,
+	CONSTANT_BUFFERS,
+	BLEND_STATE,
+	RASTERIZER_STATE,
+	DEPTH_STENCIL_STATE
+};
+const uint kNumStateBindTypes = 9u;
 
-		BlendFactor[0] = 1.0f;
-		BlendFactor[1] = 1.0f;
-		BlendFactor[2] = 1.0f;
-		BlendFactor[3] = 1.0f;
+/**
+ * Counts of the state changes issued to the device, versus the ones that were
+ * skipped because the state was already bound. Also counts the draws that were
+ * merged into the instanced draws of their neighbours
+ */
+struct GraphicsStateStats {
+	GraphicsStateStats() {
+		Reset();
 	}
 
+	/** The number of API calls made, per StateBindType */
+	uint Binds[kNumStateBindTypes];
+	/** The number of binds that were skipped because the value was already bound, per StateBindType */
+	uint SkippedBinds[kNumStateBindTypes];
+	/** The number of instanced draw calls issued for merged draw commands */
+	uint InstancedDraws;
+	/** The number of draw commands that didn't need a draw call of their own, because they were merged into an instanced draw */
+	uint DrawsCollapsed;
+
+	inline void Reset() {
+		memset(Binds, 0, sizeof(Binds));
+		memset(SkippedBinds, 0, sizeof(SkippedBinds));
+		InstancedDraws = 0u;
+		DrawsCollapsed = 0u;
+	}
+
+	inline void AddBinds(StateBindType type, uint count) { Binds[static_cast<uint>(type)] += count; }
+	inline void AddSkippedBinds(StateBindType type, uint count) { SkippedBinds[static_cast<uint>(type)] += count; }
+	/** Records one instanced draw call that replaced 'instanceCount' draw commands */
+	inline void AddInstancedDraw(uint instanceCount) {
+		++InstancedDraws;
+		DrawsCollapsed += instanceCount - 1u;
+	}
+
+	uint GetTotalBinds() const {
+		uint total = 0u;
+		for (uint i = 0; i < kNumStateBindTypes; ++i) {
+			total += Binds[i];
+		}
+		return total;
+	}
+	uint GetTotalSkippedBinds() const {
+		uint total = 0u;
+		for (uint i = 0; i < kNumStateBindTypes; ++i) {
+			total += SkippedBinds[i];
+		}
+		return total;
+	}
+};
+
+/**
+ * A shadow copy of the pipeline state that has been bound by commands. Commands compare
+ * against it, and only call into the device for the state that actually changed.
+ *
+ * Slot bound resources are kept in fixed size arrays, so a command can build a bitmask of
+ * the slots that differ, and bind each contiguous run of dirty slots with a single call.
+ *
+ * The state only knows about binds made through commands. If anything else binds to the
+ * same slots, call Invalidate() before submitting more commands.
+ */
+struct GraphicsState {
+	GraphicsState() {
+		Invalidate();
+	}
+
+	static const uint kMaxTextureSlots = 16u;
+	static const uint kMaxSamplerSlots = 16u;
+	// D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT
+	static const uint kMaxConstantBufferSlots = 14u;
+
 	MaterialShader *MaterialShader;
 	ID3D11Buffer *VertexBuffers[2];
 	ID3D11Buffer *IndexBuffer;
 
-	std::map<uint, ID3D11ShaderResourceView *> TextureSRVs;
-	std::map<uint, ID3D11SamplerState *> TextureSamplers;
+	ID3D11ShaderResourceView *TextureSRVs[kMaxTextureSlots];
+	ID3D11SamplerState *TextureSamplers[kMaxSamplerSlots];
+	ID3D11Buffer *VSConstantBuffers[kMaxConstantBufferSlots];
+	ID3D11Buffer *PSConstantBuffers[kMaxConstantBufferSlots];
 
 	BlendState BlendState;
 	float BlendFactor[4];
 	uint SampleMask;
 	RasterizerState RasterizerState;
 	DepthStencilState DepthStencilState;
+
+	GraphicsStateStats Stats;
+
+	/**
+	 * Resets the shadow state to the default device states, and forgets all the bound
+	 * shaders, buffers, and textures, so the next command re-binds them. The stats are kept
+	 */
+	void Invalidate() {
+		MaterialShader = nullptr;
+
+		// WORKAROUND: We have to manually initialize because VS 2013 compiler doesn't support array initialization in the class initializer list
+		VertexBuffers[0] = nullptr;
+		VertexBuffers[1] = nullptr;
+		IndexBuffer = nullptr;
+
+		memset(TextureSRVs, 0, sizeof(TextureSRVs));
+		memset(TextureSamplers, 0, sizeof(TextureSamplers));
+		memset(VSConstantBuffers, 0, sizeof(VSConstantBuffers));
+		memset(PSConstantBuffers, 0, sizeof(PSConstantBuffers));
+
+		BlendState = BlendState::BLEND_DISABLED;
+		BlendFactor[0] = 1.0f;
+		BlendFactor[1] = 1.0f;
+		BlendFactor[2] = 1.0f;
+		BlendFactor[3] = 1.0f;
+		SampleMask = 0xFFFFFFFF;
+		RasterizerState = RasterizerState::CULL_BACKFACES;
+		DepthStencilState = DepthStencilState::REVERSE_DEPTH_WRITE_ENABLED;
+	}
 };
 
 
@@ -0,0 +1,332 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "graphics/null_render_backend.h"
+
+#include <atomic>
+#include <vector>
+
+
+namespace Graphics {
+
+/**
+ * Implements IUnknown and ID3D11DeviceChild for the stub objects. The objects are
+ * reference counted like the real ones, and delete themselves on the last Release()
+ */
+template <typename Interface>
+class NullDeviceChild : public Interface {
+public:
+	NullDeviceChild()
+		: m_refCount(1u) {
+	}
+	virtual ~NullDeviceChild() {}
+
+private:
+	std::atomic<ULONG> m_refCount;
+
+public:
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject) {
+		*ppvObject = nullptr;
+		return E_NOINTERFACE;
+	}
+	ULONG STDMETHODCALLTYPE AddRef() {
+		return ++m_refCount;
+	}
+	ULONG STDMETHODCALLTYPE Release() {
+		ULONG refCount = --m_refCount;
+		if (refCount == 0u) {
+			delete this;
+		}
+		return refCount;
+	}
+
+	void STDMETHODCALLTYPE GetDevice(ID3D11Device **ppDevice) {
+		*ppDevice = nullptr;
+	}
+	HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID guid, UINT *pDataSize, void *pData) {
+		return E_FAIL;
+	}
+	HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID guid, UINT DataSize, const void *pData) {
+		return S_OK;
+	}
+	HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID guid, const IUnknown *pData) {
+		return S_OK;
+	}
+};
+
+class NullBuffer : public NullDeviceChild<ID3D11Buffer> {
+public:
+	NullBuffer(const D3D11_BUFFER_DESC &desc, const void *initialData)
+			: m_desc(desc) {
+		// Only buffers the CPU can write to need backing memory
+		if ((desc.CPUAccessFlags & D3D11_CPU_ACCESS_WRITE) != 0) {
+			m_data.resize(desc.ByteWidth);
+			if (initialData != nullptr) {
+				memcpy(&m_data[0], initialData, desc.ByteWidth);
+			}
+		}
+	}
+
+	D3D11_BUFFER_DESC m_desc;
+	std::vector<byte> m_data;
+
+	void STDMETHODCALLTYPE GetType(D3D11_RESOURCE_DIMENSION *pResourceDimension) {
+		*pResourceDimension = D3D11_RESOURCE_DIMENSION_BUFFER;
+	}
+	void STDMETHODCALLTYPE SetEvictionPriority(UINT EvictionPriority) {}
+	UINT STDMETHODCALLTYPE GetEvictionPriority() {
+		return 0u;
+	}
+	void STDMETHODCALLTYPE GetDesc(D3D11_BUFFER_DESC *pDesc) {
+		*pDesc = m_desc;
+	}
+};
+
+/** A view holds a reference to its resource, like the real ones do */
+template <typename Interface, typename Desc>
+class NullView : public NullDeviceChild<Interface> {
+public:
+	NullView(ID3D11Resource *resource, const Desc *desc)
+			: m_resource(resource) {
+		m_resource->AddRef();
+		if (desc != nullptr) {
+			m_desc = *desc;
+		} else {
+			memset(&m_desc, 0, sizeof(Desc));
+		}
+	}
+	~NullView() {
+		m_resource->Release();
+	}
+
+private:
+	ID3D11Resource *m_resource;
+	Desc m_desc;
+
+public:
+	void STDMETHODCALLTYPE GetResource(ID3D11Resource **ppResource) {
+		m_resource->AddRef();
+		*ppResource = m_resource;
+	}
+	void STDMETHODCALLTYPE GetDesc(Desc *pDesc) {
+		*pDesc = m_desc;
+	}
+};
+
+typedef NullView<ID3D11ShaderResourceView, D3D11_SHADER_RESOURCE_VIEW_DESC> NullShaderResourceView;
+typedef NullView<ID3D11UnorderedAccessView, D3D11_UNORDERED_ACCESS_VIEW_DESC> NullUnorderedAccessView;
+
+class NullSamplerState : public NullDeviceChild<ID3D11SamplerState> {
+public:
+	NullSamplerState(const D3D11_SAMPLER_DESC *desc) {
+		if (desc != nullptr) {
+			m_desc = *desc;
+		} else {
+			memset(&m_desc, 0, sizeof(D3D11_SAMPLER_DESC));
+		}
+	}
+
+private:
+	D3D11_SAMPLER_DESC m_desc;
+
+public:
+	void STDMETHODCALLTYPE GetDesc(D3D11_SAMPLER_DESC *pDesc) {
+		*pDesc = m_desc;
+	}
+};
+
+
+NullRenderBackend::NullRenderBackend() {
+}
+
+NullRenderBackendStats NullRenderBackend::GetStats() {
+	std::lock_guard<std::mutex> guard(m_createLock);
+	return m_stats;
+}
+
+void NullRenderBackend::ResetStats() {
+	std::lock_guard<std::mutex> guard(m_createLock);
+	m_stats.Reset();
+}
+
+ID3D11Device *NullRenderBackend::GetDevice() {
+	return nullptr;
+}
+
+HRESULT NullRenderBackend::CreateBuffer(const D3D11_BUFFER_DESC *desc, const D3D11_SUBRESOURCE_DATA *initialData, ID3D11Buffer **buffer) {
+	const void *data = initialData != nullptr ? initialData->pSysMem : nullptr;
+	*buffer = new NullBuffer(*desc, data);
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_BUFFER);
+	if (data != nullptr) {
+		m_stats.BytesCreated += desc->ByteWidth;
+	}
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateShaderResourceView(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, ID3D11ShaderResourceView **view) {
+	*view = new NullShaderResourceView(resource, desc);
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_SHADER_RESOURCE_VIEW);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateUnorderedAccessView(ID3D11Resource *resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, ID3D11UnorderedAccessView **view) {
+	*view = new NullUnorderedAccessView(resource, desc);
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_UNORDERED_ACCESS_VIEW);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateVertexShader(const void *bytecode, size_t bytecodeLength, ID3D11VertexShader **vertexShader) {
+	*vertexShader = new NullDeviceChild<ID3D11VertexShader>();
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_SHADER);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreatePixelShader(const void *bytecode, size_t bytecodeLength, ID3D11PixelShader **pixelShader) {
+	*pixelShader = new NullDeviceChild<ID3D11PixelShader>();
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_SHADER);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateComputeShader(const void *bytecode, size_t bytecodeLength, ID3D11ComputeShader **computeShader) {
+	*computeShader = new NullDeviceChild<ID3D11ComputeShader>();
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_SHADER);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *elementDescs, uint numElements, const void *bytecode, size_t bytecodeLength, ID3D11InputLayout **inputLayout) {
+	*inputLayout = new NullDeviceChild<ID3D11InputLayout>();
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_INPUT_LAYOUT);
+
+	return S_OK;
+}
+
+HRESULT NullRenderBackend::CreateSamplerState(const D3D11_SAMPLER_DESC *desc, ID3D11SamplerState **samplerState) {
+	*samplerState = new NullSamplerState(desc);
+
+	std::lock_guard<std::mutex> guard(m_createLock);
+	AddCall(RenderBackendCall::CREATE_SAMPLER_STATE);
+
+	return S_OK;
+}
+
+void *NullRenderBackend::MapDiscard(ID3D11Buffer *buffer) {
+	NullBuffer *nullBuffer = static_cast<NullBuffer *>(buffer);
+
+	// Like D3D11, only dynamic buffers can be mapped
+	if (nullBuffer->m_data.empty()) {
+		return nullptr;
+	}
+
+	AddCall(RenderBackendCall::MAP);
+	m_stats.BytesUploaded += nullBuffer->m_data.size();
+
+	return &nullBuffer->m_data[0];
+}
+
+void *NullRenderBackend::MapNoOverwrite(ID3D11Buffer *buffer) {
+	NullBuffer *nullBuffer = static_cast<NullBuffer *>(buffer);
+
+	if (nullBuffer->m_data.empty()) {
+		return nullptr;
+	}
+
+	AddCall(RenderBackendCall::MAP);
+
+	return &nullBuffer->m_data[0];
+}
+
+void NullRenderBackend::Unmap(ID3D11Buffer *buffer) {
+	// No Op. The data stays in the buffer's system memory
+}
+
+void NullRenderBackend::IASetVertexBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers, const uint *strides, const uint *offsets) {
+	AddCall(RenderBackendCall::SET_VERTEX_BUFFERS);
+}
+
+void NullRenderBackend::IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, uint offset) {
+	AddCall(RenderBackendCall::SET_INDEX_BUFFER);
+}
+
+void NullRenderBackend::VSSetShader(ID3D11VertexShader *vertexShader) {
+	AddCall(RenderBackendCall::SET_SHADER);
+}
+
+void NullRenderBackend::PSSetShader(ID3D11PixelShader *pixelShader) {
+	AddCall(RenderBackendCall::SET_SHADER);
+}
+
+void NullRenderBackend::CSSetShader(ID3D11ComputeShader *computeShader) {
+	AddCall(RenderBackendCall::SET_SHADER);
+}
+
+void NullRenderBackend::VSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	AddCall(RenderBackendCall::SET_CONSTANT_BUFFERS);
+}
+
+void NullRenderBackend::PSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	AddCall(RenderBackendCall::SET_CONSTANT_BUFFERS);
+}
+
+void NullRenderBackend::CSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) {
+	AddCall(RenderBackendCall::SET_CONSTANT_BUFFERS);
+}
+
+void NullRenderBackend::PSSetShaderResources(uint startSlot, uint numViews, ID3D11ShaderResourceView * const *views) {
+	AddCall(RenderBackendCall::SET_SHADER_RESOURCES);
+}
+
+void NullRenderBackend::PSSetSamplers(uint startSlot, uint numSamplers, ID3D11SamplerState * const *samplers) {
+	AddCall(RenderBackendCall::SET_SAMPLERS);
+}
+
+void NullRenderBackend::OMSetBlendState(ID3D11BlendState *blendState, const float blendFactor[4], uint sampleMask) {
+	AddCall(RenderBackendCall::SET_BLEND_STATE);
+}
+
+void NullRenderBackend::RSSetState(ID3D11RasterizerState *rasterizerState) {
+	AddCall(RenderBackendCall::SET_RASTERIZER_STATE);
+}
+
+void NullRenderBackend::OMSetDepthStencilState(ID3D11DepthStencilState *depthStencilState, uint stencilRef) {
+	AddCall(RenderBackendCall::SET_DEPTH_STENCIL_STATE);
+}
+
+void NullRenderBackend::Draw(uint vertexCount, uint startVertex) {
+	AddCall(RenderBackendCall::DRAW);
+	m_stats.TrianglesDrawn += vertexCount / 3u;
+}
+
+void NullRenderBackend::DrawIndexed(uint indexCount, uint startIndex, int baseVertex) {
+	AddCall(RenderBackendCall::DRAW);
+	m_stats.TrianglesDrawn += indexCount / 3u;
+}
+
+void NullRenderBackend::DrawIndexedInstanced(uint indexCountPerInstance, uint instanceCount, uint startIndex, int baseVertex, uint startInstance) {
+	AddCall(RenderBackendCall::DRAW);
+	m_stats.TrianglesDrawn += static_cast<uint64>(indexCountPerInstance / 3u) * instanceCount;
+}
+
+} // End of namespace Graphics
@@ -0,0 +1,138 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "graphics/render_backend.h"
+
+#include <cstring>
+#include <mutex>
+
+
+namespace Graphics {
+
+/** The calls a NullRenderBackend counts. Used to index NullRenderBackendStats */
+enum class RenderBackendCall {
+	CREATE_BUFFER,
+	CREATE_SHADER_RESOURCE_VIEW,
+	CREATE_UNORDERED_ACCESS_VIEW,
+	CREATE_SHADER,
+	CREATE_INPUT_LAYOUT,
+	CREATE_SAMPLER_STATE,
+	MAP,
+	SET_VERTEX_BUFFERS,
+	SET_INDEX_BUFFER,
+	SET_SHADER,
+	SET_CONSTANT_BUFFERS,
+	SET_SHADER_RESOURCES,
+	SET_SAMPLERS,
+	SET_BLEND_STATE,
+	SET_RASTERIZER_STATE,
+	SET_DEPTH_STENCIL_STATE,
+	DRAW
+};
+const uint kNumRenderBackendCalls = 17u;
+
+struct NullRenderBackendStats {
+	NullRenderBackendStats() {
+		Reset();
+	}
+
+	/** The number of calls made, per RenderBackendCall */
+	uint Calls[kNumRenderBackendCalls];
+	/** The number of bytes passed as initial data to the Create*() functions */
+	uint64 BytesCreated;
+	/**
+	 * The number of bytes mapped with MapDiscard(). A discard hands out the whole buffer,
+	 * so this is the size of the buffers, rather than the number of bytes actually written.
+	 * Maps made with MapNoOverwrite() only count as calls, since they rewrite just part of a buffer
+	 */
+	uint64 BytesUploaded;
+	/** The number of primitives drawn, assuming triangle lists */
+	uint64 TrianglesDrawn;
+
+	inline void Reset() {
+		memset(Calls, 0, sizeof(Calls));
+		BytesCreated = 0ull;
+		BytesUploaded = 0ull;
+		TrianglesDrawn = 0ull;
+	}
+
+	inline uint GetCalls(RenderBackendCall call) const { return Calls[static_cast<uint>(call)]; }
+};
+
+/**
+ * A backend without a device. Every call is counted, and then dropped.
+ *
+ * The Create*() functions hand out stub D3D11 objects, so the callers can keep reference
+ * counting, comparing, and releasing them as usual. Dynamic buffers get system memory
+ * backing, so MapDiscard() returns writable memory. Shaders and input layouts ignore their
+ * bytecode, so callers can pass any data they like
+ */
+class NullRenderBackend : public RenderBackend {
+public:
+	NullRenderBackend();
+
+private:
+	NullRenderBackendStats m_stats;
+	/** Guards m_stats in the Create*() functions, since they can be called from any thread */
+	std::mutex m_createLock;
+
+public:
+	/** Returns a copy of the stats counted since the last ResetStats() */
+	NullRenderBackendStats GetStats();
+	void ResetStats();
+
+	ID3D11Device *GetDevice();
+
+	HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc, const D3D11_SUBRESOURCE_DATA *initialData, ID3D11Buffer **buffer);
+	HRESULT CreateShaderResourceView(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, ID3D11ShaderResourceView **view);
+	HRESULT CreateUnorderedAccessView(ID3D11Resource *resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, ID3D11UnorderedAccessView **view);
+	HRESULT CreateVertexShader(const void *bytecode, size_t bytecodeLength, ID3D11VertexShader **vertexShader);
+	HRESULT CreatePixelShader(const void *bytecode, size_t bytecodeLength, ID3D11PixelShader **pixelShader);
+	HRESULT CreateComputeShader(const void *bytecode, size_t bytecodeLength, ID3D11ComputeShader **computeShader);
+	HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *elementDescs, uint numElements, const void *bytecode, size_t bytecodeLength, ID3D11InputLayout **inputLayout);
+	/**
+	 * Not part of RenderBackend, since the renderer creates its samplers on the device, through
+	 * SamplerStateManager. Lets code that only has a NullRenderBackend make stand-in samplers
+	 */
+	HRESULT CreateSamplerState(const D3D11_SAMPLER_DESC *desc, ID3D11SamplerState **samplerState);
+
+	void *MapDiscard(ID3D11Buffer *buffer);
+	void *MapNoOverwrite(ID3D11Buffer *buffer);
+	void Unmap(ID3D11Buffer *buffer);
+
+	void IASetVertexBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers, const uint *strides, const uint *offsets);
+	void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, uint offset);
+
+	void VSSetShader(ID3D11VertexShader *vertexShader);
+	void PSSetShader(ID3D11PixelShader *pixelShader);
+	void CSSetShader(ID3D11ComputeShader *computeShader);
+
+	void VSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+	void PSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+	void CSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers);
+
+	void PSSetShaderResources(uint startSlot, uint numViews, ID3D11ShaderResourceView * const *views);
+	void PSSetSamplers(uint startSlot, uint numSamplers, ID3D11SamplerState * const *samplers);
+
+	void OMSetBlendState(ID3D11BlendState *blendState, const float blendFactor[4], uint sampleMask);
+	void RSSetState(ID3D11RasterizerState *rasterizerState);
+	void OMSetDepthStencilState(ID3D11DepthStencilState *depthStencilState, uint stencilRef);
+
+	void Draw(uint vertexCount, uint startVertex);
+	void DrawIndexed(uint indexCount, uint startIndex, int baseVertex);
+	void DrawIndexedInstanced(uint indexCountPerInstance, uint instanceCount, uint startIndex, int baseVertex, uint startInstance);
+
+private:
+	inline void AddCall(RenderBackendCall call) { ++m_stats.Calls[static_cast<uint>(call)]; }
+
+	// Not implemented
+	NullRenderBackend(const NullRenderBackend &);
+	NullRenderBackend &operator=(const NullRenderBackend &);
+};
+
+} // End of namespace Graphics
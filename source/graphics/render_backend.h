@@ -0,0 +1,86 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+
+#include <d3d11.h>
+
+
+namespace Graphics {
+
+/**
+ * The device calls made by the renderer. Commands, StructuredBuffer, the shaders, and Model
+ * go through a RenderBackend instead of talking to D3D11 directly, so the CPU side of the
+ * renderer can run against a NullRenderBackend, without a GPU
+ *
+ * The resources are still D3D11 interfaces, so the rest of the engine can keep using them as
+ * handles. Each backend creates its own, and they must only be used with the backend that
+ * created them.
+ *
+ * The creation functions are thread-safe. Like the D3D11 immediate context, the rest must
+ * only be called from one thread at a time
+ */
+class RenderBackend {
+public:
+	virtual ~RenderBackend() {}
+
+	/**
+	 * Returns the D3D11 device, for the systems that still create their resources directly,
+	 * like textures and device states. Returns nullptr if the backend doesn't have a device
+	 */
+	virtual ID3D11Device *GetDevice() = 0;
+
+	virtual HRESULT CreateBuffer(const D3D11_BUFFER_DESC *desc, const D3D11_SUBRESOURCE_DATA *initialData, ID3D11Buffer **buffer) = 0;
+	virtual HRESULT CreateShaderResourceView(ID3D11Resource *resource, const D3D11_SHADER_RESOURCE_VIEW_DESC *desc, ID3D11ShaderResourceView **view) = 0;
+	virtual HRESULT CreateUnorderedAccessView(ID3D11Resource *resource, const D3D11_UNORDERED_ACCESS_VIEW_DESC *desc, ID3D11UnorderedAccessView **view) = 0;
+	virtual HRESULT CreateVertexShader(const void *bytecode, size_t bytecodeLength, ID3D11VertexShader **vertexShader) = 0;
+	virtual HRESULT CreatePixelShader(const void *bytecode, size_t bytecodeLength, ID3D11PixelShader **pixelShader) = 0;
+	virtual HRESULT CreateComputeShader(const void *bytecode, size_t bytecodeLength, ID3D11ComputeShader **computeShader) = 0;
+	virtual HRESULT CreateInputLayout(const D3D11_INPUT_ELEMENT_DESC *elementDescs, uint numElements, const void *bytecode, size_t bytecodeLength, ID3D11InputLayout **inputLayout) = 0;
+
+	/**
+	 * Maps a dynamic buffer with D3D11_MAP_WRITE_DISCARD
+	 *
+	 * @return    A pointer to the buffer memory, or nullptr if the buffer couldn't be mapped
+	 */
+	virtual void *MapDiscard(ID3D11Buffer *buffer) = 0;
+	/**
+	 * Maps a dynamic buffer with D3D11_MAP_WRITE_NO_OVERWRITE, so data can be appended to it while
+	 * the GPU still reads the parts written before. The caller must only write to parts it hasn't
+	 * written since the last MapDiscard(). If the buffer can't be mapped without overwriting, it's
+	 * discarded instead, so the caller must not rely on the rest of the buffer keeping its contents
+	 *
+	 * @return    A pointer to the buffer memory, or nullptr if the buffer couldn't be mapped
+	 */
+	virtual void *MapNoOverwrite(ID3D11Buffer *buffer) = 0;
+	virtual void Unmap(ID3D11Buffer *buffer) = 0;
+
+	virtual void IASetVertexBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers, const uint *strides, const uint *offsets) = 0;
+	virtual void IASetIndexBuffer(ID3D11Buffer *buffer, DXGI_FORMAT format, uint offset) = 0;
+
+	virtual void VSSetShader(ID3D11VertexShader *vertexShader) = 0;
+	virtual void PSSetShader(ID3D11PixelShader *pixelShader) = 0;
+	virtual void CSSetShader(ID3D11ComputeShader *computeShader) = 0;
+
+	virtual void VSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) = 0;
+	virtual void PSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) = 0;
+	virtual void CSSetConstantBuffers(uint startSlot, uint numBuffers, ID3D11Buffer * const *buffers) = 0;
+
+	virtual void PSSetShaderResources(uint startSlot, uint numViews, ID3D11ShaderResourceView * const *views) = 0;
+	virtual void PSSetSamplers(uint startSlot, uint numSamplers, ID3D11SamplerState * const *samplers) = 0;
+
+	virtual void OMSetBlendState(ID3D11BlendState *blendState, const float blendFactor[4], uint sampleMask) = 0;
+	virtual void RSSetState(ID3D11RasterizerState *rasterizerState) = 0;
+	virtual void OMSetDepthStencilState(ID3D11DepthStencilState *depthStencilState, uint stencilRef) = 0;
+
+	virtual void Draw(uint vertexCount, uint startVertex) = 0;
+	virtual void DrawIndexed(uint indexCount, uint startIndex, int baseVertex) = 0;
+	virtual void DrawIndexedInstanced(uint indexCountPerInstance, uint instanceCount, uint startIndex, int baseVertex, uint startInstance) = 0;
+};
+
+} // End of namespace Graphics
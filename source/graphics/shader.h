@@ -9,23 +9,25 @@
 #include "common/typedefs.h"
 
 #include "graphics/d3d_util.h"
+#include "graphics/render_backend.h"
 
 #include <d3d11.h>
 
 
 namespace Graphics {
 
-void SetConstants(ID3D11DeviceContext *context, ID3D11Buffer *buffer, void *data, size_t dataSize, uint slotNumber);
+void SetConstants(RenderBackend *backend, ID3D11Buffer *buffer, void *data, size_t dataSize, uint slotNumber);
 
 struct DefaultShaderConstantType {};
 
 template <typename ShaderType, typename PerFrameType, typename PerObjectType>
 class BaseShader {
 protected:
-	BaseShader(ID3D11Device *device, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
+	BaseShader(RenderBackend *backend, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
 			: m_d3dShader(nullptr),
 			  m_perFrameConstantBuffer(nullptr), 
-			  m_perObjectConstantBuffer(nullptr) {
+			  m_perObjectConstantBuffer(nullptr),
+			  m_sortId(0u) {
 		// Create the two buffers
 		D3D11_BUFFER_DESC bufferDesc;
 		bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
@@ -37,12 +39,12 @@ protected:
 		if (hasPerFrameBuffer) {
 			assert(sizeof(PerFrameType) > 0);
 			bufferDesc.ByteWidth = static_cast<uint>(Graphics::CBSize(sizeof(PerFrameType)));
-			device->CreateBuffer(&bufferDesc, nullptr, &m_perFrameConstantBuffer);
+			backend->CreateBuffer(&bufferDesc, nullptr, &m_perFrameConstantBuffer);
 		}
 		if (hasPerObjectBuffer) {
 			assert(sizeof(PerObjectType) > 0);
 			bufferDesc.ByteWidth = static_cast<uint>(Graphics::CBSize(sizeof(PerObjectType)));
-			device->CreateBuffer(&bufferDesc, nullptr, &m_perObjectConstantBuffer);
+			backend->CreateBuffer(&bufferDesc, nullptr, &m_perObjectConstantBuffer);
 		}
 	}
 
@@ -57,24 +59,28 @@ protected:
 	ShaderType *m_d3dShader;
 	ID3D11Buffer *m_perFrameConstantBuffer;
 	ID3D11Buffer *m_perObjectConstantBuffer;
+	/** A small, dense id for sort keys. Assigned once by whoever creates the shader, like MaterialShaderManager */
+	uint m_sortId;
 
 public:
 	inline ID3D11Buffer *GetPerFrameConstantBuffer() { return m_perFrameConstantBuffer; }
 	inline ID3D11Buffer *GetPerObjectConstantBuffer() { return m_perObjectConstantBuffer; }
-	virtual inline void BindToPipeline(ID3D11DeviceContext *context) = 0;
+	inline uint GetSortId() const { return m_sortId; }
+	inline void SetSortId(uint sortId) { m_sortId = sortId; }
+	virtual inline void BindToPipeline(RenderBackend *backend) = 0;
 	
 };
 
 template <typename PerFrameType = DefaultShaderConstantType, typename PerObjectType = DefaultShaderConstantType>
 class VertexShader : public BaseShader<ID3D11VertexShader, PerFrameType, PerObjectType> {
 public:
-	VertexShader(const wchar *fileName, ID3D11Device *device, bool hasPerFrameBuffer, bool hasPerObjectBuffer, ID3D11InputLayout **inputLayout = nullptr, D3D11_INPUT_ELEMENT_DESC *vertexDesc = nullptr, uint numElements = 0) 
-			: BaseShader(device, hasPerFrameBuffer, hasPerObjectBuffer) {
-		LoadVertexShader(fileName, device, &m_d3dShader, inputLayout, vertexDesc, numElements);
+	VertexShader(const wchar *fileName, RenderBackend *backend, bool hasPerFrameBuffer, bool hasPerObjectBuffer, ID3D11InputLayout **inputLayout = nullptr, D3D11_INPUT_ELEMENT_DESC *vertexDesc = nullptr, uint numElements = 0) 
+			: BaseShader(backend, hasPerFrameBuffer, hasPerObjectBuffer) {
+		LoadVertexShader(fileName, backend, &m_d3dShader, inputLayout, vertexDesc, numElements);
 	}
 
-	inline virtual void BindToPipeline(ID3D11DeviceContext *context) {
-		context->VSSetShader(m_d3dShader, nullptr, 0);
+	inline virtual void BindToPipeline(RenderBackend *backend) {
+		backend->VSSetShader(m_d3dShader);
 	}
 };
 
@@ -82,54 +88,54 @@ public:
 template <typename PerFrameType = DefaultShaderConstantType, typename PerObjectType = DefaultShaderConstantType>
 class PixelShader : public BaseShader<ID3D11PixelShader, PerFrameType, PerObjectType> {
 public:
-	PixelShader(const wchar *fileName, ID3D11Device *device, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
-			: BaseShader(device, hasPerFrameBuffer, hasPerObjectBuffer) {
-		LoadPixelShader(fileName, device, &m_d3dShader);
+	PixelShader(const wchar *fileName, RenderBackend *backend, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
+			: BaseShader(backend, hasPerFrameBuffer, hasPerObjectBuffer) {
+		LoadPixelShader(fileName, backend, &m_d3dShader);
 	}
 
-	inline virtual void BindToPipeline(ID3D11DeviceContext *context) {
-		context->PSSetShader(m_d3dShader, nullptr, 0);
+	inline virtual void BindToPipeline(RenderBackend *backend) {
+		backend->PSSetShader(m_d3dShader);
 	}
 
-	void SetPerFrameConstants(ID3D11DeviceContext *context, PerFrameType *perFrameData, uint slotNumber) {
-		SetConstants(context, m_perFrameConstantBuffer, perFrameData, sizeof(PerFrameType), slotNumber);
+	void SetPerFrameConstants(RenderBackend *backend, PerFrameType *perFrameData, uint slotNumber) {
+		SetConstants(backend, m_perFrameConstantBuffer, perFrameData, sizeof(PerFrameType), slotNumber);
 
 		// Bind it to the shader
-		context->PSSetConstantBuffers(slotNumber, 1u, &m_perFrameConstantBuffer);
+		backend->PSSetConstantBuffers(slotNumber, 1u, &m_perFrameConstantBuffer);
 	}
 
-	void SetPerObjectConstants(ID3D11DeviceContext *context, PerObjectType *perObjectData, uint slotNumber) {
-		SetConstants(context, m_perObjectConstantBuffer, perObjectData, sizeof(PerObjectType), slotNumber);
+	void SetPerObjectConstants(RenderBackend *backend, PerObjectType *perObjectData, uint slotNumber) {
+		SetConstants(backend, m_perObjectConstantBuffer, perObjectData, sizeof(PerObjectType), slotNumber);
 
 		// Bind it to the shader
-		context->PSSetConstantBuffers(slotNumber, 1u, &m_perObjectConstantBuffer);
+		backend->PSSetConstantBuffers(slotNumber, 1u, &m_perObjectConstantBuffer);
 	}
 };
 
 template <typename PerFrameType = DefaultShaderConstantType, typename PerObjectType = DefaultShaderConstantType>
 class ComputeShader : public BaseShader<ID3D11ComputeShader, PerFrameType, PerObjectType> {
 public:
-	ComputeShader(const wchar *fileName, ID3D11Device *device, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
-			: BaseShader(device, hasPerFrameBuffer, hasPerObjectBuffer) {
-		LoadComputeShader(fileName, device, &m_d3dShader);
+	ComputeShader(const wchar *fileName, RenderBackend *backend, bool hasPerFrameBuffer, bool hasPerObjectBuffer)
+			: BaseShader(backend, hasPerFrameBuffer, hasPerObjectBuffer) {
+		LoadComputeShader(fileName, backend, &m_d3dShader);
 	}
 
-	inline virtual void BindToPipeline(ID3D11DeviceContext *context) {
-		context->CSSetShader(m_d3dShader, nullptr, 0);
+	inline virtual void BindToPipeline(RenderBackend *backend) {
+		backend->CSSetShader(m_d3dShader);
 	}
 
-	void SetPerFrameConstants(ID3D11DeviceContext *context, PerFrameType *perFrameData, uint slotNumber) {
-		SetConstants(context, m_perFrameConstantBuffer, perFrameData, sizeof(PerFrameType), slotNumber);
+	void SetPerFrameConstants(RenderBackend *backend, PerFrameType *perFrameData, uint slotNumber) {
+		SetConstants(backend, m_perFrameConstantBuffer, perFrameData, sizeof(PerFrameType), slotNumber);
 
 		// Bind it to the shader
-		context->CSSetConstantBuffers(slotNumber, 1u, &m_perFrameConstantBuffer);
+		backend->CSSetConstantBuffers(slotNumber, 1u, &m_perFrameConstantBuffer);
 	}
 
-	void SetPerObjectConstants(ID3D11DeviceContext *context, PerObjectType *perObjectData, uint slotNumber) {
-		SetConstants(context, m_perObjectConstantBuffer, perObjectData, sizeof(PerObjectType), slotNumber);
+	void SetPerObjectConstants(RenderBackend *backend, PerObjectType *perObjectData, uint slotNumber) {
+		SetConstants(backend, m_perObjectConstantBuffer, perObjectData, sizeof(PerObjectType), slotNumber);
 
 		// Bind it to the shader
-		context->CSSetConstantBuffers(slotNumber, 1u, &m_perObjectConstantBuffer);
+		backend->CSSetConstantBuffers(slotNumber, 1u, &m_perObjectConstantBuffer);
 	}
 };
 
@@ -0,0 +1,74 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/halfling_sys.h"
+
+
+namespace Graphics {
+
+/**
+ * A field of an integral sort key, 'kBits' wide, starting 'kOffset' bits above the LSB
+ *
+ * A value too large for the field doesn't wrap into the fields above it. Encode() asserts,
+ * and then saturates to the largest value the field can hold
+ *
+ * @tparam kOffset    The offset of the field's LSB within the key
+ * @tparam kBits      The width of the field. Between 1 and 32 bits
+ */
+template <uint kOffset, uint kBits>
+struct SortKeyField {
+	static_assert(kBits > 0u && kBits <= 32u, "A sort key field must be between 1 and 32 bits wide");
+	static_assert(kOffset + kBits <= 64u, "A sort key field must fit within 64 bits");
+
+	static const uint kFieldOffset = kOffset;
+	static const uint kFieldBits = kBits;
+	static const uint64 kMaxValue = (1ull << kBits) - 1ull;
+	static const uint64 kMask = ((1ull << kBits) - 1ull) << kOffset;
+
+	static inline uint64 Encode(uint value) {
+		AssertMsg(value <= kMaxValue, L"Sort key field overflow. " << value << L" doesn't fit in " << static_cast<uint>(kBits) << L" bits");
+
+		uint64 saturated = value <= kMaxValue ? static_cast<uint64>(value) : static_cast<uint64>(kMaxValue);
+		return saturated << kOffset;
+	}
+
+	/**
+	 * Quantizes a value in [0, 1] to the full range of the field. Values outside the range
+	 * are clamped, rather than asserting, since they're expected for things like depth
+	 */
+	static inline uint64 EncodeUnorm(float value) {
+		value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+		return static_cast<uint64>(value * static_cast<float>(kMaxValue) + 0.5f) << kOffset;
+	}
+
+	static inline uint Decode(uint64 key) {
+		return static_cast<uint>((key & kMask) >> kOffset);
+	}
+};
+
+/**
+ * Combines the masks of a list of SortKeyFields, so a key layout can be checked with
+ * static_assert. kDisjoint is false if any of the fields overlap
+ */
+template <typename... Fields>
+struct SortKeyLayout;
+
+template <>
+struct SortKeyLayout<> {
+	static const uint64 kMask = 0ull;
+	static const bool kDisjoint = true;
+};
+
+template <typename Field, typename... Rest>
+struct SortKeyLayout<Field, Rest...> {
+	static const uint64 kMask = Field::kMask | SortKeyLayout<Rest...>::kMask;
+	static const bool kDisjoint = (Field::kMask & SortKeyLayout<Rest...>::kMask) == 0ull && SortKeyLayout<Rest...>::kDisjoint;
+};
+
+} // End of namespace Graphics
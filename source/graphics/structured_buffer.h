@@ -23,6 +23,7 @@
 #pragma once
 
 #include "graphics/d3d_util.h"
+#include "graphics/render_backend.h"
 
 #include <d3d11.h>
 #include <vector>
@@ -35,7 +36,7 @@ template <typename T>
 class StructuredBuffer {
 public:
 	// Construct a structured buffer
-	StructuredBuffer(ID3D11Device *d3dDevice, int numElements,
+	StructuredBuffer(RenderBackend *backend, int numElements,
 	                 UINT bindFlags = D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE,
 	                 bool dynamic = false);
 	~StructuredBuffer();
@@ -54,8 +55,8 @@ public:
 
 	// Only valid for dynamic buffers
 	// TODO: Support NOOVERWRITE ring buffer?
-	T *MapDiscard(ID3D11DeviceContext *d3dDeviceContext);
-	void Unmap(ID3D11DeviceContext *d3dDeviceContext);
+	T *MapDiscard(RenderBackend *backend);
+	void Unmap(RenderBackend *backend);
 
 private:
 	// Not implemented
@@ -65,7 +66,7 @@ private:
 
 
 template <typename T>
-StructuredBuffer<T>::StructuredBuffer(ID3D11Device *d3dDevice, int numElements, UINT bindFlags, bool dynamic)
+StructuredBuffer<T>::StructuredBuffer(RenderBackend *backend, int numElements, UINT bindFlags, bool dynamic)
 		: m_numElements(numElements),
 		  m_shaderResource(0),
 		  m_unorderedAccess(0) {
@@ -75,14 +76,14 @@ StructuredBuffer<T>::StructuredBuffer(ID3D11Device *d3dDevice, int numElements,
 	                        D3D11_RESOURCE_MISC_BUFFER_STRUCTURED,
 	                        sizeof(T));
 
-	d3dDevice->CreateBuffer(&desc, 0, &mBuffer);
+	backend->CreateBuffer(&desc, 0, &mBuffer);
 
 	if (bindFlags & D3D11_BIND_UNORDERED_ACCESS) {
-		d3dDevice->CreateUnorderedAccessView(mBuffer, 0, &m_unorderedAccess);
+		backend->CreateUnorderedAccessView(mBuffer, 0, &m_unorderedAccess);
 	}
 
 	if (bindFlags & D3D11_BIND_SHADER_RESOURCE) {
-		d3dDevice->CreateShaderResourceView(mBuffer, 0, &m_shaderResource);
+		backend->CreateShaderResourceView(mBuffer, 0, &m_shaderResource);
 	}
 }
 
@@ -94,16 +95,13 @@ StructuredBuffer<T>::~StructuredBuffer() {
 }
 
 template <typename T>
-T *StructuredBuffer<T>::MapDiscard(ID3D11DeviceContext *d3dDeviceContext) {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	d3dDeviceContext->Map(mBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-
-	return static_cast<T *>(mappedResource.pData);
+T *StructuredBuffer<T>::MapDiscard(RenderBackend *backend) {
+	return static_cast<T *>(backend->MapDiscard(mBuffer));
 }
 
 template <typename T>
-void StructuredBuffer<T>::Unmap(ID3D11DeviceContext *d3dDeviceContext) {
-	d3dDeviceContext->Unmap(mBuffer, 0);
+void StructuredBuffer<T>::Unmap(RenderBackend *backend) {
+	backend->Unmap(mBuffer);
 }
 
 
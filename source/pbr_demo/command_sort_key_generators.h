@@ -7,10 +7,10 @@
 #pragma once
 
 #include "graphics/shader.h"
+#include "graphics/sort_key.h"
 
 #include "scene/materials.h"
-
-#include <unordered_map>
+#include "scene/model.h"
 
 
 namespace PBRDemo {
@@ -25,23 +25,71 @@ namespace PBRDemo {
 // Vertex / index buffer bind
 // cbuffer change
 
+/**
+ * Builds the sort keys for the GBuffer pass from the sort ids stored on the shaders,
+ * materials, and models. Generating a key is just a few shifts, so it's thread-safe and
+ * can be done while recording
+ */
 class GBufferSortKeyGenerator {
-private:
-	std::unordered_map<Graphics::MaterialShader *, uint16> m_materialShaderMap;
-	std::unordered_map<const Scene::Material *, uint16> m_materialMap;
-	std::unordered_map<ID3D11Buffer *, uint16> m_vertexBufferMap;
-	std::unordered_map<ID3D11Buffer *, uint16> m_indexBufferMap;
-
 public:
 	// From MSB to LSB
-	// 12 bits - 4098 values - Material Shader
-	// 12 bits - 4098 values - Material (representing the textures)
-	// 12 bits - 4098 values - Vertex buffer
-	// 12 bits - 4098 values - Index buffer
-	// 
-	// Total - 48 bits
-	// Material
-	uint64 GenerateKey(Graphics::MaterialShader *materialShader, const Scene::Material *material, ID3D11Buffer *vertexBuffer, ID3D11Buffer *indexBuffer);
+	// 12 bits - 4096 values  - Material Shader
+	// 16 bits - 65536 values - Material (representing the textures)
+	// 20 bits - ~1M values   - Model (representing the vertex and index buffers)
+	// 16 bits - 65536 values - View depth, front to back
+	//
+	// Total - 64 bits
+	typedef Graphics::SortKeyField<52u, 12u> MaterialShaderField;
+	typedef Graphics::SortKeyField<36u, 16u> MaterialField;
+	typedef Graphics::SortKeyField<16u, 20u> ModelField;
+	typedef Graphics::SortKeyField<0u, 16u> DepthField;
+
+	typedef Graphics::SortKeyLayout<MaterialShaderField, MaterialField, ModelField, DepthField> Layout;
+	static_assert(Layout::kDisjoint, "The GBuffer sort key fields overlap");
+	static_assert(Layout::kMask == ~0ull, "The GBuffer sort key leaves bits unused");
+
+	// The keys of the draws that can be merged split the depth bits
+	//
+	// 4 bits  - 16 values   - Subset index
+	// 12 bits - 4096 values - View depth, front to back
+	typedef Graphics::SortKeyField<12u, 4u> SubsetField;
+	typedef Graphics::SortKeyField<0u, 12u> InstanceDepthField;
+
+	typedef Graphics::SortKeyLayout<MaterialShaderField, MaterialField, ModelField, SubsetField, InstanceDepthField> InstanceableLayout;
+	static_assert(InstanceableLayout::kDisjoint, "The instanceable GBuffer sort key fields overlap");
+	static_assert(InstanceableLayout::kMask == ~0ull, "The instanceable GBuffer sort key leaves bits unused");
+
+public:
+	/**
+	 * @param materialShader    The shader of the subset's material
+	 * @param material          The subset's material
+	 * @param model             The model the subset belongs to
+	 * @param viewDepth         The view space depth of the model, normalized to [0, 1] between the near and far clip planes
+	 */
+	static inline uint64 GenerateKey(const Graphics::MaterialShader *materialShader, const Scene::Material *material, const Scene::Model *model, float viewDepth) {
+		return MaterialShaderField::Encode(materialShader->GetSortId()) |
+		       MaterialField::Encode(material->SortId) |
+		       ModelField::Encode(model->SortId) |
+		       DepthField::EncodeUnorm(viewDepth);
+	}
+
+	/**
+	 * Builds the key for a draw that the bucket can merge with its neighbours. The subset index comes
+	 * before the depth, so the subsets of a model that share a material don't interleave, and the
+	 * draws of each subset stay next to each other. Within a subset, the draws are still sorted front
+	 * to back, so the merged draws, and the instances inside each of them, go out in depth order.
+	 * Subsets past the 16th share their index bits with earlier ones, which only costs some merges
+	 *
+	 * @param subsetIndex    The index of the subset within the model
+	 * @param viewDepth      The view space depth of the model, normalized to [0, 1] between the near and far clip planes
+	 */
+	static inline uint64 GenerateInstanceableKey(const Graphics::MaterialShader *materialShader, const Scene::Material *material, const Scene::Model *model, uint subsetIndex, float viewDepth) {
+		return MaterialShaderField::Encode(materialShader->GetSortId()) |
+		       MaterialField::Encode(material->SortId) |
+		       ModelField::Encode(model->SortId) |
+		       SubsetField::Encode(static_cast<uint>(subsetIndex & SubsetField::kMaxValue)) |
+		       InstanceDepthField::EncodeUnorm(viewDepth);
+	}
 };
 
 } // End of namespace PBRDemo
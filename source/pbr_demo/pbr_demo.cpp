@@ -6,9 +6,20 @@
 
 #include "pbr_demo/pbr_demo.h"
 
+#include "graphics/command_replayer.h"
+#include "graphics/null_render_backend.h"
+
+#include <algorithm>
+
 
 namespace PBRDemo {
 
+/** Record the gbuffer commands on every hardware thread */
+static uint GetNumGBufferRecordingThreads() {
+	uint hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	return std::min<uint>(hardwareThreads, Graphics::CommandBucket<uint64, Common::VirtualLinearAllocator>::kMaxRecordingThreads);
+}
+
 LRESULT PBRDemo::MsgProc(HWND hwnd, uint msg, WPARAM wParam, LPARAM lParam) {
 	// Send event message to AntTweakBar
 	if (TwEventWin(hwnd, msg, wParam, lParam)) {
@@ -25,11 +36,17 @@ PBRDemo::PBRDemo(HINSTANCE hinstance)
 	  m_farClip(5000.0f),
 	  m_cameraPanFactor(1.0f),
 	  m_cameraScrollFactor(1.0f),
-	  m_gbufferBucket(2048ull),
+	  m_workerPool(GetNumGBufferRecordingThreads() - 1u),
+	  m_gbufferBucket(16ull * 1024ull * 1024ull, GetNumGBufferRecordingThreads(), 2048u, &m_workerPool),
+	  m_instancedGBufferBucket(64ull * 1024ull, 1u, 16u),
+	  m_instancedGBufferWireframe(false),
 	  m_globalWorldTransform(DirectX::XMMatrixIdentity()),
 	  m_camera(0.0f, 0.45f * DirectX::XM_PI, 100.0f),
 	  m_showConsole(false),
+	  m_occlusionCuller(kOcclusionBufferWidth, kOcclusionBufferHeight, &m_workerPool),
 	  m_instanceBuffer(nullptr),
+	  m_autoInstancing(true),
+	  m_autoInstanceBuffer(nullptr),
 	  m_sceneLoaded(false),
 	  m_sceneIsSetup(false),
 	  m_sceneScaleFactor(0.0f),
@@ -37,6 +54,29 @@ PBRDemo::PBRDemo(HINSTANCE hinstance)
 	  m_vsync(false),
 	  m_wireframe(false),
 	  m_animateLights(true),
+	  m_frustumCulling(true),
+	  m_numModelsCulled(0u),
+	  m_numSubsetsCulled(0u),
+	  m_numInstancesCulled(0u),
+	  m_occlusionCulling(true),
+	  m_dumpOcclusionDepth(false),
+	  m_numOccluderTriangles(0u),
+	  m_numModelsOccluded(0u),
+	  m_numSubsetsOccluded(0u),
+	  m_numInstancesOccluded(0u),
+	  m_pickedModel(-1),
+	  m_pickedInstancedModel(-1),
+	  m_pickedInstance(-1),
+	  m_numGBufferStateBinds(0u),
+	  m_numGBufferStateBindsSkipped(0u),
+	  m_numGBufferInstancedDraws(0u),
+	  m_numGBufferDrawsCollapsed(0u),
+	  m_captureGBuffer(false),
+	  m_replayGBufferCaptures(false),
+	  m_numReplayedGBufferFrames(0u),
+	  m_numReplayedGBufferDrawsPerFrame(0u),
+	  m_numReplayedGBufferMapsPerFrame(0u),
+	  m_numReplayedGBufferCommandsSkipped(0u),
 	  m_numPointLightsToDraw(0u),
 	  m_numSpotLightsToDraw(0u),
 	  m_backbufferRTV(nullptr),
@@ -56,6 +96,7 @@ void PBRDemo::Shutdown() {
 	delete m_pointLightBuffer;
 	delete m_spotLightBuffer;
 	delete m_instanceBuffer;
+	delete m_autoInstanceBuffer;
 	delete(m_instancedGBufferVertexShader);
 	delete(m_fullscreenTriangleVertexShader);
 	delete(m_tiledCullFinalGatherComputeShader);
@@ -185,6 +226,11 @@ void PBRDemo::MouseDown(WPARAM buttonState, int x, int y) {
 	m_mouseLastPos.x = x;
 	m_mouseLastPos.y = y;
 
+	// Alt + left button rotates the camera. A plain left click picks the model under the cursor
+	if ((buttonState & MK_LBUTTON) != 0 && (GetKeyState(VK_MENU) & 0x8000) == 0) {
+		PickModel(x, y);
+	}
+
 	SetCapture(m_hwnd);
 }
 
@@ -214,6 +260,77 @@ void PBRDemo::MouseMove(WPARAM buttonState, int x, int y) {
 	m_mouseLastPos.y = y;
 }
 
+void PBRDemo::PickModel(int x, int y) {
+	// The BVHs are built along with the rest of the scene
+	if (!m_sceneIsSetup) {
+		return;
+	}
+
+	// Build the ray through the pixel in view space, and then move it to world space. Going
+	// through the projection scale, rather than unprojecting, works for any depth mapping
+	DirectX::XMMATRIX proj = m_camera.GetProj();
+	float viewX = (2.0f * static_cast<float>(x) / static_cast<float>(m_clientWidth) - 1.0f) / DirectX::XMVectorGetX(proj.r[0]);
+	float viewY = (1.0f - 2.0f * static_cast<float>(y) / static_cast<float>(m_clientHeight)) / DirectX::XMVectorGetY(proj.r[1]);
+
+	DirectX::XMMATRIX inverseView = DirectX::XMMatrixInverse(nullptr, m_camera.GetView());
+	DirectX::XMFLOAT3 origin;
+	DirectX::XMFLOAT3 direction;
+	DirectX::XMStoreFloat3(&origin, m_camera.GetCameraPositionXM());
+	DirectX::XMStoreFloat3(&direction, DirectX::XMVector3Normalize(DirectX::XMVector3TransformNormal(DirectX::XMVectorSet(viewX, viewY, 1.0f, 0.0f), inverseView)));
+
+	m_pickedModel = -1;
+	m_pickedInstancedModel = -1;
+	m_pickedInstance = -1;
+
+	// Each raycast only accepts hits closer than the closest one so far
+	float closest = m_farClip;
+	uint item;
+	float distance;
+	if (m_modelBVH.Raycast(origin, direction, closest, &item, &distance)) {
+		m_pickedModel = static_cast<int>(item);
+		closest = distance;
+	}
+	for (uint i = 0; i < m_instanceBVHs.size(); ++i) {
+		if (m_instanceBVHs[i].Raycast(origin, direction, closest, &item, &distance)) {
+			m_pickedModel = -1;
+			m_pickedInstancedModel = static_cast<int>(i);
+			m_pickedInstance = static_cast<int>(item);
+			closest = distance;
+		}
+	}
+}
+
+void PBRDemo::ReplayGBufferCaptures() {
+	const wchar *captureFiles[] = {kInstancedGBufferCaptureFile, kGBufferCaptureFile};
+
+	m_numReplayedGBufferFrames = 0u;
+	m_numReplayedGBufferDrawsPerFrame = 0u;
+	m_numReplayedGBufferMapsPerFrame = 0u;
+	m_numReplayedGBufferCommandsSkipped = 0u;
+
+	for (uint i = 0; i < sizeof(captureFiles) / sizeof(captureFiles[0]); ++i) {
+		// The resource ids are only unique within a capture, so each capture gets its own replayer
+		Graphics::NullRenderBackend backend;
+		Graphics::CommandReplayer replayer(&backend);
+		RegisterGBufferReplayTypes(&replayer);
+
+		// The stream only changes how runs of DrawIndexedInstanceable execute, and the gbuffer
+		// bucket only records those with auto instancing, which enables the stream
+		replayer.SetExecutionStreamEnabled(true);
+
+		uint numFrames = Graphics::ReplayCapture(captureFiles[i], &replayer);
+		if (numFrames == 0u) {
+			continue;
+		}
+
+		// The instanced bucket doesn't submit anything until there are instanced models, so it can have fewer frames
+		m_numReplayedGBufferFrames = std::max(m_numReplayedGBufferFrames, numFrames);
+		m_numReplayedGBufferDrawsPerFrame += backend.GetStats().GetCalls(Graphics::RenderBackendCall::DRAW) / numFrames;
+		m_numReplayedGBufferMapsPerFrame += backend.GetStats().GetCalls(Graphics::RenderBackendCall::MAP) / numFrames;
+		m_numReplayedGBufferCommandsSkipped += replayer.GetNumCommandsSkipped();
+	}
+}
+
 void PBRDemo::MouseWheel(int zDelta) {
 	// Make each wheel dedent correspond to a size based on the scene
 	m_camera.Zoom((float)zDelta * m_cameraScrollFactor);
@@ -12,6 +12,8 @@
 #include "graphics/command_bucket.h"
 #include "graphics/commands.h"
 
+#include "scene/frustum.h"
+
 #include <DirectXColors.h>
 
 #include <fastformat/fastformat.hpp>
@@ -20,6 +22,20 @@
 
 namespace PBRDemo {
 
+/** Sets the state shared by all the gbuffer draws of a model subset */
+static void SetGBufferDrawState(Graphics::Commands::DrawCommandBase *command, const Scene::Model *model, const Scene::Material *material, bool wireframe) {
+	command->SetMaterialShader(material->Shader);
+	command->SetVertexBuffer(model->VertexBuffer, model->VertexStride);
+	command->SetIndexBuffer(model->IndexBuffer, DXGI_FORMAT_R32_UINT);
+	for (uint k = 0; k < material->TextureSRVs.size(); ++k) {
+		command->SetTextureSRV(material->TextureSRVs[k], k);
+	}
+	for (uint k = 0; k < material->TextureSamplers.size(); ++k) {
+		command->SetTextureSampler(material->TextureSamplers[k], k);
+	}
+	command->SetRasterizerState(wireframe ? Graphics::RasterizerState::WIREFRAME : Graphics::RasterizerState::CULL_BACKFACES);
+}
+
 void PBRDemo::DrawFrame(double deltaTime) {
 	if (m_sceneLoaded.load(std::memory_order_relaxed)) {
 		if (!m_sceneIsSetup) {
@@ -53,6 +69,8 @@ void PBRDemo::DrawFrame(double deltaTime) {
 			m_cameraPanFactor = range * 0.0002857f;
 			m_cameraScrollFactor = range * 0.0002857f;
 
+			BuildSceneBVHs();
+
 			m_sceneIsSetup = true;
 		}
 		RenderMainPass();
@@ -99,7 +117,34 @@ void PBRDemo::RenderMainPass() {
 	m_immediateContext->IASetInputLayout(m_defaultInputLayout);
 	m_immediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	
+	// A capture has to be finished before it can be replayed
+	if (m_replayGBufferCaptures) {
+		m_captureGBuffer = false;
+	}
+
+	// Start or stop capturing the gbuffer frames. Each bucket submits its own frames, so each gets
+	// its own capture. Otherwise every delta would be taken against the other bucket's frame
+	if (m_captureGBuffer != m_gbufferCapture.IsOpen()) {
+		if (m_captureGBuffer) {
+			m_captureGBuffer = m_gbufferCapture.Open(kGBufferCaptureFile) && m_instancedGBufferCapture.Open(kInstancedGBufferCaptureFile);
+			if (!m_captureGBuffer) {
+				m_gbufferCapture.Close();
+			}
+		} else {
+			m_gbufferCapture.Close();
+			m_instancedGBufferCapture.Close();
+		}
+		m_gbufferBucket.SetCapture(m_captureGBuffer ? &m_gbufferCapture : nullptr);
+		m_instancedGBufferBucket.SetCapture(m_captureGBuffer ? &m_instancedGBufferCapture : nullptr);
+	}
+
+	if (m_replayGBufferCaptures) {
+		ReplayGBufferCaptures();
+		m_replayGBufferCaptures = false;
+	}
+
 	Graphics::GraphicsState currentGraphicsState;
+	Graphics::CommandContext commandContext(m_renderBackend, &m_blendStateManager, &m_rasterizerStateManager, &m_depthStencilStateManager, &currentGraphicsState);
 
 	float blendFactor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
 	m_immediateContext->OMSetBlendState(m_blendStateManager.BlendDisabled(), blendFactor, 0xFFFFFFFF);
@@ -113,159 +158,254 @@ void PBRDemo::RenderMainPass() {
 	// Cache the matrix multiplication
 	DirectX::XMMATRIX viewProj = viewMatrix * projectionMatrix;
 
+	// Only the models, subsets, and instances that intersect the camera frustum are drawn. The
+	// models and instances are found through their BVHs, so the cost follows what's visible
+	Scene::FrustumCuller frustumCuller(m_camera.GetFrustum());
+	bool frustumCulling = m_frustumCulling;
+	uint numModelsCulled = 0u;
+	std::atomic<uint> numSubsetsCulled(0u);
+	uint numInstancesCulled = 0u;
+
+	// The occluders are rasterized first, so the models, subsets, and instances hidden behind
+	// them are skipped before their packets are recorded
+	bool occlusionCulling = m_occlusionCulling && !m_occluderModels.empty();
+	std::atomic<uint> numModelsOccluded(0u);
+	std::atomic<uint> numSubsetsOccluded(0u);
+	uint numInstancesOccluded = 0u;
+	if (occlusionCulling) {
+		RasterizeOccluders(frustumCuller, viewProj);
+	}
+
 	// Draw instanced models
 	if (m_instancedModels.size() > 0) {
-		DirectX::XMVECTOR *instanceBuffer = m_instanceBuffer->MapDiscard(m_immediateContext);
-		std::vector<uint> offsets;
+		// The packets bake in the rasterizer state, so they all have to be recorded again when it changes
+		if (m_instancedGBufferWireframe != m_wireframe) {
+			m_instancedGBufferBucket.ClearPersistentCommands();
+			m_instancedGBufferInstanceCounts.clear();
+			m_instancedGBufferWireframe = m_wireframe;
+		}
+		m_instancedGBufferInstanceCounts.resize(m_instancedModels.size(), 0u);
+
+		DirectX::XMVECTOR *instanceBuffer = m_instanceBuffer->MapDiscard(m_renderBackend);
 		uint bufferOffset = 0;
-		for (auto iter = m_instancedModels.begin(); iter != m_instancedModels.end(); ++iter) {
+		for (uint i = 0; i < m_instancedModels.size(); ++i) {
 			assert(bufferOffset < static_cast<uint>(m_instanceBuffer->NumElements()));
 
-			// In the future when we support more complicated instancing, this could be something like:
-			//
-			// uint offset = bufferOffset;
-			// std::vector<DirectX::XMVECTOR, Common::AllocatorAligned16<DirectX::XMVECTOR> > instanceVectors = iter->second.InstanceVectors();
-			// for (auto vectorIter = instanceVectors.begin(); vectorIter != instanceVectors.end(); ++vectorIter) {
-			//     instanceBuffer[bufferOffset++] = *vectorIter;
-			// }
-			// 
-			// offsetAndLengths.emplace_back(offset);
+			auto instances = m_instancedModels[i].second;
 
+			// Each model keeps a range of the buffer big enough for all of its instances. The visible
+			// instances are packed at the start of the range, so culling never moves the other models
 			uint offset = bufferOffset;
-			for (auto instanceIter = iter->second->begin(); instanceIter != iter->second->end(); ++instanceIter) {
-				DirectX::XMMATRIX columnOrderMatrix = DirectX::XMMatrixTranspose(m_globalWorldTransform * (*instanceIter));
-				instanceBuffer[bufferOffset++] = columnOrderMatrix.r[0];
-				instanceBuffer[bufferOffset++] = columnOrderMatrix.r[1];
-				instanceBuffer[bufferOffset++] = columnOrderMatrix.r[2];
+			uint instanceCount = 0u;
+			uint instancesOccluded = 0u;
+			auto writeInstance = [&](uint instance) {
+				if (occlusionCulling && !m_occlusionCuller.IsVisible(m_instanceBVHs[i].GetItemBounds(instance))) {
+					++instancesOccluded;
+					return;
+				}
+
+				DirectX::XMMATRIX columnOrderMatrix = DirectX::XMMatrixTranspose(m_globalWorldTransform * (*instances)[instance]);
+				uint vector = offset + instanceCount * 3u;
+				instanceBuffer[vector] = columnOrderMatrix.r[0];
+				instanceBuffer[vector + 1] = columnOrderMatrix.r[1];
+				instanceBuffer[vector + 2] = columnOrderMatrix.r[2];
+				++instanceCount;
+			};
+
+			if (frustumCulling) {
+				m_instanceBVHs[i].QueryFrustum(frustumCuller, writeInstance);
+			} else {
+				for (uint j = 0; j < instances->size(); ++j) {
+					writeInstance(j);
+				}
 			}
 
-			offsets.emplace_back(offset);
+			bufferOffset += static_cast<uint>(instances->size()) * 3u;
+			numInstancesCulled += static_cast<uint>(instances->size()) - instanceCount - instancesOccluded;
+			numInstancesOccluded += instancesOccluded;
+
+			// The instance count is baked into the packets as well. So only the models whose
+			// visible instances changed have to be recorded again
+			if (instanceCount != m_instancedGBufferInstanceCounts[i]) {
+				m_instancedGBufferBucket.InvalidatePersistentCommands(instances);
+				if (instanceCount > 0u) {
+					RecordInstancedGBufferCommands(i, offset, instanceCount);
+				}
+				m_instancedGBufferInstanceCounts[i] = instanceCount;
+			}
 		}
 
-		m_instanceBuffer->Unmap(m_immediateContext);
+		m_instanceBuffer->Unmap(m_renderBackend);
 
 		// Set the vertex shader and bind the instance buffer to it
-		m_instancedGBufferVertexShader->BindToPipeline(m_immediateContext);
+		m_instancedGBufferVertexShader->BindToPipeline(m_renderBackend);
 		ID3D11ShaderResourceView *srv = m_instanceBuffer->GetShaderResource();
 		m_immediateContext->VSSetShaderResources(0, 1, &srv);
 
 		// Set the vertex shader frame constants
 		SetInstancedGBufferVertexShaderFrameConstants(DirectX::XMMatrixTranspose(viewProj));
-		ID3D11Buffer *instancedGBufferVertexShaderObjectConstantBuffer = m_instancedGBufferVertexShader->GetPerObjectConstantBuffer();
-
-		for (uint i = 0; i < m_instancedModels.size(); ++i) {
-			Scene::Model *model = m_instancedModels[i].first;
-
-			ID3D11Buffer *vertexBuffer = model->VertexBuffer;
-			ID3D11Buffer *indexBuffer = model->IndexBuffer;
-			uint vertexStride = model->VertexStride;
-			Scene::ModelSubset *subsets = model->Subsets;
-			uint subsetCount = model->SubsetCount;
-
-			for (uint j = 0; j < subsetCount; ++j) {
-				const Scene::Material *material = subsets[j].Material;
-				Graphics::MaterialShader *materialShader = material->Shader;
-
-				uint64 sortKey = m_gbufferSortKeyGenerator.GenerateKey(materialShader, material, vertexBuffer, indexBuffer);
-
-				// Create the command to set the vertex shader constant buffer data
-				auto mapDataCommand = m_gbufferBucket.AddCommand<Graphics::Commands::MapDataToConstantBuffer<InstancedGBufferVertexShaderObjectConstants> >(sortKey);
-				mapDataCommand->SetConstantBuffer(instancedGBufferVertexShaderObjectConstantBuffer);
-				InstancedGBufferVertexShaderObjectConstants data = {offsets[i]};
-				mapDataCommand->SetData(data);
-
-				// Create the command to bind the vertex shader constant buffer to the pipeline
-				auto bindBufferCommand = m_gbufferBucket.AppendCommand<Graphics::Commands::BindConstantBufferToVS>(mapDataCommand);
-				bindBufferCommand->SetConstantBuffer(instancedGBufferVertexShaderObjectConstantBuffer, 1u);
-
-				// Create the draw command
-				auto drawIndexedInstancedCommand = m_gbufferBucket.AppendCommand<Graphics::Commands::DrawIndexedInstanced>(bindBufferCommand);
-				drawIndexedInstancedCommand->SetMaterialShader(materialShader);
-				drawIndexedInstancedCommand->SetVertexBuffer(vertexBuffer, vertexStride);
-				drawIndexedInstancedCommand->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT);
-				for (uint k = 0 ; k < material->TextureSRVs.size(); ++k) {
-					drawIndexedInstancedCommand->SetTextureSRV(material->TextureSRVs[k], k);
-				}
-				for (uint k = 0; k < material->TextureSamplers.size(); ++k) {
-					drawIndexedInstancedCommand->SetTextureSampler(material->TextureSamplers[k], k);
-				}
-				drawIndexedInstancedCommand->SetRasterizerState(m_wireframe ? Graphics::RasterizerState::WIREFRAME : Graphics::RasterizerState::CULL_BACKFACES);
-				drawIndexedInstancedCommand->SetIndexCountPerInstance(subsets[j].IndexCount);
-				drawIndexedInstancedCommand->SetInstanceCount(static_cast<uint>(m_instancedModels[i].second->size()));
-				drawIndexedInstancedCommand->SetInstanceStart(0u);
-				drawIndexedInstancedCommand->SetIndexCount(subsets[j].IndexCount);
-				drawIndexedInstancedCommand->SetIndexStart(subsets[j].IndexStart);
-				drawIndexedInstancedCommand->SetVertexStart(subsets[j].VertexStart);
-			}
-		}
 
 		// Flush the commands to the GPU
-		m_gbufferBucket.Submit(m_device, m_immediateContext, &m_blendStateManager, &m_rasterizerStateManager, &m_depthStencilStateManager, &currentGraphicsState);
-
-		// Clear the bucket for the next use
-		m_gbufferBucket.Clear();
+		m_instancedGBufferBucket.Submit(commandContext);
 	}
 
 	// Draw non-instanced models
 	if (m_models.size() > 0) {
-		m_gbufferVertexShader->BindToPipeline(m_immediateContext);
 		ID3D11Buffer *gbufferVertexShaderObjectConstantBuffer = m_gbufferVertexShader->GetPerObjectConstantBuffer();
+		bool autoInstancing = m_autoInstancing;
 
-		for (auto iter = m_models.begin(); iter != m_models.end(); ++iter) {
-			DirectX::XMMATRIX combinedWorld = iter->second * m_globalWorldTransform;
-			DirectX::XMMATRIX worldMatrix = DirectX::XMMatrixTranspose(combinedWorld);
-			
-			DirectX::XMMATRIX worldViewProjection = DirectX::XMMatrixTranspose(combinedWorld * viewProj);
-
-			Scene::Model *model = iter->first;
-
-			ID3D11Buffer *vertexBuffer = model->VertexBuffer;
-			ID3D11Buffer *indexBuffer = model->IndexBuffer;
-			uint vertexStride = model->VertexStride;
-			Scene::ModelSubset *subsets = model->Subsets;
-			uint subsetCount = model->SubsetCount;
-
-			for (uint j = 0; j < subsetCount; ++j) {
-				const Scene::Material *material = subsets[j].Material;
-				Graphics::MaterialShader *materialShader = material->Shader;
-
-				uint64 sortKey = m_gbufferSortKeyGenerator.GenerateKey(materialShader, material, vertexBuffer, indexBuffer);
-
-				// Create the command to set the vertex shader constant buffer data
-				auto mapDataCommand = m_gbufferBucket.AddCommand<Graphics::Commands::MapDataToConstantBuffer<GBufferVertexShaderObjectConstants> >(sortKey);
-				mapDataCommand->SetConstantBuffer(gbufferVertexShaderObjectConstantBuffer);
-				GBufferVertexShaderObjectConstants data = {worldViewProjection, worldMatrix};
-				mapDataCommand->SetData(data);
-
-				// Create the command to bind the vertex shader constant buffer to the pipeline
-				auto bindBufferCommand = m_gbufferBucket.AppendCommand<Graphics::Commands::BindConstantBufferToVS>(mapDataCommand);
-				bindBufferCommand->SetConstantBuffer(gbufferVertexShaderObjectConstantBuffer, 1u);
-
-				// Create the draw command
-				auto drawIndexedCommand = m_gbufferBucket.AppendCommand<Graphics::Commands::DrawIndexed>(bindBufferCommand);
-				drawIndexedCommand->SetMaterialShader(materialShader);
-				drawIndexedCommand->SetVertexBuffer(vertexBuffer, vertexStride);
-				drawIndexedCommand->SetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT);
-				for (uint k = 0; k < material->TextureSRVs.size(); ++k) {
-					drawIndexedCommand->SetTextureSRV(material->TextureSRVs[k], k);
+		if (autoInstancing) {
+			// The merged draws read their world matrices from the instance stream, like the instanced models
+			m_instancedGBufferVertexShader->BindToPipeline(m_renderBackend);
+			ID3D11ShaderResourceView *srv = m_autoInstanceBuffer->GetShaderResource();
+			m_immediateContext->VSSetShaderResources(0, 1, &srv);
+
+			SetInstancedGBufferVertexShaderFrameConstants(DirectX::XMMatrixTranspose(viewProj));
+		} else {
+			m_gbufferVertexShader->BindToPipeline(m_renderBackend);
+		}
+
+		// The draws are only merged when the bucket hands them over in runs
+		m_gbufferBucket.SetExecutionStreamEnabled(autoInstancing);
+
+		// Used to normalize the view depth of the models for the sort keys. The projection uses
+		// reversed depth, but this is the linear view space depth, so near still maps to 0
+		float inverseDepthRange = 1.0f / (m_farClip - m_nearClip);
+
+		// The recording threads only see the visible models
+		Common::FrameVector<uint> visibleModels(&m_frameAllocator);
+		if (frustumCulling) {
+			visibleModels.reserve(m_models.size());
+			m_modelBVH.QueryFrustum(frustumCuller, [&](uint modelIndex) {
+				visibleModels.push_back(modelIndex);
+			});
+			numModelsCulled = static_cast<uint>(m_models.size() - visibleModels.size());
+		}
+		uint modelCount = frustumCulling ? static_cast<uint>(visibleModels.size()) : static_cast<uint>(m_models.size());
+
+		// Record the commands for the models across all the recording threads
+		m_gbufferBucket.RecordParallel(modelCount, [&](GBufferCommandBucket::Recorder &recorder, uint begin, uint end) {
+			uint rangeSubsetsCulled = 0u;
+			uint rangeModelsOccluded = 0u;
+			uint rangeSubsetsOccluded = 0u;
+
+			for (uint k = begin; k < end; ++k) {
+				uint i = frustumCulling ? visibleModels[k] : k;
+
+				if (occlusionCulling && !m_occlusionCuller.IsVisible(m_modelBVH.GetItemBounds(i))) {
+					++rangeModelsOccluded;
+					continue;
+				}
+
+				DirectX::XMMATRIX combinedWorld = m_models[i].second * m_globalWorldTransform;
+				DirectX::XMMATRIX worldMatrix = DirectX::XMMatrixTranspose(combinedWorld);
+
+				Scene::Model *model = m_models[i].first;
+				Scene::ModelSubset *subsets = model->Subsets;
+				uint subsetCount = model->SubsetCount;
+
+				// The model's bounds already cover a model with a single subset
+				bool cullSubsets = frustumCulling && subsetCount > 1u;
+				bool occludeSubsets = occlusionCulling && subsetCount > 1u;
+
+				// Sort front to back by the depth of the center of the model's bounds
+				DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(model->GetAABBMin_XM(), model->GetAABBMax_XM()), 0.5f);
+				DirectX::XMVECTOR viewCenter = DirectX::XMVector3TransformCoord(center, combinedWorld * viewMatrix);
+				float viewDepth = (DirectX::XMVectorGetZ(viewCenter) - m_nearClip) * inverseDepthRange;
+
+				if (autoInstancing) {
+					GBufferInstanceData instanceData = {{worldMatrix.r[0], worldMatrix.r[1], worldMatrix.r[2]}};
+
+					for (uint j = 0; j < subsetCount; ++j) {
+						if (cullSubsets && !frustumCuller.IntersectsAABB(subsets[j].AABB_min, subsets[j].AABB_max, combinedWorld)) {
+							++rangeSubsetsCulled;
+							continue;
+						}
+						if (occludeSubsets && !m_occlusionCuller.IsVisible(subsets[j].AABB_min, subsets[j].AABB_max, combinedWorld)) {
+							++rangeSubsetsOccluded;
+							continue;
+						}
+
+						const Scene::Material *material = subsets[j].Material;
+
+						uint64 sortKey = GBufferSortKeyGenerator::GenerateInstanceableKey(material->Shader, material, model, j, viewDepth);
+
+						// A single command, so the neighbouring draws of the same subset can be merged
+						auto drawCommand = recorder.AddCommand<Graphics::Commands::DrawIndexedInstanceable<GBufferInstanceData> >(sortKey);
+						SetGBufferDrawState(drawCommand, model, material, m_wireframe);
+						drawCommand->SetInstanceStream(&m_autoInstanceStream);
+						drawCommand->SetIndexCount(subsets[j].IndexCount);
+						drawCommand->SetIndexStart(subsets[j].IndexStart);
+						drawCommand->SetVertexStart(subsets[j].VertexStart);
+						drawCommand->SetInstanceData(instanceData);
+					}
+
+					continue;
 				}
-				for (uint k = 0; k < material->TextureSamplers.size(); ++k) {
-					drawIndexedCommand->SetTextureSampler(material->TextureSamplers[k], k);
+			
+				DirectX::XMMATRIX worldViewProjection = DirectX::XMMatrixTranspose(combinedWorld * viewProj);
+
+				for (uint j = 0; j < subsetCount; ++j) {
+					if (cullSubsets && !frustumCuller.IntersectsAABB(subsets[j].AABB_min, subsets[j].AABB_max, combinedWorld)) {
+						++rangeSubsetsCulled;
+						continue;
+					}
+					if (occludeSubsets && !m_occlusionCuller.IsVisible(subsets[j].AABB_min, subsets[j].AABB_max, combinedWorld)) {
+						++rangeSubsetsOccluded;
+						continue;
+					}
+
+					const Scene::Material *material = subsets[j].Material;
+					Graphics::MaterialShader *materialShader = material->Shader;
+
+					uint64 sortKey = GBufferSortKeyGenerator::GenerateKey(materialShader, material, model, viewDepth);
+
+					// Create the command to set the vertex shader constant buffer data
+					auto mapDataCommand = recorder.AddCommand<Graphics::Commands::MapDataToConstantBuffer<GBufferVertexShaderObjectConstants> >(sortKey);
+					mapDataCommand->SetConstantBuffer(gbufferVertexShaderObjectConstantBuffer);
+					GBufferVertexShaderObjectConstants data = {worldViewProjection, worldMatrix};
+					mapDataCommand->SetData(data);
+
+					// Create the command to bind the vertex shader constant buffer to the pipeline
+					auto bindBufferCommand = recorder.AppendCommand<Graphics::Commands::BindConstantBufferToVS>(mapDataCommand);
+					bindBufferCommand->SetConstantBuffer(gbufferVertexShaderObjectConstantBuffer, 1u);
+
+					// Create the draw command
+					auto drawIndexedCommand = recorder.AppendCommand<Graphics::Commands::DrawIndexed>(bindBufferCommand);
+					SetGBufferDrawState(drawIndexedCommand, model, material, m_wireframe);
+					drawIndexedCommand->SetIndexCount(subsets[j].IndexCount);
+					drawIndexedCommand->SetIndexStart(subsets[j].IndexStart);
+					drawIndexedCommand->SetVertexStart(subsets[j].VertexStart);
 				}
-				drawIndexedCommand->SetRasterizerState(m_wireframe ? Graphics::RasterizerState::WIREFRAME : Graphics::RasterizerState::CULL_BACKFACES);
-				drawIndexedCommand->SetIndexCount(subsets[j].IndexCount);
-				drawIndexedCommand->SetIndexStart(subsets[j].IndexStart);
-				drawIndexedCommand->SetVertexStart(subsets[j].VertexStart);
 			}
-		}
+
+			numSubsetsCulled.fetch_add(rangeSubsetsCulled, std::memory_order_relaxed);
+			numModelsOccluded.fetch_add(rangeModelsOccluded, std::memory_order_relaxed);
+			numSubsetsOccluded.fetch_add(rangeSubsetsOccluded, std::memory_order_relaxed);
+		});
+
+		// The instanced models wrote their own start vectors to the per-object constant buffer
+		m_autoInstanceStream.InvalidateStartVector();
 
 		// Flush the commands to the GPU
-		m_gbufferBucket.Submit(m_device, m_immediateContext, &m_blendStateManager, &m_rasterizerStateManager, &m_depthStencilStateManager, &currentGraphicsState);
+		m_gbufferBucket.Submit(commandContext);
 
 		// Clear the bucket for the next use
 		m_gbufferBucket.Clear();
 	}
 
+	m_numGBufferStateBinds = currentGraphicsState.Stats.GetTotalBinds();
+	m_numGBufferStateBindsSkipped = currentGraphicsState.Stats.GetTotalSkippedBinds();
+	m_numGBufferInstancedDraws = currentGraphicsState.Stats.InstancedDraws;
+	m_numGBufferDrawsCollapsed = currentGraphicsState.Stats.DrawsCollapsed;
+	m_numModelsCulled = numModelsCulled;
+	m_numSubsetsCulled = numSubsetsCulled.load(std::memory_order_relaxed);
+	m_numInstancesCulled = numInstancesCulled;
+	m_numOccluderTriangles = occlusionCulling ? m_occlusionCuller.GetStats().TrianglesRasterized : 0u;
+	m_numModelsOccluded = numModelsOccluded.load(std::memory_order_relaxed);
+	m_numSubsetsOccluded = numSubsetsOccluded.load(std::memory_order_relaxed);
+	m_numInstancesOccluded = numInstancesOccluded;
+
 
 	// Final gather pass
 
@@ -274,7 +414,7 @@ void PBRDemo::RenderMainPass() {
 	m_immediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Bind the vertex shader
-	m_fullscreenTriangleVertexShader->BindToPipeline(m_immediateContext);
+	m_fullscreenTriangleVertexShader->BindToPipeline(m_renderBackend);
 
 	// Set light buffers
 	SetLightBuffers();
@@ -297,7 +437,7 @@ void PBRDemo::RenderMainPass() {
 	m_immediateContext->CSSetShaderResources(0, 4, &m_gBufferSRVs.front());
 
 	// Bind the shader and set the constant buffer variables
-	m_tiledCullFinalGatherComputeShader->BindToPipeline(m_immediateContext);
+	m_tiledCullFinalGatherComputeShader->BindToPipeline(m_renderBackend);
 	SetTiledCullFinalGatherShaderConstants(transposedWorldViewMatrix, tranposedProjMatrix, transposedInvViewProj);
 
 	if (m_pointLights.size() > 0) {
@@ -323,6 +463,69 @@ void PBRDemo::RenderMainPass() {
 	m_immediateContext->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
 }
 
+void PBRDemo::RasterizeOccluders(const Scene::FrustumCuller &frustumCuller, const DirectX::XMMATRIX &viewProj) {
+	m_occlusionCuller.BeginFrame(viewProj);
+
+	for (auto iter = m_occluderModels.begin(); iter != m_occluderModels.end(); ++iter) {
+		Scene::Model *model = m_models[*iter].first;
+		DirectX::XMMATRIX combinedWorld = m_models[*iter].second * m_globalWorldTransform;
+
+		if (!frustumCuller.IntersectsAABB(model->AABB_min, model->AABB_max, combinedWorld)) {
+			continue;
+		}
+
+		for (uint j = 0; j < model->SubsetCount; ++j) {
+			m_occlusionCuller.AddOccluderAABB(model->Subsets[j].AABB_min, model->Subsets[j].AABB_max, combinedWorld);
+		}
+	}
+
+	m_occlusionCuller.Rasterize();
+
+	if (m_dumpOcclusionDepth) {
+		m_occlusionCuller.WriteDepthImage(L"occlusion_depth.pgm");
+		m_dumpOcclusionDepth = false;
+	}
+}
+
+void PBRDemo::RecordInstancedGBufferCommands(uint modelIndex, uint instanceOffset, uint instanceCount) {
+	ID3D11Buffer *instancedGBufferVertexShaderObjectConstantBuffer = m_instancedGBufferVertexShader->GetPerObjectConstantBuffer();
+
+	Scene::Model *model = m_instancedModels[modelIndex].first;
+	// The ModelManager shares a model between all the entries that load the same file. So the
+	// packets are owned by the entry's instances instead, which are unique to the entry
+	const void *owner = m_instancedModels[modelIndex].second;
+	Scene::ModelSubset *subsets = model->Subsets;
+	uint subsetCount = model->SubsetCount;
+
+	for (uint j = 0; j < subsetCount; ++j) {
+		const Scene::Material *material = subsets[j].Material;
+		Graphics::MaterialShader *materialShader = material->Shader;
+
+		// The instances are spread through the scene, so there isn't one depth to sort them by
+		uint64 sortKey = GBufferSortKeyGenerator::GenerateKey(materialShader, material, model, 0.0f);
+
+		// Create the command to set the vertex shader constant buffer data
+		auto mapDataCommand = m_instancedGBufferBucket.AddPersistentCommand<Graphics::Commands::MapDataToConstantBuffer<InstancedGBufferVertexShaderObjectConstants> >(sortKey, owner, material);
+		mapDataCommand->SetConstantBuffer(instancedGBufferVertexShaderObjectConstantBuffer);
+		InstancedGBufferVertexShaderObjectConstants data = {instanceOffset};
+		mapDataCommand->SetData(data);
+
+		// Create the command to bind the vertex shader constant buffer to the pipeline
+		auto bindBufferCommand = m_instancedGBufferBucket.AppendPersistentCommand<Graphics::Commands::BindConstantBufferToVS>(mapDataCommand);
+		bindBufferCommand->SetConstantBuffer(instancedGBufferVertexShaderObjectConstantBuffer, 1u);
+
+		// Create the draw command
+		auto drawIndexedInstancedCommand = m_instancedGBufferBucket.AppendPersistentCommand<Graphics::Commands::DrawIndexedInstanced>(bindBufferCommand);
+		SetGBufferDrawState(drawIndexedInstancedCommand, model, material, m_wireframe);
+		drawIndexedInstancedCommand->SetIndexCountPerInstance(subsets[j].IndexCount);
+		drawIndexedInstancedCommand->SetInstanceCount(instanceCount);
+		drawIndexedInstancedCommand->SetInstanceStart(0u);
+		drawIndexedInstancedCommand->SetIndexCount(subsets[j].IndexCount);
+		drawIndexedInstancedCommand->SetIndexStart(subsets[j].IndexStart);
+		drawIndexedInstancedCommand->SetVertexStart(subsets[j].VertexStart);
+	}
+}
+
 void PBRDemo::SetInstancedGBufferVertexShaderFrameConstants(DirectX::XMMATRIX &viewProjMatrix) {
 	InstancedGBufferVertexShaderFrameConstants vertexShaderFrameConstants;
 	vertexShaderFrameConstants.ViewProj = viewProjMatrix;
@@ -350,28 +553,28 @@ void PBRDemo::SetTiledCullFinalGatherShaderConstants(DirectX::XMMATRIX &worldVie
 	computeShaderFrameConstants.CameraClipPlanes.y = m_farClip;
 	computeShaderFrameConstants.NumSpotLightsToDraw = m_numSpotLightsToDraw;
 	
-	m_tiledCullFinalGatherComputeShader->SetPerFrameConstants(m_immediateContext, &computeShaderFrameConstants, 0u);
+	m_tiledCullFinalGatherComputeShader->SetPerFrameConstants(m_renderBackend, &computeShaderFrameConstants, 0u);
 }
 
 void PBRDemo::SetLightBuffers() {
 	if (m_numPointLightsToDraw > 0) {
 		assert(m_pointLightBuffer->NumElements() >= (int)m_numPointLightsToDraw);
 
-		Scene::ShaderPointLight *pointLightArray = m_pointLightBuffer->MapDiscard(m_immediateContext);
+		Scene::ShaderPointLight *pointLightArray = m_pointLightBuffer->MapDiscard(m_renderBackend);
 		for (unsigned int i = 0; i < m_numPointLightsToDraw; ++i) {
 			pointLightArray[i] = m_pointLights[i].GetShaderPackedLight();
 		}
-		m_pointLightBuffer->Unmap(m_immediateContext);
+		m_pointLightBuffer->Unmap(m_renderBackend);
 	}
 
 	if (m_numSpotLightsToDraw > 0) {
 		assert(m_spotLightBuffer->NumElements() >= (int)m_numSpotLightsToDraw);
 
-		Scene::ShaderSpotLight *spotLightArray = m_spotLightBuffer->MapDiscard(m_immediateContext);
+		Scene::ShaderSpotLight *spotLightArray = m_spotLightBuffer->MapDiscard(m_renderBackend);
 		for (unsigned int i = 0; i < m_numSpotLightsToDraw; ++i) {
 			spotLightArray[i] = m_spotLights[i].GetShaderPackedLight();
 		}
-		m_spotLightBuffer->Unmap(m_immediateContext);
+		m_spotLightBuffer->Unmap(m_renderBackend);
 	}
 }
 
@@ -384,8 +587,8 @@ void PBRDemo::PostProcess() {
 	m_immediateContext->IASetInputLayout(nullptr);
 	m_immediateContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	m_fullscreenTriangleVertexShader->BindToPipeline(m_immediateContext);
-	m_postProcessPixelShader->BindToPipeline(m_immediateContext);
+	m_fullscreenTriangleVertexShader->BindToPipeline(m_renderBackend);
+	m_postProcessPixelShader->BindToPipeline(m_renderBackend);
 
 	m_immediateContext->RSSetState(m_rasterizerStateManager.NoCull());
 	float blendFactor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -409,7 +612,7 @@ void PBRDemo::RenderHUD() {
 	m_immediateContext->OMSetRenderTargets(1, &m_backbufferRTV, nullptr);
 
 	m_spriteRenderer.Begin(m_immediateContext, Graphics::SpriteRenderer::Point);
-	std::wstring output;
+	Common::FrameWString output(&m_frameAllocator);
 	fastformat::write(output, L"FPS: ", m_fps, L"\nFrame Time: ", m_frameTime, L" (ms)");
 	
 	DirectX::XMFLOAT4X4 transform {1, 0, 0, 0,
@@ -14,8 +14,13 @@
 #include "common/vector.h"
 #include "common/allocator_16_byte_aligned.h"
 #include "common/linear_allocator.h"
+#include "common/object_pool.h"
+#include "common/virtual_linear_allocator.h"
+#include "common/worker_pool.h"
 
 #include "scene/camera.h"
+#include "scene/bounding_volume_hierarchy.h"
+#include "scene/occlusion_culler.h"
 #include "scene/lights.h"
 #include "scene/light_animator.h"
 
@@ -32,6 +37,7 @@
 #include "graphics/sprite_font.h"
 #include "graphics/shader.h"
 #include "graphics/command_bucket.h"
+#include "graphics/commands.h"
 
 #include <vector>
 #include <AntTweakBar.h>
@@ -44,14 +50,40 @@ class Model;
 class ModelToLoad;
 }
 
+namespace Graphics {
+class CommandReplayer;
+}
+
 namespace PBRDemo {
 
+/** The capture ids of the commands the gbuffer pass records, besides the built-in ones. See Graphics::Commands::CommandTypeId */
+enum GBufferCommandTypeId : uint16 {
+	COMMAND_TYPE_MAP_GBUFFER_OBJECT_CONSTANTS = Graphics::Commands::COMMAND_TYPE_USER,
+	COMMAND_TYPE_MAP_INSTANCED_GBUFFER_OBJECT_CONSTANTS,
+	COMMAND_TYPE_DRAW_GBUFFER_INSTANCEABLE
+};
+
+/** The capture of the non-instanced models' gbuffer frames */
+const wchar kGBufferCaptureFile[] = L"gbuffer.hcap";
+/** The capture of the instanced models' gbuffer frames. See PBRDemo::m_instancedGBufferBucket */
+const wchar kInstancedGBufferCaptureFile[] = L"instanced_gbuffer.hcap";
+
+/** Registers the commands the gbuffer pass records with the command capture */
+void RegisterGBufferCaptureTypes();
+/** Registers the same commands with a replayer, so the gbuffer captures can be replayed */
+void RegisterGBufferReplayTypes(Graphics::CommandReplayer *replayer);
+
 class PBRDemo : public Engine::HalflingEngine {
 public:
 	PBRDemo(HINSTANCE hinstance);
 
 private:
 	static const uint kMaxInstanceVectorsPerFrame = 5000;
+	/** The size of the buffer the merged draws of the non-instanced models stream their world matrices into */
+	static const uint kMaxAutoInstanceVectors = 3 * 1024;
+	/** The size of the occlusion depth buffer. Small enough to rasterize in well under a millisecond */
+	static const uint kOcclusionBufferWidth = 256u;
+	static const uint kOcclusionBufferHeight = 144u;
 
 	float m_nearClip;
 	float m_farClip;
@@ -65,9 +97,19 @@ private:
 	Engine::ModelManager m_modelManager;
 	Engine::MaterialShaderManager m_materialShaderManager;
 	Engine::MaterialCache m_materialCache;
+
+	/** Shared by the gbuffer recording and the occlusion rasterizer, which run one after the other */
+	Common::WorkerPool m_workerPool;
 	
-	GBufferSortKeyGenerator m_gbufferSortKeyGenerator;
-	Graphics::CommandBucket<uint64, 2048> m_gbufferBucket;
+	typedef Graphics::CommandBucket<uint64, Common::VirtualLinearAllocator> GBufferCommandBucket;
+
+	GBufferCommandBucket m_gbufferBucket;
+	/** Only holds persistent packets. See RecordInstancedGBufferCommands() */
+	GBufferCommandBucket m_instancedGBufferBucket;
+	/** The wireframe setting the persistent instanced packets were recorded with */
+	bool m_instancedGBufferWireframe;
+	/** The number of visible instances the persistent packets of each instanced model were recorded with */
+	std::vector<uint> m_instancedGBufferInstanceCounts;
 
 	Engine::Console m_console;
 	bool m_showConsole;
@@ -76,8 +118,24 @@ private:
 
 	std::vector<std::pair<Scene::Model *, DirectX::XMMATRIX>, Common::Allocator16ByteAligned<std::pair<Scene::Model *, DirectX::XMMATRIX> > > m_models;
 	std::vector<std::pair<Scene::Model *, std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *> > m_instancedModels;
+	Common::ObjectPool<std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > > m_instanceVectorPool;
+
+	/** The world space bounds of m_models. Built once the scene is loaded */
+	Scene::BoundingVolumeHierarchy m_modelBVH;
+	/** The world space bounds of the instances of each of m_instancedModels */
+	std::vector<Scene::BoundingVolumeHierarchy> m_instanceBVHs;
+	/** The indices into m_models of the models marked as occluders in scene.json */
+	std::vector<uint> m_occluderModels;
+	Scene::OcclusionCuller m_occlusionCuller;
 
 	Graphics::StructuredBuffer<DirectX::XMVECTOR> *m_instanceBuffer;
+	/** 
+	 * When set, the non-instanced models are drawn with DrawIndexedInstanceable, so the gbuffer bucket
+	 * merges the neighbouring draws of the same model into instanced draws
+	 */
+	bool m_autoInstancing;
+	Graphics::StructuredBuffer<DirectX::XMVECTOR> *m_autoInstanceBuffer;
+	Graphics::Commands::InstanceStream m_autoInstanceStream;
 
 	std::vector<Scene::ModelToLoad *> m_modelsToLoad;
 	std::atomic<bool> m_sceneLoaded;
@@ -96,6 +154,37 @@ private:
 	bool m_vsync;
 	bool m_wireframe;
 	bool m_animateLights;
+	bool m_frustumCulling;
+	uint m_numModelsCulled;
+	uint m_numSubsetsCulled;
+	uint m_numInstancesCulled;
+	bool m_occlusionCulling;
+	/** Writes the occlusion depth buffer to occlusion_depth.pgm on the next frame, when set */
+	bool m_dumpOcclusionDepth;
+	uint m_numOccluderTriangles;
+	uint m_numModelsOccluded;
+	uint m_numSubsetsOccluded;
+	uint m_numInstancesOccluded;
+	/** The model under the last click, or -1. An index into m_models */
+	int m_pickedModel;
+	/** The instanced model and instance under the last click, or -1 */
+	int m_pickedInstancedModel;
+	int m_pickedInstance;
+	uint m_numGBufferStateBinds;
+	uint m_numGBufferStateBindsSkipped;
+	uint m_numGBufferInstancedDraws;
+	uint m_numGBufferDrawsCollapsed;
+
+	/** Streams the submitted gbuffer frames to kGBufferCaptureFile and kInstancedGBufferCaptureFile while set */
+	bool m_captureGBuffer;
+	Graphics::CommandCapture m_gbufferCapture;
+	Graphics::CommandCapture m_instancedGBufferCapture;
+	/** Replays the gbuffer captures on the next frame, when set. See ReplayGBufferCaptures() */
+	bool m_replayGBufferCaptures;
+	uint m_numReplayedGBufferFrames;
+	uint m_numReplayedGBufferDrawsPerFrame;
+	uint m_numReplayedGBufferMapsPerFrame;
+	uint m_numReplayedGBufferCommandsSkipped;
 	uint32 m_numSpotLightsToDraw;
 	uint32 m_numPointLightsToDraw;
 
@@ -161,9 +250,42 @@ private:
 	void InitTweakBar();
 	void LoadShaders();
 
+	/** Builds the bounding volume hierarchies over the models and instances, once the scene is loaded */
+	void BuildSceneBVHs();
+
+	/**
+	 * Finds the closest model or instance whose bounds are under a point on the screen, and
+	 * stores it in m_pickedModel, or m_pickedInstancedModel and m_pickedInstance
+	 *
+	 * @param x    The x coordinate of the point, in client pixels
+	 * @param y    The y coordinate of the point, in client pixels
+	 */
+	void PickModel(int x, int y);
+	/**
+	 * Replays the gbuffer captures through a NullRenderBackend, so the cost of the captured frames
+	 * can be compared between changes without a GPU. The results are shown on the settings bar
+	 */
+	void ReplayGBufferCaptures();
+
 	// Rendering methods
 	/** Renders the geometry */
 	void RenderMainPass();
+	/**
+	 * Rasterizes the subset bounds of the occluder models on screen into m_occlusionCuller
+	 *
+	 * @param frustumCuller    The camera frustum. Occluders outside it can't hide anything on screen
+	 * @param viewProj         The view projection matrix of the camera
+	 */
+	void RasterizeOccluders(const Scene::FrustumCuller &frustumCuller, const DirectX::XMMATRIX &viewProj);
+	/**
+	 * Records the gbuffer packets of an instanced model into m_instancedGBufferBucket as
+	 * persistent packets, so they're only recorded again when the model's visible instances change
+	 *
+	 * @param modelIndex        The index of the model in m_instancedModels
+	 * @param instanceOffset    The offset of the model's transforms in m_instanceBuffer
+	 * @param instanceCount     The number of visible instances
+	 */
+	void RecordInstancedGBufferCommands(uint modelIndex, uint instanceOffset, uint instanceCount);
 	/** Renders the geometry using Deferred Shading */
 	void DeferredRenderingPass();
 	/** Does the post processing for the frame */
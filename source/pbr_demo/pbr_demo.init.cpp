@@ -10,8 +10,11 @@
 
 #include "common/math.h"
 #include "common/string_util.h"
-#include "common/file_io_util.h"
-#include "common/memory_stream.h"
+#include "common/mapped_file.h"
+#include "common/async_file_reader.h"
+
+#include "graphics/command_replayer.h"
+#include "graphics/commands.h"
 
 #include "scene/halfling_model_file.h"
 #include "scene/model.h"
@@ -28,11 +31,12 @@
 namespace PBRDemo {
 
 void LoadScene(std::atomic<bool> *sceneIsLoaded, 
-               ID3D11Device *device, 
+               Graphics::RenderBackend *backend, 
                Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager,
                std::vector<Scene::ModelToLoad *> *modelsToLoad, 
                std::vector<std::pair<Scene::Model *, DirectX::XMMATRIX>, Common::Allocator16ByteAligned<std::pair<Scene::Model *, DirectX::XMMATRIX> > > *modelList, 
                std::vector<std::pair<Scene::Model *, std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *> > *instancedModelList,
+               std::vector<uint> *occluderModelList,
 			   uint modelInstanceThreshold);
 
 void TW_CALL GetDirectionalLightColorCallback(void *value, void *clientData);
@@ -45,6 +49,20 @@ void TW_CALL GetDirectionalLightDirectionCallback(void *value, void *clientData)
 void TW_CALL SetDirectionalLightDirectionCallback(const void *value, void *clientData);
 
 
+void RegisterGBufferCaptureTypes() {
+	Graphics::Commands::RegisterCommandCaptureTypes();
+	Graphics::RegisterCaptureCommandType<Graphics::Commands::MapDataToConstantBuffer<GBufferVertexShaderObjectConstants> >(COMMAND_TYPE_MAP_GBUFFER_OBJECT_CONSTANTS);
+	Graphics::RegisterCaptureCommandType<Graphics::Commands::MapDataToConstantBuffer<InstancedGBufferVertexShaderObjectConstants> >(COMMAND_TYPE_MAP_INSTANCED_GBUFFER_OBJECT_CONSTANTS);
+	Graphics::RegisterCaptureCommandType<Graphics::Commands::DrawIndexedInstanceable<GBufferInstanceData> >(COMMAND_TYPE_DRAW_GBUFFER_INSTANCEABLE);
+}
+
+void RegisterGBufferReplayTypes(Graphics::CommandReplayer *replayer) {
+	Graphics::Commands::RegisterCommandReplayTypes(replayer);
+	replayer->RegisterCommandType<Graphics::Commands::MapDataToConstantBuffer<GBufferVertexShaderObjectConstants> >(COMMAND_TYPE_MAP_GBUFFER_OBJECT_CONSTANTS);
+	replayer->RegisterCommandType<Graphics::Commands::MapDataToConstantBuffer<InstancedGBufferVertexShaderObjectConstants> >(COMMAND_TYPE_MAP_INSTANCED_GBUFFER_OBJECT_CONSTANTS);
+	replayer->RegisterCommandType<Graphics::Commands::DrawIndexedInstanceable<GBufferInstanceData> >(COMMAND_TYPE_DRAW_GBUFFER_INSTANCEABLE);
+}
+
 bool PBRDemo::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint32 screenHeight, bool fullscreen) {
 	LoadSceneJson();
 
@@ -53,7 +71,7 @@ bool PBRDemo::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint32 scre
 		return false;
 	}
 
-	m_materialShaderManager.Initialize(m_device, L"matte_gray.hmat");
+	m_materialShaderManager.Initialize(m_renderBackend, L"matte_gray.hmat");
 
 	InitTweakBar();
 
@@ -62,19 +80,29 @@ bool PBRDemo::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint32 scre
 	m_rasterizerStateManager.Initialize(m_device);
 	m_samplerStateManager.Initialize(m_device);
 
-	m_sceneLoaderThread = std::thread(LoadScene, &m_sceneLoaded, m_device, &m_textureManager, &m_modelManager, &m_materialShaderManager, &m_materialCache, &m_samplerStateManager, &m_modelsToLoad, &m_models, &m_instancedModels, m_modelInstanceThreshold);
+	// Register the commands we record, so the gbuffer frames can be captured
+	RegisterGBufferCaptureTypes();
+
+	m_sceneLoaderThread = std::thread(LoadScene, &m_sceneLoaded, m_renderBackend, &m_textureManager, &m_modelManager, &m_materialShaderManager, &m_materialCache, &m_samplerStateManager, &m_modelsToLoad, &m_models, &m_instancedModels, &m_occluderModels, m_modelInstanceThreshold);
 
 	LoadShaders();
 
-	m_instanceBuffer = new Graphics::StructuredBuffer<DirectX::XMVECTOR>(m_device, kMaxInstanceVectorsPerFrame, D3D11_BIND_SHADER_RESOURCE, true);
+	m_instanceBuffer = new Graphics::StructuredBuffer<DirectX::XMVECTOR>(m_renderBackend, kMaxInstanceVectorsPerFrame, D3D11_BIND_SHADER_RESOURCE, true);
+
+	// The merged draws share the start vector constant buffer with the instanced models. Both write it before they draw
+	m_autoInstanceBuffer = new Graphics::StructuredBuffer<DirectX::XMVECTOR>(m_renderBackend, kMaxAutoInstanceVectors, D3D11_BIND_SHADER_RESOURCE, true);
+	m_autoInstanceStream.InstanceBuffer = m_autoInstanceBuffer->GetBuffer();
+	m_autoInstanceStream.NumVectors = static_cast<uint>(kMaxAutoInstanceVectors);
+	m_autoInstanceStream.StartVectorConstantBuffer = m_instancedGBufferVertexShader->GetPerObjectConstantBuffer();
+	m_autoInstanceStream.StartVectorSlot = 1u;
 
 	// Create light buffers
-	// This has to be done after the Engine has been Initialized so we have a valid m_device
+	// This has to be done after the Engine has been Initialized so we have a valid m_renderBackend
 	if (m_pointLights.size() > 0) {
-		m_pointLightBuffer = new Graphics::StructuredBuffer<Scene::ShaderPointLight>(m_device, static_cast<uint>(m_pointLights.size()), D3D11_BIND_SHADER_RESOURCE, true);
+		m_pointLightBuffer = new Graphics::StructuredBuffer<Scene::ShaderPointLight>(m_renderBackend, static_cast<uint>(m_pointLights.size()), D3D11_BIND_SHADER_RESOURCE, true);
 	}
 	if (m_spotLights.size() > 0) {
-		m_spotLightBuffer = new Graphics::StructuredBuffer<Scene::ShaderSpotLight>(m_device, static_cast<uint>(m_spotLights.size()), D3D11_BIND_SHADER_RESOURCE, true);
+		m_spotLightBuffer = new Graphics::StructuredBuffer<Scene::ShaderSpotLight>(m_renderBackend, static_cast<uint>(m_spotLights.size()), D3D11_BIND_SHADER_RESOURCE, true);
 	}
 
 	m_spriteRenderer.Initialize(m_device);
@@ -90,18 +118,15 @@ bool PBRDemo::Initialize(LPCTSTR mainWndCaption, uint32 screenWidth, uint32 scre
 }
 
 void PBRDemo::LoadSceneJson() {
-	// Read the entire file into memory
-	DWORD bytesRead;
-	char *fileBuffer = Common::ReadWholeFile(L"scene.json", &bytesRead);
+	// Map the file and parse straight out of the mapping
+	Common::MappedFile file(L"scene.json");
 	
 	// TODO: Add error handling
-	assert(fileBuffer != NULL);
-
-	Common::MemoryInputStream fin(fileBuffer, bytesRead);
+	assert(file.IsOpen());
 	
 	Json::Reader reader;
 	Json::Value root;
-	reader.parse(fin, root, false);
+	reader.parse(file.GetChars(), file.GetChars() + file.GetSize(), root, false);
 
 	m_nearClip = root.get("NearClip", m_nearClip).asSingle();
 	m_farClip = root.get("FarClip", m_farClip).asSingle();
@@ -118,12 +143,12 @@ void PBRDemo::LoadSceneJson() {
 		std::string materialName = materials[i]["Name"].asString();
 
 		Scene::ModelToLoadMaterial material;
-		material.HMATFilePath = Common::ToWideStr(materials[i]["HMATFilePath"].asString());
+		material.HMATFilePath = Common::InternString(materials[i]["HMATFilePath"].asString());
 
 		Json::Value textureDefinitions = materials[i]["TextureDefinitions"];
 		for (uint j = 0; j < textureDefinitions.size(); ++j) {
 			Scene::TextureDescription description;
-			description.FilePath = Common::ToWideStr(textureDefinitions[j]["FilePath"].asString());
+			description.FilePath = Common::InternString(textureDefinitions[j]["FilePath"].asString());
 			description.Sampler = Scene::ParseSamplerTypeFromString(textureDefinitions[j]["Sampler"].asString(), Scene::LINEAR_WRAP);
 
 			material.Textures.push_back(description);
@@ -135,7 +160,7 @@ void PBRDemo::LoadSceneJson() {
 	Json::Value models = root["Models"];
 	for (uint i = 0; i < models.size(); ++i) {
 		Json::Value instances = models[i]["Instances"];
-		auto *instanceVector = new std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> >();
+		auto *instanceVector = m_instanceVectorPool.Get(m_instanceVectorPool.Create());
 		for (uint j = 0; j < instances.size(); ++j) {
 			instanceVector->push_back(DirectX::XMMatrixSet(instances[j][0u].asSingle(), instances[j][1u].asSingle(), instances[j][2u].asSingle(), instances[j][3u].asSingle(),
 				instances[j][4u].asSingle(), instances[j][5u].asSingle(), instances[j][6u].asSingle(), instances[j][7u].asSingle(),
@@ -144,11 +169,13 @@ void PBRDemo::LoadSceneJson() {
 		}
 
 		std::string type = models[i]["Type"].asString();
+		bool occluder = models[i].get("Occluder", false).asBool();
 
 		if (_stricmp(type.c_str(), "file") == 0) {
 			std::string filePath = models[i]["FilePath"].asString();
 
 			Scene::FileModelToLoad *model = new Scene::FileModelToLoad(filePath, instanceVector);
+			model->Occluder = occluder;
 			m_modelsToLoad.push_back(model);
 		} else if (_stricmp(type.c_str(), "plane") == 0) {
 			float width = models[i]["Width"].asSingle();
@@ -164,6 +191,7 @@ void PBRDemo::LoadSceneJson() {
 
 			Scene::PlaneModelToLoad *model = new Scene::PlaneModelToLoad(width, depth, x_subdivisions, z_subdivisions, x_textureTiling, z_textureTiling, iter->second, instanceVector);
 
+			model->Occluder = occluder;
 			m_modelsToLoad.push_back(model);
 		} else if (_stricmp(type.c_str(), "box") == 0) {
 			float width = models[i]["Width"].asSingle();
@@ -176,6 +204,7 @@ void PBRDemo::LoadSceneJson() {
 
 			Scene::BoxModelToLoad *model = new Scene::BoxModelToLoad(width, depth, height, iter->second, instanceVector);
 
+			model->Occluder = occluder;
 			m_modelsToLoad.push_back(model);
 		} else if (_stricmp(type.c_str(), "sphere") == 0) {
 			float radius = models[i]["Radius"].asSingle();
@@ -188,6 +217,7 @@ void PBRDemo::LoadSceneJson() {
 
 			Scene::SphereModelToLoad *model = new Scene::SphereModelToLoad(radius, sliceCount, stackCount, iter->second, instanceVector);
 
+			model->Occluder = occluder;
 			m_modelsToLoad.push_back(model);
 		}
 	}
@@ -423,6 +453,30 @@ void PBRDemo::InitTweakBar() {
 	TwAddVarRW(m_settingsBar, "V-Sync", TwType::TW_TYPE_BOOLCPP, &m_vsync, "");
 	TwAddVarRW(m_settingsBar, "Wireframe", TwType::TW_TYPE_BOOLCPP, &m_wireframe, "");
 	TwAddVarRW(m_settingsBar, "Animate Lights", TW_TYPE_BOOLCPP, &m_animateLights, "");
+	TwAddVarRO(m_settingsBar, "GBuffer State Binds", TW_TYPE_UINT32, &m_numGBufferStateBinds, "");
+	TwAddVarRO(m_settingsBar, "GBuffer Skipped Binds", TW_TYPE_UINT32, &m_numGBufferStateBindsSkipped, "");
+	TwAddVarRW(m_settingsBar, "Auto Instancing", TW_TYPE_BOOLCPP, &m_autoInstancing, "");
+	TwAddVarRW(m_settingsBar, "Frustum Culling", TW_TYPE_BOOLCPP, &m_frustumCulling, "");
+	TwAddVarRO(m_settingsBar, "Models Culled", TW_TYPE_UINT32, &m_numModelsCulled, "");
+	TwAddVarRO(m_settingsBar, "Subsets Culled", TW_TYPE_UINT32, &m_numSubsetsCulled, "");
+	TwAddVarRO(m_settingsBar, "Instances Culled", TW_TYPE_UINT32, &m_numInstancesCulled, "");
+	TwAddVarRW(m_settingsBar, "Occlusion Culling", TW_TYPE_BOOLCPP, &m_occlusionCulling, "");
+	TwAddVarRW(m_settingsBar, "Dump Occlusion Depth", TW_TYPE_BOOLCPP, &m_dumpOcclusionDepth, "");
+	TwAddVarRO(m_settingsBar, "Occluder Triangles", TW_TYPE_UINT32, &m_numOccluderTriangles, "");
+	TwAddVarRO(m_settingsBar, "Models Occluded", TW_TYPE_UINT32, &m_numModelsOccluded, "");
+	TwAddVarRO(m_settingsBar, "Subsets Occluded", TW_TYPE_UINT32, &m_numSubsetsOccluded, "");
+	TwAddVarRO(m_settingsBar, "Instances Occluded", TW_TYPE_UINT32, &m_numInstancesOccluded, "");
+	TwAddVarRO(m_settingsBar, "Picked Model", TW_TYPE_INT32, &m_pickedModel, "");
+	TwAddVarRO(m_settingsBar, "Picked Instanced Model", TW_TYPE_INT32, &m_pickedInstancedModel, "");
+	TwAddVarRO(m_settingsBar, "Picked Instance", TW_TYPE_INT32, &m_pickedInstance, "");
+	TwAddVarRO(m_settingsBar, "GBuffer Instanced Draws", TW_TYPE_UINT32, &m_numGBufferInstancedDraws, "");
+	TwAddVarRO(m_settingsBar, "GBuffer Draws Collapsed", TW_TYPE_UINT32, &m_numGBufferDrawsCollapsed, "");
+	TwAddVarRW(m_settingsBar, "Capture GBuffer", TW_TYPE_BOOLCPP, &m_captureGBuffer, "");
+	TwAddVarRW(m_settingsBar, "Replay GBuffer Capture", TW_TYPE_BOOLCPP, &m_replayGBufferCaptures, "");
+	TwAddVarRO(m_settingsBar, "Replayed Frames", TW_TYPE_UINT32, &m_numReplayedGBufferFrames, "");
+	TwAddVarRO(m_settingsBar, "Replayed Draws / Frame", TW_TYPE_UINT32, &m_numReplayedGBufferDrawsPerFrame, "");
+	TwAddVarRO(m_settingsBar, "Replayed Maps / Frame", TW_TYPE_UINT32, &m_numReplayedGBufferMapsPerFrame, "");
+	TwAddVarRO(m_settingsBar, "Replay Commands Skipped", TW_TYPE_UINT32, &m_numReplayedGBufferCommandsSkipped, "");
 
 	TwAddVarCB(m_settingsBar, "Directional Light Color", TW_TYPE_COLOR3F, SetDirectionalLightColorCallback, GetDirectionalLightColorCallback, &m_directionalLight, "");
 	TwAddVarCB(m_settingsBar, "Directional Light Intensity", TW_TYPE_FLOAT, SetDirectionalLightIntensityCallback, GetDirectionalLightIntensityCallback, &m_directionalLight, " min=1.0 max=20.0 ");
@@ -430,25 +484,70 @@ void PBRDemo::InitTweakBar() {
 }
 
 void LoadScene(std::atomic<bool> *sceneIsLoaded, 
-               ID3D11Device *device, 
+               Graphics::RenderBackend *backend, 
                Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager,
                std::vector<Scene::ModelToLoad *> *modelsToLoad, 
                std::vector<std::pair<Scene::Model *, DirectX::XMMATRIX>, Common::Allocator16ByteAligned<std::pair<Scene::Model *, DirectX::XMMATRIX> > > *modelList, 
                std::vector<std::pair<Scene::Model *, std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *> > *instancedModelList,
+               std::vector<uint> *occluderModelList,
 			   uint modelInstanceThreshold) {
+	// Keep the file reads a few models ahead of the one being created. The disk stays busy while we
+	// parse, but only a bounded number of read files are held in memory at once
+	Common::AsyncFileReader fileReader;
+	const size_t readAhead = 2u * fileReader.GetMaxOutstandingReads();
+	auto nextRequest = modelsToLoad->begin();
+
 	for (auto iter = modelsToLoad->begin(); iter != modelsToLoad->end(); ++iter) {
-		Scene::Model *newModel = (*iter)->CreateModel(device, textureManager, modelManager, materialShaderManager, materialCache, samplerStateManager);
+		for (; nextRequest != modelsToLoad->end() && static_cast<size_t>(nextRequest - iter) < readAhead; ++nextRequest) {
+			(*nextRequest)->RequestFiles(&fileReader, modelManager);
+		}
+
+		Scene::Model *newModel = (*iter)->CreateModel(backend, textureManager, modelManager, materialShaderManager, materialCache, samplerStateManager);
+		if (newModel == nullptr) {
+			// The model or its material failed to load. Leave it out of the scene, rather than drawing a null model
+			continue;
+		}
 
-		if ((*iter)->Instances->size() > modelInstanceThreshold) {
+		if ((*iter)->Instances->size() > modelInstanceThreshold && !(*iter)->Occluder) {
 			instancedModelList->emplace_back(newModel, (*iter)->Instances);
 		} else {
-			modelList->emplace_back(newModel, (*(*iter)->Instances)[0]);
+			// Each instance is drawn on its own. The gbuffer bucket merges them back together when auto instancing is on
+			for (auto instanceIter = (*iter)->Instances->begin(); instanceIter != (*iter)->Instances->end(); ++instanceIter) {
+				if ((*iter)->Occluder) {
+					occluderModelList->push_back(static_cast<uint>(modelList->size()));
+				}
+				modelList->emplace_back(newModel, *instanceIter);
+			}
 		}
 	}
 
 	sceneIsLoaded->store(true, std::memory_order_relaxed);
 }
 
+void PBRDemo::BuildSceneBVHs() {
+	std::vector<Scene::AABB> bounds;
+
+	bounds.reserve(m_models.size());
+	for (auto iter = m_models.begin(); iter != m_models.end(); ++iter) {
+		Scene::AABB modelBounds = {iter->first->AABB_min, iter->first->AABB_max};
+		bounds.push_back(Scene::TransformAABB(modelBounds, iter->second * m_globalWorldTransform));
+	}
+	m_modelBVH.Build(bounds.empty() ? nullptr : &bounds[0], static_cast<uint>(bounds.size()));
+
+	m_instanceBVHs.resize(m_instancedModels.size());
+	for (uint i = 0; i < m_instancedModels.size(); ++i) {
+		Scene::Model *model = m_instancedModels[i].first;
+		auto instances = m_instancedModels[i].second;
+		Scene::AABB modelBounds = {model->AABB_min, model->AABB_max};
+
+		bounds.clear();
+		for (auto instanceIter = instances->begin(); instanceIter != instances->end(); ++instanceIter) {
+			bounds.push_back(Scene::TransformAABB(modelBounds, m_globalWorldTransform * (*instanceIter)));
+		}
+		m_instanceBVHs[i].Build(bounds.empty() ? nullptr : &bounds[0], static_cast<uint>(bounds.size()));
+	}
+}
+
 void PBRDemo::LoadShaders() {
 	D3D11_INPUT_ELEMENT_DESC vertexDesc[] = {
 		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
@@ -457,11 +556,11 @@ void PBRDemo::LoadShaders() {
 		{"TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0}
 	};
 
-	m_gbufferVertexShader = new Graphics::VertexShader<Graphics::DefaultShaderConstantType, GBufferVertexShaderObjectConstants>(L"gbuffer_vs.cso", m_device, false, true, &m_defaultInputLayout, vertexDesc, 4);
-	m_instancedGBufferVertexShader = new Graphics::VertexShader<InstancedGBufferVertexShaderFrameConstants, InstancedGBufferVertexShaderObjectConstants>(L"instanced_gbuffer_vs.cso", m_device, true, true);
-	m_fullscreenTriangleVertexShader = new Graphics::VertexShader<>(L"fullscreen_triangle_vs.cso", m_device, false, false);
-	m_tiledCullFinalGatherComputeShader = new Graphics::ComputeShader<TiledCullFinalGatherComputeShaderFrameConstants, Graphics::DefaultShaderConstantType>(L"tiled_cull_final_gather_cs.cso", m_device, true, false);
-	m_postProcessPixelShader = new Graphics::PixelShader<>(L"post_process_ps.cso", m_device, false, false);
+	m_gbufferVertexShader = new Graphics::VertexShader<Graphics::DefaultShaderConstantType, GBufferVertexShaderObjectConstants>(L"gbuffer_vs.cso", m_renderBackend, false, true, &m_defaultInputLayout, vertexDesc, 4);
+	m_instancedGBufferVertexShader = new Graphics::VertexShader<InstancedGBufferVertexShaderFrameConstants, InstancedGBufferVertexShaderObjectConstants>(L"instanced_gbuffer_vs.cso", m_renderBackend, true, true);
+	m_fullscreenTriangleVertexShader = new Graphics::VertexShader<>(L"fullscreen_triangle_vs.cso", m_renderBackend, false, false);
+	m_tiledCullFinalGatherComputeShader = new Graphics::ComputeShader<TiledCullFinalGatherComputeShaderFrameConstants, Graphics::DefaultShaderConstantType>(L"tiled_cull_final_gather_cs.cso", m_renderBackend, true, false);
+	m_postProcessPixelShader = new Graphics::PixelShader<>(L"post_process_ps.cso", m_renderBackend, false, false);
 }
 
 } // End of namespace PBRDemo
@@ -28,6 +28,11 @@ struct InstancedGBufferVertexShaderObjectConstants {
 	uint StartVector;
 };
 
+/** The per-object data instanced_gbuffer_vs.hlsl reads from the instance buffer. The first three rows of the transposed world matrix */
+struct GBufferInstanceData {
+	DirectX::XMVECTOR WorldRows[3];
+};
+
 
 // Tiled cull final gather pass
 struct TiledCullFinalGatherComputeShaderFrameConstants {
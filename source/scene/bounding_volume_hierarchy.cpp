@@ -0,0 +1,352 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "scene/bounding_volume_hierarchy.h"
+
+#include <algorithm>
+#include <cfloat>
+
+
+namespace Scene {
+
+static inline AABB EmptyAABB() {
+	AABB aabb = {DirectX::XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX), DirectX::XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX)};
+	return aabb;
+}
+
+static inline void GrowAABB(AABB *aabb, const AABB &other) {
+	aabb->Min.x = std::min(aabb->Min.x, other.Min.x);
+	aabb->Min.y = std::min(aabb->Min.y, other.Min.y);
+	aabb->Min.z = std::min(aabb->Min.z, other.Min.z);
+	aabb->Max.x = std::max(aabb->Max.x, other.Max.x);
+	aabb->Max.y = std::max(aabb->Max.y, other.Max.y);
+	aabb->Max.z = std::max(aabb->Max.z, other.Max.z);
+}
+
+static inline float HalfSurfaceArea(const AABB &aabb) {
+	float x = aabb.Max.x - aabb.Min.x;
+	float y = aabb.Max.y - aabb.Min.y;
+	float z = aabb.Max.z - aabb.Min.z;
+
+	return x * y + y * z + z * x;
+}
+
+static inline float GetAxis(const DirectX::XMFLOAT3 &vector, uint axis) {
+	return (&vector.x)[axis];
+}
+
+/**
+ * Slab test. Returns whether the ray hits the box before 'maxDistance', and if so, the
+ * distance along the ray where it enters the box
+ */
+static inline bool IntersectRayAABB(const DirectX::XMFLOAT3 &origin, const DirectX::XMFLOAT3 &inverseDirection, float maxDistance, const AABB &aabb, float *entryDistance) {
+	float tNear = 0.0f;
+	float tFar = maxDistance;
+
+	for (uint axis = 0; axis < 3u; ++axis) {
+		float t0 = (GetAxis(aabb.Min, axis) - GetAxis(origin, axis)) * GetAxis(inverseDirection, axis);
+		float t1 = (GetAxis(aabb.Max, axis) - GetAxis(origin, axis)) * GetAxis(inverseDirection, axis);
+
+		// Written so a NaN, from a ray in the plane of a slab, leaves the interval unchanged
+		tNear = std::max(tNear, std::min(t0, t1));
+		tFar = std::min(tFar, std::max(t0, t1));
+	}
+
+	*entryDistance = tNear;
+	return tNear <= tFar;
+}
+
+
+AABB TransformAABB(const AABB &aabb, const DirectX::XMMATRIX &world) {
+	DirectX::XMVECTOR min = DirectX::XMLoadFloat3(&aabb.Min);
+	DirectX::XMVECTOR max = DirectX::XMLoadFloat3(&aabb.Max);
+
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(min, max), 0.5f);
+	DirectX::XMVECTOR extents = DirectX::XMVectorScale(DirectX::XMVectorSubtract(max, min), 0.5f);
+
+	// Arvo's method, like FrustumCuller::IntersectsAABB()
+	DirectX::XMVECTOR worldExtents = DirectX::XMVectorMultiply(DirectX::XMVectorSplatX(extents), DirectX::XMVectorAbs(world.r[0]));
+	worldExtents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatY(extents), DirectX::XMVectorAbs(world.r[1]), worldExtents);
+	worldExtents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatZ(extents), DirectX::XMVectorAbs(world.r[2]), worldExtents);
+
+	DirectX::XMVECTOR worldCenter = DirectX::XMVector3Transform(center, world);
+
+	AABB result;
+	DirectX::XMStoreFloat3(&result.Min, DirectX::XMVectorSubtract(worldCenter, worldExtents));
+	DirectX::XMStoreFloat3(&result.Max, DirectX::XMVectorAdd(worldCenter, worldExtents));
+
+	return result;
+}
+
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy()
+	: m_needsRefit(false) {
+}
+
+void BoundingVolumeHierarchy::Build(const AABB *itemBounds, uint itemCount) {
+	m_nodes.clear();
+	m_parents.clear();
+	m_dirtyNodes.clear();
+	m_needsRefit = false;
+
+	m_itemBounds.assign(itemBounds, itemBounds + itemCount);
+	m_itemOrder.resize(itemCount);
+	m_itemLeaves.resize(itemCount);
+
+	if (itemCount == 0u) {
+		return;
+	}
+
+	std::vector<DirectX::XMFLOAT3> centroids(itemCount);
+	for (uint i = 0; i < itemCount; ++i) {
+		m_itemOrder[i] = i;
+		centroids[i] = DirectX::XMFLOAT3((itemBounds[i].Min.x + itemBounds[i].Max.x) * 0.5f,
+		                                 (itemBounds[i].Min.y + itemBounds[i].Max.y) * 0.5f,
+		                                 (itemBounds[i].Min.z + itemBounds[i].Max.z) * 0.5f);
+	}
+
+	// A binary tree with at least one item per leaf never has more than 2n - 1 nodes
+	m_nodes.reserve(2u * itemCount - 1u);
+	m_parents.reserve(2u * itemCount - 1u);
+
+	BuildNode(&centroids[0], 0u, itemCount, 0u);
+
+	m_dirtyNodes.resize(m_nodes.size(), 0u);
+}
+
+uint BoundingVolumeHierarchy::BuildNode(const DirectX::XMFLOAT3 *centroids, uint firstItem, uint itemCount, uint depth) {
+	uint nodeIndex = static_cast<uint>(m_nodes.size());
+
+	Node node;
+	node.Bounds = EmptyAABB();
+	node.FirstItem = firstItem;
+	node.ItemCount = itemCount;
+	node.RightChild = 0u;
+
+	AABB centroidBounds = EmptyAABB();
+	for (uint i = firstItem; i < firstItem + itemCount; ++i) {
+		uint item = m_itemOrder[i];
+		GrowAABB(&node.Bounds, m_itemBounds[item]);
+
+		AABB centroid = {centroids[item], centroids[item]};
+		GrowAABB(&centroidBounds, centroid);
+	}
+
+	m_nodes.push_back(node);
+	// The caller fixes up the parents of children
+	m_parents.push_back(nodeIndex);
+
+	if (itemCount <= kMaxLeafItems || depth >= kMaxDepth) {
+		for (uint i = firstItem; i < firstItem + itemCount; ++i) {
+			m_itemLeaves[m_itemOrder[i]] = nodeIndex;
+		}
+		return nodeIndex;
+	}
+
+	// Split along the axis where the centroids are most spread out
+	uint axis = 0u;
+	float extent = centroidBounds.Max.x - centroidBounds.Min.x;
+	if (centroidBounds.Max.y - centroidBounds.Min.y > extent) {
+		axis = 1u;
+		extent = centroidBounds.Max.y - centroidBounds.Min.y;
+	}
+	if (centroidBounds.Max.z - centroidBounds.Min.z > extent) {
+		axis = 2u;
+		extent = centroidBounds.Max.z - centroidBounds.Min.z;
+	}
+
+	uint leftCount = 0u;
+	if (extent > 0.0f) {
+		float axisMin = GetAxis(centroidBounds.Min, axis);
+		float binScale = static_cast<float>(kNumBins) / extent;
+
+		AABB binBounds[kNumBins];
+		uint binCounts[kNumBins];
+		for (uint i = 0; i < kNumBins; ++i) {
+			binBounds[i] = EmptyAABB();
+			binCounts[i] = 0u;
+		}
+
+		for (uint i = firstItem; i < firstItem + itemCount; ++i) {
+			uint item = m_itemOrder[i];
+			uint bin = std::min(static_cast<uint>((GetAxis(centroids[item], axis) - axisMin) * binScale), kNumBins - 1u);
+
+			GrowAABB(&binBounds[bin], m_itemBounds[item]);
+			++binCounts[bin];
+		}
+
+		// Sweep from the right to get the cost of everything after each split, and then from
+		// the left to find the cheapest split
+		float rightCosts[kNumBins];
+		AABB rightBounds = EmptyAABB();
+		uint rightCount = 0u;
+		for (uint i = kNumBins - 1u; i > 0u; --i) {
+			GrowAABB(&rightBounds, binBounds[i]);
+			rightCount += binCounts[i];
+			rightCosts[i] = rightCount > 0u ? static_cast<float>(rightCount) * HalfSurfaceArea(rightBounds) : 0.0f;
+		}
+
+		float bestCost = FLT_MAX;
+		uint bestSplit = 0u;
+		AABB leftBounds = EmptyAABB();
+		uint runningLeftCount = 0u;
+		for (uint i = 0; i < kNumBins - 1u; ++i) {
+			GrowAABB(&leftBounds, binBounds[i]);
+			runningLeftCount += binCounts[i];
+
+			if (runningLeftCount == 0u || runningLeftCount == itemCount) {
+				continue;
+			}
+
+			float cost = static_cast<float>(runningLeftCount) * HalfSurfaceArea(leftBounds) + rightCosts[i + 1u];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		// Leaves are capped at kMaxLeafItems, so the cheapest split is taken even when it's no
+		// cheaper than leaving the node as a leaf
+		if (bestCost < FLT_MAX) {
+			uint *first = &m_itemOrder[0] + firstItem;
+			uint *middle = std::partition(first, first + itemCount, [&](uint item) {
+				return std::min(static_cast<uint>((GetAxis(centroids[item], axis) - axisMin) * binScale), kNumBins - 1u) <= bestSplit;
+			});
+			leftCount = static_cast<uint>(middle - first);
+		}
+	}
+
+	// The centroids can't be separated by the bins. Split the items in half instead, so leaves stay small
+	if (leftCount == 0u || leftCount == itemCount) {
+		leftCount = itemCount / 2u;
+
+		uint *first = &m_itemOrder[0] + firstItem;
+		std::nth_element(first, first + leftCount, first + itemCount, [&](uint lhs, uint rhs) {
+			return GetAxis(centroids[lhs], axis) < GetAxis(centroids[rhs], axis);
+		});
+	}
+
+	uint leftChild = BuildNode(centroids, firstItem, leftCount, depth + 1u);
+	uint rightChild = BuildNode(centroids, firstItem + leftCount, itemCount - leftCount, depth + 1u);
+
+	m_nodes[nodeIndex].RightChild = rightChild;
+	m_parents[leftChild] = nodeIndex;
+	m_parents[rightChild] = nodeIndex;
+
+	return nodeIndex;
+}
+
+void BoundingVolumeHierarchy::SetItemBounds(uint item, const AABB &bounds) {
+	m_itemBounds[item] = bounds;
+
+	// Mark the path to the root. Stop at the first node that's already marked, since
+	// everything above it is too
+	uint node = m_itemLeaves[item];
+	while (m_dirtyNodes[node] == 0u) {
+		m_dirtyNodes[node] = 1u;
+		if (node == 0u) {
+			break;
+		}
+		node = m_parents[node];
+	}
+
+	m_needsRefit = true;
+}
+
+void BoundingVolumeHierarchy::Refit() {
+	if (!m_needsRefit) {
+		return;
+	}
+
+	// Children always come after their parents, so walking backwards refits bottom up
+	for (uint i = static_cast<uint>(m_nodes.size()); i-- > 0u;) {
+		if (m_dirtyNodes[i] == 0u) {
+			continue;
+		}
+
+		Node &node = m_nodes[i];
+		if (node.RightChild == 0u) {
+			node.Bounds = EmptyAABB();
+			for (uint j = node.FirstItem; j < node.FirstItem + node.ItemCount; ++j) {
+				GrowAABB(&node.Bounds, m_itemBounds[m_itemOrder[j]]);
+			}
+		} else {
+			node.Bounds = m_nodes[i + 1u].Bounds;
+			GrowAABB(&node.Bounds, m_nodes[node.RightChild].Bounds);
+		}
+
+		m_dirtyNodes[i] = 0u;
+	}
+
+	m_needsRefit = false;
+}
+
+bool BoundingVolumeHierarchy::Raycast(const DirectX::XMFLOAT3 &origin, const DirectX::XMFLOAT3 &direction, float maxDistance, uint *hitItem, float *hitDistance) const {
+	if (m_nodes.empty()) {
+		return false;
+	}
+
+	// Division by zero gives infinity, which the slab test handles
+	DirectX::XMFLOAT3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	bool hit = false;
+	float closest = maxDistance;
+
+	float distance;
+	if (!IntersectRayAABB(origin, inverseDirection, closest, m_nodes[0].Bounds, &distance)) {
+		return false;
+	}
+
+	uint stack[kMaxDepth + 1u];
+	uint stackSize = 0u;
+	stack[stackSize++] = 0u;
+
+	while (stackSize > 0u) {
+		uint nodeIndex = stack[--stackSize];
+		const Node &node = m_nodes[nodeIndex];
+
+		// Nodes are tested before they're pushed, but a closer hit may have been found since
+		if (!IntersectRayAABB(origin, inverseDirection, closest, node.Bounds, &distance)) {
+			continue;
+		}
+
+		if (node.RightChild == 0u) {
+			for (uint i = node.FirstItem; i < node.FirstItem + node.ItemCount; ++i) {
+				uint item = m_itemOrder[i];
+
+				if (IntersectRayAABB(origin, inverseDirection, closest, m_itemBounds[item], &distance) && (!hit || distance < closest)) {
+					closest = distance;
+					*hitItem = item;
+					hit = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first, so hits in it can cull the further one
+		uint leftChild = nodeIndex + 1u;
+		float leftDistance;
+		float rightDistance;
+		bool hitLeft = IntersectRayAABB(origin, inverseDirection, closest, m_nodes[leftChild].Bounds, &leftDistance);
+		bool hitRight = IntersectRayAABB(origin, inverseDirection, closest, m_nodes[node.RightChild].Bounds, &rightDistance);
+
+		if (hitLeft && hitRight) {
+			stack[stackSize++] = leftDistance <= rightDistance ? node.RightChild : leftChild;
+			stack[stackSize++] = leftDistance <= rightDistance ? leftChild : node.RightChild;
+		} else if (hitLeft) {
+			stack[stackSize++] = leftChild;
+		} else if (hitRight) {
+			stack[stackSize++] = node.RightChild;
+		}
+	}
+
+	if (hit) {
+		*hitDistance = closest;
+	}
+	return hit;
+}
+
+} // End of namespace Scene
@@ -0,0 +1,235 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/halfling_sys.h"
+
+#include "scene/frustum.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+
+namespace Scene {
+
+struct AABB {
+	DirectX::XMFLOAT3 Min;
+	DirectX::XMFLOAT3 Max;
+};
+
+/**
+ * Transforms a box, and returns the axis-aligned box around the result
+ *
+ * @param aabb     The box to transform
+ * @param world    The transform
+ */
+AABB TransformAABB(const AABB &aabb, const DirectX::XMMATRIX &world);
+
+/**
+ * A bounding volume hierarchy over a set of world space boxes, used to find the boxes
+ * inside a frustum, touching a sphere, or hit by a ray, without testing every box
+ *
+ * The tree is built top down, splitting each node with a binned surface area heuristic. The
+ * nodes are stored depth first in a single array. A node's left child directly follows it, so
+ * every child comes after its parent, and the items under a node are a contiguous range of
+ * the item order.
+ *
+ * When items move, SetItemBounds() and then Refit() grow or shrink the nodes above them,
+ * without changing the tree. The tree gets looser as items move away from where it was built,
+ * so call Build() again after large changes.
+ *
+ * Items are identified by their index in the array passed to Build().
+ */
+class BoundingVolumeHierarchy {
+public:
+	BoundingVolumeHierarchy();
+
+private:
+	struct Node {
+		AABB Bounds;
+		/** The first index into m_itemOrder of the items under this node */
+		uint FirstItem;
+		uint ItemCount;
+		/** The index of the right child. 0 for leaves, since the root is never a child */
+		uint RightChild;
+	};
+
+	static const uint kMaxLeafItems = 4u;
+	static const uint kNumBins = 16u;
+	/** The depth limit of the tree. Nodes at the limit become leaves, however many items they hold */
+	static const uint kMaxDepth = 48u;
+
+	std::vector<Node> m_nodes;
+	std::vector<uint> m_parents;
+	/** Nodes that need refitting. Bytes, rather than std::vector<bool>, so they're cheap to scan */
+	std::vector<byte> m_dirtyNodes;
+	bool m_needsRefit;
+
+	std::vector<AABB> m_itemBounds;
+	/** The items, ordered so the items under every node are contiguous */
+	std::vector<uint> m_itemOrder;
+	/** The leaf holding each item */
+	std::vector<uint> m_itemLeaves;
+
+public:
+	/**
+	 * Builds the tree over a new set of items, replacing any previous items
+	 *
+	 * @param itemBounds    The world space bounds of each item
+	 * @param itemCount     The number of items
+	 */
+	void Build(const AABB *itemBounds, uint itemCount);
+	/**
+	 * Changes the bounds of an item. The nodes above it are updated on the next Refit()
+	 *
+	 * @param item      The index of the item
+	 * @param bounds    The new world space bounds of the item
+	 */
+	void SetItemBounds(uint item, const AABB &bounds);
+	/**
+	 * Updates the bounds of every node above an item changed by SetItemBounds(), bottom up.
+	 * Queries made before Refit() use the old node bounds
+	 */
+	void Refit();
+
+	inline uint GetItemCount() const { return static_cast<uint>(m_itemBounds.size()); }
+	inline uint GetNodeCount() const { return static_cast<uint>(m_nodes.size()); }
+	inline const AABB &GetItemBounds(uint item) const { return m_itemBounds[item]; }
+
+	/**
+	 * Calls 'visitor(uint item)' for every item that intersects or is inside a frustum. The
+	 * items under a node that's entirely inside the frustum are accepted without testing them
+	 *
+	 * @param culler     The frustum to test against
+	 * @param visitor    Called once for each visible item, in no particular order
+	 */
+	template <typename Visitor>
+	void QueryFrustum(const FrustumCuller &culler, Visitor visitor) const;
+	/**
+	 * Calls 'visitor(uint item)' for every item whose bounds touch a sphere. For example, to
+	 * find the objects a point light can reach
+	 *
+	 * @param center     The center of the sphere
+	 * @param radius     The radius of the sphere
+	 * @param visitor    Called once for each item touching the sphere, in no particular order
+	 */
+	template <typename Visitor>
+	void QuerySphere(const DirectX::XMFLOAT3 &center, float radius, Visitor visitor) const;
+	/**
+	 * Finds the closest item whose bounds are hit by a ray
+	 *
+	 * @param origin         The start of the ray
+	 * @param direction      The direction of the ray. Distances are in multiples of its length
+	 * @param maxDistance    Hits further than this are ignored
+	 * @param hitItem        Set to the closest item hit, if there was one
+	 * @param hitDistance    Set to the distance along the ray of the entry point into the item's bounds. 0 if the ray starts inside them
+	 * @return               Whether any item was hit
+	 */
+	bool Raycast(const DirectX::XMFLOAT3 &origin, const DirectX::XMFLOAT3 &direction, float maxDistance, uint *hitItem, float *hitDistance) const;
+
+private:
+	uint BuildNode(const DirectX::XMFLOAT3 *centroids, uint firstItem, uint itemCount, uint depth);
+
+	static inline void GetCenterAndExtents(const AABB &aabb, DirectX::XMFLOAT3 *center, DirectX::XMFLOAT3 *extents) {
+		center->x = (aabb.Min.x + aabb.Max.x) * 0.5f;
+		center->y = (aabb.Min.y + aabb.Max.y) * 0.5f;
+		center->z = (aabb.Min.z + aabb.Max.z) * 0.5f;
+		extents->x = (aabb.Max.x - aabb.Min.x) * 0.5f;
+		extents->y = (aabb.Max.y - aabb.Min.y) * 0.5f;
+		extents->z = (aabb.Max.z - aabb.Min.z) * 0.5f;
+	}
+
+	static inline bool SphereTouchesAABB(const DirectX::XMFLOAT3 &center, float radiusSquared, const AABB &aabb) {
+		// The squared distance from the center to the closest point in the box
+		float dx = center.x < aabb.Min.x ? aabb.Min.x - center.x : (center.x > aabb.Max.x ? center.x - aabb.Max.x : 0.0f);
+		float dy = center.y < aabb.Min.y ? aabb.Min.y - center.y : (center.y > aabb.Max.y ? center.y - aabb.Max.y : 0.0f);
+		float dz = center.z < aabb.Min.z ? aabb.Min.z - center.z : (center.z > aabb.Max.z ? center.z - aabb.Max.z : 0.0f);
+
+		return dx * dx + dy * dy + dz * dz <= radiusSquared;
+	}
+};
+
+
+template <typename Visitor>
+void BoundingVolumeHierarchy::QueryFrustum(const FrustumCuller &culler, Visitor visitor) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	uint stack[kMaxDepth + 1u];
+	uint stackSize = 0u;
+	stack[stackSize++] = 0u;
+
+	while (stackSize > 0u) {
+		const Node &node = m_nodes[stack[--stackSize]];
+
+		DirectX::XMFLOAT3 center;
+		DirectX::XMFLOAT3 extents;
+		GetCenterAndExtents(node.Bounds, &center, &extents);
+
+		FrustumTestResult result = culler.ClassifyAABB(center, extents);
+		if (result == FrustumTestResult::OUTSIDE) {
+			continue;
+		}
+
+		if (result == FrustumTestResult::INSIDE) {
+			for (uint i = node.FirstItem; i < node.FirstItem + node.ItemCount; ++i) {
+				visitor(m_itemOrder[i]);
+			}
+		} else if (node.RightChild == 0u) {
+			for (uint i = node.FirstItem; i < node.FirstItem + node.ItemCount; ++i) {
+				uint item = m_itemOrder[i];
+
+				GetCenterAndExtents(m_itemBounds[item], &center, &extents);
+				if (culler.IntersectsAABB(center, extents)) {
+					visitor(item);
+				}
+			}
+		} else {
+			uint nodeIndex = static_cast<uint>(&node - &m_nodes[0]);
+			stack[stackSize++] = node.RightChild;
+			stack[stackSize++] = nodeIndex + 1u;
+		}
+	}
+}
+
+template <typename Visitor>
+void BoundingVolumeHierarchy::QuerySphere(const DirectX::XMFLOAT3 &center, float radius, Visitor visitor) const {
+	if (m_nodes.empty()) {
+		return;
+	}
+
+	float radiusSquared = radius * radius;
+
+	uint stack[kMaxDepth + 1u];
+	uint stackSize = 0u;
+	stack[stackSize++] = 0u;
+
+	while (stackSize > 0u) {
+		uint nodeIndex = stack[--stackSize];
+		const Node &node = m_nodes[nodeIndex];
+
+		if (!SphereTouchesAABB(center, radiusSquared, node.Bounds)) {
+			continue;
+		}
+
+		if (node.RightChild == 0u) {
+			for (uint i = node.FirstItem; i < node.FirstItem + node.ItemCount; ++i) {
+				uint item = m_itemOrder[i];
+				if (SphereTouchesAABB(center, radiusSquared, m_itemBounds[item])) {
+					visitor(item);
+				}
+			}
+		} else {
+			stack[stackSize++] = node.RightChild;
+			stack[stackSize++] = nodeIndex + 1u;
+		}
+	}
+}
+
+} // End of namespace Scene
@@ -13,6 +13,7 @@ namespace Scene {
 
 void Camera::Rotate(float dTheta, float dPhi) {
 	m_viewNeedsUpdate = true;
+	m_frustumNeedsUpdate = true;
 
 	if (m_up > 0.0f) {
 		m_theta += dTheta;
@@ -39,6 +40,7 @@ void Camera::Rotate(float dTheta, float dPhi) {
 
 void Camera::Zoom(float distance) {
 	m_viewNeedsUpdate = true;
+	m_frustumNeedsUpdate = true;
 
 	m_radius -= distance;
 
@@ -53,6 +55,7 @@ void Camera::Zoom(float distance) {
 
 void Camera::Pan(float dx, float dy) {
 	m_viewNeedsUpdate = true;
+	m_frustumNeedsUpdate = true;
 
 	DirectX::XMVECTOR look = DirectX::XMVector3Normalize(DirectX::XMVectorSubtract(m_target, GetCameraPositionXM()));
 	DirectX::XMVECTOR worldUp = DirectX::XMVectorSet(0.0f, m_up, 0.0f, 0.0f);
@@ -68,6 +71,8 @@ void Camera::UpdateViewMatrix() {
 }
 
 void Camera::UpdateProjectionMatrix(float clientWidth, float clientHeight, float nearClip, float farClip) {
+	m_frustumNeedsUpdate = true;
+
 	m_proj = DirectX::XMMatrixPerspectiveFovLH(0.25f * DirectX::XM_PI, clientWidth / clientHeight, nearClip, farClip);
 }
 
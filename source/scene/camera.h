@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include "scene/frustum.h"
+
 #include <DirectXMath.h>
 
 
@@ -26,7 +28,8 @@ public:
 		  m_target(DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f)),
 		  m_view(DirectX::XMMatrixIdentity()),
 		  m_proj(DirectX::XMMatrixIdentity()),
-		  m_viewNeedsUpdate(true) {
+		  m_viewNeedsUpdate(true),
+		  m_frustumNeedsUpdate(true) {
 	}
 	Camera(float theta, float phi, float radius) 
 		: m_theta(theta), 
@@ -36,7 +39,8 @@ public:
 		  m_target(DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 0.0f)),
 		  m_view(DirectX::XMMatrixIdentity()),
 		  m_proj(DirectX::XMMatrixIdentity()),
-		  m_viewNeedsUpdate(true) {
+		  m_viewNeedsUpdate(true),
+		  m_frustumNeedsUpdate(true) {
 	}
 
 private:
@@ -52,6 +56,10 @@ private:
 
 	bool m_viewNeedsUpdate;
 
+	/** The frustum of the view and projection matrices. Lazy loaded like the view matrix */
+	Frustum m_frustum;
+	bool m_frustumNeedsUpdate;
+
 public:
 	/**
 	 * Rotate the camera about a point in front of it (m_target). Theta is a rotation 
@@ -128,6 +136,20 @@ public:
 	 * @return    The projection matrix
 	 */
 	inline DirectX::XMMATRIX GetProj() { return m_proj; }
+	/**
+	 * Returns the world space frustum of the camera. The planes are only extracted
+	 * again after the camera moves, or the projection changes
+	 *
+	 * @return    The frustum
+	 */
+	inline const Frustum &GetFrustum() {
+		if (m_frustumNeedsUpdate) {
+			m_frustum = Frustum(GetView() * m_proj);
+			m_frustumNeedsUpdate = false;
+		}
+
+		return m_frustum;
+	}
 
 private:
 	/**
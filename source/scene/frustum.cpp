@@ -0,0 +1,159 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "scene/frustum.h"
+
+#include <cmath>
+
+
+namespace Scene {
+
+Frustum::Frustum() {
+	// An empty frustum doesn't cull anything
+	for (uint i = 0; i < kNumPlanes; ++i) {
+		Planes[i] = Common::float4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const DirectX::XMMATRIX &viewProj) {
+	// Gribb / Hartmann plane extraction. Clip space is row vector times matrix, so the planes
+	// are built from the columns, which are the rows of the transpose
+	DirectX::XMFLOAT4X4 columns;
+	DirectX::XMStoreFloat4x4(&columns, DirectX::XMMatrixTranspose(viewProj));
+
+	Common::float4 x(columns._11, columns._12, columns._13, columns._14);
+	Common::float4 y(columns._21, columns._22, columns._23, columns._24);
+	Common::float4 z(columns._31, columns._32, columns._33, columns._34);
+	Common::float4 w(columns._41, columns._42, columns._43, columns._44);
+
+	Planes[0] = w + x;
+	Planes[1] = w - x;
+	Planes[2] = w + y;
+	Planes[3] = w - y;
+	Planes[4] = z;
+	Planes[5] = w - z;
+
+	Common::NormalizePlanes(Planes, kNumPlanes);
+}
+
+
+FrustumCuller::FrustumCuller(const Frustum &frustum) {
+	for (uint i = 0; i < kNumPaddedPlanes; ++i) {
+		const Common::float4 &plane = frustum.Planes[i < Frustum::kNumPlanes ? i : 0u];
+
+		m_planeX[i] = plane.X;
+		m_planeY[i] = plane.Y;
+		m_planeZ[i] = plane.Z;
+		m_planeW[i] = plane.W;
+	}
+}
+
+bool FrustumCuller::IntersectsAABB(const DirectX::XMFLOAT3 &center, const DirectX::XMFLOAT3 &extents) const {
+	// The box is outside if it's entirely behind any one plane. That's when the distance from the
+	// center to the plane is less than minus the projection of the extents onto the plane normal
+	#if HALFLING_MATH_SSE
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		const __m128 centerX = _mm_set1_ps(center.x);
+		const __m128 centerY = _mm_set1_ps(center.y);
+		const __m128 centerZ = _mm_set1_ps(center.z);
+		const __m128 extentsX = _mm_set1_ps(extents.x);
+		const __m128 extentsY = _mm_set1_ps(extents.y);
+		const __m128 extentsZ = _mm_set1_ps(extents.z);
+
+		for (uint i = 0; i < kNumPaddedPlanes; i += 4) {
+			__m128 planeX = _mm_loadu_ps(m_planeX + i);
+			__m128 planeY = _mm_loadu_ps(m_planeY + i);
+			__m128 planeZ = _mm_loadu_ps(m_planeZ + i);
+
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX, centerX), _mm_mul_ps(planeY, centerY)), _mm_add_ps(_mm_mul_ps(planeZ, centerZ), _mm_loadu_ps(m_planeW + i)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, planeX), extentsX), _mm_mul_ps(_mm_andnot_ps(signMask, planeY), extentsY)), _mm_mul_ps(_mm_andnot_ps(signMask, planeZ), extentsZ));
+
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0) {
+				return false;
+			}
+		}
+	#else
+		for (uint i = 0; i < Frustum::kNumPlanes; ++i) {
+			float distance = m_planeX[i] * center.x + m_planeY[i] * center.y + m_planeZ[i] * center.z + m_planeW[i];
+			float radius = std::abs(m_planeX[i]) * extents.x + std::abs(m_planeY[i]) * extents.y + std::abs(m_planeZ[i]) * extents.z;
+
+			if (distance + radius < 0.0f) {
+				return false;
+			}
+		}
+	#endif
+
+	return true;
+}
+
+FrustumTestResult FrustumCuller::ClassifyAABB(const DirectX::XMFLOAT3 &center, const DirectX::XMFLOAT3 &extents) const {
+	// The box is inside when it's entirely in front of every plane
+	bool inside = true;
+
+	#if HALFLING_MATH_SSE
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+
+		const __m128 centerX = _mm_set1_ps(center.x);
+		const __m128 centerY = _mm_set1_ps(center.y);
+		const __m128 centerZ = _mm_set1_ps(center.z);
+		const __m128 extentsX = _mm_set1_ps(extents.x);
+		const __m128 extentsY = _mm_set1_ps(extents.y);
+		const __m128 extentsZ = _mm_set1_ps(extents.z);
+
+		for (uint i = 0; i < kNumPaddedPlanes; i += 4) {
+			__m128 planeX = _mm_loadu_ps(m_planeX + i);
+			__m128 planeY = _mm_loadu_ps(m_planeY + i);
+			__m128 planeZ = _mm_loadu_ps(m_planeZ + i);
+
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX, centerX), _mm_mul_ps(planeY, centerY)), _mm_add_ps(_mm_mul_ps(planeZ, centerZ), _mm_loadu_ps(m_planeW + i)));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, planeX), extentsX), _mm_mul_ps(_mm_andnot_ps(signMask, planeY), extentsY)), _mm_mul_ps(_mm_andnot_ps(signMask, planeZ), extentsZ));
+
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps())) != 0) {
+				return FrustumTestResult::OUTSIDE;
+			}
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), _mm_setzero_ps())) != 0) {
+				inside = false;
+			}
+		}
+	#else
+		for (uint i = 0; i < Frustum::kNumPlanes; ++i) {
+			float distance = m_planeX[i] * center.x + m_planeY[i] * center.y + m_planeZ[i] * center.z + m_planeW[i];
+			float radius = std::abs(m_planeX[i]) * extents.x + std::abs(m_planeY[i]) * extents.y + std::abs(m_planeZ[i]) * extents.z;
+
+			if (distance + radius < 0.0f) {
+				return FrustumTestResult::OUTSIDE;
+			}
+			if (distance - radius < 0.0f) {
+				inside = false;
+			}
+		}
+	#endif
+
+	return inside ? FrustumTestResult::INSIDE : FrustumTestResult::INTERSECTS;
+}
+
+bool FrustumCuller::IntersectsAABB(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world) const {
+	DirectX::XMVECTOR min = DirectX::XMLoadFloat3(&aabbMin);
+	DirectX::XMVECTOR max = DirectX::XMLoadFloat3(&aabbMax);
+
+	DirectX::XMVECTOR center = DirectX::XMVectorScale(DirectX::XMVectorAdd(min, max), 0.5f);
+	DirectX::XMVECTOR extents = DirectX::XMVectorScale(DirectX::XMVectorSubtract(max, min), 0.5f);
+
+	// Arvo's method. Each world axis of the box grows by the absolute contribution of every local axis
+	DirectX::XMVECTOR worldExtents = DirectX::XMVectorMultiply(DirectX::XMVectorSplatX(extents), DirectX::XMVectorAbs(world.r[0]));
+	worldExtents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatY(extents), DirectX::XMVectorAbs(world.r[1]), worldExtents);
+	worldExtents = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorSplatZ(extents), DirectX::XMVectorAbs(world.r[2]), worldExtents);
+
+	DirectX::XMFLOAT3 worldCenter;
+	DirectX::XMFLOAT3 worldHalfSize;
+	DirectX::XMStoreFloat3(&worldCenter, DirectX::XMVector3Transform(center, world));
+	DirectX::XMStoreFloat3(&worldHalfSize, worldExtents);
+
+	return IntersectsAABB(worldCenter, worldHalfSize);
+}
+
+} // End of namespace Scene
@@ -0,0 +1,89 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/math.h"
+
+#include <DirectXMath.h>
+
+
+namespace Scene {
+
+/**
+ * The six planes bounding a view frustum
+ *
+ * The planes are extracted from a view projection matrix, so they're in world space, and
+ * their normals point into the frustum. A reversed depth projection swaps the near and far
+ * planes, but the volume they bound stays the same.
+ */
+struct Frustum {
+	Frustum();
+	explicit Frustum(const DirectX::XMMATRIX &viewProj);
+
+	static const uint kNumPlanes = 6u;
+
+	/** Normalized planes of the form (A, B, C, D). Left, right, bottom, top, near, far */
+	Common::float4 Planes[kNumPlanes];
+};
+
+/** Where a box lies relative to a frustum. See FrustumCuller::ClassifyAABB() */
+enum class FrustumTestResult {
+	OUTSIDE,
+	INTERSECTS,
+	INSIDE
+};
+
+/**
+ * Tests axis-aligned bounding boxes against a frustum
+ *
+ * The planes are stored with each component in its own array, so a box is tested against 4
+ * planes per SSE instruction. Build one per frame from the camera frustum. It's read only after
+ * construction, so any number of threads can cull with the same culler.
+ */
+class FrustumCuller {
+public:
+	explicit FrustumCuller(const Frustum &frustum);
+
+private:
+	// Padded to a multiple of 4 with copies of the first plane
+	static const uint kNumPaddedPlanes = 8u;
+
+	float m_planeX[kNumPaddedPlanes];
+	float m_planeY[kNumPaddedPlanes];
+	float m_planeZ[kNumPaddedPlanes];
+	float m_planeW[kNumPaddedPlanes];
+
+public:
+	/**
+	 * Returns whether a box intersects or is inside the frustum. The test is conservative. Some
+	 * boxes that are just outside a corner of the frustum are reported as visible
+	 *
+	 * @param center     The center of the box
+	 * @param extents    The half size of the box along each axis
+	 */
+	bool IntersectsAABB(const DirectX::XMFLOAT3 &center, const DirectX::XMFLOAT3 &extents) const;
+	/**
+	 * Transforms a box to world space, and returns whether the box around the result
+	 * intersects or is inside the frustum
+	 *
+	 * @param aabbMin    The minimum corner of the box, in object space
+	 * @param aabbMax    The maximum corner of the box, in object space
+	 * @param world      The object to world transform
+	 */
+	bool IntersectsAABB(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world) const;
+	/**
+	 * Like IntersectsAABB(), but also reports when a box is entirely inside the frustum, so
+	 * everything within the box can be accepted without testing it
+	 *
+	 * @param center     The center of the box
+	 * @param extents    The half size of the box along each axis
+	 */
+	FrustumTestResult ClassifyAABB(const DirectX::XMFLOAT3 &center, const DirectX::XMFLOAT3 &extents) const;
+};
+
+} // End of namespace Scene
@@ -7,9 +7,10 @@
 #include "scene/geometry_generator.h"
 
 #include "common/file_io_util.h"
+#include "common/mapped_file.h"
 #include "common/string_util.h"
 #include "common/memory_stream.h"
-#include "common/hash.h"
+#include "common/flat_hash_map.h"
 
 #include <unordered_map>
 #include <tuple>
@@ -375,7 +376,7 @@ bool GeometryGenerator::LoadFromOBJ(const wchar *fileName, MeshData *meshData, s
 	std::vector<std::wstring> meshMatLibs;
 
 	//Arrays to store our model's information
-	std::unordered_map<TupleUInt3, uint> vertexMap;
+	Common::FlatHashMap<TupleUInt3, uint> vertexMap;
 
 	std::vector<DirectX::XMFLOAT3> vertPos;
 	std::vector<DirectX::XMFLOAT3> vertNorm;
@@ -387,13 +388,12 @@ bool GeometryGenerator::LoadFromOBJ(const wchar *fileName, MeshData *meshData, s
 	std::string line;
 	char nextChar;
 	
-	DWORD bytesRead;
-	char *fileBuffer = Common::ReadWholeFile(fileName, &bytesRead);
-	if (fileBuffer == NULL) {
+	Common::MappedFile objFile(fileName);
+	if (!objFile.IsOpen()) {
 		return false;
 	}
 
-	Common::MemoryInputStream fin(fileBuffer, bytesRead);
+	Common::MemoryInputStream fin(objFile.GetChars(), static_cast<size_t>(objFile.GetSize()));
 
 	uint lineNumber = 0;
 	while (SafeGetLine(fin, line)) {
@@ -613,8 +613,8 @@ bool GeometryGenerator::LoadFromOBJ(const wchar *fileName, MeshData *meshData, s
 		lastSubset->IndexCount = static_cast<uint>(meshData->Indices.size()) - lastSubset->IndexStart;
 	}
 
-	// Release the obj file memory
-	delete[] fileBuffer;
+	// Release the obj file mapping
+	objFile.Close();
 
 	// Materials aren't required
 	if (meshMatLibs.size() == 0) {
@@ -628,12 +628,12 @@ bool GeometryGenerator::LoadFromOBJ(const wchar *fileName, MeshData *meshData, s
 
 	// Run through each mtl file and fill materialMap from them
 	for (auto iter = meshMatLibs.begin(); iter != meshMatLibs.end(); ++iter) {
-		fileBuffer = Common::ReadWholeFile(iter->c_str(), &bytesRead);
-		if (fileBuffer == NULL) {
+		Common::MappedFile mtlFile(iter->c_str());
+		if (!mtlFile.IsOpen()) {
 			return false;
 		}
 
-		Common::MemoryInputStream fin(fileBuffer, bytesRead);
+		Common::MemoryInputStream fin(mtlFile.GetChars(), static_cast<size_t>(mtlFile.GetSize()));
 		
 		while (SafeGetLine(fin, line)) {
 			Common::Trim(line);
@@ -779,8 +779,6 @@ bool GeometryGenerator::LoadFromOBJ(const wchar *fileName, MeshData *meshData, s
 				break;
 			}
 		}
-
-		delete[] fileBuffer;
 	}
 
 	uint totalVertices = static_cast<uint>(meshData->Vertices.size());
@@ -7,128 +7,154 @@
 #include "scene/halfling_model_file.h"
 
 #include "common/file_io_util.h"
-#include "common/memory_stream.h"
+#include "common/mapped_file.h"
+#include "common/binary_reader.h"
 #include "common/endian.h"
+#include "common/string_id.h"
 #include "common/string_util.h"
 
 #include "engine/texture_manager.h"
+#include "engine/model_manager.h"
 #include "engine/material_shader_manager.h"
 #include "engine/material_cache.h"
 
+#include "graphics/commands.h"
+
 #include <string>
 #include <fstream>
+#include <algorithm>
 
 namespace Scene {
 
-Model *HalflingModelFile::Load(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const wchar *filePath) {
-	// Read the entire file into memory
-	DWORD bytesRead;
-	char *fileBuffer = Common::ReadWholeFile(filePath, &bytesRead);
-	if (fileBuffer == NULL) {
-		return NULL;
+bool HalflingModelFile::Load(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const wchar *filePath, Model *model) {
+	// Map the file and parse straight out of the mapping
+	Common::MappedFile file(filePath);
+	if (!file.IsOpen()) {
+		return false;
 	}
 
-	Common::MemoryInputStream fin(fileBuffer, bytesRead);
+	return LoadFromMemory(backend, textureManager, modelManager, materialShaderManager, materialCache, samplerStateManager, file.GetChars(), static_cast<size_t>(file.GetSize()), model);
+}
 
-	// Read in the file data
+bool HalflingModelFile::LoadFromMemory(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const char *fileData, size_t fileSize, Model *model) {
+	Common::BinaryReader reader(fileData, fileSize);
 
 	// Check that this is a 'HFM' file
 	uint32 fileId;
-	fin.readUInt32(&fileId);
-	if (fileId != MKTAG('\0', 'F', 'M', 'H')) {
-		return NULL;
+	if (!reader.ReadUInt32(&fileId) || fileId != MKTAG('\0', 'F', 'M', 'H')) {
+		return false;
 	}
 
 	// File format version
 	byte fileFormatVersion;
-	fin.readByte(&fileFormatVersion);
+	reader.ReadByte(&fileFormatVersion);
 	assert(fileFormatVersion == kFileFormatVersion);
 
 	// Flags
-	uint64 flags;
-	fin.readUInt64(&flags);
+	uint64 flags = 0;
+	reader.ReadUInt64(&flags);
 
 	// String table
-	std::string *stringTable = nullptr;
+	// The strings are interned straight out of the file buffer, so the texture and shader
+	// lookups below are keyed by id, and don't need a temporary string each
+	std::vector<Common::StringId> stringTable;
 	if ((flags & HAS_STRING_TABLE) == HAS_STRING_TABLE) {
-		uint32 numStrings;
-		fin.readUInt32(&numStrings);
-
-		stringTable = new std::string[numStrings];
-
-		for (uint i = 0; i < numStrings; ++i) {
-			uint16 stringLength;
-			fin.readUInt16(&stringLength);
-
-			// Read in the string characters
-			stringTable[i].resize(stringLength + 1); // Allow space for the null terminator
-			fin.read(&stringTable[i][0], stringLength);
+		uint32 numStrings = 0;
+		reader.ReadUInt32(&numStrings);
+
+		stringTable.resize(std::min<size_t>(numStrings, reader.Remaining() / sizeof(uint16)));
+		for (uint i = 0; i < stringTable.size(); ++i) {
+			uint16 length = 0;
+			reader.ReadUInt16(&length);
+			const char *chars = reader.View<char>(length);
+			if (chars == nullptr) {
+				return false;
+			}
 
-			// Manually create the null terminator
-			stringTable[i][stringLength] = '\0';
+			stringTable[i] = Common::InternString(chars, length);
 		}
 	}
 
 	// Num vertices
-	uint32 numVertices;
-	fin.readUInt32(&numVertices);
+	uint32 numVertices = 0;
+	reader.ReadUInt32(&numVertices);
 
 	// Num indices
-	uint32 numIndices;
-	fin.readUInt32(&numIndices);
+	uint32 numIndices = 0;
+	reader.ReadUInt32(&numIndices);
 
 	// Num vertex elements
 	// TODO: Do we want to store this?
 
 	// Vertex buffer desc
 	D3D11_BUFFER_DESC vertexBufferDesc;
-	fin.read((char *)&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
+	reader.Read(&vertexBufferDesc);
 
 	// Index buffer desc
 	D3D11_BUFFER_DESC indexBufferDesc;
-	fin.read((char *)&indexBufferDesc, sizeof(D3D11_BUFFER_DESC));
+	reader.Read(&indexBufferDesc);
 
-	// Vertex data
-	char *vertexData = new char[vertexBufferDesc.ByteWidth];
-	fin.read(vertexData, vertexBufferDesc.ByteWidth);
+	if (reader.HasError()) {
+		return false;
+	}
 
-	// Index data
-	char *indexData = new char[indexBufferDesc.ByteWidth];
-	fin.read(indexData, indexBufferDesc.ByteWidth);
+	// The vertex and index data are handed straight from the file buffer to the device
+	const byte *vertexData = reader.View<byte>(vertexBufferDesc.ByteWidth);
+	const byte *indexData = reader.View<byte>(indexBufferDesc.ByteWidth);
 
 	// Material table
-	MaterialTableData *materialTable = nullptr;
+	std::vector<MaterialTableData> materialTable;
 	if ((flags & HAS_MATERIAL_TABLE) == HAS_MATERIAL_TABLE) {
-		uint32 numMaterials;
-		fin.readUInt32(&numMaterials);
-
-		materialTable = new MaterialTableData[numMaterials];
-
-		for (uint i = 0; i < numMaterials; ++i) {
-			fin.readUInt32(&materialTable[i].HMATFilePathIndex);
+		uint32 numMaterials = 0;
+		reader.ReadUInt32(&numMaterials);
+
+		materialTable.resize(std::min<size_t>(numMaterials, reader.Remaining() / (2 * sizeof(uint32))));
+		for (uint i = 0; i < materialTable.size(); ++i) {
+			reader.ReadUInt32(&materialTable[i].HMATFilePathIndex);
+			if (materialTable[i].HMATFilePathIndex >= stringTable.size()) {
+				return false;
+			}
 			
-			uint32 numTextures;
-			fin.readUInt32(&numTextures);
+			uint32 numTextures = 0;
+			reader.ReadUInt32(&numTextures);
+			// A draw command can't bind any more textures than this
+			if (numTextures > Graphics::Commands::DrawCommandBase::kMaxTextureBindings) {
+				return false;
+			}
 
-			for (uint j = 0; j < numTextures; ++j) {
+			for (uint j = 0; j < numTextures && !reader.HasError(); ++j) {
 				TextureData data;
-				fin.readUInt32(&data.FilePathIndex);
-				fin.readByte(&data.Sampler);
+				reader.ReadUInt32(&data.FilePathIndex);
+				reader.ReadByte(&data.Sampler);
+				if (data.FilePathIndex >= stringTable.size()) {
+					return false;
+				}
 				materialTable[i].Textures.push_back(data);
 			}
 		}
 	}
 
 	// Num subsets
-	uint32 numSubsets;
-	fin.readUInt32(&numSubsets);
+	uint32 numSubsets = 0;
+	reader.ReadUInt32(&numSubsets);
 
 	// Subset data
-	Subset *subsets = new Subset[numSubsets];
-	fin.read((char *)subsets, sizeof(Subset) * numSubsets);
+	const Subset *subsets = reader.View<Subset>(numSubsets);
+
+	if (reader.HasError() || numSubsets == 0) {
+		return false;
+	}
+
+	// Every subset needs a material, since the draws read it unchecked. Reject the file before
+	// anything is allocated for it
+	for (uint i = 0; i < numSubsets; ++i) {
+		if (subsets[i].MaterialIndex >= materialTable.size()) {
+			return false;
+		}
+	}
 
 	// Process the subsets
-	ModelSubset *modelSubsets = new ModelSubset[numSubsets];
+	ModelSubset *modelSubsets = modelManager->AllocateSubsets(numSubsets);
 	for (uint i = 0; i < numSubsets; ++i) {
 		ZeroMemory(&modelSubsets[i], sizeof(ModelSubset));
 
@@ -140,34 +166,25 @@ Model *HalflingModelFile::Load(ID3D11Device *device, Engine::TextureManager *tex
 		modelSubsets[i].AABB_min = subsets[i].AABB_min;
 		modelSubsets[i].AABB_max = subsets[i].AABB_max;
 
-		MaterialTableData materialData = materialTable[subsets[i].MaterialIndex];
+		const MaterialTableData &materialData = materialTable[subsets[i].MaterialIndex];
 
-		std::wstring hmatFilePath = Common::ToWideStr(stringTable[materialData.HMATFilePathIndex]);
-		Graphics::MaterialShader *shader = materialShaderManager->GetShader(device, hmatFilePath);
+		Graphics::MaterialShader *shader = materialShaderManager->GetShader(backend, stringTable[materialData.HMATFilePathIndex]);
 		std::vector<ID3D11ShaderResourceView *> textureSRVs;
 		std::vector<ID3D11SamplerState *> textureSamplers;
 		for (uint j = 0; j < materialData.Textures.size(); ++j) {
-			std::wstring wideFileName(stringTable[materialData.Textures[j].FilePathIndex].begin(), stringTable[materialData.Textures[j].FilePathIndex].end());
-			textureSRVs.push_back(textureManager->GetSRVFromFile(device, wideFileName, D3D11_USAGE_IMMUTABLE));
+			textureSRVs.push_back(textureManager->GetSRVFromFile(backend->GetDevice(), stringTable[materialData.Textures[j].FilePathIndex], D3D11_USAGE_IMMUTABLE));
 			textureSamplers.push_back(GetSamplerStateFromSamplerType(static_cast<TextureSampler>(materialData.Textures[j].Sampler), samplerStateManager));
 		}
 
 		modelSubsets[i].Material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
 	}
 
-	// Cleanup
-	delete[] stringTable;
-	delete[] materialTable;
-	delete[] subsets;
-
-	// Create the model with the read data
-	Model *model = new Model();
+	// Fill the model with the read data
+	model->CreateVertexBuffer(backend, const_cast<byte *>(vertexData), numVertices, vertexBufferDesc, DisposeAfterUse::NO);
+	model->CreateIndexBuffer(backend, reinterpret_cast<uint *>(const_cast<byte *>(indexData)), numIndices, indexBufferDesc, DisposeAfterUse::NO);
+	model->CreateSubsets(modelSubsets, numSubsets, DisposeAfterUse::NO);
 
-	model->CreateVertexBuffer(device, vertexData, numVertices, vertexBufferDesc);
-	model->CreateIndexBuffer(device, (uint *)indexData, numIndices, indexBufferDesc);
-	model->CreateSubsets(modelSubsets, numSubsets);
-
-	return model;
+	return true;
 }
 
 
@@ -252,111 +269,101 @@ void HalflingModelFile::Write(const wchar *filepath, uint numVertices, uint numI
 }
 
 void HalflingModelFile::VerifyFileIntegrity(const wchar *filepath) {
-	// Read the entire file into memory
-	DWORD bytesRead;
-	char *fileBuffer = Common::ReadWholeFile(filepath, &bytesRead);
-	assert(fileBuffer != NULL);
+	Common::MappedFile file(filepath);
+	assert(file.IsOpen());
 
-	Common::MemoryInputStream fin(fileBuffer, bytesRead);
+	Common::BinaryReader reader(file.GetData(), static_cast<size_t>(file.GetSize()));
 
 	// Read in the file data
 
 	// Check that this is a 'HFM' file
 	uint32 fileId;
-	fin.readUInt32(&fileId);
+	reader.ReadUInt32(&fileId);
 	assert(fileId == MKTAG('\0', 'F', 'M', 'H'));
 
 	// File format version
 	byte fileFormatVersion;
-	fin.readByte(&fileFormatVersion);
+	reader.ReadByte(&fileFormatVersion);
 	assert(fileFormatVersion == kFileFormatVersion);
 
 	// Flags
-	uint64 flags;
-	fin.readUInt64(&flags);
+	uint64 flags = 0;
+	reader.ReadUInt64(&flags);
 
 	// String table
-	std::string *stringTable = nullptr;
 	uint32 numStrings = 0;
 	if ((flags & HAS_STRING_TABLE) == HAS_STRING_TABLE) {
-		fin.readUInt32(&numStrings);
+		reader.ReadUInt32(&numStrings);
 
-		stringTable = new std::string[numStrings];
-
-		for (uint i = 0; i < numStrings; ++i) {
-			uint16 stringLength;
-			fin.readUInt16(&stringLength);
-
-			// Read in the string characters
-			stringTable[i].resize(stringLength + 1); // Allow space for the null terminator
-			fin.read(&stringTable[i][0], stringLength);
-
-			// Manually create the null terminator
-			stringTable[i][stringLength] = '\0';
+		for (uint i = 0; i < numStrings && !reader.HasError(); ++i) {
+			uint16 stringLength = 0;
+			reader.ReadUInt16(&stringLength);
+			reader.Skip(stringLength);
 		}
 	}
 
 	// Num vertices
-	uint32 numVertices;
-	fin.readUInt32(&numVertices);
+	uint32 numVertices = 0;
+	reader.ReadUInt32(&numVertices);
 
 	// Num indices
-	uint32 numIndices;
-	fin.readUInt32(&numIndices);
+	uint32 numIndices = 0;
+	reader.ReadUInt32(&numIndices);
 
 	// Vertex buffer desc
 	D3D11_BUFFER_DESC vertexBufferDesc;
-	fin.read((char *)&vertexBufferDesc, sizeof(D3D11_BUFFER_DESC));
+	reader.Read(&vertexBufferDesc);
 
 	// Index buffer desc
 	D3D11_BUFFER_DESC indexBufferDesc;
-	fin.read((char *)&indexBufferDesc, sizeof(D3D11_BUFFER_DESC));
+	reader.Read(&indexBufferDesc);
 
 	// Vertex data
-	char *vertexData = new char[vertexBufferDesc.ByteWidth];
-	fin.read(vertexData, vertexBufferDesc.ByteWidth);
+	reader.Skip(vertexBufferDesc.ByteWidth);
 
 	// Index data
-	char *indexData = new char[indexBufferDesc.ByteWidth];
-	fin.read(indexData, indexBufferDesc.ByteWidth);
+	reader.Skip(indexBufferDesc.ByteWidth);
 
 	// Material table
-	MaterialTableData *materialTable = nullptr;
-	uint32 numMaterials;
+	std::vector<MaterialTableData> materialTable;
 	if ((flags & HAS_MATERIAL_TABLE) == HAS_MATERIAL_TABLE) {
-		fin.readUInt32(&numMaterials);
-
-		materialTable = new MaterialTableData[numMaterials];
+		uint32 numMaterials = 0;
+		reader.ReadUInt32(&numMaterials);
 
-		for (uint i = 0; i < numMaterials; ++i) {
-			fin.readUInt32(&materialTable[i].HMATFilePathIndex);
+		for (uint i = 0; i < numMaterials && !reader.HasError(); ++i) {
+			MaterialTableData materialData;
+			reader.ReadUInt32(&materialData.HMATFilePathIndex);
 
-			uint32 numTextures;
-			fin.readUInt32(&numTextures);
+			uint32 numTextures = 0;
+			reader.ReadUInt32(&numTextures);
 
-			for (uint j = 0; j < numTextures; ++j) {
+			for (uint j = 0; j < numTextures && !reader.HasError(); ++j) {
 				TextureData data;
-				fin.readUInt32(&data.FilePathIndex);
-				fin.readByte(&data.Sampler);
-				materialTable[i].Textures.push_back(data);
+				reader.ReadUInt32(&data.FilePathIndex);
+				reader.ReadByte(&data.Sampler);
+				materialData.Textures.push_back(data);
 			}
+
+			materialTable.push_back(materialData);
 		}
 	}
 
 	// Num subsets
-	uint32 numSubsets;
-	fin.readUInt32(&numSubsets);
+	uint32 numSubsets = 0;
+	reader.ReadUInt32(&numSubsets);
 
 	// Subset data
-	Subset *subsets = new Subset[numSubsets];
-	fin.read((char *)subsets, sizeof(Subset) * numSubsets);
+	const Subset *subsets = reader.View<Subset>(numSubsets);
+	assert(!reader.HasError());
+	assert(reader.IsAtEnd());
 
 	// Process the subsets
 	for (uint i = 0; i < numSubsets; ++i) {
 		assert(subsets[i].VertexCount > 0);
 		assert(subsets[i].IndexCount > 0);
+		assert(subsets[i].MaterialIndex < materialTable.size());
 
-		MaterialTableData materialData = materialTable[subsets[i].MaterialIndex];
+		const MaterialTableData &materialData = materialTable[subsets[i].MaterialIndex];
 
 		assert(materialData.HMATFilePathIndex < numStrings);
 
@@ -365,11 +372,6 @@ void HalflingModelFile::VerifyFileIntegrity(const wchar *filepath) {
 			assert(materialData.Textures[j].Sampler >= LINEAR_CLAMP && materialData.Textures[j].Sampler <= ANISOTROPIC_WRAP);
 		}
 	}
-
-	// Cleanup
-	delete[] stringTable;
-	delete[] materialTable;
-	delete[] subsets;
 }
 
 } // End of namespace Scene
@@ -62,7 +62,20 @@ private:
 	static const byte kFileFormatVersion = 3;
 
 public:
-	static Model *Load(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const wchar *filePath);
+	/**
+	 * Loads a Halfling Model File into an existing model
+	 *
+	 * @param backend                  The render backend to create the buffers and shaders with
+	 * @param textureManager           The texture manager to load the textures through
+	 * @param modelManager             The model manager that owns 'model'. The subsets are allocated from it
+	 * @param materialShaderManager    The material shader manager to load the shaders through
+	 * @param materialCache            The material cache to create the materials through
+	 * @param samplerStateManager      The sampler state manager
+	 * @param filePath                 The path to the file
+	 * @param model                    The model to fill
+	 * @return                         True if the file was loaded successfully
+	 */
+	static bool Load(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const wchar *filePath, Model *model);
 	static void Write(const wchar *filepath, 
 	                  uint numVertices, uint numIndices, 
 	                  D3D11_BUFFER_DESC *vertexBufferDesc,
@@ -74,6 +87,15 @@ public:
 	                  std::vector<Subset> &subsets, 
 	                  std::vector<std::string> &stringTable,
 	                  std::vector<MaterialTableData> &materialTable);
+	/**
+	 * Parses a Halfling Model File that is already in memory into an existing model.
+	 * The vertex and index data are passed to the backend directly from 'fileData', without an intermediate copy
+	 *
+	 * @param fileData    The contents of the file. Must stay valid until the function returns
+	 * @param fileSize    The size of the file in bytes
+	 * @return            False if the data is not a valid Halfling Model File or is truncated
+	 */
+	static bool LoadFromMemory(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager, const char *fileData, size_t fileSize, Model *model);
 	static void VerifyFileIntegrity(const wchar *filepath);
 };
 
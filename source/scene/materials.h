@@ -17,15 +17,21 @@
 namespace Scene {
 
 struct Material {
-	Material(Graphics::MaterialShader *shader, std::vector<ID3D11ShaderResourceView *> &textureSRVs, std::vector<ID3D11SamplerState *> &textureSamplers)
+	Material(Graphics::MaterialShader *shader, std::vector<ID3D11ShaderResourceView *> &textureSRVs, std::vector<ID3D11SamplerState *> &textureSamplers, uint sortId = 0u)
 		: Shader(shader),
 		  TextureSRVs(textureSRVs),
-		  TextureSamplers(textureSamplers) {
+		  TextureSamplers(textureSamplers),
+		  SortId(sortId) {
 	}
 
 	Graphics::MaterialShader *Shader;
 	std::vector<ID3D11ShaderResourceView *> TextureSRVs;
 	std::vector<ID3D11SamplerState *> TextureSamplers;
+	/**
+	 * A small, dense id for sort keys. Assigned once by the MaterialCache, so it isn't part
+	 * of the Material's value. operator==() and MaterialHasher ignore it
+	 */
+	uint SortId;
 
 	bool operator==(const Material &rhs) const {
 		return Shader == rhs.Shader && Common::CompareVectors(TextureSRVs, rhs.TextureSRVs) && Common::CompareVectors(TextureSamplers, rhs.TextureSamplers);
@@ -34,19 +40,31 @@ struct Material {
 
 class MaterialHasher {
 public:
-	size_t operator()(const Material &key) const {
-		size_t hash = (size_t)key.Shader;
+	uint64 operator()(const Material &key) const {
+		Common::Hash<void *> pointerHasher;
+		uint64 hash = pointerHasher(key.Shader);
 
 		for (auto iter = key.TextureSRVs.begin(); iter != key.TextureSRVs.end(); ++iter) {
-			hash = hash_combiner(hash, (size_t)(*iter));
+			hash = Common::HashCombine(hash, pointerHasher(*iter));
 		}
 
 		for (auto iter = key.TextureSamplers.begin(); iter != key.TextureSamplers.end(); ++iter) {
-			hash = hash_combiner(hash, (size_t)(*iter));
+			hash = Common::HashCombine(hash, pointerHasher(*iter));
 		}
 
 		return hash;
 	}
+	inline uint64 operator()(const Material *key) const {
+		return (*this)(*key);
+	}
+};
+
+/** Compares Materials by value, through pointers. For containers keyed by pointers to pooled Materials */
+class MaterialPointerEqual {
+public:
+	inline bool operator()(const Material *lhs, const Material *rhs) const {
+		return *lhs == *rhs;
+	}
 };
 
 } // End of namespace Scene
@@ -11,7 +11,7 @@
 
 namespace Scene {
 
-void Model::CreateVertexBuffer(ID3D11Device *device, void *vertices, size_t vertexStride, uint vertexCount, DisposeAfterUse disposeAfterUse) {
+void Model::CreateVertexBuffer(Graphics::RenderBackend *backend, void *vertices, size_t vertexStride, uint vertexCount, DisposeAfterUse disposeAfterUse) {
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
 	vbd.ByteWidth = static_cast<uint>(vertexStride) * vertexCount;
@@ -20,23 +20,23 @@ void Model::CreateVertexBuffer(ID3D11Device *device, void *vertices, size_t vert
 	vbd.MiscFlags = 0;
 	vbd.StructureByteStride = 0;
 
-	CreateVertexBuffer(device, vertices, vertexCount, vbd, disposeAfterUse);
+	CreateVertexBuffer(backend, vertices, vertexCount, vbd, disposeAfterUse);
 }
 
-void Model::CreateVertexBuffer(ID3D11Device *device, void *vertices, uint vertexCount, D3D11_BUFFER_DESC vertexBufferDesc, DisposeAfterUse disposeAfterUse) {
+void Model::CreateVertexBuffer(Graphics::RenderBackend *backend, void *vertices, uint vertexCount, D3D11_BUFFER_DESC vertexBufferDesc, DisposeAfterUse disposeAfterUse) {
 	VertexStride = vertexBufferDesc.ByteWidth / vertexCount;
 	
 	D3D11_SUBRESOURCE_DATA vInitData;
 	vInitData.pSysMem = vertices;
 
-	HR(device->CreateBuffer(&vertexBufferDesc, &vInitData, &VertexBuffer));
+	HR(backend->CreateBuffer(&vertexBufferDesc, &vInitData, &VertexBuffer));
 
 	if (disposeAfterUse == DisposeAfterUse::YES) {
 		delete[] vertices;
 	}
 }
 
-void Model::CreateIndexBuffer(ID3D11Device *device, uint *indices, uint indexCount, DisposeAfterUse disposeAfterUse) {
+void Model::CreateIndexBuffer(Graphics::RenderBackend *backend, uint *indices, uint indexCount, DisposeAfterUse disposeAfterUse) {
 	D3D11_BUFFER_DESC ibd;
 	ibd.Usage = D3D11_USAGE_IMMUTABLE;
 	ibd.ByteWidth = sizeof(uint) * indexCount;
@@ -45,14 +45,14 @@ void Model::CreateIndexBuffer(ID3D11Device *device, uint *indices, uint indexCou
 	ibd.MiscFlags = 0;
 	ibd.StructureByteStride = 0;
 	
-	CreateIndexBuffer(device, indices, indexCount, ibd, disposeAfterUse);
+	CreateIndexBuffer(backend, indices, indexCount, ibd, disposeAfterUse);
 }
 
-void Model::CreateIndexBuffer(ID3D11Device *device, uint *indices, uint indexCount, D3D11_BUFFER_DESC indexBufferDesc, DisposeAfterUse disposeAfterUse) {
+void Model::CreateIndexBuffer(Graphics::RenderBackend *backend, uint *indices, uint indexCount, D3D11_BUFFER_DESC indexBufferDesc, DisposeAfterUse disposeAfterUse) {
 	D3D11_SUBRESOURCE_DATA iInitData;
 	iInitData.pSysMem = indices;
 	
-	HR(device->CreateBuffer(&indexBufferDesc, &iInitData, &IndexBuffer));
+	HR(backend->CreateBuffer(&indexBufferDesc, &iInitData, &IndexBuffer));
 
 	if (disposeAfterUse == DisposeAfterUse::YES) {
 		delete[] indices;
@@ -76,7 +76,7 @@ void Model::CreateSubsets(ModelSubset *subsetArray, uint subsetCount, DisposeAft
 	DirectX::XMStoreFloat3(&AABB_max, tempAABB_max);
 }
 
-void InstancedModel::CreateInstanceBuffer(ID3D11Device *device, size_t instanceStride, uint maxInstanceCount, void *instanceData, DisposeAfterUse disposeAfterUse) {
+void InstancedModel::CreateInstanceBuffer(Graphics::RenderBackend *backend, size_t instanceStride, uint maxInstanceCount, void *instanceData, DisposeAfterUse disposeAfterUse) {
 	InstanceStride = static_cast<uint>(instanceStride);
 	MaxInstanceCount = maxInstanceCount;
 
@@ -88,30 +88,27 @@ void InstancedModel::CreateInstanceBuffer(ID3D11Device *device, size_t instanceS
 	instbd.MiscFlags = 0;
 	instbd.StructureByteStride = 0;
 
-	CreateInstanceBuffer(device, instbd, instanceData, disposeAfterUse);
+	CreateInstanceBuffer(backend, instbd, instanceData, disposeAfterUse);
 }
 
-void InstancedModel::CreateInstanceBuffer(ID3D11Device *device, D3D11_BUFFER_DESC instanceBufferDesc, void *instanceData, DisposeAfterUse disposeAfterUse) {
+void InstancedModel::CreateInstanceBuffer(Graphics::RenderBackend *backend, D3D11_BUFFER_DESC instanceBufferDesc, void *instanceData, DisposeAfterUse disposeAfterUse) {
 	D3D11_SUBRESOURCE_DATA iInitData;
 	iInitData.pSysMem = instanceData;
 
-	HR(device->CreateBuffer(&instanceBufferDesc, instanceData ? &iInitData : nullptr, &InstanceBuffer));
+	HR(backend->CreateBuffer(&instanceBufferDesc, instanceData ? &iInitData : nullptr, &InstanceBuffer));
 
 	if (disposeAfterUse == DisposeAfterUse::YES) {
 		delete[] instanceData;
 	}
 }
 
-void *InstancedModel::MapInstanceBuffer(ID3D11DeviceContext *deviceContext, uint *out_maxNumInstances) {
-	D3D11_MAPPED_SUBRESOURCE mappedResource;
-	deviceContext->Map(InstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-
+void *InstancedModel::MapInstanceBuffer(Graphics::RenderBackend *backend, uint *out_maxNumInstances) {
 	*out_maxNumInstances = MaxInstanceCount;
-	return mappedResource.pData;
+	return backend->MapDiscard(InstanceBuffer);
 }
 
-void InstancedModel::UnMapInstanceBuffer(ID3D11DeviceContext *deviceContext) {
-	deviceContext->Unmap(InstanceBuffer, 0);
+void InstancedModel::UnMapInstanceBuffer(Graphics::RenderBackend *backend) {
+	backend->Unmap(InstanceBuffer);
 }
 
 } // End of namespace Scene
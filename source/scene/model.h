@@ -9,6 +9,7 @@
 #include "common/typedefs.h"
 
 #include "graphics/d3d_util.h"
+#include "graphics/render_backend.h"
 #include "graphics/shader.h"
 
 #include "scene/model_loading.h"
@@ -50,6 +51,7 @@ public:
 		  SubsetCount(0u),
 		  AABB_min(0.0f, 0.0f, 0.0f),
 		  AABB_max(0.0f, 0.0f, 0.0f),
+		  SortId(0u),
 		  m_disposeSubsetArray(DisposeAfterUse::YES) {
 	}
 
@@ -73,6 +75,12 @@ public:
 	DirectX::XMFLOAT3 AABB_min;
 	DirectX::XMFLOAT3 AABB_max;
 
+	/**
+	 * A small, dense id for sort keys. Assigned once by the ModelManager. The vertex and
+	 * index buffers belong to the model, so the one id stands in for both of them
+	 */
+	uint SortId;
+
 private:
 	DisposeAfterUse m_disposeSubsetArray;
 
@@ -91,26 +99,26 @@ public:
 	 * NOTE: CreateVertexBuffer(), CreateIndexBuffer(), and CreateSubsets() *MUST ALL* be called before
 	 *       any Draw*Subset() calls
 	 *
-	 * @param device             The DirectX device
+	 * @param backend            The render backend to create the buffer with
 	 * @param vertices           An array holding the vertex data
 	 * @param vertexStride       The stride of a single vertex
 	 * @param vertexCount        The number of vertices
 	 * @param disposeAfterUse    If YES, the function will call delete[] on 'vertices' when it finishes
 	 */
-	void CreateVertexBuffer(ID3D11Device *device, void *vertices, size_t vertexStride, uint vertexCount, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateVertexBuffer(Graphics::RenderBackend *backend, void *vertices, size_t vertexStride, uint vertexCount, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 	/**
 	 * Creates the vertex buffer for the model. All subsets share the same vertex buffer.
 	 *
 	 * NOTE: CreateVertexBuffer(), CreateIndexBuffer(), and CreateSubsets() *MUST ALL* be called before
 	 *       any Draw*Subset() calls
 	 *
-	 * @param device              The DirectX device
+	 * @param backend             The render backend to create the buffer with
 	 * @param vertices            An array holding the vertex data
 	 * @param vertexCount         The number of vertices
 	 * @param vertexBufferDesc    The vertex buffer description
 	 * @param disposeAfterUse     If YES, the function will call delete[] on 'vertices' when it finishes
 	 */
-	void CreateVertexBuffer(ID3D11Device *device, void *vertices, uint vertexCount, D3D11_BUFFER_DESC vertexBufferDesc, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateVertexBuffer(Graphics::RenderBackend *backend, void *vertices, uint vertexCount, D3D11_BUFFER_DESC vertexBufferDesc, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 	/**
 	 * Creates the index buffer for the model. All subsets share the same index buffer.
 	 * Assumes D3D11_USAGE_IMMUTABLE with no cpu access flags and no misc flags.
@@ -118,25 +126,25 @@ public:
 	 * NOTE: CreateVertexBuffer(), CreateIndexBuffer(), and CreateSubsets() *MUST ALL* be called before
 	 *       any Draw*Subset() calls
 	 *
-	 * @param device             The DirectX device
+	 * @param backend            The render backend to create the buffer with
 	 * @param indices            An array holding the index data
 	 * @param indexCount         The number of indices
 	 * @param disposeAfterUse    If YES, the function will call delete[] on 'indices' when it finishes
 	 */
-	void CreateIndexBuffer(ID3D11Device *device, uint *indices, uint indexCount, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateIndexBuffer(Graphics::RenderBackend *backend, uint *indices, uint indexCount, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 	/**
 	 * Creates the index buffer for the model. All subsets share the same index buffer.
 	 *
 	 * NOTE: CreateVertexBuffer(), CreateIndexBuffer(), and CreateSubsets() *MUST ALL* be called before
 	 *       any Draw*Subset() calls
 	 *
-	 * @param device             The DirectX device
+	 * @param backend            The render backend to create the buffer with
 	 * @param indices            An array holding the index data
 	 * @param indexCount         The number of indices
 	 * @param indexBufferDesc    The index buffer description
 	 * @param disposeAfterUse    If YES, the function will call delete[] on 'indices' when it finishes
 	 */
-	void CreateIndexBuffer(ID3D11Device *device, uint *indices, uint indexCount, D3D11_BUFFER_DESC indexBufferDesc, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateIndexBuffer(Graphics::RenderBackend *backend, uint *indices, uint indexCount, D3D11_BUFFER_DESC indexBufferDesc, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 	/**
 	 * Sets the subsets for the model
 	 *
@@ -176,37 +184,37 @@ public:
 	/**
 	 * Creates the instance buffer for the model
 	 *
-	 * @param device              The DirectX device
+	 * @param backend             The render backend to create the buffer with
 	 * @param instanceStride      The stride of the each instance
 	 * @param maxInstanceCount    The maximum number of instances
 	 * @param instanceData        [Optional] Data to fill the instance buffer with
 	 * @param disposeAfterUse     If YES, the function will call delete[] on 'instanceData' when it finishes
 	 */
-	void CreateInstanceBuffer(ID3D11Device *device, size_t instanceStride, uint maxInstanceCount, void *instanceData = nullptr, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateInstanceBuffer(Graphics::RenderBackend *backend, size_t instanceStride, uint maxInstanceCount, void *instanceData = nullptr, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 	/**
 	 * Creates the instance buffer for the model
 	 *
-	 * @param device                The DirectX device
+	 * @param backend               The render backend to create the buffer with
 	 * @param instanceBufferDesc    The instance buffer description
 	 * @param maxInstanceCount      The maximum number of instances
 	 * @param instanceData          [Optional] Data to fill the instance buffer with
 	 * @param disposeAfterUse       If YES, the function will call delete[] on 'instanceData' when it finishes
 	 */
-	void CreateInstanceBuffer(ID3D11Device *device, D3D11_BUFFER_DESC instanceBufferDesc, void *instanceData = nullptr, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
+	void CreateInstanceBuffer(Graphics::RenderBackend *backend, D3D11_BUFFER_DESC instanceBufferDesc, void *instanceData = nullptr, DisposeAfterUse disposeAfterUse = DisposeAfterUse::YES);
 
 	/**
 	 * Maps the instance buffer to local memory so that it can be written to
 	 *
-	 * @param deviceContext          A DirectX device context
+	 * @param backend                The render backend
 	 * @param out_maxNumInstances    Will be filled with the maximum number of instances the buffer can support
 	 */
-	void *MapInstanceBuffer(ID3D11DeviceContext *deviceContext, uint *out_maxNumInstances);
+	void *MapInstanceBuffer(Graphics::RenderBackend *backend, uint *out_maxNumInstances);
 	/**
 	 * Un-map the instance buffer, allowing it to be used by the GPU again
 	 *
-	 * @param deviceContext    A DirectX device context
+	 * @param backend    The render backend
 	 */
-	void UnMapInstanceBuffer(ID3D11DeviceContext *deviceContext);
+	void UnMapInstanceBuffer(Graphics::RenderBackend *backend);
 };
 
 } // End of namespace Scene
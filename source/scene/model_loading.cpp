@@ -62,8 +62,25 @@ ID3D11SamplerState *GetSamplerStateFromSamplerType(TextureSampler samplerType, G
 }
 
 
-Model *FileModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
-	return m_modelManager->GetModel(m_device, m_textureManager, materialShaderManager, materialCache, samplerStateManager, m_filePath.c_str());
+void FileModelToLoad::RequestFiles(Common::AsyncFileReader *fileReader, Engine::ModelManager *modelManager) {
+	if (modelManager->ReserveFileRead(m_filePath)) {
+		m_pendingRead = fileReader->Read(Common::GetInternedString(m_filePath));
+	}
+}
+
+Model *FileModelToLoad::CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+	if (!m_pendingRead.valid()) {
+		return modelManager->GetModel(backend, textureManager, materialShaderManager, materialCache, samplerStateManager, m_filePath);
+	}
+
+	// Fall back to reading the file synchronously if the read threw
+	Common::AsyncReadResult fileContents;
+	try {
+		fileContents = m_pendingRead.get();
+	} catch (...) {
+		return modelManager->GetModel(backend, textureManager, materialShaderManager, materialCache, samplerStateManager, m_filePath);
+	}
+	return modelManager->GetModel(backend, textureManager, materialShaderManager, materialCache, samplerStateManager, m_filePath, &fileContents);
 }
 
 struct Vertex {
@@ -73,9 +90,24 @@ struct Vertex {
 	DirectX::XMFLOAT3 tangent;
 };
 
-Model *PlaneModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+Model *PlaneModelToLoad::CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+	Graphics::MaterialShader *shader = materialShaderManager->GetShader(backend, m_material.HMATFilePath);
+	std::vector<ID3D11ShaderResourceView *> textureSRVs;
+	std::vector<ID3D11SamplerState *> textureSamplers;
+	for (uint i = 0; i < m_material.Textures.size(); ++i) {
+		textureSRVs.push_back(textureManager->GetSRVFromFile(backend->GetDevice(), m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
+		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
+	}
+
+	// Reject the material before anything is allocated for the model
+	const Material *material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
+	if (material == nullptr) {
+		return nullptr;
+	}
+
 	GeometryGenerator::MeshData meshData;
-	ModelSubset *subset = new ModelSubset[1];
+	ModelSubset *subset = modelManager->AllocateSubsets(1);
+	subset->Material = material;
 
 	GeometryGenerator::CreateGrid(m_width, m_depth, m_x_subdivisions, m_z_subdivisions, &meshData, m_x_textureTiling, m_z_textureTiling);
 	subset->AABB_min = DirectX::XMFLOAT3(-m_width * 0.5f, 0.0f, -m_depth * 0.5f);
@@ -86,16 +118,6 @@ Model *PlaneModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManage
 	subset->VertexStart = 0u;
 	subset->VertexCount = static_cast<uint>(meshData.Vertices.size());
 
-	Graphics::MaterialShader *shader = materialShaderManager->GetShader(device, m_material.HMATFilePath);
-	std::vector<ID3D11ShaderResourceView *> textureSRVs;
-	std::vector<ID3D11SamplerState *> textureSamplers;
-	for (uint i = 0; i < m_material.Textures.size(); ++i) {
-		textureSRVs.push_back(textureManager->GetSRVFromFile(device, m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
-		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
-	}
-
-	subset->Material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
-
 	Vertex *vertices = new Vertex[meshData.Vertices.size()];
 	for (uint i = 0; i < meshData.Vertices.size(); ++i) {
 		vertices[i].pos = meshData.Vertices[i].Position;
@@ -105,16 +127,31 @@ Model *PlaneModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManage
 	}
 
 	Model *newModel = modelManager->CreateUnnamedModel();
-	newModel->CreateVertexBuffer(device, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
-	newModel->CreateIndexBuffer(device, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
-	newModel->CreateSubsets(subset, 1);
+	newModel->CreateVertexBuffer(backend, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
+	newModel->CreateIndexBuffer(backend, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
+	newModel->CreateSubsets(subset, 1, DisposeAfterUse::NO);
 
 	return newModel;
 }
 
-Model *BoxModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+Model *BoxModelToLoad::CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+	Graphics::MaterialShader *shader = materialShaderManager->GetShader(backend, m_material.HMATFilePath);
+	std::vector<ID3D11ShaderResourceView *> textureSRVs;
+	std::vector<ID3D11SamplerState *> textureSamplers;
+	for (uint i = 0; i < m_material.Textures.size(); ++i) {
+		textureSRVs.push_back(textureManager->GetSRVFromFile(backend->GetDevice(), m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
+		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
+	}
+
+	// Reject the material before anything is allocated for the model
+	const Material *material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
+	if (material == nullptr) {
+		return nullptr;
+	}
+
 	GeometryGenerator::MeshData meshData;
-	ModelSubset *subset = new ModelSubset[1];
+	ModelSubset *subset = modelManager->AllocateSubsets(1);
+	subset->Material = material;
 
 	GeometryGenerator::CreateBox(m_width, m_height, m_depth, &meshData);
 	subset->AABB_min = DirectX::XMFLOAT3(-m_width * 0.5f, -m_height * 0.5f, -m_depth * 0.5f);
@@ -125,16 +162,6 @@ Model *BoxModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager
 	subset->VertexStart = 0u;
 	subset->VertexCount = static_cast<uint>(meshData.Vertices.size());
 
-	Graphics::MaterialShader *shader = materialShaderManager->GetShader(device, m_material.HMATFilePath);
-	std::vector<ID3D11ShaderResourceView *> textureSRVs;
-	std::vector<ID3D11SamplerState *> textureSamplers;
-	for (uint i = 0; i < m_material.Textures.size(); ++i) {
-		textureSRVs.push_back(textureManager->GetSRVFromFile(device, m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
-		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
-	}
-
-	subset->Material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
-
 	Vertex *vertices = new Vertex[meshData.Vertices.size()];
 	for (uint i = 0; i < meshData.Vertices.size(); ++i) {
 		vertices[i].pos = meshData.Vertices[i].Position;
@@ -144,16 +171,31 @@ Model *BoxModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager
 	}
 
 	Model *newModel = modelManager->CreateUnnamedModel();
-	newModel->CreateVertexBuffer(device, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
-	newModel->CreateIndexBuffer(device, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
-	newModel->CreateSubsets(subset, 1);
+	newModel->CreateVertexBuffer(backend, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
+	newModel->CreateIndexBuffer(backend, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
+	newModel->CreateSubsets(subset, 1, DisposeAfterUse::NO);
 
 	return newModel;
 }
 
-Model *SphereModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+Model *SphereModelToLoad::CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) {
+	Graphics::MaterialShader *shader = materialShaderManager->GetShader(backend, m_material.HMATFilePath);
+	std::vector<ID3D11ShaderResourceView *> textureSRVs;
+	std::vector<ID3D11SamplerState *> textureSamplers;
+	for (uint i = 0; i < m_material.Textures.size(); ++i) {
+		textureSRVs.push_back(textureManager->GetSRVFromFile(backend->GetDevice(), m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
+		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
+	}
+
+	// Reject the material before anything is allocated for the model
+	const Material *material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
+	if (material == nullptr) {
+		return nullptr;
+	}
+
 	GeometryGenerator::MeshData meshData;
-	ModelSubset *subset = new ModelSubset[1];
+	ModelSubset *subset = modelManager->AllocateSubsets(1);
+	subset->Material = material;
 
 	GeometryGenerator::CreateSphere(m_radius, m_sliceCount, m_stackCount, &meshData);
 	subset->AABB_min = DirectX::XMFLOAT3(-m_radius, -m_radius, -m_radius);
@@ -164,16 +206,6 @@ Model *SphereModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManag
 	subset->VertexStart = 0u;
 	subset->VertexCount = static_cast<uint>(meshData.Vertices.size());
 
-	Graphics::MaterialShader *shader = materialShaderManager->GetShader(device, m_material.HMATFilePath);
-	std::vector<ID3D11ShaderResourceView *> textureSRVs;
-	std::vector<ID3D11SamplerState *> textureSamplers;
-	for (uint i = 0; i < m_material.Textures.size(); ++i) {
-		textureSRVs.push_back(textureManager->GetSRVFromFile(device, m_material.Textures[i].FilePath, D3D11_USAGE_IMMUTABLE));
-		textureSamplers.push_back(GetSamplerStateFromSamplerType(m_material.Textures[i].Sampler, samplerStateManager));
-	}
-
-	subset->Material = materialCache->getMaterial(shader, textureSRVs, textureSamplers);
-
 	Vertex *vertices = new Vertex[meshData.Vertices.size()];
 	for (uint i = 0; i < meshData.Vertices.size(); ++i) {
 		vertices[i].pos = meshData.Vertices[i].Position;
@@ -183,9 +215,9 @@ Model *SphereModelToLoad::CreateModel(ID3D11Device *device, Engine::TextureManag
 	}
 
 	Model *newModel = modelManager->CreateUnnamedModel();
-	newModel->CreateVertexBuffer(device, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
-	newModel->CreateIndexBuffer(device, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
-	newModel->CreateSubsets(subset, 1);
+	newModel->CreateVertexBuffer(backend, vertices, sizeof(Vertex), static_cast<uint>(meshData.Vertices.size()));
+	newModel->CreateIndexBuffer(backend, &meshData.Indices[0], static_cast<uint>(meshData.Indices.size()), DisposeAfterUse::NO);
+	newModel->CreateSubsets(subset, 1, DisposeAfterUse::NO);
 
 	return newModel;
 }
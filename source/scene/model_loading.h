@@ -9,14 +9,16 @@
 #include "common/typedefs.h"
 
 #include "common/allocator_16_byte_aligned.h"
+#include "common/async_file_reader.h"
+#include "common/string_id.h"
 
+#include <future>
 #include <string>
 #include <vector>
 
 #include <DirectXMath.h>
 
 
-struct ID3D11Device;
 struct ID3D11SamplerState;
 
 namespace Engine {
@@ -27,6 +29,7 @@ class MaterialCache;
 }
 
 namespace Graphics {
+class RenderBackend;
 class SamplerStateManager;
 }
 
@@ -56,12 +59,12 @@ TextureSampler ParseSamplerTypeFromString(std::string &inputString, TextureSampl
 ID3D11SamplerState *GetSamplerStateFromSamplerType(TextureSampler samplerType, Graphics::SamplerStateManager *samplerStateManager);
 
 struct TextureDescription {
-	std::wstring FilePath;
+	Common::StringId FilePath;
 	TextureSampler Sampler;
 };
 
 struct ModelToLoadMaterial {
-	std::wstring HMATFilePath;
+	Common::StringId HMATFilePath;
 	std::vector<TextureDescription> Textures;
 };
 
@@ -69,7 +72,8 @@ struct ModelToLoadMaterial {
 class ModelToLoad {
 protected:
 	ModelToLoad(std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *instances)
-		: Instances(instances) {
+		: Instances(instances),
+		  Occluder(false) {
 	}
 
 public:
@@ -77,9 +81,23 @@ public:
 
 public:
 	std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *Instances;
+	/**
+	 * Whether the model's subset bounds are rasterized as occluders. Only set this for models that
+	 * fill their subset bounds, like walls and floors. Occluders are never drawn instanced
+	 */
+	bool Occluder;
 
 public:
-	virtual Model *CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) = 0;
+	/**
+	 * Queues reads for any files the model needs, so they can stream in while other models are being created.
+	 * CreateModel() will use the read data if it was requested, otherwise it reads the files synchronously
+	 *
+	 * @param fileReader      The reader to queue the reads on
+	 * @param modelManager    Used to skip files that are already loaded, or already requested by another model
+	 */
+	virtual void RequestFiles(Common::AsyncFileReader * /* fileReader */, Engine::ModelManager * /* modelManager */) {}
+	/** Creates the model. Returns nullptr if the model or its material couldn't be loaded */
+	virtual Model *CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager) = 0;
 };
 
 
@@ -87,17 +105,16 @@ class FileModelToLoad : public ModelToLoad {
 public:
 	FileModelToLoad(const std::string &filePath, std::vector<DirectX::XMMATRIX, Common::Allocator16ByteAligned<DirectX::XMMATRIX> > *instances)
 		: ModelToLoad(instances),
-		  m_filePath(filePath.begin(), filePath.end()) {
+		  m_filePath(Common::InternString(filePath)) {
 	}
 
 private:
-	std::wstring m_filePath;
-	ID3D11Device *m_device;
-	Engine::TextureManager *m_textureManager;
-	Engine::ModelManager *m_modelManager;
+	Common::StringId m_filePath;
+	std::future<Common::AsyncReadResult> m_pendingRead;
 
 public:
-	Model *CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
+	void RequestFiles(Common::AsyncFileReader *fileReader, Engine::ModelManager *modelManager);
+	Model *CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
 };
 
 
@@ -124,7 +141,7 @@ private:
 	ModelToLoadMaterial m_material;
 
 public:
-	Model *CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
+	Model *CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
 };
 
 
@@ -145,7 +162,7 @@ private:
 	ModelToLoadMaterial m_material;
 
 public:
-	Model *CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
+	Model *CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
 };
 
 
@@ -166,7 +183,7 @@ private:
 	ModelToLoadMaterial m_material;
 
 public:
-	Model *CreateModel(ID3D11Device *device, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
+	Model *CreateModel(Graphics::RenderBackend *backend, Engine::TextureManager *textureManager, Engine::ModelManager *modelManager, Engine::MaterialShaderManager *materialShaderManager, Engine::MaterialCache *materialCache, Graphics::SamplerStateManager *samplerStateManager);
 };
 
 } // End of namespace Scene
@@ -0,0 +1,479 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#include "scene/occlusion_culler.h"
+
+#include "common/halfling_sys.h"
+#include "common/math.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+
+
+namespace Scene {
+
+/**
+ * Triangles are clipped to a guard band this many times the size of the screen, rather than to
+ * the screen itself. The rasterizer skips the pixels outside the screen. The band just keeps the
+ * screen space coordinates small enough for the edge functions to stay precise
+ */
+static const float kGuardBand = 2.0f;
+
+/** A triangle clipped by the near plane and the 4 guard band planes can have up to 8 vertices */
+static const uint kMaxClippedVertices = 8u;
+static const uint kNumClipPlanes = 5u;
+
+/** The signed distance to each clip plane. Positive is inside */
+static inline float ClipPlaneDistance(const DirectX::XMFLOAT4 &vertex, uint plane) {
+	switch (plane) {
+	case 0:
+		// With reversed depth, the near plane is at z == w
+		return vertex.w - vertex.z;
+	case 1:
+		return kGuardBand * vertex.w - vertex.x;
+	case 2:
+		return kGuardBand * vertex.w + vertex.x;
+	case 3:
+		return kGuardBand * vertex.w - vertex.y;
+	default:
+		return kGuardBand * vertex.w + vertex.y;
+	}
+}
+
+static inline DirectX::XMFLOAT4 LerpVertex(const DirectX::XMFLOAT4 &a, const DirectX::XMFLOAT4 &b, float t) {
+	return DirectX::XMFLOAT4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+}
+
+static inline DirectX::XMFLOAT4 TransformToClipSpace(const DirectX::XMFLOAT3 &position, const DirectX::XMMATRIX &worldViewProj) {
+	DirectX::XMFLOAT4 clipPosition;
+	DirectX::XMStoreFloat4(&clipPosition, DirectX::XMVector3Transform(DirectX::XMLoadFloat3(&position), worldViewProj));
+
+	return clipPosition;
+}
+
+
+OcclusionCuller::OcclusionCuller(uint width, uint height, Common::WorkerPool *workerPool)
+		: m_width(width),
+		  m_height(height),
+		  m_workerPool(workerPool),
+		  m_tilesX((width + kTileSize - 1u) / kTileSize),
+		  m_tilesY((height + kTileSize - 1u) / kTileSize) {
+	AssertMsg(width > 0u && height > 0u, L"An OcclusionCuller needs a depth buffer of at least 1 x 1 pixels");
+
+	DirectX::XMStoreFloat4x4(&m_viewProj, DirectX::XMMatrixIdentity());
+
+	// Halve the size until the top level is a single texel
+	uint levelWidth = width;
+	uint levelHeight = height;
+	for (;;) {
+		DepthLevel level;
+		level.Width = levelWidth;
+		level.Height = levelHeight;
+		level.Depth.resize(levelWidth * levelHeight, 0.0f);
+		m_levels.push_back(level);
+
+		if (levelWidth == 1u && levelHeight == 1u) {
+			break;
+		}
+		levelWidth = (levelWidth + 1u) / 2u;
+		levelHeight = (levelHeight + 1u) / 2u;
+	}
+
+	m_tileBins.resize(m_tilesX * m_tilesY);
+}
+
+void OcclusionCuller::BeginFrame(const DirectX::XMMATRIX &viewProj) {
+	DirectX::XMStoreFloat4x4(&m_viewProj, viewProj);
+
+	// Reversed depth clears to the far plane at 0. The bins keep their capacity, so the steady
+	// state doesn't allocate
+	for (auto iter = m_levels.begin(); iter != m_levels.end(); ++iter) {
+		std::fill(iter->Depth.begin(), iter->Depth.end(), 0.0f);
+	}
+	for (auto iter = m_tileBins.begin(); iter != m_tileBins.end(); ++iter) {
+		iter->clear();
+	}
+	m_triangles.clear();
+	m_stats.Reset();
+}
+
+void OcclusionCuller::AddOccluderMesh(const DirectX::XMFLOAT3 *positions, uint positionStride, uint vertexCount, const uint *indices, uint indexCount, const DirectX::XMMATRIX &world) {
+	DirectX::XMMATRIX worldViewProj = world * DirectX::XMLoadFloat4x4(&m_viewProj);
+
+	m_clipPositions.resize(vertexCount);
+	const byte *position = reinterpret_cast<const byte *>(positions);
+	for (uint i = 0; i < vertexCount; ++i, position += positionStride) {
+		m_clipPositions[i] = TransformToClipSpace(*reinterpret_cast<const DirectX::XMFLOAT3 *>(position), worldViewProj);
+	}
+
+	for (uint i = 0; i + 2u < indexCount; i += 3u) {
+		AddClipSpaceTriangle(m_clipPositions[indices[i]], m_clipPositions[indices[i + 1u]], m_clipPositions[indices[i + 2u]]);
+	}
+}
+
+void OcclusionCuller::AddOccluderAABB(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world) {
+	// Corner i takes the max x when bit 0 is set, the max y for bit 1, and the max z for bit 2
+	DirectX::XMFLOAT3 corners[8];
+	for (uint i = 0; i < 8u; ++i) {
+		corners[i] = DirectX::XMFLOAT3((i & 1u) != 0u ? aabbMax.x : aabbMin.x,
+		                               (i & 2u) != 0u ? aabbMax.y : aabbMin.y,
+		                               (i & 4u) != 0u ? aabbMax.z : aabbMin.z);
+	}
+
+	// Clockwise when seen from outside the box, like the rest of the engine's geometry
+	static const uint kBoxIndices[36] = {
+		0, 2, 3, 0, 3, 1, // -Z
+		4, 5, 7, 4, 7, 6, // +Z
+		4, 6, 2, 4, 2, 0, // -X
+		1, 3, 7, 1, 7, 5, // +X
+		1, 5, 4, 1, 4, 0, // -Y
+		2, 6, 7, 2, 7, 3  // +Y
+	};
+
+	AddOccluderMesh(corners, sizeof(DirectX::XMFLOAT3), 8u, kBoxIndices, 36u, world);
+}
+
+void OcclusionCuller::AddClipSpaceTriangle(const DirectX::XMFLOAT4 &v0, const DirectX::XMFLOAT4 &v1, const DirectX::XMFLOAT4 &v2) {
+	DirectX::XMFLOAT4 polygon[kMaxClippedVertices];
+	DirectX::XMFLOAT4 clipped[kMaxClippedVertices];
+	polygon[0] = v0;
+	polygon[1] = v1;
+	polygon[2] = v2;
+	uint vertexCount = 3u;
+
+	// Sutherland-Hodgman against each plane. Most triangles are inside all of them, and skip the copies
+	for (uint plane = 0; plane < kNumClipPlanes; ++plane) {
+		float distances[kMaxClippedVertices];
+		bool allInside = true;
+		for (uint i = 0; i < vertexCount; ++i) {
+			distances[i] = ClipPlaneDistance(polygon[i], plane);
+			allInside = allInside && distances[i] >= 0.0f;
+		}
+		if (allInside) {
+			continue;
+		}
+
+		uint clippedCount = 0u;
+		for (uint i = 0; i < vertexCount; ++i) {
+			uint next = i + 1u < vertexCount ? i + 1u : 0u;
+
+			if (distances[i] >= 0.0f) {
+				clipped[clippedCount++] = polygon[i];
+			}
+			if ((distances[i] >= 0.0f) != (distances[next] >= 0.0f)) {
+				clipped[clippedCount++] = LerpVertex(polygon[i], polygon[next], distances[i] / (distances[i] - distances[next]));
+			}
+		}
+
+		if (clippedCount < 3u) {
+			++m_stats.TrianglesCulled;
+			return;
+		}
+
+		std::copy(clipped, clipped + clippedCount, polygon);
+		vertexCount = clippedCount;
+	}
+
+	// Everything in front of the near plane has a positive w, so the divide is safe
+	float x[kMaxClippedVertices];
+	float y[kMaxClippedVertices];
+	float z[kMaxClippedVertices];
+	for (uint i = 0; i < vertexCount; ++i) {
+		float inverseW = 1.0f / polygon[i].w;
+		x[i] = (polygon[i].x * inverseW * 0.5f + 0.5f) * static_cast<float>(m_width);
+		y[i] = (0.5f - polygon[i].y * inverseW * 0.5f) * static_cast<float>(m_height);
+		z[i] = polygon[i].z * inverseW;
+	}
+
+	// Clipping keeps the polygon convex, so it can be split into a fan
+	for (uint i = 1; i + 1u < vertexCount; ++i) {
+		float fanX[3] = {x[0], x[i], x[i + 1u]};
+		float fanY[3] = {y[0], y[i], y[i + 1u]};
+		float fanZ[3] = {z[0], z[i], z[i + 1u]};
+
+		BinTriangle(fanX, fanY, fanZ);
+	}
+}
+
+void OcclusionCuller::BinTriangle(const float *x, const float *y, const float *z) {
+	// Twice the signed area. The screen's y axis points down, so clockwise triangles are positive
+	float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+	if (area <= 0.0f) {
+		++m_stats.TrianglesCulled;
+		return;
+	}
+
+	// The pixels whose centers are inside the triangle's bounds
+	int minX = std::max(static_cast<int>(std::ceil(std::min(std::min(x[0], x[1]), x[2]) - 0.5f)), 0);
+	int minY = std::max(static_cast<int>(std::ceil(std::min(std::min(y[0], y[1]), y[2]) - 0.5f)), 0);
+	int maxX = std::min(static_cast<int>(std::floor(std::max(std::max(x[0], x[1]), x[2]) - 0.5f)), static_cast<int>(m_width) - 1);
+	int maxY = std::min(static_cast<int>(std::floor(std::max(std::max(y[0], y[1]), y[2]) - 0.5f)), static_cast<int>(m_height) - 1);
+	if (minX > maxX || minY > maxY) {
+		++m_stats.TrianglesCulled;
+		return;
+	}
+
+	BinnedTriangle triangle;
+	triangle.MinX = minX;
+	triangle.MinY = minY;
+	triangle.MaxX = maxX;
+	triangle.MaxY = maxY;
+
+	// Edge i is opposite vertex i, and is positive on the inside
+	float inverseArea = 1.0f / area;
+	triangle.DepthA = 0.0f;
+	triangle.DepthB = 0.0f;
+	triangle.DepthC = 0.0f;
+	for (uint i = 0; i < 3u; ++i) {
+		uint a = (i + 1u) % 3u;
+		uint b = (i + 2u) % 3u;
+
+		triangle.EdgeA[i] = y[a] - y[b];
+		triangle.EdgeB[i] = x[b] - x[a];
+		triangle.EdgeC[i] = -(triangle.EdgeA[i] * x[a] + triangle.EdgeB[i] * y[a]);
+
+		// The edge functions divided by the area are the barycentric coordinates
+		triangle.DepthA += triangle.EdgeA[i] * z[i] * inverseArea;
+		triangle.DepthB += triangle.EdgeB[i] * z[i] * inverseArea;
+		triangle.DepthC += triangle.EdgeC[i] * z[i] * inverseArea;
+	}
+
+	// The depth is evaluated at pixel centers. Moving it back by half a pixel gives each pixel the
+	// farthest depth the triangle has within it, so a sloped occluder never ends up nearer than it is
+	triangle.DepthC -= 0.5f * (std::abs(triangle.DepthA) + std::abs(triangle.DepthB));
+
+	uint triangleIndex = static_cast<uint>(m_triangles.size());
+	m_triangles.push_back(triangle);
+	++m_stats.TrianglesRasterized;
+
+	for (uint tileY = static_cast<uint>(minY) / kTileSize; tileY <= static_cast<uint>(maxY) / kTileSize; ++tileY) {
+		for (uint tileX = static_cast<uint>(minX) / kTileSize; tileX <= static_cast<uint>(maxX) / kTileSize; ++tileX) {
+			m_tileBins[tileY * m_tilesX + tileX].push_back(triangleIndex);
+			++m_stats.TileBinEntries;
+		}
+	}
+}
+
+void OcclusionCuller::Rasterize() {
+	uint tileCount = m_tilesX * m_tilesY;
+
+	// The tiles don't share any pixels, so each tile is a task of its own. The pool hands the
+	// tiles out one at a time, so threads that get empty tiles just take more
+	if (m_workerPool != nullptr) {
+		m_workerPool->ParallelFor(tileCount, [this](uint tile) {
+			RasterizeTile(tile);
+		});
+	} else {
+		for (uint tile = 0; tile < tileCount; ++tile) {
+			RasterizeTile(tile);
+		}
+	}
+
+	BuildDepthHierarchy();
+}
+
+void OcclusionCuller::RasterizeTile(uint tile) {
+	const std::vector<uint> &bin = m_tileBins[tile];
+	if (bin.empty()) {
+		return;
+	}
+
+	int tileMinX = static_cast<int>((tile % m_tilesX) * kTileSize);
+	int tileMinY = static_cast<int>((tile / m_tilesX) * kTileSize);
+	int tileMaxX = std::min(tileMinX + static_cast<int>(kTileSize), static_cast<int>(m_width)) - 1;
+	int tileMaxY = std::min(tileMinY + static_cast<int>(kTileSize), static_cast<int>(m_height)) - 1;
+
+	float *depthBuffer = &m_levels[0].Depth[0];
+
+	#if HALFLING_MATH_AVX
+		const __m256 laneOffsets8 = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	#endif
+	#if HALFLING_MATH_SSE
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	#endif
+
+	for (auto iter = bin.begin(); iter != bin.end(); ++iter) {
+		const BinnedTriangle &triangle = m_triangles[*iter];
+
+		int minX = std::max(triangle.MinX, tileMinX);
+		int maxX = std::min(triangle.MaxX, tileMaxX);
+		int minY = std::max(triangle.MinY, tileMinY);
+		int maxY = std::min(triangle.MaxY, tileMaxY);
+
+		for (int py = minY; py <= maxY; ++py) {
+			float centerY = static_cast<float>(py) + 0.5f;
+			float rowEdge0 = triangle.EdgeB[0] * centerY + triangle.EdgeC[0];
+			float rowEdge1 = triangle.EdgeB[1] * centerY + triangle.EdgeC[1];
+			float rowEdge2 = triangle.EdgeB[2] * centerY + triangle.EdgeC[2];
+			float rowDepth = triangle.DepthB * centerY + triangle.DepthC;
+
+			float *row = depthBuffer + py * static_cast<int>(m_width);
+			int px = minX;
+
+			// A pixel is covered when its center is on the inside of all 3 edges. Covered pixels
+			// keep the nearer of the two depths, which is the greater one
+			#if HALFLING_MATH_AVX
+				for (; px + 8 <= maxX + 1; px += 8) {
+					__m256 centerX = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(px)), laneOffsets8);
+
+					__m256 edge0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.EdgeA[0]), centerX), _mm256_set1_ps(rowEdge0));
+					__m256 edge1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.EdgeA[1]), centerX), _mm256_set1_ps(rowEdge1));
+					__m256 edge2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.EdgeA[2]), centerX), _mm256_set1_ps(rowEdge2));
+
+					__m256 zero = _mm256_setzero_ps();
+					__m256 covered = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(edge0, zero, _CMP_GE_OQ), _mm256_cmp_ps(edge1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(edge2, zero, _CMP_GE_OQ));
+
+					__m256 depth = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(triangle.DepthA), centerX), _mm256_set1_ps(rowDepth));
+					__m256 previous = _mm256_loadu_ps(row + px);
+					_mm256_storeu_ps(row + px, _mm256_blendv_ps(previous, _mm256_max_ps(previous, depth), covered));
+				}
+			#endif
+
+			#if HALFLING_MATH_SSE
+				for (; px + 4 <= maxX + 1; px += 4) {
+					__m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(px)), laneOffsets);
+
+					__m128 edge0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.EdgeA[0]), centerX), _mm_set1_ps(rowEdge0));
+					__m128 edge1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.EdgeA[1]), centerX), _mm_set1_ps(rowEdge1));
+					__m128 edge2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.EdgeA[2]), centerX), _mm_set1_ps(rowEdge2));
+
+					__m128 zero = _mm_setzero_ps();
+					__m128 covered = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+
+					__m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.DepthA), centerX), _mm_set1_ps(rowDepth));
+					__m128 previous = _mm_loadu_ps(row + px);
+					__m128 nearest = _mm_max_ps(previous, depth);
+
+					// SSE1 has no blend
+					_mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(covered, nearest), _mm_andnot_ps(covered, previous)));
+				}
+			#endif
+
+			for (; px <= maxX; ++px) {
+				float centerX = static_cast<float>(px) + 0.5f;
+
+				if (triangle.EdgeA[0] * centerX + rowEdge0 >= 0.0f &&
+				    triangle.EdgeA[1] * centerX + rowEdge1 >= 0.0f &&
+				    triangle.EdgeA[2] * centerX + rowEdge2 >= 0.0f) {
+					row[px] = std::max(row[px], triangle.DepthA * centerX + rowDepth);
+				}
+			}
+		}
+	}
+}
+
+void OcclusionCuller::BuildDepthHierarchy() {
+	for (uint level = 1; level < m_levels.size(); ++level) {
+		const DepthLevel &source = m_levels[level - 1u];
+		DepthLevel &destination = m_levels[level];
+
+		for (uint y = 0; y < destination.Height; ++y) {
+			uint sourceY0 = y * 2u;
+			uint sourceY1 = std::min(sourceY0 + 1u, source.Height - 1u);
+
+			for (uint x = 0; x < destination.Width; ++x) {
+				uint sourceX0 = x * 2u;
+				uint sourceX1 = std::min(sourceX0 + 1u, source.Width - 1u);
+
+				// The farthest depth is the smallest one
+				float farthest = std::min(std::min(source.Depth[sourceY0 * source.Width + sourceX0], source.Depth[sourceY0 * source.Width + sourceX1]),
+				                          std::min(source.Depth[sourceY1 * source.Width + sourceX0], source.Depth[sourceY1 * source.Width + sourceX1]));
+				destination.Depth[y * destination.Width + x] = farthest;
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const AABB &worldBounds) const {
+	DirectX::XMMATRIX viewProj = DirectX::XMLoadFloat4x4(&m_viewProj);
+
+	float minX = FLT_MAX;
+	float minY = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxY = -FLT_MAX;
+	float nearestDepth = 0.0f;
+
+	for (uint i = 0; i < 8u; ++i) {
+		DirectX::XMFLOAT3 corner((i & 1u) != 0u ? worldBounds.Max.x : worldBounds.Min.x,
+		                         (i & 2u) != 0u ? worldBounds.Max.y : worldBounds.Min.y,
+		                         (i & 4u) != 0u ? worldBounds.Max.z : worldBounds.Min.z);
+		DirectX::XMFLOAT4 clipCorner = TransformToClipSpace(corner, viewProj);
+
+		// A box crossing the near plane could cover anything
+		if (ClipPlaneDistance(clipCorner, 0u) < 0.0f) {
+			return true;
+		}
+
+		float inverseW = 1.0f / clipCorner.w;
+		float x = (clipCorner.x * inverseW * 0.5f + 0.5f) * static_cast<float>(m_width);
+		float y = (0.5f - clipCorner.y * inverseW * 0.5f) * static_cast<float>(m_height);
+
+		minX = std::min(minX, x);
+		minY = std::min(minY, y);
+		maxX = std::max(maxX, x);
+		maxY = std::max(maxY, y);
+		nearestDepth = std::max(nearestDepth, clipCorner.z * inverseW);
+	}
+
+	// Every pixel the box's screen rectangle touches, and a pixel more on each side. Occluder
+	// pixels are covered when their centers are, so an occluder can cover up to half a pixel
+	// more than it should along its edges. The extra pixels catch boxes peeking past the edges
+	int pixelMinX = std::max(static_cast<int>(std::floor(minX)) - 1, 0);
+	int pixelMinY = std::max(static_cast<int>(std::floor(minY)) - 1, 0);
+	int pixelMaxX = std::min(static_cast<int>(std::floor(maxX)) + 1, static_cast<int>(m_width) - 1);
+	int pixelMaxY = std::min(static_cast<int>(std::floor(maxY)) + 1, static_cast<int>(m_height) - 1);
+	if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY) {
+		return true;
+	}
+
+	// Go up the hierarchy until the rectangle covers at most 4 x 4 texels
+	uint level = 0u;
+	while (level + 1u < m_levels.size() && ((pixelMaxX >> level) - (pixelMinX >> level) > 3 || (pixelMaxY >> level) - (pixelMinY >> level) > 3)) {
+		++level;
+	}
+
+	const DepthLevel &depthLevel = m_levels[level];
+	for (int y = pixelMinY >> level; y <= (pixelMaxY >> level); ++y) {
+		for (int x = pixelMinX >> level; x <= (pixelMaxX >> level); ++x) {
+			// Visible if the box is in front of the farthest occluder anywhere in the texel
+			if (nearestDepth >= depthLevel.Depth[y * depthLevel.Width + x]) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+bool OcclusionCuller::IsVisible(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world) const {
+	AABB bounds = {aabbMin, aabbMax};
+	return IsVisible(TransformAABB(bounds, world));
+}
+
+bool OcclusionCuller::WriteDepthImage(const wchar *filePath) const {
+	std::ofstream file(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	const std::vector<float> &depth = m_levels[0].Depth;
+	float nearest = *std::max_element(depth.begin(), depth.end());
+	float scale = nearest > 0.0f ? 255.0f / nearest : 0.0f;
+
+	std::vector<byte> pixels(depth.size());
+	for (size_t i = 0; i < depth.size(); ++i) {
+		pixels[i] = static_cast<byte>(std::min(depth[i] * scale + 0.5f, 255.0f));
+	}
+
+	file << "P5\n" << m_width << " " << m_height << "\n255\n";
+	file.write(reinterpret_cast<const char *>(&pixels[0]), pixels.size());
+
+	return file.good();
+}
+
+} // End of namespace Scene
@@ -0,0 +1,184 @@
+/* The Halfling Project - A Graphics Engine and Projects
+ *
+ * The Halfling Project is the legal property of Adrian Astley
+ * Copyright Adrian Astley 2013 - 2014
+ */
+
+#pragma once
+
+#include "common/typedefs.h"
+#include "common/worker_pool.h"
+
+#include "scene/bounding_volume_hierarchy.h"
+
+#include <DirectXMath.h>
+#include <vector>
+
+
+namespace Scene {
+
+struct OcclusionCullerStats {
+	OcclusionCullerStats() {
+		Reset();
+	}
+
+	/** The occluder triangles binned for rasterization, after clipping */
+	uint TrianglesRasterized;
+	/** The occluder triangles dropped for facing away, having no area, or being off screen */
+	uint TrianglesCulled;
+	/** The number of tile bin entries. A triangle is binned into every tile its bounds overlap */
+	uint TileBinEntries;
+
+	inline void Reset() {
+		TrianglesRasterized = 0u;
+		TrianglesCulled = 0u;
+		TileBinEntries = 0u;
+	}
+};
+
+/**
+ * Rasterizes occluders into a small depth buffer on the CPU, so objects hidden behind them can
+ * be skipped before their commands are recorded
+ *
+ * Depth is reversed, like DepthStencilStateManager::ReverseDepthWriteEnabled(). The buffer is
+ * cleared to 0 at the far plane, and each occluder pixel keeps the greatest, nearest, depth.
+ * The occluder triangles are clipped, set up, and binned into tiles on the calling thread.
+ * Rasterize() then fills the tiles in parallel, and builds a hierarchy of the buffer, where each
+ * texel holds the farthest depth of the 4 texels below it.
+ *
+ * An object is hidden when the nearest point of its bounds is behind the farthest occluder
+ * depth everywhere its bounds cover. Occluders must not be larger than the geometry they stand
+ * for, or they'll hide objects that can be seen. Cracks between occluders that are narrower than
+ * a pixel of the buffer are treated as closed.
+ *
+ * Usage per frame:
+ *     BeginFrame(), then AddOccluder*() from a single thread, then Rasterize(). IsVisible() can
+ *     then be called from any number of threads until the next BeginFrame()
+ */
+class OcclusionCuller {
+public:
+	/**
+	 * @param width         The width of the depth buffer in pixels
+	 * @param height        The height of the depth buffer in pixels
+	 * @param workerPool    [Optional] The threads Rasterize() splits the tiles across. If null, the tiles are rasterized on the calling thread
+	 */
+	OcclusionCuller(uint width, uint height, Common::WorkerPool *workerPool = nullptr);
+
+	static const uint kTileSize = 32u;
+
+private:
+	/** The screen space triangle, as 3 edge functions and a depth plane of the form A * x + B * y + C */
+	struct BinnedTriangle {
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+		float DepthA;
+		float DepthB;
+		float DepthC;
+		/** The inclusive range of pixels the triangle can cover */
+		int MinX;
+		int MinY;
+		int MaxX;
+		int MaxY;
+	};
+
+	struct DepthLevel {
+		uint Width;
+		uint Height;
+		std::vector<float> Depth;
+	};
+
+	uint m_width;
+	uint m_height;
+	Common::WorkerPool *m_workerPool;
+	uint m_tilesX;
+	uint m_tilesY;
+
+	DirectX::XMFLOAT4X4 m_viewProj;
+
+	/** Level 0 is the depth buffer itself. Each level after it is half the size of the one before */
+	std::vector<DepthLevel> m_levels;
+	std::vector<BinnedTriangle> m_triangles;
+	/** The indices into m_triangles of the triangles overlapping each tile */
+	std::vector<std::vector<uint> > m_tileBins;
+	/** Scratch space for the clip space positions of AddOccluderMesh() */
+	std::vector<DirectX::XMFLOAT4> m_clipPositions;
+
+	OcclusionCullerStats m_stats;
+
+public:
+	/**
+	 * Clears the depth buffer and the occluders for a new frame
+	 *
+	 * @param viewProj    The view projection matrix of the camera. It must use reversed depth
+	 */
+	void BeginFrame(const DirectX::XMMATRIX &viewProj);
+	/**
+	 * Adds an indexed triangle list as an occluder. Triangles are culled when they face away from
+	 * the camera, with the same clockwise front faces as the gbuffer pass
+	 *
+	 * @param positions         The position of the first vertex
+	 * @param positionStride    The distance in bytes between the positions of consecutive vertices
+	 * @param vertexCount       The number of vertices
+	 * @param indices           Three indices per triangle
+	 * @param indexCount        The number of indices
+	 * @param world             The object to world transform
+	 */
+	void AddOccluderMesh(const DirectX::XMFLOAT3 *positions, uint positionStride, uint vertexCount, const uint *indices, uint indexCount, const DirectX::XMMATRIX &world);
+	/**
+	 * Adds a solid box as an occluder. Only use this for geometry that fills its bounds, like
+	 * walls and floors
+	 *
+	 * @param aabbMin    The minimum corner of the box, in object space
+	 * @param aabbMax    The maximum corner of the box, in object space
+	 * @param world      The object to world transform
+	 */
+	void AddOccluderAABB(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world);
+	/** Rasterizes the occluders added since BeginFrame(), and builds the depth hierarchy */
+	void Rasterize();
+
+	/**
+	 * Returns false if a box is entirely hidden by the occluders. Boxes that cross the near plane
+	 * or are off screen are reported as visible. Leave those to the frustum culling
+	 *
+	 * @param worldBounds    The world space bounds of the object
+	 */
+	bool IsVisible(const AABB &worldBounds) const;
+	/**
+	 * Transforms a box to world space, and returns false if the box around the result is
+	 * entirely hidden by the occluders
+	 *
+	 * @param aabbMin    The minimum corner of the box, in object space
+	 * @param aabbMax    The maximum corner of the box, in object space
+	 * @param world      The object to world transform
+	 */
+	bool IsVisible(const DirectX::XMFLOAT3 &aabbMin, const DirectX::XMFLOAT3 &aabbMax, const DirectX::XMMATRIX &world) const;
+
+	/**
+	 * Writes the depth buffer to a binary PGM image, for tuning the occluders. Depth is scaled so
+	 * the nearest pixel is white. Black pixels have no occluder
+	 *
+	 * @param filePath    The path of the image file
+	 * @return            Whether the file could be written
+	 */
+	bool WriteDepthImage(const wchar *filePath) const;
+
+	inline const OcclusionCullerStats &GetStats() const { return m_stats; }
+	inline uint GetWidth() const { return m_width; }
+	inline uint GetHeight() const { return m_height; }
+	/** Returns the depth buffer. 'width' floats per row, starting at the top */
+	inline const float *GetDepthBuffer() const { return &m_levels[0].Depth[0]; }
+
+private:
+	/** Clips a clip space triangle, and sets up and bins the pieces */
+	void AddClipSpaceTriangle(const DirectX::XMFLOAT4 &v0, const DirectX::XMFLOAT4 &v1, const DirectX::XMFLOAT4 &v2);
+	void BinTriangle(const float *x, const float *y, const float *z);
+	void RasterizeTile(uint tile);
+	void BuildDepthHierarchy();
+
+	// Not implemented
+	OcclusionCuller(const OcclusionCuller &);
+	OcclusionCuller &operator=(const OcclusionCuller &);
+};
+
+} // End of namespace Scene